@@ -0,0 +1,140 @@
+#ifndef __GGP_AMBIENT_INCLUDES__
+#define __GGP_AMBIENT_INCLUDES__
+
+// Image based ambient light from the sky (see SkyLighting.h),
+// and what builds it, with the diffuse part taken from a grid
+// of baked probes where there is one (see LightProbeGrid.h)
+// - Include after Include.hlsli, which has PI
+
+// The sky's diffuse and specular light.  The irradiance is
+// its radiance in spherical harmonics, already convolved for
+// Lambert and divided by pi (see SphericalHarmonics.h).
+cbuffer AmbientData : register(b3)
+{
+    float4 irradiance[9]; // RGB in xyz
+    float diffuseIntensity;
+    float specularIntensity;
+    float specularMipCount; // The last mip of the specular map is fully rough
+    float useProbes; // 1 when there's a probe grid to sample
+    float3 probeGridOrigin; // Where the first probe is
+    float probeGridSpacing;
+    float3 probeGridCounts; // Probes along each axis
+    float probeNormalBias; // How far off the surface to sample, in probe spacings
+}
+
+// The direction through a point on a cube face, with uv from
+// 0 to 1 across and down it - must match CubeDirection() in
+// SphericalHarmonics.cpp
+float3 CubeDirection(uint face, float2 uv)
+{
+    float2 p = uv * 2.0f - 1.0f;
+    float3 directions[6] =
+    {
+        float3(1.0f, -p.y, -p.x),
+        float3(-1.0f, -p.y, p.x),
+        float3(p.x, 1.0f, p.y),
+        float3(p.x, -1.0f, -p.y),
+        float3(p.x, -p.y, 1.0f),
+        float3(-p.x, -p.y, -1.0f)
+    };
+    return normalize(directions[face]);
+}
+
+// Evaluates SH9 coefficients in a direction
+float3 EvaluateSH(float3 c[9], float3 n)
+{
+    return c[0] * 0.282095f +
+        c[1] * 0.488603f * n.y +
+        c[2] * 0.488603f * n.z +
+        c[3] * 0.488603f * n.x +
+        c[4] * 1.092548f * n.x * n.y +
+        c[5] * 1.092548f * n.y * n.z +
+        c[6] * 0.315392f * (3.0f * n.z * n.z - 1.0f) +
+        c[7] * 1.092548f * n.x * n.z +
+        c[8] * 0.546274f * (n.x * n.x - n.y * n.y);
+}
+
+// The sky's irradiance in a direction
+float3 IrradianceSH(float3 n)
+{
+    float3 c[9];
+    for (uint k = 0; k < 9; k++)
+        c[k] = irradiance[k].rgb;
+    return EvaluateSH(c, n);
+}
+
+// --------------------------------------------------------
+// The irradiance at a point, trilinearly interpolated from
+// the probes around it, fading to the sky's over the cell
+// past the edge of the grid
+// - The grid is one 3D texture with the 9 coefficients
+//   stacked along z, so coefficient k of probe (x, y, z) is
+//   the texel at (x, y, k * counts.z + z).  Sampling stays
+//   between the first and last probes' texel centers, so it
+//   never blends in the next coefficient's probes.
+// --------------------------------------------------------
+float3 AmbientIrradiance(Texture3D probeGrid, SamplerState ambientSampler, float3 worldPos, float3 normal)
+{
+    float3 sky = IrradianceSH(normal);
+    if (useProbes == 0.0f)
+        return sky;
+
+    float3 cell = (worldPos + normal * probeNormalBias * probeGridSpacing - probeGridOrigin) / probeGridSpacing;
+    float3 outside = max(max(-cell, cell - (probeGridCounts - 1.0f)), 0.0f);
+    float fade = saturate(1.0f - max(outside.x, max(outside.y, outside.z)));
+    if (fade <= 0.0f)
+        return sky;
+
+    float3 uvw = (clamp(cell, 0.0f, probeGridCounts - 1.0f) + 0.5f) / probeGridCounts;
+    uvw.z /= 9.0f;
+    float3 c[9];
+    for (uint k = 0; k < 9; k++)
+        c[k] = probeGrid.SampleLevel(ambientSampler, uvw + float3(0.0f, 0.0f, k / 9.0f), 0).rgb;
+    return lerp(sky, EvaluateSH(c, normal), fade);
+}
+
+// The i-th of count points spread evenly over the unit square
+float2 Hammersley(uint i, uint count)
+{
+    return float2((i + 0.5f) / count, reversebits(i) * 2.3283064365386963e-10f);
+}
+
+// A half vector around n, with GGX's distribution of them for
+// the given roughness (remapped to a = roughness^2, as D_GGX is)
+float3 ImportanceSampleGGX(float2 xi, float3 n, float roughness)
+{
+    float a = roughness * roughness;
+    float phi = 2.0f * PI * xi.x;
+    float cosTheta = sqrt((1.0f - xi.y) / (1.0f + (a * a - 1.0f) * xi.y));
+    float sinTheta = sqrt(1.0f - cosTheta * cosTheta);
+    float3 h = float3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+
+    float3 up = abs(n.z) < 0.999f ? float3(0, 0, 1) : float3(1, 0, 0);
+    float3 tangent = normalize(cross(up, n));
+    float3 bitangent = cross(n, tangent);
+    return tangent * h.x + bitangent * h.y + n * h.z;
+}
+
+// --------------------------------------------------------
+// The sky's light on a surface, split sum style: the
+// specular map holds the sky prefiltered for each roughness
+// (view and normal taken as the same), and the BRDF LUT the
+// scale and bias that turn F0 into the rest of the integral
+// - The diffuse irradiance is passed in, from the sky or the
+//   probes (see AmbientIrradiance())
+// --------------------------------------------------------
+float3 AmbientLight(TextureCube specularMap, Texture2D brdfLut, SamplerState ambientSampler, float3 diffuseIrradiance,
+    float3 normal, float3 V, float3 surfaceColor, float3 specularColor, float roughness, float metalness)
+{
+    float NdotV = saturate(dot(normal, V));
+    float2 brdf = brdfLut.SampleLevel(ambientSampler, float2(NdotV, roughness), 0).rg;
+    float3 F = specularColor * brdf.x + brdf.y;
+
+    float3 R = reflect(-V, normal);
+    float3 prefiltered = specularMap.SampleLevel(ambientSampler, R, roughness * (specularMipCount - 1.0f)).rgb;
+
+    float3 diffuse = diffuseIrradiance * surfaceColor * (1.0f - F) * (1.0f - metalness);
+    return max(diffuse, 0.0f) * diffuseIntensity + prefiltered * F * specularIntensity;
+}
+
+#endif
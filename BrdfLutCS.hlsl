@@ -0,0 +1,56 @@
+#include "Include.hlsli"
+#include "Ambient.hlsli"
+
+cbuffer LutData : register(b0)
+{
+    uint lutSize; // Texels per side
+    uint sampleCount;
+}
+
+// The scale (r) and bias (g) to F0 for each NdotV (across)
+// and roughness (down)
+RWTexture2D<float2> Output : register(u0);
+
+// Schlick-GGX for image based light, where k is a / 2 rather
+// than the (roughness + 1)^2 / 8 that G_SchlickGGX uses for
+// punctual lights
+float G_SmithIBL(float NdotV, float NdotL, float roughness)
+{
+    float k = roughness * roughness * 0.5f;
+    return NdotV / (NdotV * (1.0f - k) + k) * NdotL / (NdotL * (1.0f - k) + k);
+}
+
+// --------------------------------------------------------
+// The second half of the split sum: the specular BRDF
+// integrated over the hemisphere against a white sky, split
+// into what multiplies F0 and what's added to it
+// --------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    if (any(id.xy >= lutSize))
+        return;
+
+    float NdotV = (id.x + 0.5f) / lutSize;
+    float roughness = (id.y + 0.5f) / lutSize;
+    float3 N = float3(0, 0, 1);
+    float3 V = float3(sqrt(1.0f - NdotV * NdotV), 0.0f, NdotV);
+
+    float2 sum = float2(0, 0);
+    for (uint i = 0; i < sampleCount; i++)
+    {
+        float3 H = ImportanceSampleGGX(Hammersley(i, sampleCount), N, roughness);
+        float3 L = reflect(-V, H);
+        float NdotL = saturate(L.z);
+        float NdotH = saturate(H.z);
+        float VdotH = saturate(dot(V, H));
+        if (NdotL <= 0.0f)
+            continue;
+
+        // The BRDF over the pdf of each sample, less F
+        float visibility = G_SmithIBL(NdotV, NdotL, roughness) * VdotH / (NdotH * NdotV);
+        float fresnel = pow(1.0f - VdotH, 5.0f);
+        sum += float2((1.0f - fresnel) * visibility, fresnel * visibility);
+    }
+    Output[id.xy] = sum / sampleCount;
+}
@@ -15,7 +15,7 @@ Camera::Camera(
 	fov(fov),
 	aspectRatio(aspectRatio)
 {
-	nearP = 0.1f;
+	nearP = 0.01f;
 	farP = 1000;
 	//setposition
 	transform = Transform();
@@ -75,8 +75,8 @@ void Camera::UpdateProjectionMatrix(float aspectRatio)
 	XMMATRIX proj = XMMatrixPerspectiveFovLH(
 		fov,
 		aspectRatio,
-		0.01f,  //near clip dist
-		1000.0f); //far clip dist
+		nearP,  //near clip dist
+		farP); //far clip dist
 
 	XMStoreFloat4x4(&projectionMatrix, proj);
 }
@@ -96,7 +96,28 @@ DirectX::XMFLOAT4X4 Camera::GetProjection()
 	return projectionMatrix;
 }
 
+// --------------------------------------------------------
+// The camera's view volume in world space, for culling
+// --------------------------------------------------------
+DirectX::BoundingFrustum Camera::GetFrustum()
+{
+	BoundingFrustum frustum;
+	BoundingFrustum::CreateFromMatrix(frustum, XMLoadFloat4x4(&projectionMatrix));
+	frustum.Transform(frustum, XMMatrixInverse(0, XMLoadFloat4x4(&viewMatrix)));
+	return frustum;
+}
+
 float Camera::GetFov()
 {
 	return fov;
 }
+
+float Camera::GetNearClip()
+{
+	return nearP;
+}
+
+float Camera::GetFarClip()
+{
+	return farP;
+}
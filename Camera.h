@@ -1,5 +1,6 @@
 #pragma once
 #include "Transform.h"
+#include <DirectXCollision.h>
 class Camera
 {
 public:
@@ -20,7 +21,10 @@ public:
 
 	DirectX::XMFLOAT4X4 GetView();
 	DirectX::XMFLOAT4X4 GetProjection();
+	DirectX::BoundingFrustum GetFrustum();
 	float GetFov();
+	float GetNearClip();
+	float GetFarClip();
 private:
 	DirectX::XMFLOAT4X4 viewMatrix;
 	DirectX::XMFLOAT4X4 projectionMatrix;
@@ -0,0 +1,114 @@
+#include "ConstantRing.h"
+
+// Offsets and sizes passed to *SetConstantBuffers1 are in 16 byte
+// constants, and must be multiples of 16 constants (256 bytes)
+#define RING_ALIGNMENT 256
+
+ConstantRing::ConstantRing(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int initialCapacity)
+	:
+	device(device),
+	supported(false),
+	capacity(0),
+	offset(0)
+{
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+		supported = options.ConstantBufferOffsetting == TRUE;
+
+	if (supported)
+		Resize(initialCapacity > RING_ALIGNMENT ? initialCapacity : RING_ALIGNMENT);
+}
+
+ConstantRing::~ConstantRing()
+{
+}
+
+bool ConstantRing::IsSupported() { return supported; }
+
+// --------------------------------------------------------
+// Starts a new frame's allocations from the beginning of the
+// ring.  If the last frame ran out of room, the ring grows
+// to fit it first, so overflow only costs a frame or two.
+// --------------------------------------------------------
+void ConstantRing::BeginFrame()
+{
+	unsigned int requested = offset.load();
+	if (requested > capacity)
+	{
+		unsigned int newCapacity = capacity;
+		while (newCapacity < requested)
+			newCapacity *= 2;
+		Resize(newCapacity);
+	}
+	offset = 0;
+}
+
+// --------------------------------------------------------
+// Copies everything allocated this frame to the GPU with one
+// Map.  Must be called after all recording has finished, and
+// before the command lists that read the ring are executed.
+// --------------------------------------------------------
+void ConstantRing::Upload(ID3D11DeviceContext* context)
+{
+	unsigned int used = GetUsedBytes();
+	if (used == 0)
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, &data[0], used);
+	context->Unmap(buffer.Get(), 0);
+}
+
+// --------------------------------------------------------
+// Reserves room for one constant buffer's worth of data
+//
+// size          - Size of the data in bytes
+// firstConstant - Receives the offset to bind, in constants
+// constantCount - Receives the size to bind, in constants
+//
+// Returns where to write the data, or null if the ring is full
+// (the caller should fall back to an ordinary buffer)
+// --------------------------------------------------------
+unsigned char* ConstantRing::Allocate(unsigned int size, unsigned int& firstConstant, unsigned int& constantCount)
+{
+	unsigned int alignedSize = (size + RING_ALIGNMENT - 1) & ~(RING_ALIGNMENT - 1);
+	unsigned int start = offset.fetch_add(alignedSize);
+	if (!supported || start + alignedSize > capacity)
+		return 0;
+
+	firstConstant = start / 16;
+	constantCount = alignedSize / 16;
+	return &data[start];
+}
+
+ID3D11Buffer* ConstantRing::GetBuffer() { return buffer.Get(); }
+unsigned int ConstantRing::GetCapacity() { return capacity; }
+
+unsigned int ConstantRing::GetUsedBytes()
+{
+	unsigned int used = offset.load();
+	return used < capacity ? used : capacity;
+}
+
+// --------------------------------------------------------
+// (Re)creates the GPU buffer and its CPU copy
+// - Constant buffers bound with offsets may be larger than
+//   the usual 64KB limit, only each bound range can't be
+// --------------------------------------------------------
+void ConstantRing::Resize(unsigned int newCapacity)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = newCapacity;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	buffer.Reset();
+	device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+	data.resize(newCapacity);
+	capacity = newCapacity;
+}
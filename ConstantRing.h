@@ -0,0 +1,50 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+#include <vector>
+#include <atomic>
+
+// --------------------------------------------------------
+// One large constant buffer that a frame's per draw constants
+// are suballocated from, instead of each shader rewriting its
+// own small buffers over and over
+//
+// - Allocations are 256 byte aligned, as offsets passed to
+//   *SetConstantBuffers1 must be multiples of 16 constants
+// - Data is gathered in CPU memory while draws are recorded
+//   into deferred contexts, then sent to the GPU with a single
+//   Map(DISCARD) before the command lists are executed
+// - Requires Direct3D 11.1 constant buffer offsetting, see
+//   IsSupported()
+// --------------------------------------------------------
+class ConstantRing
+{
+public:
+	ConstantRing(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int initialCapacity);
+	~ConstantRing();
+
+	bool IsSupported();
+
+	// Once per frame, before and after recording
+	void BeginFrame();
+	void Upload(ID3D11DeviceContext* context);
+
+	// Safe to call from several threads at once
+	unsigned char* Allocate(unsigned int size, unsigned int& firstConstant, unsigned int& constantCount);
+
+	ID3D11Buffer* GetBuffer();
+	unsigned int GetUsedBytes();
+	unsigned int GetCapacity();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	bool supported;
+
+	std::vector<unsigned char> data;	// CPU copy, uploaded by Upload()
+	unsigned int capacity;
+	std::atomic<unsigned int> offset;	// Bytes requested this frame, may pass capacity
+
+	void Resize(unsigned int newCapacity);
+};
@@ -0,0 +1,50 @@
+#include "GpuScene.hlsli"
+
+cbuffer CullData : register(b0)
+{
+    float4 frustumPlanes[6]; // xyz = normal pointing inwards, w = distance
+    uint instanceCount;
+};
+
+StructuredBuffer<GpuInstance> Instances : register(t0);
+StructuredBuffer<GpuMesh> Meshes : register(t1);
+
+// Indirect args, DRAW_ARGS_SIZE uints per draw slot.  Instance counts
+// start at zero, start instances are the first ID of each slot's range.
+RWBuffer<uint> DrawArgs : register(u0);
+
+// Instance IDs of the visible instances, grouped by draw slot
+RWBuffer<uint> VisibleIds : register(u1);
+
+// --------------------------------------------------------
+// Tests one instance's world space bounds against the frustum
+// and, if visible, appends it to its draw slot
+// --------------------------------------------------------
+[numthreads(64, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    if (id.x >= instanceCount)
+        return;
+
+    GpuInstance instance = Instances[id.x];
+    GpuMesh mesh = Meshes[instance.meshIndex];
+
+    // Transform the mesh's box into a world space box
+    float3 center = mul(instance.world, float4(mesh.boundsCenter, 1.0f)).xyz;
+    float3 extents = mul(abs((float3x3) instance.world), mesh.boundsExtents);
+
+    // Outside if the box is entirely behind any plane
+    [unroll]
+    for (uint p = 0; p < 6; p++)
+    {
+        float distance = dot(frustumPlanes[p].xyz, center) + frustumPlanes[p].w;
+        float radius = dot(abs(frustumPlanes[p].xyz), extents);
+        if (distance + radius < 0.0f)
+            return;
+    }
+
+    uint args = instance.drawSlot * DRAW_ARGS_SIZE;
+    uint index;
+    InterlockedAdd(DrawArgs[args + DRAW_ARGS_INSTANCE_COUNT], 1, index);
+    VisibleIds[DrawArgs[args + DRAW_ARGS_START_INSTANCE] + index] = id.x;
+}
@@ -1,12 +1,16 @@
 #include "Include.hlsli"
 
 //Constant buffer
-cbuffer ExternalData : register(b0)
+cbuffer PerFrame : register(b0)
 {
-    float4 colorTint;
     float3 cameraPos;
 }
 
+cbuffer PerObject : register(b1)
+{
+    float4 colorTint;
+}
+
 struct VertexToPixel
 {
 	// Data type
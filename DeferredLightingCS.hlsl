@@ -0,0 +1,210 @@
+#include "Include.hlsli"
+#include "Shadows.hlsli"
+#include "Ambient.hlsli"
+
+// Pixels per side of a tile, which is also one thread group
+#define TILE_SIZE 16
+
+// Lights a tile can hold - past this, its pixels fall back
+// to the light manager's cluster lists
+#define MAX_TILE_LIGHTS 256
+
+cbuffer LightingData : register(b0)
+{
+    matrix invViewProjection; // Screen to world, to rebuild positions from depth
+    matrix view;
+    matrix lightView;
+    matrix lightProjection; // The first cascade's
+    float3 cameraPos;
+    uint lightCount;
+    float2 projectionScale; // The projection's _11 and _22
+    float2 depthParams; // The projection's _33 and _43: viewZ = y / (depth - x)
+    uint2 screenSize;
+    int shadowLightIndex; // The light the shadow map is rendered from, or -1
+    uint lightDebugView; // One of LIGHT_DEBUG_*
+    uint globalLightCount; // Directional lights, at the front of ClusterLightIndices
+    uint3 clusterCounts; // Tiles across, tiles down, depth slices
+    float clusterDepthScale;
+    float2 clusterTileScale; // Pixels to tiles
+    float clusterDepthBias;
+}
+
+// The G-buffer (see GBuffer.h)
+Texture2D AlbedoBuffer : register(t0);
+Texture2D NormalBuffer : register(t1);
+Texture2D MaterialBuffer : register(t2);
+Texture2D<float> DepthBuffer : register(t3);
+
+Texture2DArray ShadowMap : register(t4);
+StructuredBuffer<Light> Lights : register(t5);
+Texture2DArray ShadowAtlas : register(t6);
+StructuredBuffer<ShadowView> ShadowViews : register(t7);
+Texture2DArray ShadowMoments : register(t8);
+TextureCube SpecularMap : register(t9);
+Texture2D BrdfLut : register(t10);
+Texture3D ProbeGrid : register(t11);
+StructuredBuffer<uint2> ClusterRanges : register(t12); // See PixelShader.hlsl
+StructuredBuffer<uint> ClusterLightIndices : register(t13);
+SamplerComparisonState ShadowSampler : register(s0);
+SamplerState MomentSampler : register(s1);
+SamplerState AmbientSampler : register(s2);
+
+RWTexture2D<unorm float4> Output : register(u0);
+
+// The tile's depth range, as float bits (positive floats sort
+// the same as their bits), and the lights that can reach it
+groupshared uint tileMinZ;
+groupshared uint tileMaxZ;
+groupshared uint tileLightCount;
+groupshared uint tileLights[MAX_TILE_LIGHTS];
+
+// Does a view space sphere reach into the tile's frustum?
+// Edges are where x / z (or y / z) meets the tile's sides.
+bool SphereInTile(float3 center, float radius, float left, float right, float bottom, float top, float minZ, float maxZ)
+{
+    return center.z + radius >= minZ && center.z - radius <= maxZ &&
+        dot(normalize(float3(1, 0, -left)), center) >= -radius &&
+        dot(normalize(float3(-1, 0, right)), center) >= -radius &&
+        dot(normalize(float3(0, 1, -bottom)), center) >= -radius &&
+        dot(normalize(float3(0, -1, top)), center) >= -radius;
+}
+
+// --------------------------------------------------------
+// Lights the G-buffer one tile per thread group:
+//  1. Find the tile's depth range from the depth buffer
+//  2. Cull every light against the tile, a light per thread
+//  3. Light each pixel with just the tile's lights - or, if
+//     more reach it than it can hold, its cluster's lights
+// Sky pixels (nothing drawn) are left for the sky to fill.
+// --------------------------------------------------------
+[numthreads(TILE_SIZE, TILE_SIZE, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint3 threadId : SV_GroupThreadID, uint groupIndex : SV_GroupIndex)
+{
+    if (groupIndex == 0)
+    {
+        tileMinZ = 0x7F7FFFFF; // Largest float
+        tileMaxZ = 0;
+        tileLightCount = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    bool onScreen = all(id.xy < screenSize);
+    float depth = onScreen ? DepthBuffer[id.xy] : 1.0f;
+    bool surface = onScreen && depth < 1.0f;
+    float viewZ = depthParams.y / (depth - depthParams.x);
+    if (surface)
+    {
+        InterlockedMin(tileMinZ, asuint(viewZ));
+        InterlockedMax(tileMaxZ, asuint(viewZ));
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // The tile's sides as x / z and y / z in view space
+    float2 tileMin = groupId.xy * TILE_SIZE;
+    float2 tileMax = tileMin + TILE_SIZE;
+    float left = (tileMin.x / screenSize.x * 2.0f - 1.0f) / projectionScale.x;
+    float right = (tileMax.x / screenSize.x * 2.0f - 1.0f) / projectionScale.x;
+    float top = (1.0f - tileMin.y / screenSize.y * 2.0f) / projectionScale.y;
+    float bottom = (1.0f - tileMax.y / screenSize.y * 2.0f) / projectionScale.y;
+    float minZ = asfloat(tileMinZ);
+    float maxZ = asfloat(tileMaxZ);
+
+    for (uint i = groupIndex; i < lightCount; i += TILE_SIZE * TILE_SIZE)
+    {
+        Light light = Lights[i];
+        bool reaches = light.type == LIGHT_TYPE_DIRECTIONAL;
+        if (!reaches)
+        {
+            float3 center = mul(view, float4(light.position, 1.0f)).xyz;
+            reaches = SphereInTile(center, light.range, left, right, bottom, top, minZ, maxZ);
+        }
+
+        if (reaches)
+        {
+            uint slot;
+            InterlockedAdd(tileLightCount, 1, slot);
+            if (slot < MAX_TILE_LIGHTS)
+                tileLights[slot] = i;
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (!surface)
+        return;
+
+    // Too many lights for the tile: the pixel's cluster has a
+    // list of its own, global lights first, same as PixelShader.hlsl
+    bool overflow = tileLightCount > MAX_TILE_LIGHTS;
+    uint count = tileLightCount;
+    uint2 clusterRange = uint2(0, 0);
+    if (overflow)
+    {
+        uint3 cluster;
+        cluster.xy = min((uint2)((id.xy + 0.5f) * clusterTileScale), clusterCounts.xy - 1);
+        cluster.z = (uint)clamp(floor(log(viewZ) * clusterDepthScale - clusterDepthBias), 0.0f, (float)(clusterCounts.z - 1));
+        clusterRange = ClusterRanges[(cluster.z * clusterCounts.y + cluster.y) * clusterCounts.x + cluster.x];
+        count = globalLightCount + clusterRange.y;
+    }
+
+    if (lightDebugView == LIGHT_DEBUG_LIGHT_COUNT)
+    {
+        // Tiles that overflowed are outlined in magenta
+        bool edge = any(threadId.xy == 0) || any(threadId.xy == TILE_SIZE - 1);
+        Output[id.xy] = overflow && edge ? float4(1, 0, 1, 1) : float4(HeatColor(count / LIGHT_DEBUG_MAX_LIGHTS), 1);
+        return;
+    }
+    if (lightDebugView == LIGHT_DEBUG_SLICES)
+    {
+        // Tiles shaded by how much depth they span - tiles over
+        // an edge take in every light along it
+        float checker = ((groupId.x + groupId.y) & 1) ? 1.0f : 0.6f;
+        Output[id.xy] = float4(HeatColor((maxZ - minZ) / 20.0f) * checker, 1);
+        return;
+    }
+
+    // Rebuild the surface from the G-buffer
+    float2 ndc = float2((id.x + 0.5f) / screenSize.x * 2.0f - 1.0f, 1.0f - (id.y + 0.5f) / screenSize.y * 2.0f);
+    float4 worldPosition = mul(invViewProjection, float4(ndc, depth, 1.0f));
+    worldPosition /= worldPosition.w;
+
+    float3 surfaceColor = AlbedoBuffer[id.xy].rgb;
+    float3 normal = OctahedralDecode(NormalBuffer[id.xy].xy);
+    float2 roughnessMetalness = MaterialBuffer[id.xy].xy;
+    float3 specularColor = lerp(F0_NON_METAL, surfaceColor, roughnessMetalness.y);
+    float3 V = normalize(cameraPos - worldPosition.xyz);
+
+    // Same shadow test as PixelShader.hlsl, with the first
+    // cascade's position worked out here rather than in a vertex
+    // shader, and its change between pixels from the size of a
+    // pixel at this depth rather than from derivatives
+    float shadowAmount = 1.0f;
+    float2x2 shadowRotation = PoissonRotation(id.xy);
+    if (shadowLightIndex >= 0)
+    {
+        float4 shadowMapPos = mul(lightProjection, mul(lightView, float4(worldPosition.xyz, 1.0f)));
+        float viewDepth = mul(view, float4(worldPosition.xyz, 1.0f)).z;
+        float pixelSize = viewDepth * 2.0f / (projectionScale.y * screenSize.y);
+        shadowAmount = CascadedShadow(ShadowMap, ShadowMoments, ShadowSampler, MomentSampler,
+            shadowMapPos.xyz / shadowMapPos.w, viewDepth, pixelSize * cascadeProjection.x, shadowRotation);
+    }
+
+    float3 totalLight = float3(0, 0, 0);
+    for (uint j = 0; j < count; j++)
+    {
+        uint lightIndex = !overflow ? tileLights[j] :
+            ClusterLightIndices[j < globalLightCount ? j : clusterRange.x + j - globalLightCount];
+        Light light = Lights[lightIndex];
+        float3 lightResult = EvaluateLight(light, worldPosition.xyz, normal, V,
+            surfaceColor, specularColor, roughnessMetalness.x, roughnessMetalness.y);
+        if ((int)lightIndex == shadowLightIndex)
+            lightResult *= shadowAmount;
+        else if (light.shadowView >= 0)
+            lightResult *= AtlasShadow(ShadowAtlas, ShadowSampler, ShadowViews, light, worldPosition.xyz, shadowRotation);
+        totalLight += lightResult;
+    }
+    float3 ambientIrradiance = AmbientIrradiance(ProbeGrid, AmbientSampler, worldPosition.xyz, normal);
+    totalLight += AmbientLight(SpecularMap, BrdfLut, AmbientSampler, ambientIrradiance,
+        normal, V, surfaceColor, specularColor, roughnessMetalness.x, roughnessMetalness.y);
+
+    Output[id.xy] = float4(pow(totalLight, 1.0f / 2.2f), 1);
+}
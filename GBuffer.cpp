@@ -0,0 +1,87 @@
+#include "GBuffer.h"
+
+// Formats of each target, and the bytes each takes a pixel
+namespace
+{
+	const DXGI_FORMAT TargetFormats[GBUFFER_TARGET_COUNT] =
+	{
+		DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+		DXGI_FORMAT_R16G16_SNORM,
+		DXGI_FORMAT_R8G8_UNORM,
+	};
+	const unsigned int TargetBytes[GBUFFER_TARGET_COUNT] = { 4, 4, 2 };
+	const unsigned int DepthBytes = 4;
+}
+
+GBuffer::GBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int width, unsigned int height)
+	:
+	device(device),
+	width(0),
+	height(0)
+{
+	Resize(width, height);
+}
+
+GBuffer::~GBuffer()
+{
+}
+
+// --------------------------------------------------------
+// (Re)creates every target at the given size
+// --------------------------------------------------------
+void GBuffer::Resize(unsigned int width, unsigned int height)
+{
+	this->width = width;
+	this->height = height;
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = width;
+	desc.Height = height;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	for (unsigned int t = 0; t < GBUFFER_TARGET_COUNT; t++)
+	{
+		desc.Format = TargetFormats[t];
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		device->CreateTexture2D(&desc, 0, texture.GetAddressOf());
+		device->CreateRenderTargetView(texture.Get(), 0, rtvs[t].ReleaseAndGetAddressOf());
+		device->CreateShaderResourceView(texture.Get(), 0, srvs[t].ReleaseAndGetAddressOf());
+		rtvTable[t] = rtvs[t].Get();
+	}
+
+	// Typeless, so it can be both a depth buffer and a texture
+	desc.Format = DXGI_FORMAT_R32_TYPELESS;
+	desc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> depthTexture;
+	device->CreateTexture2D(&desc, 0, depthTexture.GetAddressOf());
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(depthTexture.Get(), &dsvDesc, dsv.ReleaseAndGetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(depthTexture.Get(), &srvDesc, depthSRV.ReleaseAndGetAddressOf());
+}
+
+ID3D11RenderTargetView* const* GBuffer::GetRTVs() { return rtvTable; }
+ID3D11DepthStencilView* GBuffer::GetDSV() { return dsv.Get(); }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GBuffer::GetSRV(GBufferTarget target) { return srvs[target]; }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GBuffer::GetDepthSRV() { return depthSRV; }
+
+unsigned int GBuffer::GetBytesPerPixel()
+{
+	unsigned int bytes = DepthBytes;
+	for (unsigned int t = 0; t < GBUFFER_TARGET_COUNT; t++)
+		bytes += TargetBytes[t];
+	return bytes;
+}
+
+unsigned int GBuffer::GetTotalBytes() { return GetBytesPerPixel() * width * height; }
@@ -0,0 +1,55 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+
+// Render targets of the G-buffer, in the order GBufferPS.hlsl writes them
+enum GBufferTarget
+{
+	GBUFFER_ALBEDO = 0,		// RGBA8 sRGB: linear albedo
+	GBUFFER_NORMAL = 1,		// RG16 SNORM: octahedral world space normal
+	GBUFFER_MATERIAL = 2,	// RG8: roughness, metalness
+	GBUFFER_TARGET_COUNT
+};
+
+// GBufferPS.hlsl's textureMask bit for an albedo map, next to
+// the PS_FEATURE_* map bits (without one, it uses the tint)
+#define GBUFFER_ALBEDO_MAP	(1 << 4)
+
+// --------------------------------------------------------
+// The textures the deferred path draws the scene into, to be
+// lit afterwards by DeferredLightingCS.hlsl
+//
+// - Kept small, at 14 bytes a pixel including depth, as every
+//   byte is written once and read back once per frame
+// - Has its own depth buffer, which the lighting pass reads
+//   (the window's can't be sampled)
+// - Resize() replaces every view, so get them again after
+// --------------------------------------------------------
+class GBuffer
+{
+public:
+	GBuffer(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int width, unsigned int height);
+	~GBuffer();
+
+	void Resize(unsigned int width, unsigned int height);
+
+	// All GBUFFER_TARGET_COUNT targets, for OMSetRenderTargets()
+	ID3D11RenderTargetView* const* GetRTVs();
+	ID3D11DepthStencilView* GetDSV();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV(GBufferTarget target);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetDepthSRV();
+
+	unsigned int GetBytesPerPixel();
+	unsigned int GetTotalBytes();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	unsigned int width;
+	unsigned int height;
+
+	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtvs[GBUFFER_TARGET_COUNT];
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srvs[GBUFFER_TARGET_COUNT];
+	ID3D11RenderTargetView* rtvTable[GBUFFER_TARGET_COUNT]; // Owned by rtvs
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> dsv;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> depthSRV;
+};
@@ -0,0 +1,77 @@
+#include "Include.hlsli"
+
+// Which of the material's maps to sample - the same bits as
+// PS_FEATURE_* in ShaderVariants.h, plus the albedo map, which
+// every PixelShader.hlsl variant has (GBUFFER_ALBEDO_MAP in
+// GBuffer.h).  A uniform branch rather than variants, as it's
+// the only thing that differs.
+#define MATERIAL_NORMAL_MAP     (1 << 0)
+#define MATERIAL_ROUGHNESS_MAP  (1 << 1)
+#define MATERIAL_METALNESS_MAP  (1 << 2)
+#define MATERIAL_ALBEDO_MAP     (1 << 4)
+
+// The same registers as PixelShader.hlsl's
+cbuffer PerObject : register(b1)
+{
+    float4 colorTint; // The albedo when there's no albedo map
+}
+
+cbuffer PerMaterial : register(b4)
+{
+    float roughness; // Used when there's no roughness map
+    uint textureMask; // MATERIAL_* bits
+}
+
+// Same registers as PixelShader.hlsl, so materials bind their
+// textures here exactly as they do for the forward path
+Texture2D Albedo : register(t0);
+Texture2D NormalMap : register(t1);
+Texture2D RoughnessMap : register(t2);
+Texture2D MetalnessMap : register(t3);
+SamplerState BasicSampler : register(s0);
+
+// Must match the vertex shaders' output
+struct VertexToPixel
+{
+    float4 screenPosition : SV_POSITION;
+    float2 uv : TEXCOORD;
+    float3 normal : NORMAL;
+    float3 worldPosition : POSITION;
+    float3 tangent : TANGENT;
+    float4 shadowMapPos : SHADOW_POSITION;
+};
+
+// Laid out by GBuffer (see GBuffer.h)
+struct GBufferOutput
+{
+    float4 albedo : SV_TARGET0; // Linear, stored as sRGB
+    float2 normal : SV_TARGET1; // World space, octahedral
+    float2 roughnessMetalness : SV_TARGET2;
+};
+
+// --------------------------------------------------------
+// Writes the surface to the G-buffer, to be lit later by
+// DeferredLightingCS.hlsl - everything here matches how
+// PixelShader.hlsl reads its surface
+// --------------------------------------------------------
+GBufferOutput main(VertexToPixel input)
+{
+    float3 normal = normalize(input.normal);
+    if (textureMask & MATERIAL_NORMAL_MAP)
+    {
+        float3 unpackedNormal = normalize(NormalMap.Sample(BasicSampler, input.uv).rgb * 2 - 1);
+        float3 T = normalize(input.tangent);
+        T = normalize(T - normal * dot(T, normal));
+        float3 B = cross(T, normal);
+        normal = normalize(mul(unpackedNormal, float3x3(T, B, normal)));
+    }
+
+    GBufferOutput output;
+    output.albedo = (textureMask & MATERIAL_ALBEDO_MAP) ?
+        float4(pow(Albedo.Sample(BasicSampler, input.uv).rgb, 2.2f), 1) :
+        float4(colorTint.rgb, 1);
+    output.normal = OctahedralEncode(normal);
+    output.roughnessMetalness.x = (textureMask & MATERIAL_ROUGHNESS_MAP) ? RoughnessMap.Sample(BasicSampler, input.uv).r : roughness;
+    output.roughnessMetalness.y = (textureMask & MATERIAL_METALNESS_MAP) ? MetalnessMap.Sample(BasicSampler, input.uv).r : 0.0f;
+    return output;
+}
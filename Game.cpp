@@ -3,6 +3,8 @@
 #include "Input.h"
 #include "Material.h"
 #include "WICTextureLoader.h"
+#include <chrono>
+#include <algorithm>
 
 // Needed for a helper function to load pre-compiled shader files
 #pragma comment(lib, "d3dcompiler.lib")
@@ -33,14 +35,7 @@ Game::Game(HINSTANCE hInstance)
 	CreateConsoleWindow(500, 120, 32, 120);
 	printf("Console window created successfully.  Feel free to printf() here.\n");
 #endif
-	directionalLight1 = {};
-	directionalLight2 = {};
-	directionalLight3 = {};
-	pointLight1 = {};
-	pointLight2 = {};
 	blurAmount = 0.0f;
-	XMStoreFloat4x4(&lightViewMatrix, XMMatrixIdentity());
-	XMStoreFloat4x4(&lightProjectionMatrix, XMMatrixIdentity());
 }
 
 // --------------------------------------------------------
@@ -70,12 +65,33 @@ void Game::Init()
 	// Helper methods for loading shaders, creating some basic
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
+	stateObjects = std::make_shared<StateObjectCache>(device);
 	LoadShaders();
 	LoadTextures();
 	CreateGeometry();
 	LoadSky();
 	PostProcessSetup();
 
+	// One frame's worth of per instance data, grown as needed
+	instanceBuffer = std::make_shared<InstanceBuffer>(device, context, 1024);
+
+	// Built from the entities on the first GPU driven frame
+	gpuScene = std::make_shared<GpuScene>(device, context, cullCS);
+
+	// Static entities are merged into 16x16 unit chunks
+	staticBatcher = std::make_shared<StaticBatcher>(device, context, 16.0f);
+
+	// Probes every 4 units over the static entities, baked in
+	// the background once they're seen (in UpdateDrawEntities())
+	// on threads of their own, so the frame never waits on them
+	lightProbes = std::make_shared<LightProbeGrid>(device, context, 4.0f,
+		std::max(1u, std::thread::hardware_concurrency()));
+
+	// Only drawn into when deferred shading is on
+	gBuffer = std::make_shared<GBuffer>(device, windowWidth, windowHeight);
+
+	gpuTimer = std::make_shared<GpuTimer>(device, context, GPU_TIME_SECTION_COUNT);
+
 	// Set initial graphics API state
 	//  - These settings persist until we change them
 	//  - Some of these, like the primitive topology & input layout, probably won't change
@@ -103,37 +119,92 @@ void Game::Init()
 		camera[1] = std::make_shared<Camera>(0.0f, 0.0f, -10.0f, 5.0f, 10.0f, XM_PI / 3, (float)this->windowWidth / this->windowHeight);
 		camera[2] = std::make_shared<Camera>(-10.0f, 0.0f, -10.0f, 5.0f, 10.0f, XM_PI / 4, (float)this->windowWidth / this->windowHeight);
 
-		directionalLight1.type = LIGHT_TYPE_DIRECTIONAL;
-		directionalLight1.direction = XMFLOAT3(1.0f, 0.0f, 0.0f);
-		directionalLight1.color = XMFLOAT3(0.0f, 0.0f, 0.0f);
-		directionalLight1.intensity = 0.5f;
-
-		directionalLight2.type = LIGHT_TYPE_DIRECTIONAL;
-		directionalLight2.direction = XMFLOAT3(1.0f, -1.0f, 0.0f);
-		directionalLight2.color = XMFLOAT3(1.0f, 1.0f, 1.0f);
-		directionalLight2.intensity = 0.5f;
-
-		directionalLight3.type = LIGHT_TYPE_DIRECTIONAL;
-		directionalLight3.direction = XMFLOAT3(0.0f, 0.0f, 1.0f);
-		directionalLight3.color = XMFLOAT3(0.0f, 0.0f, 0.0f);
-		directionalLight3.intensity = 0.5f;
-
-		pointLight1.type = LIGHT_TYPE_POINT;
-		pointLight1.direction = XMFLOAT3(0.0f, 0.0f, -1.0f);
-		pointLight1.color = XMFLOAT3(0.0f, 0.0f, 0.0f);
-		pointLight1.position = XMFLOAT3(0.0f, 0.0f, 1.0f);
-		pointLight1.intensity = 0.5f;
-		pointLight1.range = 100.0f;
-
-		pointLight2.type = LIGHT_TYPE_POINT;
-		pointLight2.direction = XMFLOAT3(0.0f, 0.0f, 1.0f);
-		pointLight2.color = XMFLOAT3(0.0f, 0.0f, 0.0f);
-		pointLight2.position = XMFLOAT3(0.0f, -1.0f, 0.0f);
-		pointLight2.intensity = 0.5f;
-		pointLight2.range = 100.0f;
+		// Lights start out black (off) except the second, which
+		// casts the shadow - they can be turned on in the UI
+		lightManager = std::make_shared<LightManager>(device, context, 64);
+
+		Light light = {};
+		light.type = LIGHT_TYPE_DIRECTIONAL;
+		light.direction = XMFLOAT3(1.0f, 0.0f, 0.0f);
+		light.color = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		light.intensity = 0.5f;
+		lightManager->Add(light);
+
+		light.direction = XMFLOAT3(1.0f, -1.0f, 0.0f);
+		light.color = XMFLOAT3(1.0f, 1.0f, 1.0f);
+		shadowLightIndex = lightManager->Add(light);
+
+		light.direction = XMFLOAT3(0.0f, 0.0f, 1.0f);
+		light.color = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		lightManager->Add(light);
+
+		light = {};
+		light.type = LIGHT_TYPE_POINT;
+		light.direction = XMFLOAT3(0.0f, 0.0f, -1.0f);
+		light.color = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		light.position = XMFLOAT3(0.0f, 0.0f, 1.0f);
+		light.intensity = 0.5f;
+		light.range = 100.0f;
+		lightManager->Add(light);
+
+		light.direction = XMFLOAT3(0.0f, 0.0f, 1.0f);
+		light.position = XMFLOAT3(0.0f, -1.0f, 0.0f);
+		lightManager->Add(light);
+
+		light = {};
+		light.type = LIGHT_TYPE_SPOT;
+		light.direction = XMFLOAT3(0.0f, -1.0f, 0.0f);
+		light.color = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		light.position = XMFLOAT3(0.0f, 4.0f, 0.0f);
+		light.intensity = 2.0f;
+		light.range = 20.0f;
+		light.spotFallOff = 16.0f;
+		lightManager->Add(light);
+
+		sceneLightCount = lightManager->GetCount();
 	}
 	CreateShadows();
 
+	// Every material samples the shadow map
+	litMaterials = { mat1, mat2, mat3, mat4, mat5, mat6 };
+	SetMaterialShadowMaps();
+	SelectShaderVariants();
+
+	//Multithreaded recording setup
+	{
+		// Each recording thread needs its own shader data slot
+		// (slot 0 is the main thread's), so that caps the count
+		maxRenderThreads = (int)std::thread::hardware_concurrency();
+		maxRenderThreads = std::max(1, std::min(maxRenderThreads, (int)ISimpleShader::MaxContextSlots - 1));
+		workerPool = std::make_shared<WorkerPool>(maxRenderThreads);
+
+		deferredContexts.resize(maxRenderThreads);
+		for (auto& deferred : deferredContexts)
+			device->CreateDeferredContext(0, deferred.GetAddressOf());
+		commandLists.resize(RENDER_PASS_COUNT * maxRenderThreads);
+		threadStats.resize(maxRenderThreads);
+
+		// Every context gets a state cache, used by the shaders
+		// recording from the matching slot as well as by Game
+		stateCaches.push_back(std::make_shared<StateCache>(context));
+		for (auto& deferred : deferredContexts)
+			stateCaches.push_back(std::make_shared<StateCache>(deferred));
+		for (unsigned int s = 0; s < stateCaches.size(); s++)
+			ISimpleShader::SetStateCache(s, stateCaches[s].get());
+
+		// Without driver support the runtime emulates command
+		// lists, which works but gains much less from threading
+		D3D11_FEATURE_DATA_THREADING threading = {};
+		device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading));
+		driverCommandLists = threading.DriverCommandLists == TRUE;
+
+		// Enough for a few thousand draws, it grows if needed
+		constantRing = std::make_shared<ConstantRing>(device, 1024 * 1024);
+	}
+
+	// Every state object has been created by now, so lookups
+	// from here on (possibly from several threads) never add any
+	stateObjects->Freeze();
 }
 
 // --------------------------------------------------------
@@ -146,6 +217,10 @@ void Game::Init()
 // --------------------------------------------------------
 void Game::LoadShaders()
 {
+	// Timed, to show what the reflection cache saves
+	ShaderCache::ResetStats();
+	std::chrono::high_resolution_clock::time_point loadStart = std::chrono::high_resolution_clock::now();
+
 	//vertex shader
 	vertexShader = std::make_shared<SimpleVertexShader>(
 		device,
@@ -156,6 +231,7 @@ void Game::LoadShaders()
 		device,
 		context,
 		FixPath(L"PixelShader.cso").c_str());
+	pixelVariants = std::make_shared<ShaderVariants>(device, context, L"PixelShader", pixelShader);
 	customShader = std::make_shared<SimplePixelShader>(
 		device,
 		context,
@@ -176,6 +252,31 @@ void Game::LoadShaders()
 		context,
 		FixPath(L"ShadowVS.cso").c_str());
 
+	instancedVS = std::make_shared<SimpleVertexShader>(
+		device,
+		context,
+		FixPath(L"InstancedVS.cso").c_str());
+
+	instancedShadowVS = std::make_shared<SimpleVertexShader>(
+		device,
+		context,
+		FixPath(L"InstancedShadowVS.cso").c_str());
+
+	gpuDrivenVS = std::make_shared<SimpleVertexShader>(
+		device,
+		context,
+		FixPath(L"GpuDrivenVS.cso").c_str());
+
+	gpuDrivenShadowVS = std::make_shared<SimpleVertexShader>(
+		device,
+		context,
+		FixPath(L"GpuDrivenShadowVS.cso").c_str());
+
+	cullCS = std::make_shared<SimpleComputeShader>(
+		device,
+		context,
+		FixPath(L"CullInstancesCS.cso").c_str());
+
 	ppVS = std::make_shared<SimpleVertexShader>(
 		device,
 		context,
@@ -185,6 +286,50 @@ void Game::LoadShaders()
 		device,
 		context,
 		FixPath(L"PostPS.cso").c_str());
+
+	gBufferPS = std::make_shared<SimplePixelShader>(
+		device,
+		context,
+		FixPath(L"GBufferPS.cso").c_str());
+
+	deferredLightingCS = std::make_shared<SimpleComputeShader>(
+		device,
+		context,
+		FixPath(L"DeferredLightingCS.cso").c_str());
+
+	shadowMomentsCS = std::make_shared<SimpleComputeShader>(
+		device,
+		context,
+		FixPath(L"ShadowMomentsCS.cso").c_str());
+
+	shadowBlurCS = std::make_shared<SimpleComputeShader>(
+		device,
+		context,
+		FixPath(L"ShadowBlurCS.cso").c_str());
+
+	skyCaptureCS = std::make_shared<SimpleComputeShader>(
+		device,
+		context,
+		FixPath(L"SkyCaptureCS.cso").c_str());
+
+	specularPrefilterCS = std::make_shared<SimpleComputeShader>(
+		device,
+		context,
+		FixPath(L"SpecularPrefilterCS.cso").c_str());
+
+	brdfLutCS = std::make_shared<SimpleComputeShader>(
+		device,
+		context,
+		FixPath(L"BrdfLutCS.cso").c_str());
+
+	std::chrono::duration<float, std::milli> loadElapsed = std::chrono::high_resolution_clock::now() - loadStart;
+	shaderLoadTime = loadElapsed.count();
+
+	ResolveShaderParams();
+
+	// Shader sources are in the project folder, two up from the exe
+	hotReload = std::make_shared<ShaderHotReload>(FixPath(L"../../"));
+	WatchShaders();
 }
 
 void Game::LoadTextures()
@@ -197,7 +342,7 @@ void Game::LoadTextures()
 	samplerDescription.MaxAnisotropy = 8;
 	samplerDescription.MaxLOD = D3D11_FLOAT32_MAX;
 
-	device->CreateSamplerState(&samplerDescription, samplerState.GetAddressOf());
+	samplerState = stateObjects->GetSamplerState(samplerDescription);
 
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> bronzeSRVA, bronzeSRVN, bronzeSRVR, bronzeSRVM;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cobblestoneSRVA, cobblestoneSRVN, cobblestoneSRVR, cobblestoneSRVM;
@@ -232,6 +377,7 @@ void Game::LoadTextures()
 		0, bronzeSRVM.GetAddressOf());
 
 	mat1 = std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.0);
+	mat1->SetInstancedVertexShader(instancedVS);
 	mat1->AddSampler("BasicSampler", samplerState);
 	mat1->AddTextureSRV("Albedo", bronzeSRVA);
 	mat1->AddTextureSRV("NormalMap", bronzeSRVN);
@@ -264,6 +410,7 @@ void Game::LoadTextures()
 		0, cobblestoneSRVM.GetAddressOf());
 
 	mat2 = std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.0);
+	mat2->SetInstancedVertexShader(instancedVS);
 	mat2->AddSampler("BasicSampler", samplerState);
 	mat2->AddTextureSRV("Albedo", cobblestoneSRVA);
 	mat2->AddTextureSRV("NormalMap", cobblestoneSRVN);
@@ -296,6 +443,7 @@ void Game::LoadTextures()
 		0, floorSRVM.GetAddressOf());
 
 	mat3 = std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.0);
+	mat3->SetInstancedVertexShader(instancedVS);
 	mat3->AddSampler("BasicSampler", samplerState);
 	mat3->AddTextureSRV("Albedo", floorSRVA);
 	mat3->AddTextureSRV("NormalMap", floorSRVN);
@@ -328,6 +476,7 @@ void Game::LoadTextures()
 		0, paintSRVM.GetAddressOf());
 
 	mat4 = std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.0);
+	mat4->SetInstancedVertexShader(instancedVS);
 	mat4->AddSampler("BasicSampler", samplerState);
 	mat4->AddTextureSRV("Albedo", paintSRVA);
 	mat4->AddTextureSRV("NormalMap", paintSRVN);
@@ -360,6 +509,7 @@ void Game::LoadTextures()
 		0, scratchSRVM.GetAddressOf());
 
 	mat5 = std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.0);
+	mat5->SetInstancedVertexShader(instancedVS);
 	mat5->AddSampler("BasicSampler", samplerState);
 	mat5->AddTextureSRV("Albedo", scratchSRVA);
 	mat5->AddTextureSRV("NormalMap", scratchSRVN);
@@ -392,6 +542,7 @@ void Game::LoadTextures()
 		0, woodSRVM.GetAddressOf());
 
 	mat6 = std::make_shared<Material>(XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), vertexShader, pixelShader, 0.0);
+	mat6->SetInstancedVertexShader(instancedVS);
 	mat6->AddSampler("BasicSampler", samplerState);
 	mat6->AddTextureSRV("Albedo", woodSRVA);
 	mat6->AddTextureSRV("NormalMap", woodSRVN);
@@ -408,56 +559,46 @@ void Game::LoadSky()
 		srvSky,
 		skyVS,
 		skyPS,
-		context);
-
-	sky.SetSrv(sky.CreateCubemap(
-		FixPath(L"../../Assets/Planet/right.png").c_str(),
-		FixPath(L"../../Assets/Planet/left.png").c_str(),
-		FixPath(L"../../Assets/Planet/up.png").c_str(),
-		FixPath(L"../../Assets/Planet/down.png").c_str(),
-		FixPath(L"../../Assets/Planet/front.png").c_str(),
-		FixPath(L"../../Assets/Planet/back.png").c_str()));
+		context,
+		stateObjects);
+
+	skyFaces = {
+		FixPath(L"../../Assets/Planet/right.png"),
+		FixPath(L"../../Assets/Planet/left.png"),
+		FixPath(L"../../Assets/Planet/up.png"),
+		FixPath(L"../../Assets/Planet/down.png"),
+		FixPath(L"../../Assets/Planet/front.png"),
+		FixPath(L"../../Assets/Planet/back.png") };
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> skyCubemap = sky.CreateCubemap(
+		skyFaces[0].c_str(), skyFaces[1].c_str(), skyFaces[2].c_str(),
+		skyFaces[3].c_str(), skyFaces[4].c_str(), skyFaces[5].c_str());
+	sky.SetSrv(skyCubemap);
+
+	// The ambient light comes from the cache next to the exe,
+	// unless the sky's files no longer match it
+	skyLighting = std::make_shared<SkyLighting>(device, context, stateObjects,
+		skyCaptureCS, specularPrefilterCS, brdfLutCS, FixPath(L"SkyLighting.cache"));
+	skyLighting->SetSky(skyCubemap, skyFaces);
+
+	// Trilinear, for the specular map's roughness mips
+	D3D11_SAMPLER_DESC ambientSampDesc = {};
+	ambientSampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	ambientSampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	ambientSampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	ambientSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	ambientSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	ambientSampler = stateObjects->GetSamplerState(ambientSampDesc);
 }
 
 void Game::CreateShadows()
 {
-	// Create the actual texture that will be the shadow map
-	D3D11_TEXTURE2D_DESC shadowDesc = {};
-	shadowDesc.Width = shadowMapResolution; // Ideally a power of 2 (like 1024)
-	shadowDesc.Height = shadowMapResolution; // Ideally a power of 2 (like 1024)
-	shadowDesc.ArraySize = 1;
-	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
-	shadowDesc.CPUAccessFlags = 0;
-	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-	shadowDesc.MipLevels = 1;
-	shadowDesc.MiscFlags = 0;
-	shadowDesc.SampleDesc.Count = 1;
-	shadowDesc.SampleDesc.Quality = 0;
-	shadowDesc.Usage = D3D11_USAGE_DEFAULT;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
-	device->CreateTexture2D(&shadowDesc, 0, shadowTexture.GetAddressOf());
-
-	// Create the depth/stencil view
-	D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
-	shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	shadowDSDesc.Texture2D.MipSlice = 0;
-	device->CreateDepthStencilView(
-		shadowTexture.Get(),
-		&shadowDSDesc,
-		shadowDSV.GetAddressOf());
-	// Create the SRV for the shadow map
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	device->CreateShaderResourceView(
-		shadowTexture.Get(),
-		&srvDesc,
-		shadowSRV.GetAddressOf());
+	// Three cascades of 2048x2048 to start with, changeable in the UI
+	shadowCascades = std::make_shared<ShadowCascades>(device, 3, 2048);
+
+	// Room for 32 shadowed point lights' views, though the
+	// UI limits how many lights get them
+	shadowAtlas = std::make_shared<ShadowAtlas>(device, context, 4096, 32 * 6);
 
-	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
 	D3D11_SAMPLER_DESC shadowSampDesc = {};
 	shadowSampDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_MIP_LINEAR;
 	shadowSampDesc.ComparisonFunc = D3D11_COMPARISON_LESS;
@@ -465,27 +606,184 @@ void Game::CreateShadows()
 	shadowSampDesc.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
 	shadowSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
 	shadowSampDesc.BorderColor[0] = 1.0f; // Only need the first component
-	device->CreateSamplerState(&shadowSampDesc, &this->shadowSampler);
+	shadowSampler = stateObjects->GetSamplerState(shadowSampDesc);
+
+	// EVSM's moments are filtered like any texture, picking
+	// their mip by how far apart pixels fall in the cascade
+	shadowFilter = std::make_shared<ShadowFilter>(device, context, shadowMomentsCS, shadowBlurCS);
+	D3D11_SAMPLER_DESC momentSampDesc = {};
+	momentSampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	momentSampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	momentSampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	momentSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	momentSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	momentSampler = stateObjects->GetSamplerState(momentSampDesc);
+
+	D3D11_RASTERIZER_DESC shadowRastDesc = {};
+	shadowRastDesc.FillMode = D3D11_FILL_SOLID;
+	shadowRastDesc.CullMode = D3D11_CULL_BACK;
+	shadowRastDesc.DepthClipEnable = true;
+	shadowRastDesc.DepthBias = 1000; // Min. precision units, not world units!
+	shadowRastDesc.SlopeScaledDepthBias = 1.0f; // Bias more based on slope
+	shadowRasterizer = stateObjects->GetRasterizerState(shadowRastDesc);
+}
 
-	XMVECTOR lightDirection = XMVectorSet(
-		directionalLight2.direction.x,
-		directionalLight2.direction.y,
-		directionalLight2.direction.z, 0.0f);
+// --------------------------------------------------------
+// Fits the shadow cascades to the active camera, along the
+// shadow casting light - done every frame, as the camera
+// can move
+// --------------------------------------------------------
+void Game::UpdateShadowCascades()
+{
+	std::shared_ptr<Camera> cam = camera[activeCamera];
+	shadowCascades->SetStaticCaching(cacheStaticShadows && !useGpuDriven);
+	shadowCascades->Update(
+		cam->GetView(),
+		cam->GetProjection(),
+		cam->GetNearClip(),
+		cam->GetFarClip(),
+		lightManager->Get(shadowLightIndex).direction);
+
+	// EVSM's moments follow the cascades' size
+	shadowFilter->Update(shadowCascades.get());
+}
 
-	XMMATRIX lightView = XMMatrixLookToLH(
-		-lightDirection * 20, // Position: "Backing up" 20 units from origin
-		lightDirection, // Direction: light's direction
-		XMVectorSet(1, 0, 0, 0)); // Up: World up vector (Y axis)
+// --------------------------------------------------------
+// Picks the point and spot lights that cast shadows this
+// frame and packs their views into the shadow atlas
+// - A light's importance is how much of the screen it could
+//   cover, times how bright it is, and its tiles are sized
+//   by how much of the screen it covers
+// - Tiles are halved, least important light first, until all
+//   of them fit the atlas - lights that still don't fit at the
+//   smallest size go without
+// --------------------------------------------------------
+void Game::UpdateLocalShadows()
+{
+	localShadows.clear();
+	atlasFrustums.clear();
+	shadowAtlas->Clear();
+
+	std::shared_ptr<Camera> cam = camera[activeCamera];
+	BoundingFrustum frustum = cam->GetFrustum();
+	XMFLOAT4X4 cameraProjection = cam->GetProjection();
+	XMFLOAT3 cameraPositionFloat = cam->GetTransform()->GetPosition();
+	XMVECTOR cameraPosition = XMLoadFloat3(&cameraPositionFloat);
+	unsigned int maxTile = shadowAtlas->GetResolution() / 4;
+
+	for (unsigned int i = 0; i < lightManager->GetCount() && !useGpuDriven; i++) {
+		const Light& light = lightManager->Get(i);
+		float brightness = light.intensity * std::max(light.color.x, std::max(light.color.y, light.color.z));
+		if (light.type == LIGHT_TYPE_DIRECTIONAL || light.range <= 0.0f || brightness <= 0.0f)
+			continue;
+		if (!frustum.Intersects(BoundingSphere(light.position, light.range)))
+			continue;
+
+		// Roughly the fraction of the screen's height its range covers
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&light.position) - cameraPosition));
+		float coverage = distance > light.range ? std::min(1.0f, light.range * cameraProjection._22 / distance) : 1.0f;
+
+		LocalShadow shadow = {};
+		shadow.lightIndex = i;
+		shadow.viewCount = light.type == LIGHT_TYPE_POINT ? 6 : 1;
+		shadow.size = SHADOW_ATLAS_MIN_TILE;
+		while (shadow.size < maxTile && shadow.size < coverage * maxTile)
+			shadow.size *= 2;
+		shadow.importance = coverage * brightness;
+		shadow.firstView = -1;
+		localShadows.push_back(shadow);
+	}
 
-	float lightProjectionSize = 15.0f; // Tweak for your scene!
-	XMMATRIX lightProjection = XMMatrixOrthographicLH(
-		lightProjectionSize,
-		lightProjectionSize,
-		1.0f,
-		100.0f);
+	std::sort(localShadows.begin(), localShadows.end(), [](const LocalShadow& a, const LocalShadow& b) {
+		return a.importance > b.importance;
+	});
+	if (localShadows.size() > (size_t)maxLocalShadows)
+		localShadows.resize(maxLocalShadows);
+
+	unsigned int budget = shadowAtlas->GetResolution() * shadowAtlas->GetResolution();
+	while (!localShadows.empty()) {
+		unsigned int area = 0;
+		for (LocalShadow& shadow : localShadows)
+			area += shadow.viewCount * shadow.size * shadow.size;
+		if (area <= budget)
+			break;
+
+		size_t shrink = localShadows.size();
+		while (shrink > 0 && localShadows[shrink - 1].size <= SHADOW_ATLAS_MIN_TILE)
+			shrink--;
+		if (shrink > 0)
+			localShadows[shrink - 1].size /= 2;
+		else
+			localShadows.pop_back();
+	}
 
-	XMStoreFloat4x4(&lightViewMatrix, lightView);
-	XMStoreFloat4x4(&lightProjectionMatrix, lightProjection);
+	// Largest first, so the atlas packs them without gaps
+	std::stable_sort(localShadows.begin(), localShadows.end(), [](const LocalShadow& a, const LocalShadow& b) {
+		return a.size > b.size;
+	});
+
+	// Point lights look down each axis, with a 90 degree view each
+	const XMFLOAT3 faceDirections[6] = {
+		XMFLOAT3(1, 0, 0), XMFLOAT3(-1, 0, 0), XMFLOAT3(0, 1, 0),
+		XMFLOAT3(0, -1, 0), XMFLOAT3(0, 0, 1), XMFLOAT3(0, 0, -1) };
+	const XMFLOAT3 faceUps[6] = {
+		XMFLOAT3(0, 1, 0), XMFLOAT3(0, 1, 0), XMFLOAT3(0, 0, -1),
+		XMFLOAT3(0, 0, 1), XMFLOAT3(0, 1, 0), XMFLOAT3(0, 1, 0) };
+	const float nearZ = 0.05f;
+
+	lightShadowViews.assign(lightManager->GetCount(), -1);
+	for (LocalShadow& shadow : localShadows) {
+		const Light& light = lightManager->Get(shadow.lightIndex);
+		XMVECTOR position = XMLoadFloat3(&light.position);
+		for (unsigned int v = 0; v < shadow.viewCount; v++) {
+			XMMATRIX view;
+			XMMATRIX projection;
+			if (light.type == LIGHT_TYPE_POINT) {
+				view = XMMatrixLookToLH(position, XMLoadFloat3(&faceDirections[v]), XMLoadFloat3(&faceUps[v]));
+				projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, nearZ, light.range);
+			}
+			else {
+				// Wide enough for the cone to fade below 5% (see
+				// SpotCone), but no wider than 120 degrees
+				XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&light.direction));
+				XMVECTOR up = fabsf(XMVectorGetY(direction)) > 0.99f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+				float halfAngle = acosf(powf(0.05f, 1.0f / std::max(light.spotFallOff, 1.0f)));
+				view = XMMatrixLookToLH(position, direction, up);
+				projection = XMMatrixPerspectiveFovLH(std::min(halfAngle * 2.0f, XMConvertToRadians(120.0f)), 1.0f, nearZ, light.range);
+			}
+
+			XMFLOAT4X4 viewMatrix;
+			XMFLOAT4X4 projectionMatrix;
+			XMStoreFloat4x4(&viewMatrix, view);
+			XMStoreFloat4x4(&projectionMatrix, projection);
+			int index = shadowAtlas->AddView(viewMatrix, projectionMatrix, shadow.size);
+			if (v == 0)
+				shadow.firstView = index;
+
+			BoundingFrustum viewFrustum;
+			BoundingFrustum::CreateFromMatrix(viewFrustum, projection);
+			viewFrustum.Transform(viewFrustum, XMMatrixInverse(0, view));
+			atlasFrustums.push_back(viewFrustum);
+		}
+		lightShadowViews[shadow.lightIndex] = shadow.firstView;
+	}
+
+	// Only lights whose view changed are uploaded again
+	for (unsigned int i = 0; i < lightManager->GetCount(); i++)
+		lightManager->SetShadowView(i, lightShadowViews[i]);
+	shadowAtlas->Upload();
+}
+
+// --------------------------------------------------------
+// Gives every lit material the current shadow map, which is
+// replaced when the cascade count or resolution changes
+// --------------------------------------------------------
+void Game::SetMaterialShadowMaps()
+{
+	for (auto& m : litMaterials) {
+		m->AddTextureSRV("ShadowMap", shadowCascades->GetSRV());
+		m->AddSampler("ShadowSampler", shadowSampler);
+	}
 }
 
 void Game::PostProcessSetup()
@@ -497,14 +795,15 @@ void Game::PostProcessSetup()
 	ppSampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
 	ppSampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
 	ppSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
-	device->CreateSamplerState(&ppSampDesc, ppSampler.GetAddressOf());
+	ppSampler = stateObjects->GetSamplerState(ppSampDesc);
 
 	// Describe the texture we're creating
 	D3D11_TEXTURE2D_DESC textureDesc = {};
 	textureDesc.Width = windowWidth;
 	textureDesc.Height = windowHeight;
 	textureDesc.ArraySize = 1;
-	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	// (Unordered access for the deferred lighting pass to write)
+	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
 	textureDesc.CPUAccessFlags = 0;
 	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	textureDesc.MipLevels = 1;
@@ -532,6 +831,11 @@ void Game::PostProcessSetup()
 		ppTexture.Get(),
 		0,
 		ppSRV.ReleaseAndGetAddressOf());
+	// Create the Unordered Access View
+	device->CreateUnorderedAccessView(
+		ppTexture.Get(),
+		0,
+		ppUAV.ReleaseAndGetAddressOf());
 }
 
 // --------------------------------------------------------
@@ -539,58 +843,168 @@ void Game::PostProcessSetup()
 // --------------------------------------------------------
 void Game::CreateGeometry()
 {
-	shapes[0] = std::make_shared<GameEntity>(
+	entities.resize(sceneShapeCount);
+
+	entities[0] = std::make_shared<GameEntity>(
 		std::make_shared<Mesh>(
 			FixPath(L"../../Assets/Models/cube.obj").c_str(),
 			device,
 			context),
 		mat1);
-	shapes[0]->GetTransform()->MoveAbsolute(-12, 0, 0);
+	entities[0]->GetTransform()->MoveAbsolute(-12, 0, 0);
 
-	shapes[1] = std::make_shared<GameEntity>(
+	entities[1] = std::make_shared<GameEntity>(
 		std::make_shared<Mesh>(
 			FixPath(L"../../Assets/Models/cylinder.obj").c_str(),
 			device,
 			context),
 		mat2);
-	shapes[1]->GetTransform()->MoveAbsolute(-5, 0, 0);
+	entities[1]->GetTransform()->MoveAbsolute(-5, 0, 0);
 
-	shapes[2] = std::make_shared<GameEntity>(
+	entities[2] = std::make_shared<GameEntity>(
 		std::make_shared<Mesh>(
 			FixPath(L"../../Assets/Models/helix.obj").c_str(),
 			device,
 			context),
 		mat3);
-	shapes[2]->GetTransform()->MoveAbsolute(0, 0, 0);
+	entities[2]->GetTransform()->MoveAbsolute(0, 0, 0);
 
-	shapes[3] = std::make_shared<GameEntity>(
+	entities[3] = std::make_shared<GameEntity>(
 		std::make_shared<Mesh>(
 			FixPath(L"../../Assets/Models/sphere.obj").c_str(),
 			device,
 			context),
 		mat4);
-	shapes[3]->GetTransform()->MoveAbsolute(5, 0, 0);
+	entities[3]->GetTransform()->MoveAbsolute(5, 0, 0);
 
-	shapes[4] = std::make_shared<GameEntity>(
+	entities[4] = std::make_shared<GameEntity>(
 		std::make_shared<Mesh>(
 			FixPath(L"../../Assets/Models/torus.obj").c_str(),
 			device,
 			context),
 		mat5);
-	shapes[4]->GetTransform()->MoveAbsolute(10, 0, 0);
+	entities[4]->GetTransform()->MoveAbsolute(10, 0, 0);
 
-	shapes[5] = std::make_shared<GameEntity>(std::make_shared<Mesh>(
+	entities[5] = std::make_shared<GameEntity>(std::make_shared<Mesh>(
 		FixPath(L"../../Assets/Models/cube.obj").c_str(),
 		device,
 		context),
 		mat6);
-	shapes[5]->GetTransform()->Scale(15.0f, 1.0f, 10.0f);
-	shapes[5]->GetTransform()->MoveAbsolute(0, -2.5f, 0);
+	entities[5]->GetTransform()->Scale(15.0f, 1.0f, 10.0f);
+	entities[5]->GetTransform()->MoveAbsolute(0, -2.5f, 0);
 
 	skyMesh = std::make_shared<Mesh>(
 		FixPath(L"../../Assets/Models/cube.obj").c_str(),
 		device,
 		context);
+
+	// Shared by every stress test entity
+	cubeMesh = std::make_shared<Mesh>(
+		FixPath(L"../../Assets/Models/cube.obj").c_str(),
+		device,
+		context);
+}
+
+// --------------------------------------------------------
+// Replaces any previous stress test entities with a grid of
+// "count" identical cubes (same mesh, same material), for
+// comparing draw calls and CPU time with instancing on/off
+// --------------------------------------------------------
+void Game::SpawnStressTest(int count)
+{
+	entities.resize(sceneShapeCount);
+
+	int side = (int)ceil(sqrt((float)count));
+	for (int i = 0; i < count; i++)
+	{
+		std::shared_ptr<GameEntity> cube = std::make_shared<GameEntity>(cubeMesh, mat1);
+		cube->SetStatic(stressTestStatic);
+		cube->GetTransform()->SetScale(0.5f, 0.5f, 0.5f);
+		cube->GetTransform()->SetPosition(
+			(i % side - side / 2) * 1.5f,
+			-1.5f,
+			10.0f + (i / side) * 1.5f);
+		entities.push_back(cube);
+	}
+	staticSetDirty = true;
+}
+
+// --------------------------------------------------------
+// Replaces any previous stress test lights with a grid of
+// "count" small colored lights over the stress test cubes,
+// every third one a spot light pointing down
+// --------------------------------------------------------
+void Game::SpawnStressLights(int count)
+{
+	lightManager->Truncate(sceneLightCount);
+
+	const XMFLOAT3 colors[6] = {
+		XMFLOAT3(1.0f, 0.2f, 0.2f), XMFLOAT3(0.2f, 1.0f, 0.2f), XMFLOAT3(0.2f, 0.2f, 1.0f),
+		XMFLOAT3(1.0f, 1.0f, 0.2f), XMFLOAT3(1.0f, 0.2f, 1.0f), XMFLOAT3(0.2f, 1.0f, 1.0f) };
+
+	int side = (int)ceil(sqrt((float)count));
+	for (int i = 0; i < count; i++)
+	{
+		Light light = {};
+		light.type = (i % 3 == 2) ? LIGHT_TYPE_SPOT : LIGHT_TYPE_POINT;
+		light.direction = XMFLOAT3(0.0f, -1.0f, 0.0f);
+		light.position = XMFLOAT3(
+			(i % side - side / 2) * 3.0f,
+			0.0f,
+			10.0f + (i / side) * 3.0f);
+		light.color = colors[i % 6];
+		light.intensity = 1.0f;
+		light.range = 4.0f;
+		light.spotFallOff = 8.0f;
+		lightManager->Add(light);
+	}
+}
+
+// --------------------------------------------------------
+// Rebuilds the list of entities to draw after the set of
+// static entities has changed, merging the static ones
+// into chunks when static batching is on
+// --------------------------------------------------------
+void Game::UpdateDrawEntities()
+{
+	if (!staticSetDirty)
+		return;
+
+	drawEntities.clear();
+	if (useStaticBatching) {
+		staticBatcher->Rebuild(entities);
+		for (auto& e : entities) {
+			if (!e->IsStatic())
+				drawEntities.push_back(e);
+		}
+		staticBatcher->GetChunkEntities(drawEntities);
+	}
+	else {
+		drawEntities = entities;
+	}
+
+	// Only the probes near static entities that changed are
+	// baked again, with the lights as they are now - they show
+	// up a few frames later
+	SetProbeLighting();
+	lightProbes->Update(entities);
+
+	staticSetDirty = false;
+	gpuSceneDirty = true;
+	shadowCascades->InvalidateStaticCache();
+}
+
+// --------------------------------------------------------
+// Hands the light probes the lights and the sky as they are
+// now, for their next bake
+// --------------------------------------------------------
+void Game::SetProbeLighting()
+{
+	std::vector<Light> lights;
+	for (unsigned int i = 0; i < lightManager->GetCount(); i++)
+		lights.push_back(lightManager->Get(i));
+	lightProbes->SetLights(lights);
+	lightProbes->SetSky(skyLighting->GetRadiance());
 }
 
 
@@ -608,6 +1022,12 @@ void Game::OnResize()
 	}
 	// Handle base-level DX resize stuff
 	DXCore::OnResize();
+
+	// Screen sized targets have to match the new size
+	if (gBuffer) {
+		gBuffer->Resize(windowWidth, windowHeight);
+		PostProcessSetup();
+	}
 }
 
 // --------------------------------------------------------
@@ -615,6 +1035,17 @@ void Game::OnResize()
 // --------------------------------------------------------
 void Game::Update(float deltaTime, float totalTime)
 {
+	// Swap in shaders recompiled since the last frame - nothing
+	// is recording, so this is the one safe point to do it
+	if (hotReload->ApplyReloads() > 0) {
+		ResolveShaderParams();
+		for (auto& m : litMaterials)
+			m->ResolveBindings();
+	}
+
+	// Likewise the light probes of a bake that finished
+	lightProbes->ApplyBake();
+
 	{
 		// Feed fresh input data to ImGui
 		ImGuiIO& io = ImGui::GetIO();
@@ -638,22 +1069,22 @@ void Game::Update(float deltaTime, float totalTime)
 		ImGui::Begin("Window");
 		ImGui::Text("FPS: %f", io.Framerate);
 		ImGui::Text("Window dimensions: %i x %i", windowWidth, windowHeight);
-		for (int i = 0; i < 6; i++) {
+		for (int i = 0; i < sceneShapeCount; i++) {
 			ImGui::PushID(i);
 			if (ImGui::CollapsingHeader("Shape"))
 			{
 
 				if (ImGui::DragFloat3("Translation", translation[i])) {
-					shapes[i]->GetTransform()->SetPosition(XMFLOAT3(translation[i]));
+					entities[i]->GetTransform()->SetPosition(XMFLOAT3(translation[i]));
 				}
 				if (ImGui::DragFloat3("Rotation", rotation[i])) {
-					shapes[i]->GetTransform()->SetRotation(XMFLOAT3(rotation[i]));
+					entities[i]->GetTransform()->SetRotation(XMFLOAT3(rotation[i]));
 				}
 				if (ImGui::DragFloat3("Scale", scale[i])) {
-					shapes[i]->GetTransform()->SetScale(XMFLOAT3(scale[i]));
+					entities[i]->GetTransform()->SetScale(XMFLOAT3(scale[i]));
 				}
 				if (ImGui::ColorEdit3("Color", colorOffset[i])) {
-					shapes[i]->GetMesh()->SetTint(colorOffset[i][0], colorOffset[i][1], colorOffset[i][2], colorOffset[i][3]);
+					entities[i]->GetMesh()->SetTint(colorOffset[i][0], colorOffset[i][1], colorOffset[i][2], colorOffset[i][3]);
 				}
 			}
 			ImGui::PopID();
@@ -670,51 +1101,445 @@ void Game::Update(float deltaTime, float totalTime)
 			}
 		}
 		if (ImGui::CollapsingHeader("Light Settings")) {
-			ImGui::Text("Directional Light 1 x: %f y: %f z: %f",
-				directionalLight1.direction.x,
-				directionalLight1.direction.y,
-				directionalLight1.direction.z);
-			ImGui::PushID(6);
-			if (ImGui::ColorEdit3("Color", colorOffset[0])) {
-				directionalLight1.color = XMFLOAT3(colorOffset[0][0], colorOffset[0][1], colorOffset[0][2]);
+			const char* typeNames[3] = { "Directional", "Point", "Spot" };
+			ImGui::Text("%u lights (buffer holds %u)", lightManager->GetCount(), lightManager->GetCapacity());
+
+			// Only the scene's own lights are listed, not spawned ones
+			for (unsigned int i = 0; i < sceneLightCount; i++) {
+				Light light = lightManager->Get(i);
+				ImGui::PushID(6 + i);
+				if (ImGui::TreeNode("Light", "%s light %u%s", typeNames[light.type], i + 1, (int)i == shadowLightIndex ? " (casts shadows)" : "")) {
+					bool changed = ImGui::ColorEdit3("Color", &light.color.x);
+					changed |= ImGui::SliderFloat("Intensity", &light.intensity, 0.0f, 5.0f);
+					if (light.type != LIGHT_TYPE_POINT)
+						changed |= ImGui::DragFloat3("Direction", &light.direction.x, 0.01f);
+					if (light.type != LIGHT_TYPE_DIRECTIONAL) {
+						changed |= ImGui::DragFloat3("Position", &light.position.x, 0.05f);
+						changed |= ImGui::DragFloat("Range", &light.range, 0.1f, 0.0f, 1000.0f);
+					}
+					if (light.type == LIGHT_TYPE_SPOT)
+						changed |= ImGui::SliderFloat("Spot falloff", &light.spotFallOff, 1.0f, 128.0f);
+					if (changed) {
+						lightManager->Set(i, light);
+					}
+					ImGui::TreePop();
+				}
+				ImGui::PopID();
 			}
-			ImGui::PopID();
-			ImGui::Text("Directional Light 2 x: %f y: %f z: %f",
-				directionalLight2.direction.x,
-				directionalLight2.direction.y,
-				directionalLight2.direction.z);
-			ImGui::PushID(7);
-			if (ImGui::ColorEdit3("Color", colorOffset[1])) {
-				directionalLight2.color = XMFLOAT3(colorOffset[1][0], colorOffset[1][1], colorOffset[1][2]);
+
+			if (ImGui::Checkbox("Clustered lighting", &useClusteredLighting)) {
+				lightManager->SetClustering(useClusteredLighting);
 			}
-			ImGui::PopID();
-			ImGui::Text("Directional Light 3 x: %f y: %f z: %f",
-				directionalLight3.direction.x,
-				directionalLight3.direction.y,
-				directionalLight3.direction.z);
-			ImGui::PushID(8);
-			if (ImGui::ColorEdit3("Color", colorOffset[2])) {
-				directionalLight3.color = XMFLOAT3(colorOffset[2][0], colorOffset[2][1], colorOffset[2][2]);
+			LightBinner& binner = lightManager->GetBinner();
+			ImGui::Text("%ux%ux%u clusters, %u light references, at most %u in a cluster",
+				binner.GetTilesX(),
+				binner.GetTilesY(),
+				binner.GetSlices(),
+				(unsigned int)binner.GetLightIndices().size() - binner.GetGlobalLightCount(),
+				binner.GetMaxClusterLights());
+			const char* debugViewNames[3] = { "Off", "Lights per pixel", "Cluster slices" };
+			ImGui::Combo("Debug view", &lightDebugView, debugViewNames, 3);
+
+			ImGui::SliderInt("Stress test lights", &stressLightCount, 0, 2000);
+			if (ImGui::Button("Spawn stress test lights")) {
+				SpawnStressLights(stressLightCount);
 			}
-			ImGui::PopID();
-			ImGui::Text("Point Light 1 x: %f y: %f z: %f",
-				pointLight1.direction.x,
-				pointLight1.direction.y,
-				pointLight1.direction.z);
-			ImGui::PushID(9);
-			if (ImGui::ColorEdit3("Color", colorOffset[3])) {
-				pointLight1.color = XMFLOAT3(colorOffset[3][0], colorOffset[3][1], colorOffset[3][2]);
+		}
+		if (ImGui::CollapsingHeader("Shadows")) {
+			// Changing the count or resolution replaces the shadow map
+			int cascadeCount = (int)shadowCascades->GetCascadeCount();
+			if (ImGui::SliderInt("Cascades", &cascadeCount, 1, MAX_SHADOW_CASCADES)) {
+				shadowCascades->SetCascadeCount(cascadeCount);
+				SetMaterialShadowMaps();
 			}
-			ImGui::PopID();
-			ImGui::Text("Point Light 2 x: %f y: %f z: %f",
-				pointLight2.direction.x,
-				pointLight2.direction.y,
-				pointLight2.direction.z);
-			ImGui::PushID(10);
-			if (ImGui::ColorEdit3("Color", colorOffset[4])) {
-				pointLight2.color = XMFLOAT3(colorOffset[4][0], colorOffset[4][1], colorOffset[4][2]);
+			const char* resolutionNames[4] = { "512", "1024", "2048", "4096" };
+			int resolutionIndex = 0;
+			while (resolutionIndex < 3 && (512u << resolutionIndex) < shadowCascades->GetResolution())
+				resolutionIndex++;
+			if (ImGui::Combo("Resolution", &resolutionIndex, resolutionNames, 4)) {
+				shadowCascades->SetResolution(512u << resolutionIndex);
+				SetMaterialShadowMaps();
+			}
+
+			float splitLambda = shadowCascades->GetSplitLambda();
+			if (ImGui::SliderFloat("Split (even - logarithmic)", &splitLambda, 0.0f, 1.0f))
+				shadowCascades->SetSplitLambda(splitLambda);
+			float shadowDistance = shadowCascades->GetShadowDistance();
+			if (ImGui::SliderFloat("Shadow distance", &shadowDistance, 5.0f, 200.0f))
+				shadowCascades->SetShadowDistance(shadowDistance);
+			float blendFraction = shadowCascades->GetBlendFraction();
+			if (ImGui::SliderFloat("Cascade blend", &blendFraction, 0.0f, 0.5f))
+				shadowCascades->SetBlendFraction(blendFraction);
+			ImGui::Checkbox("Cache static casters", &cacheStaticShadows);
+			int updateInterval = (int)shadowCascades->GetUpdateInterval();
+			if (ImGui::SliderInt("Frames between far cascade updates", &updateInterval, 1, 8))
+				shadowCascades->SetUpdateInterval(updateInterval);
+
+			// Only the CPU culled paths count casters
+			if (!useGpuDriven) {
+				ImGui::Text("Directional light: %u of %u casters rendered",
+					renderStats.shadowCastersDrawn,
+					renderStats.shadowCastersDrawn + renderStats.shadowCastersCulled);
+			}
+			for (unsigned int c = 0; c < shadowCascades->GetCascadeCount(); c++) {
+				const char* state =
+					!shadowCascades->IsDrawn(c) ? "kept" :
+					shadowCascades->IsStaticDrawn(c) ? "static redrawn" :
+					shadowCascades->GetStaticCaching() ? "static cached" : "drawn";
+				ImGui::Text("Cascade %u: to %.1f units, %s, %u casters, %.3f + %.3f ms GPU (static + dynamic)",
+					c + 1,
+					shadowCascades->GetSplitDepth(c),
+					state,
+					renderStats.shadowCasters[c],
+					gpuTimer->GetTime(GPU_TIME_STATIC_SHADOW + c),
+					gpuTimer->GetTime(GPU_TIME_SHADOW + c));
+			}
+
+			// Point and spot lights, packed into the atlas every frame
+			ImGui::Separator();
+			ImGui::SliderInt("Shadowed point/spot lights", &maxLocalShadows, 0, 32);
+			const char* atlasNames[4] = { "1024", "2048", "4096", "8192" };
+			int atlasIndex = 0;
+			while (atlasIndex < 3 && (1024u << atlasIndex) < shadowAtlas->GetResolution())
+				atlasIndex++;
+			if (ImGui::Combo("Atlas resolution", &atlasIndex, atlasNames, 4))
+				shadowAtlas->SetResolution(1024u << atlasIndex);
+			unsigned int atlasResolution = shadowAtlas->GetResolution();
+			ImGui::Text("Atlas: %u views, %.1f%% used, %.1f MB, %.3f ms GPU%s",
+				shadowAtlas->GetViewCount(),
+				100.0f * shadowAtlas->GetUsedTexels() / (atlasResolution * atlasResolution),
+				atlasResolution * atlasResolution * 4 / (1024.0f * 1024.0f),
+				gpuTimer->GetTime(GPU_TIME_ATLAS_SHADOW),
+				useGpuDriven ? " (not with GPU driven drawing)" : "");
+
+			// Each light's tiles in its own color, over the whole atlas
+			const float mapSize = 256.0f;
+			float mapScale = mapSize / atlasResolution;
+			ImVec2 origin = ImGui::GetCursorScreenPos();
+			ImDrawList* drawList = ImGui::GetWindowDrawList();
+			drawList->AddRectFilled(origin, ImVec2(origin.x + mapSize, origin.y + mapSize), IM_COL32(32, 32, 32, 255));
+			for (size_t s = 0; s < localShadows.size(); s++) {
+				ImU32 color = ImColor::HSV(s * 0.13f, 0.6f, 0.9f);
+				for (unsigned int v = 0; v < localShadows[s].viewCount; v++) {
+					const ShadowAtlas::Tile& tile = shadowAtlas->GetTile(localShadows[s].firstView + v);
+					ImVec2 min(origin.x + tile.x * mapScale, origin.y + tile.y * mapScale);
+					ImVec2 max(min.x + tile.size * mapScale, min.y + tile.size * mapScale);
+					drawList->AddRectFilled(min, max, color);
+					drawList->AddRect(min, max, IM_COL32(0, 0, 0, 255));
+				}
+			}
+			ImGui::Dummy(ImVec2(mapSize, mapSize));
+
+			for (size_t s = 0; s < localShadows.size(); s++) {
+				const LocalShadow& shadow = localShadows[s];
+				ImGui::TextColored(ImColor::HSV(s * 0.13f, 0.6f, 0.9f), "%s light %u: %u x %ux%u, %u of %u casters rendered",
+					lightManager->Get(shadow.lightIndex).type == LIGHT_TYPE_POINT ? "Point" : "Spot",
+					shadow.lightIndex + 1,
+					shadow.viewCount,
+					shadow.size,
+					shadow.size,
+					shadow.casters,
+					(unsigned int)drawEntities.size());
+			}
+
+			// Filtering, of both the cascades and the atlas
+			ImGui::Separator();
+			const char* filterNames[SHADOW_FILTER_COUNT];
+			for (unsigned int m = 0; m < SHADOW_FILTER_COUNT; m++)
+				filterNames[m] = ShadowFilter::GetModeName(m);
+			int filterMode = (int)shadowFilter->GetMode();
+			if (ImGui::Combo("Filtering", &filterMode, filterNames, SHADOW_FILTER_COUNT))
+				shadowFilter->SetMode(filterMode);
+			if (filterMode == SHADOW_FILTER_GRID) {
+				int gridSize = (int)shadowFilter->GetGridSize();
+				if (ImGui::SliderInt("Taps per side", &gridSize, 1, SHADOW_FILTER_MAX_GRID))
+					shadowFilter->SetGridSize(gridSize);
+			}
+			else if (filterMode == SHADOW_FILTER_POISSON || filterMode == SHADOW_FILTER_PCSS) {
+				int taps = (int)shadowFilter->GetTaps();
+				if (ImGui::SliderInt("Taps", &taps, 1, SHADOW_FILTER_MAX_TAPS))
+					shadowFilter->SetTaps(taps);
+			}
+			if (filterMode != SHADOW_FILTER_HARDWARE) {
+				// EVSM still uses it for the atlas, which has no moments
+				float filterRadius = shadowFilter->GetRadius();
+				if (ImGui::SliderFloat(filterMode == SHADOW_FILTER_PCSS ? "Widest radius (texels)" : "Radius (texels)", &filterRadius, 0.5f, 16.0f))
+					shadowFilter->SetRadius(filterRadius);
+			}
+			if (filterMode == SHADOW_FILTER_PCSS) {
+				float sunSize = shadowFilter->GetSunSize();
+				if (ImGui::SliderFloat("Sun size (degrees)", &sunSize, 0.1f, 10.0f))
+					shadowFilter->SetSunSize(sunSize);
+				float lightSize = shadowFilter->GetLightSize();
+				if (ImGui::SliderFloat("Point/spot light radius", &lightSize, 0.01f, 1.0f))
+					shadowFilter->SetLightSize(lightSize);
+			}
+			if (filterMode == SHADOW_FILTER_EVSM) {
+				int blurRadius = (int)shadowFilter->GetBlurRadius();
+				if (ImGui::SliderInt("Blur radius (texels)", &blurRadius, 0, SHADOW_BLUR_MAX_RADIUS))
+					shadowFilter->SetBlurRadius(blurRadius);
+				XMFLOAT2 exponents = shadowFilter->GetExponents();
+				if (ImGui::SliderFloat2("Exponents (+, -)", &exponents.x, 1.0f, 42.0f))
+					shadowFilter->SetExponents(exponents.x, exponents.y);
+				float bleedReduction = shadowFilter->GetBleedReduction();
+				if (ImGui::SliderFloat("Light bleeding reduction", &bleedReduction, 0.0f, 0.9f))
+					shadowFilter->SetBleedReduction(bleedReduction);
+				ImGui::Text("Moments: %.1f MB, %u cascade(s) filtered this frame",
+					shadowFilter->GetMomentsBytes() / (1024.0f * 1024.0f),
+					shadowFilter->GetFilteredCount());
+			}
+
+			// Filtering costs twice: making EVSM's moments, and every
+			// tap the opaque pass (or deferred lighting) takes
+			ImGui::Text("GPU: %.3f ms prefiltering, %.3f ms %s",
+				gpuTimer->GetTime(GPU_TIME_SHADOW_FILTER),
+				gpuTimer->GetTime(useDeferred ? GPU_TIME_LIGHTING : GPU_TIME_OPAQUE),
+				useDeferred ? "deferred lighting" : "opaque pass");
+			if (filterBenchmarkMode >= 0) {
+				ImGui::Text("Measuring %s...", ShadowFilter::GetModeName(filterBenchmarkMode));
+			}
+			else if (ImGui::Button("Measure every filtering mode")) {
+				filterBenchmarkRestore = shadowFilter->GetMode();
+				filterBenchmarkMode = 0;
+				filterBenchmarkFrame = 0;
+				filterBenchmarkTotal = 0.0f;
+				for (unsigned int m = 0; m < SHADOW_FILTER_COUNT; m++)
+					filterBenchmarkResults[m] = 0.0f;
+				shadowFilter->SetMode(0);
+			}
+			for (unsigned int m = 0; m < SHADOW_FILTER_COUNT; m++) {
+				if (filterBenchmarkResults[m] > 0.0f)
+					ImGui::Text("  %s: %.3f ms", ShadowFilter::GetModeName(m), filterBenchmarkResults[m]);
+			}
+		}
+		if (ImGui::CollapsingHeader("Sky Lighting")) {
+			ImGui::SliderFloat("Diffuse ambient", &ambientDiffuse, 0.0f, 4.0f);
+			ImGui::SliderFloat("Specular ambient", &ambientSpecular, 0.0f, 4.0f);
+
+			// Either change builds everything again (unless cached)
+			const char* sizeNames[4] = { "32", "64", "128", "256" };
+			int sizeIndex = 0;
+			while (sizeIndex < 3 && (32u << sizeIndex) < skyLighting->GetSize())
+				sizeIndex++;
+			if (ImGui::Combo("Specular map size", &sizeIndex, sizeNames, 4))
+				skyLighting->SetSize(32u << sizeIndex);
+			const char* sampleNames[5] = { "32", "64", "128", "256", "512" };
+			int sampleIndex = 0;
+			while (sampleIndex < 4 && (32u << sampleIndex) < skyLighting->GetSampleCount())
+				sampleIndex++;
+			if (ImGui::Combo("Prefilter samples", &sampleIndex, sampleNames, 5))
+				skyLighting->SetSampleCount(32u << sampleIndex);
+			if (ImGui::Button("Rebuild, ignoring the cache"))
+				skyLighting->Rebuild();
+
+			if (skyLighting->WasLoadedFromCache()) {
+				ImGui::Text("Loaded from the cache in %.2f ms (%.1f KB)",
+					skyLighting->GetBuildTime(), skyLighting->GetCacheBytes() / 1024.0f);
+			}
+			else {
+				ImGui::Text("Built in %.2f ms, %.3f ms of it projecting into SH",
+					skyLighting->GetBuildTime(), skyLighting->GetProjectionTime());
+			}
+			ImGui::Text("%u specular mips, %ux%u BRDF LUT",
+				skyLighting->GetSpecularMipCount(), SKY_LIGHTING_LUT_SIZE, SKY_LIGHTING_LUT_SIZE);
+
+			// The irradiance facing along each axis, gamma encoded
+			// as the scene's colors are
+			const char* axisNames[6] = { "+X", "-X", "+Y", "-Y", "+Z", "-Z" };
+			for (unsigned int face = 0; face < 6; face++) {
+				XMFLOAT4 color;
+				XMVECTOR irradiance = SphericalHarmonics::Evaluate(skyLighting->GetIrradiance(),
+					SphericalHarmonics::CubeDirection(face, 0.0f, 0.0f));
+				XMStoreFloat4(&color, XMVectorPow(XMVectorSaturate(irradiance), XMVectorReplicate(1.0f / 2.2f)));
+				if (face > 0)
+					ImGui::SameLine();
+				ImGui::ColorButton(axisNames[face], ImVec4(color.x, color.y, color.z, 1.0f));
+			}
+			ImGui::SameLine();
+			ImGui::Text("Irradiance");
+			ImGui::Image(skyLighting->GetBrdfLutSRV().Get(), ImVec2(128, 128));
+		}
+		if (ImGui::CollapsingHeader("Light Probes")) {
+			ImGui::Checkbox("Use light probes", &useLightProbes);
+			ImGui::SliderFloat("Normal bias", &probeNormalBias, 0.0f, 1.0f);
+
+			// Ray settings, the lights and the sky only change the
+			// probes when they're baked again
+			const char* rayNames[4] = { "64", "128", "256", "512" };
+			int rayIndex = 0;
+			while (rayIndex < 3 && (64u << rayIndex) < lightProbes->GetRayCount())
+				rayIndex++;
+			if (ImGui::Combo("Rays per probe", &rayIndex, rayNames, 4))
+				lightProbes->SetRayCount(64u << rayIndex);
+			float maxDistance = lightProbes->GetMaxDistance();
+			if (ImGui::SliderFloat("Ray distance", &maxDistance, 4.0f, 64.0f))
+				lightProbes->SetMaxDistance(maxDistance);
+			if (ImGui::Button("Bake all")) {
+				SetProbeLighting();
+				lightProbes->BakeAll();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("Measure bake scaling")) {
+				SetProbeLighting();
+				lightProbes->MeasureScaling();
+			}
+
+			XMUINT3 counts = lightProbes->GetCounts();
+			ImGui::Text("%u probes (%ux%ux%u), %.1f units apart, %u inside geometry",
+				lightProbes->GetProbeCount(), counts.x, counts.y, counts.z,
+				lightProbes->GetSpacing(), lightProbes->GetInvalidCount());
+			ImGui::Text("Scene: %u triangles, %s in %.1f ms",
+				lightProbes->GetTriangleCount(),
+				lightProbes->WasSceneRefitted() ? "refitted" : "gathered and built",
+				lightProbes->GetSceneTime());
+			ImGui::Text("Last bake: %u probes in %.1f ms%s",
+				lightProbes->GetBakedCount(), lightProbes->GetBakeTime(),
+				lightProbes->IsBaking() ? " (baking...)" : "");
+			const std::vector<float>& scalingTimes = lightProbes->GetScalingTimes();
+			for (unsigned int t = 0; t < scalingTimes.size(); t++) {
+				ImGui::Text("  %u threads: %.1f ms (%.2fx)", t + 1, scalingTimes[t],
+					scalingTimes[0] / scalingTimes[t]);
+			}
+		}
+		if (ImGui::CollapsingHeader("Render Stats")) {
+			ImGui::Checkbox("Instancing", &useInstancing);
+			ImGui::Checkbox("GPU driven (compute culling + indirect draws)", &useGpuDriven);
+			if (ImGui::Checkbox("Static batching", &useStaticBatching)) {
+				staticSetDirty = true;
+			}
+			if (useStaticBatching) {
+				unsigned int merged = staticBatcher->GetStaticEntityCount();
+				unsigned int chunks = staticBatcher->GetChunkCount();
+				ImGui::Text("Static: %u entities in %u chunks (%i fewer draws)",
+					merged,
+					chunks,
+					(int)merged - (int)chunks);
+				ImGui::Text("Static memory: %.1f KB merged vs %.1f KB shared meshes",
+					staticBatcher->GetMergedBytes() / 1024.0f,
+					staticBatcher->GetSourceBytes() / 1024.0f);
+				ImGui::Text("Chunks rebuilt last change: %u", staticBatcher->GetLastRebuildCount());
+			}
+			ImGui::Text("Entities: %i (%u visible, %u culled)",
+				(int)entities.size(),
+				renderStats.entitiesVisible,
+				renderStats.entitiesCulled);
+			ImGui::Text("Draw calls: %u (%u instanced, %u instances)",
+				renderStats.drawCalls,
+				renderStats.instancedDrawCalls,
+				renderStats.instancesDrawn);
+			ImGui::Text("Sorted draws: %u, material changes: %u",
+				renderStats.queuedDraws,
+				renderStats.materialChanges);
+			ImGui::Text("Skipped: %u shader, %u material, %u mesh, %u cbuffer",
+				renderStats.shaderChangesSkipped,
+				renderStats.materialChangesSkipped,
+				renderStats.meshChangesSkipped,
+				renderStats.constantUploadsSkipped);
+			ImGui::Text("State calls: %u issued, %u redundant dropped",
+				renderStats.stateCallsIssued,
+				renderStats.stateCallsFiltered);
+			ImGui::Text("State objects: %u (%u created after loading)",
+				stateObjects->GetStateCount(),
+				stateObjects->GetLateCreationCount());
+			ImGui::Text("Constants: %.1f KB in %u uploads (%u unchanged skipped)",
+				renderStats.constantBytesUploaded / 1024.0f,
+				renderStats.constantBuffersUploaded,
+				renderStats.constantBuffersSkipped);
+			ImGui::Checkbox("Upload unchanged constants", &ISimpleShader::UploadUnchanged);
+			if (constantRing->IsSupported()) {
+				ImGui::Checkbox("Constant ring (offset binding)", &useConstantRing);
+				ImGui::Text("Ring: %u of %u uploads, %.1f of %.1f KB used",
+					renderStats.constantRingUploads,
+					renderStats.constantBuffersUploaded,
+					constantRing->GetUsedBytes() / 1024.0f,
+					constantRing->GetCapacity() / 1024.0f);
+			}
+			else {
+				ImGui::Text("Constant ring: needs Direct3D 11.1 constant buffer offsetting");
+			}
+			ImGui::Text("CPU draw time: %.3f ms", cpuDrawTime);
+
+			// D3D11 has no memory traffic counters, so the G-buffer's
+			// is estimated from its size: each byte is written by the
+			// opaque pass (more with overdraw) and read once by lighting
+			ImGui::Checkbox("Deferred shading", &useDeferred);
+			float shadowTime = 0.0f;
+			for (unsigned int section = GPU_TIME_STATIC_SHADOW; section < GPU_TIME_OPAQUE; section++)
+				shadowTime += gpuTimer->GetTime(section);
+			ImGui::Text("GPU: %.3f ms shadows, %.3f ms opaque, %.3f ms lighting, %.3f ms sky + post",
+				shadowTime,
+				gpuTimer->GetTime(GPU_TIME_OPAQUE),
+				gpuTimer->GetTime(GPU_TIME_LIGHTING),
+				gpuTimer->GetTime(GPU_TIME_SKY_AND_POST));
+			unsigned long long opaquePixels = gpuTimer->GetPixelShaderInvocations(GPU_TIME_OPAQUE);
+			ImGui::Text("Opaque pixels shaded: %llu (%.2fx overdraw), lighting threads: %llu",
+				opaquePixels,
+				(float)opaquePixels / (windowWidth * windowHeight),
+				gpuTimer->GetComputeShaderInvocations(GPU_TIME_LIGHTING));
+			float gBufferMB = gBuffer->GetTotalBytes() / (1024.0f * 1024.0f);
+			if (useDeferred) {
+				ImGui::Text("G-buffer: %.1f MB (%u bytes/pixel), ~%.1f MB written + %.1f MB read a frame",
+					gBufferMB,
+					gBuffer->GetBytesPerPixel(),
+					opaquePixels * gBuffer->GetBytesPerPixel() / (1024.0f * 1024.0f),
+					gBufferMB);
+			}
+			else {
+				ImGui::Text("G-buffer: %.1f MB, unused by forward shading", gBufferMB);
+			}
+			ImGui::Text("Shader load: %.2f ms (%u of %u reflections cached)",
+				shaderLoadTime,
+				ShaderCache::GetHitCount(),
+				ShaderCache::GetHitCount() + ShaderCache::GetMissCount());
+			ImGui::Text("Pixel shader variants: %u loaded (%.1f KB), %u not compiled",
+				pixelVariants->GetLoadedCount(),
+				pixelVariants->GetLoadedBytes() / 1024.0f,
+				pixelVariants->GetMissingCount());
+			if (ImGui::TreeNode("Shader hot reload")) {
+				for (const ShaderHotReload::Status& status : hotReload->GetStatus()) {
+					if (!status.Errors.empty()) {
+						ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s: failed (%.1f ms)", status.Name.c_str(), status.CompileTime);
+						ImGui::TextWrapped("%s", status.Errors.c_str());
+					}
+					else if (status.ReloadCount > 0) {
+						ImGui::Text("%s: reloaded %u time(s), last compile %.1f ms", status.Name.c_str(), status.ReloadCount, status.CompileTime);
+					}
+					else {
+						ImGui::Text("%s: watching", status.Name.c_str());
+					}
+				}
+				ImGui::TreePop();
+			}
+			ImGui::SliderInt("Render threads", &renderThreads, 1, maxRenderThreads);
+			ImGui::Text("Submit time: %.3f ms (driver command lists: %s)",
+				submitTime,
+				driverCommandLists ? "yes" : "no");
+			if (benchmarkThreads > 0) {
+				ImGui::Text("Benchmarking %i thread(s)...", benchmarkThreads);
+			}
+			else if (ImGui::Button("Benchmark render threads")) {
+				benchmarkResults.clear();
+				benchmarkThreads = 1;
+				benchmarkFrame = 0;
+				benchmarkTotal = 0.0f;
+				renderThreads = 1;
+			}
+			for (size_t i = 0; i < benchmarkResults.size(); i++) {
+				ImGui::Text("  %i thread(s): %.3f ms", (int)i + 1, benchmarkResults[i]);
+			}
+			if (ImGui::Button("Benchmark shader params")) {
+				RunParamBenchmark();
+			}
+			if (paramBenchmarkHandle > 0.0f) {
+				ImGui::Text("  By name: %.1f ns, by handle: %.1f ns per set",
+					paramBenchmarkString,
+					paramBenchmarkHandle);
+			}
+			ImGui::SliderInt("Stress test cubes", &stressTestCount, 0, 10000);
+			ImGui::Checkbox("Stress test cubes are static", &stressTestStatic);
+			if (ImGui::Button("Spawn stress test")) {
+				SpawnStressTest(stressTestCount);
 			}
-			ImGui::PopID();
 		}
 		ImGui::SliderInt("Blur Amount", &blurAmount, 0.0f, 5.0f);
 		//ImGui::Image(shadowSRV.Get(), ImVec2(1024, 1024));
@@ -725,13 +1550,16 @@ void Game::Update(float deltaTime, float totalTime)
 		}
 	}
 
+	// The shadow casting light may have been turned on or off above
+	SelectShaderVariants();
+
 	//Shape movement
 	if (counter < 200 && going) {
-		shapes[0]->GetTransform()->MoveAbsolute(0.02f, 0, 0);
-		shapes[1]->GetTransform()->Scale(0.999f, 0.999f, 0.999f);
-		shapes[2]->GetTransform()->MoveAbsolute(0, 0.02f, 0);
-		shapes[3]->GetTransform()->Scale(1.001f, 1.001f, 1.001f);
-		shapes[4]->GetTransform()->MoveAbsolute(0, 0, 0.02f);
+		entities[0]->GetTransform()->MoveAbsolute(0.02f, 0, 0);
+		entities[1]->GetTransform()->Scale(0.999f, 0.999f, 0.999f);
+		entities[2]->GetTransform()->MoveAbsolute(0, 0.02f, 0);
+		entities[3]->GetTransform()->Scale(1.001f, 1.001f, 1.001f);
+		entities[4]->GetTransform()->MoveAbsolute(0, 0, 0.02f);
 		counter++;
 	}
 	else {
@@ -741,11 +1569,11 @@ void Game::Update(float deltaTime, float totalTime)
 		else {
 			going = false;
 		}
-		shapes[0]->GetTransform()->MoveAbsolute(-0.02f, 0, 0);
-		shapes[1]->GetTransform()->Scale(1.001f, 1.001f, 1.001f);
-		shapes[2]->GetTransform()->MoveAbsolute(0, -0.02f, 0);
-		shapes[3]->GetTransform()->Scale(0.999f, 0.999f, 0.999f);
-		shapes[4]->GetTransform()->MoveAbsolute(0, 0, -0.02f);
+		entities[0]->GetTransform()->MoveAbsolute(-0.02f, 0, 0);
+		entities[1]->GetTransform()->Scale(1.001f, 1.001f, 1.001f);
+		entities[2]->GetTransform()->MoveAbsolute(0, -0.02f, 0);
+		entities[3]->GetTransform()->Scale(0.999f, 0.999f, 0.999f);
+		entities[4]->GetTransform()->MoveAbsolute(0, 0, -0.02f);
 		counter--;
 	}
 
@@ -758,59 +1586,1155 @@ void Game::Update(float deltaTime, float totalTime)
 }
 
 // --------------------------------------------------------
-// Clear the screen, redraw everything, present to the user
+// Fills the render queue with every draw needed this frame
+// - Only entities inside the camera's frustum go in the
+//   opaque pass, keyed by shaders, material, mesh and depth
+// - Each cascade only gets the entities that can shadow
+//   something visible in its slice of the view (see
+//   below), keyed by mesh and then depth towards the light
+// - With the static shadow cache on, static entities only
+//   go in a cascade's static pass, when its cache is redrawn
 // --------------------------------------------------------
-void Game::Draw(float deltaTime, float totalTime)
+void Game::BuildRenderQueue()
 {
-	{
-		Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
-		D3D11_RASTERIZER_DESC shadowRastDesc = {};
-		shadowRastDesc.FillMode = D3D11_FILL_SOLID;
-		shadowRastDesc.CullMode = D3D11_CULL_BACK;
-		shadowRastDesc.DepthClipEnable = true;
-		shadowRastDesc.DepthBias = 1000; // Min. precision units, not world units!
-		shadowRastDesc.SlopeScaledDepthBias = 1.0f; // Bias more based on slope
-		device->CreateRasterizerState(&shadowRastDesc, &shadowRasterizer);
-		context->RSSetState(shadowRasterizer.Get());
-
-		//Shadow map render
-		context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-		ID3D11RenderTargetView* nullRTV{};
-		context->OMSetRenderTargets(1, &nullRTV, shadowDSV.Get());
-		context->PSSetShader(0, 0, 0);
-		D3D11_VIEWPORT viewport = {};
-		viewport.Width = (float)shadowMapResolution;
-		viewport.Height = (float)shadowMapResolution;
-		viewport.MaxDepth = 1.0f;
-		context->RSSetViewports(1, &viewport);
-		shadowVS->SetShader();
-		shadowVS->SetMatrix4x4("view", lightViewMatrix);
-		shadowVS->SetMatrix4x4("projection", lightProjectionMatrix);
-
-		// Loop and draw all entities
-		for (int i = 0; i < 6; i++) {
-			shadowVS->SetMatrix4x4("world", shapes[i]->GetTransform()->GetWorldMatrix());
-			shadowVS->CopyAllBufferData();
-
-			// Draw the mesh directly to avoid the entity's material
-			// Note: Your code may differ significantly here!
-			shapes[i]->GetMesh()->Draw();
+	renderQueue.Clear();
+
+	std::shared_ptr<Camera> cam = camera[activeCamera];
+	BoundingFrustum frustum = cam->GetFrustum();
+	XMFLOAT4X4 viewMatrix = cam->GetView();
+	XMMATRIX view = XMLoadFloat4x4(&viewMatrix);
+	float farClip = cam->GetFarClip();
+
+	XMFLOAT4X4 lightViewMatrix = shadowCascades->GetView();
+	XMMATRIX lightView = XMLoadFloat4x4(&lightViewMatrix);
+	unsigned int cascadeCount = shadowCascades->GetCascadeCount();
+
+	// Everything visible in each cascade's slice, in light space
+	BoundingBox receivers[MAX_SHADOW_CASCADES];
+	bool hasReceivers[MAX_SHADOW_CASCADES] = {};
+
+	worldBounds.resize(drawEntities.size());
+	lightSpaceBounds.resize(drawEntities.size());
+	for (size_t i = 0; i < drawEntities.size(); i++) {
+		GameEntity* e = drawEntities[i].get();
+		Mesh* mesh = e->GetMesh().get();
+		Material* material = e->GetMaterial().get();
+		BoundingBox bounds = e->GetWorldBounds();
+		worldBounds[i] = bounds;
+		bounds.Transform(lightSpaceBounds[i], lightView);
+
+		if (!frustum.Intersects(bounds)) {
+			renderStats.entitiesCulled++;
+			continue;
+		}
+		renderStats.entitiesVisible++;
+
+		// Shader ID is the vertex and pixel shader IDs side by side
+		std::shared_ptr<SimpleVertexShader> vs = useInstancing && material->GetInstancedVertexShader() ?
+			material->GetInstancedVertexShader() :
+			material->GetVertexShader();
+		unsigned int shaderId = ((vs->GetId() & 0x3F) << 6) | (material->GetPixelShader()->GetId() & 0x3F);
+
+		float viewDepth = XMVectorGetZ(XMVector3TransformCoord(XMLoadFloat3(&bounds.Center), view));
+		renderQueue.Add(
+			RenderQueue::MakeKey(RENDER_PASS_OPAQUE, shaderId, material->GetId(), mesh->GetId(), viewDepth / farClip),
+			e);
+
+		for (unsigned int c = 0; c < cascadeCount; c++) {
+			if (!shadowCascades->GetReceiverVolume(c).Intersects(bounds))
+				continue;
+			if (hasReceivers[c])
+				BoundingBox::CreateMerged(receivers[c], receivers[c], lightSpaceBounds[i]);
+			else
+				receivers[c] = lightSpaceBounds[i];
+			hasReceivers[c] = true;
+		}
+	}
+
+	// A caster can only shadow a receiver it's in front of (along
+	// the light) and overlaps side to side, so each cascade casts
+	// from the part of its box across from the receivers and no
+	// further away than the furthest of them.  Cascades with
+	// nothing visible in them draw nothing.
+	BoundingBox castFrom[MAX_SHADOW_CASCADES];
+	for (unsigned int c = 0; c < cascadeCount; c++) {
+		if (!hasReceivers[c] || !shadowCascades->IsDrawn(c))
+			continue;
+		const BoundingBox& box = shadowCascades->GetCasterBox(c);
+		XMVECTOR boxMin = XMLoadFloat3(&box.Center) - XMLoadFloat3(&box.Extents);
+		XMVECTOR boxMax = XMLoadFloat3(&box.Center) + XMLoadFloat3(&box.Extents);
+		XMVECTOR receiverMin = XMLoadFloat3(&receivers[c].Center) - XMLoadFloat3(&receivers[c].Extents);
+		XMVECTOR receiverMax = XMLoadFloat3(&receivers[c].Center) + XMLoadFloat3(&receivers[c].Extents);
+		XMVECTOR castMin = XMVectorSelect(XMVectorMax(boxMin, receiverMin), boxMin, g_XMSelect0010);
+		XMVECTOR castMax = XMVectorMin(boxMax, receiverMax);
+		if (!XMVector3LessOrEqual(castMin, castMax)) {
+			hasReceivers[c] = false;
+			continue;
 		}
+		BoundingBox::CreateFromPoints(castFrom[c], castMin, castMax);
+	}
+
+	// Shadow draws share a shader and a material, so they sort by
+	// mesh (for instancing), then front to back along the light
+	// - The static cache outlives the frame's view, so it takes
+	//   every static caster in the cascade's box
+	std::shared_ptr<SimpleVertexShader> shadowShader = useInstancing ? instancedShadowVS : shadowVS;
+	unsigned int shadowShaderId = (shadowShader->GetId() & 0x3F) << 6;
+	bool cacheStatic = shadowCascades->GetStaticCaching();
+	for (size_t i = 0; i < drawEntities.size(); i++) {
+		bool isStatic = cacheStatic && drawEntities[i]->IsStatic();
+		bool drawn = false;
+		for (unsigned int c = 0; c < cascadeCount; c++) {
+			const BoundingBox& box = shadowCascades->GetCasterBox(c);
+			unsigned int pass;
+			if (isStatic) {
+				if (!shadowCascades->IsStaticDrawn(c) || !box.Intersects(lightSpaceBounds[i]))
+					continue;
+				pass = RENDER_PASS_STATIC_SHADOW + c;
+			}
+			else {
+				if (!hasReceivers[c] || !castFrom[c].Intersects(lightSpaceBounds[i]))
+					continue;
+				pass = RENDER_PASS_SHADOW + c;
+			}
+			float lightDepth = (lightSpaceBounds[i].Center.z - (box.Center.z - box.Extents.z)) / (box.Extents.z * 2.0f);
+			renderQueue.Add(
+				RenderQueue::MakeKey(pass, shadowShaderId, 0, drawEntities[i]->GetMesh()->GetId(), lightDepth),
+				drawEntities[i].get());
+			renderStats.shadowCasters[c]++;
+			drawn = true;
+		}
+		if (drawn)
+			renderStats.shadowCastersDrawn++;
+		else
+			renderStats.shadowCastersCulled++;
+	}
+
+	// Point and spot lights only draw what's in their range, into
+	// each atlas view it's in - the view goes in the key's
+	// material, so each view's draws end up together
+	for (LocalShadow& shadow : localShadows) {
+		const Light& light = lightManager->Get(shadow.lightIndex);
+		BoundingSphere reach(light.position, light.range);
+		for (size_t i = 0; i < drawEntities.size(); i++) {
+			if (!reach.Intersects(worldBounds[i]))
+				continue;
+			XMVECTOR offset = XMLoadFloat3(&worldBounds[i].Center) - XMLoadFloat3(&light.position);
+			float lightDepth = XMVectorGetX(XMVector3Length(offset)) / light.range;
+			for (unsigned int v = 0; v < shadow.viewCount; v++) {
+				unsigned int view = shadow.firstView + v;
+				if (!atlasFrustums[view].Intersects(worldBounds[i]))
+					continue;
+				renderQueue.Add(
+					RenderQueue::MakeKey(RENDER_PASS_ATLAS_SHADOW, shadowShaderId, view, drawEntities[i]->GetMesh()->GetId(), lightDepth),
+					drawEntities[i].get());
+				shadow.casters++;
+			}
+		}
+	}
+
+	renderQueue.Sort();
+	renderStats.queuedDraws = renderQueue.GetCount();
+}
+
+// --------------------------------------------------------
+// Walks the sorted queue and turns each run of items with
+// identical state into draw packets, gathering the matrices
+// of instanced runs into the instance buffer as it goes
+// --------------------------------------------------------
+void Game::BuildDrawPackets()
+{
+	drawPackets.clear();
+	instanceBuffer->Clear();
+	for (unsigned int p = 0; p <= RENDER_PASS_COUNT; p++)
+		passStart[p] = 0;
+
+	unsigned int count = renderQueue.GetCount();
+	unsigned int i = 0;
+	while (i < count) {
+		uint64_t key = renderQueue.GetKey(i);
+		unsigned int pass = RenderQueue::GetPass(key);
+		GameEntity* first = renderQueue.GetEntity(i);
+		Mesh* mesh = first->GetMesh().get();
+		Material* material = first->GetMaterial().get();
+		bool shadow = IsShadowPass(pass);
+
+		// IDs are truncated in the key, so also check the
+		// actual pointers before putting draws in one run
+		unsigned int end = i + 1;
+		while (end < count && RenderQueue::SameState(key, renderQueue.GetKey(end))) {
+			GameEntity* next = renderQueue.GetEntity(end);
+			if (next->GetMesh().get() != mesh) break;
+			if (!shadow && next->GetMaterial().get() != material) break;
+			end++;
+		}
+
+		if (useInstancing && (shadow || material->GetInstancedVertexShader())) {
+			DrawPacket packet = {};
+			packet.entity = first;
+			packet.instanced = true;
+			packet.firstInstance = instanceBuffer->GetCount();
+			packet.instanceCount = end - i;
+			packet.shadowView = RenderQueue::GetMaterial(key);
+			for (unsigned int j = i; j < end; j++) {
+				std::shared_ptr<Transform> transform = renderQueue.GetEntity(j)->GetTransform();
+				instanceBuffer->Add(transform->GetWorldMatrix(), transform->GetWorldInverseTransposeMatrix());
+			}
+			drawPackets.push_back(packet);
+		}
+		else {
+			for (unsigned int j = i; j < end; j++) {
+				DrawPacket packet = {};
+				packet.entity = renderQueue.GetEntity(j);
+				packet.shadowView = RenderQueue::GetMaterial(key);
+				drawPackets.push_back(packet);
+			}
+		}
+
+		// Packets come out in pass order, so any later pass
+		// can't start before the packets added so far
+		for (unsigned int p = pass + 1; p <= RENDER_PASS_COUNT; p++)
+			passStart[p] = (unsigned int)drawPackets.size();
+
+		i = end;
+	}
+
+	instanceBuffer->Upload();
+}
+
+// --------------------------------------------------------
+// Sets the render targets and fixed function state a pass
+// draws with, on either the immediate or a deferred context
+// (through that context's state cache)
+// --------------------------------------------------------
+void Game::BeginPass(unsigned int pass, StateCache* target)
+{
+	D3D11_VIEWPORT viewport = {};
+	viewport.MaxDepth = 1.0f;
+
+	target->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	target->OMSetDepthStencilState(0, 0);
+	if (pass == RENDER_PASS_ATLAS_SHADOW) {
+		// Each view's packets set their own tile (see SubmitPackets)
+		ID3D11RenderTargetView* nullRTV{};
+		target->OMSetRenderTargets(1, &nullRTV, shadowAtlas->GetDSV());
+		target->RSSetState(shadowRasterizer.Get());
+		target->PSSetShader(0);
+		viewport.Width = (float)shadowAtlas->GetResolution();
+		viewport.Height = (float)shadowAtlas->GetResolution();
+	}
+	else if (IsShadowPass(pass)) {
+		ID3D11RenderTargetView* nullRTV{};
+		unsigned int cascade = GetPassCascade(pass);
+		target->OMSetRenderTargets(1, &nullRTV, IsStaticShadowPass(pass) ?
+			shadowCascades->GetStaticDSV(cascade) :
+			shadowCascades->GetDSV(cascade));
+		target->RSSetState(shadowRasterizer.Get());
+		target->PSSetShader(0);
+		viewport.Width = (float)shadowCascades->GetResolution();
+		viewport.Height = (float)shadowCascades->GetResolution();
+	}
+	else if (useDeferred) {
+		// Lit afterwards, by RunDeferredLighting()
+		target->OMSetRenderTargets(GBUFFER_TARGET_COUNT, gBuffer->GetRTVs(), gBuffer->GetDSV());
+		target->RSSetState(0);
+		viewport.Width = (float)this->windowWidth;
+		viewport.Height = (float)this->windowHeight;
+	}
+	else {
+		target->OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthBufferDSV.Get());
+		target->RSSetState(0);
 		viewport.Width = (float)this->windowWidth;
 		viewport.Height = (float)this->windowHeight;
-		context->RSSetViewports(1, &viewport);
-		context->OMSetRenderTargets(
-			1,
-			backBufferRTV.GetAddressOf(),
-			depthBufferDSV.Get());
-		context->RSSetState(0);
 	}
+	target->RSSetViewport(viewport);
+}
 
-	//Pre render
-	{
-		const float clearColor[4] = { 1.0,1.0,1.0,1.0 };
-		context->ClearRenderTargetView(ppRTV.Get(), clearColor);
-		context->OMSetRenderTargets(1, ppRTV.GetAddressOf(), depthBufferDSV.Get());
+// --------------------------------------------------------
+// Issues a range of one pass's packets, only setting shaders,
+// materials, meshes and constant buffers when they differ
+// from the previous packet's
+// - Safe to call from several threads at once, as long as
+//   each uses its own context and shader slot (see
+//   ISimpleShader::SetThreadContext) and its own stats
+//
+// firstPacket/lastPacket - The range [first, last) to draw
+// target                 - State cache of the context to record into
+// stats                  - Receives this range's counters
+// forward                - With deferred shading on, draw only the
+//                          packets GBufferPS can't (see
+//                          DrawForwardAfterLighting), instead of
+//                          only the ones it can
+// --------------------------------------------------------
+void Game::SubmitPackets(
+	unsigned int pass,
+	unsigned int firstPacket,
+	unsigned int lastPacket,
+	StateCache* target,
+	RenderStats& stats,
+	bool forward)
+{
+	std::shared_ptr<Camera> cam = camera[activeCamera];
+	bool shadow = IsShadowPass(pass);
+	bool atlas = pass == RENDER_PASS_ATLAS_SHADOW;
+	bool gBufferPass = useDeferred && !shadow && !forward;
+
+	// What the previous packet left bound
+	int boundShadowView = -1;
+	SimpleVertexShader* boundVS = 0;
+	SimplePixelShader* boundPS = 0;
+	Material* boundMaterial = 0;
+	Mesh* boundTint = 0;
+	Mesh* boundMesh = 0;
+	bool boundInstanced = false;
+
+	for (unsigned int p = firstPacket; p < lastPacket; p++) {
+		DrawPacket& packet = drawPackets[p];
+		std::shared_ptr<Mesh> mesh = packet.entity->GetMesh();
+		std::shared_ptr<Material> material = packet.entity->GetMaterial();
+
+		// Deferred shading splits the scene's packets between
+		// the G-buffer and the forward draw after lighting
+		if (useDeferred && !shadow &&
+			psParams[material->GetPixelShader()->GetId()].gBuffer == forward)
+			continue;
+
+		std::shared_ptr<SimpleVertexShader> vs;
+		if (shadow)
+			vs = packet.instanced ? instancedShadowVS : shadowVS;
+		else
+			vs = packet.instanced ? material->GetInstancedVertexShader() : material->GetVertexShader();
+
+		const SceneVSParams& vsp = vsParams[vs->GetId()];
+
+		// Vertex shader and its per pass data
+		bool vsDirty = false;
+		if (vs.get() != boundVS) {
+			vs->SetShader();
+			if (atlas) {
+				boundShadowView = -1; // Set below, on the new shader
+			}
+			else if (shadow) {
+				vs->SetMatrix4x4(vsp.view, shadowCascades->GetView());
+				vs->SetMatrix4x4(vsp.projection, shadowCascades->GetProjection(GetPassCascade(pass)));
+			}
+			else {
+				// The pixel shader finds the other cascades from the first
+				vs->SetMatrix4x4(vsp.view, cam->GetView());
+				vs->SetMatrix4x4(vsp.projection, cam->GetProjection());
+				vs->SetMatrix4x4(vsp.lightView, shadowCascades->GetView());
+				vs->SetMatrix4x4(vsp.lightProjection, shadowCascades->GetProjection(0));
+			}
+			boundVS = vs.get();
+			vsDirty = true;
+		}
+		else {
+			stats.shaderChangesSkipped++;
+		}
+
+		// Each atlas view has its own matrices and tile
+		if (atlas && (int)packet.shadowView != boundShadowView) {
+			const ShadowAtlas::Tile& tile = shadowAtlas->GetTile(packet.shadowView);
+			D3D11_VIEWPORT viewport = {};
+			viewport.TopLeftX = (float)tile.x;
+			viewport.TopLeftY = (float)tile.y;
+			viewport.Width = (float)tile.size;
+			viewport.Height = (float)tile.size;
+			viewport.MaxDepth = 1.0f;
+			target->RSSetViewport(viewport);
+			vs->SetMatrix4x4(vsp.view, shadowAtlas->GetView(packet.shadowView));
+			vs->SetMatrix4x4(vsp.projection, shadowAtlas->GetProjection(packet.shadowView));
+			boundShadowView = (int)packet.shadowView;
+			vsDirty = true;
+		}
+
+		if (!packet.instanced) {
+			std::shared_ptr<Transform> transform = packet.entity->GetTransform();
+			vs->SetMatrix4x4(vsp.world, transform->GetWorldMatrix());
+			if (!shadow)
+				vs->SetMatrix4x4(vsp.worldInvTranspose, transform->GetWorldInverseTransposeMatrix());
+			vsDirty = true;
+		}
+
+		if (vsDirty)
+			vs->CopyAllBufferData();
+		else
+			stats.constantUploadsSkipped++;
+
+		// Pixel shader, material and tint (no pixel shader for shadows)
+		// - Deferred shading writes every material it can to the
+		//   G-buffer with the same shader, which doesn't light anything
+		if (!shadow) {
+			std::shared_ptr<SimplePixelShader> ps = gBufferPass ? gBufferPS : material->GetPixelShader();
+			const ScenePSParams& psp = psParams[ps->GetId()];
+			bool psDirty = false;
+			if (ps.get() != boundPS) {
+				ps->SetShader();
+				if (!gBufferPass)
+					SetScenePixelData(ps);
+				boundPS = ps.get();
+				boundMaterial = 0; // Textures and values live in the pixel shader,
+				boundTint = 0;	   // so they need setting on the new one too
+				psDirty = true;
+			}
+			else {
+				stats.shaderChangesSkipped++;
+			}
+
+			// Material values are in their own buffer (PerMaterial),
+			// so only a new material uploads them - not a new tint
+			if (material.get() != boundMaterial) {
+				material->PrepareMaterial();
+				stats.materialChanges++;
+				ps->SetFloat(psp.roughness, material->GetRoughness());
+				if (gBufferPass)
+					ps->SetInt(psp.textureMask, (int)GetGBufferTextureMask(material.get()));
+				boundMaterial = material.get();
+				psDirty = true;
+			}
+			else {
+				stats.materialChangesSkipped++;
+			}
+
+			if (mesh.get() != boundTint) {
+				ps->SetFloat4(psp.colorTint, mesh->GetTint());
+				boundTint = mesh.get();
+				psDirty = true;
+			}
+
+			if (psDirty)
+				ps->CopyAllBufferData();
+			else
+				stats.constantUploadsSkipped++;
+		}
+
+		// Geometry
+		if (mesh.get() != boundMesh || packet.instanced != boundInstanced) {
+			if (packet.instanced)
+				mesh->SetInstancedBuffers(target, instanceBuffer->GetBuffer(), sizeof(InstanceData));
+			else
+				mesh->SetBuffers(target);
+			boundMesh = mesh.get();
+			boundInstanced = packet.instanced;
+		}
+		else {
+			stats.meshChangesSkipped++;
+		}
+
+		if (packet.instanced) {
+			mesh->DrawIndexedInstanced(target->GetContext(), packet.instanceCount, packet.firstInstance);
+			stats.instancedDrawCalls++;
+			stats.instancesDrawn += packet.instanceCount;
+		}
+		else {
+			mesh->DrawIndexed(target->GetContext());
+		}
+		stats.drawCalls++;
+	}
+}
+
+// --------------------------------------------------------
+// Splits every pass's packets between threadCount threads,
+// each recording its share into its own deferred context,
+// then plays the command lists back in order: all of the
+// shadow lists first, then all of the opaque lists
+//
+// ring - If not null, every thread's constants are written to
+//        this ring, which is uploaded with one Map once all
+//        threads are done and before any list executes
+// --------------------------------------------------------
+void Game::RecordPassesThreaded(unsigned int threadCount, ConstantRing* ring)
+{
+	if (ring)
+		ring->BeginFrame();
+
+	workerPool->Run(threadCount, [&](unsigned int t) {
+		ID3D11DeviceContext* deferred = deferredContexts[t].Get();
+		StateCache* state = stateCaches[t + 1].get();
+		ISimpleShader::SetThreadContext(deferred, t + 1, ring);
+		threadStats[t].Reset();
+
+		for (unsigned int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+			if (!IsPassActive(pass))
+				continue;
+
+			// Even split by packet count, which is close enough
+			// as most packets are single draws of similar cost
+			unsigned int count = passStart[pass + 1] - passStart[pass];
+			unsigned int first = passStart[pass] + count * t / threadCount;
+			unsigned int last = passStart[pass] + count * (t + 1) / threadCount;
+
+			// Each pass is its own command list, which starts
+			// without any of the state or constant data set before
+			ISimpleShader::InvalidateUploads(t + 1);
+			state->Invalidate();
+			BeginPass(pass, state);
+			SubmitPackets(pass, first, last, state, threadStats[t]);
+			deferred->FinishCommandList(FALSE, commandLists[pass * maxRenderThreads + t].ReleaseAndGetAddressOf());
+		}
+
+		ISimpleShader::SetThreadContext(0, 0);
+	});
+
+	if (ring)
+		ring->Upload(context.Get());
+
+	for (unsigned int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+		if (!IsPassActive(pass))
+			continue;
+
+		if (pass == RENDER_PASS_OPAQUE)
+			PrefilterShadows();
+		gpuTimer->Start(pass);
+		BeginShadowTarget(pass);
+		for (unsigned int t = 0; t < threadCount; t++) {
+			Microsoft::WRL::ComPtr<ID3D11CommandList>& list = commandLists[pass * maxRenderThreads + t];
+			context->ExecuteCommandList(list.Get(), FALSE);
+			list.Reset();
+		}
+		gpuTimer->Stop(pass);
+	}
+
+	// The lists have rewritten buffers the immediate context
+	// may think are still holding its own data, and executing
+	// them cleared its state
+	ISimpleShader::InvalidateUploads(0);
+	stateCaches[0]->Invalidate();
+
+	for (unsigned int t = 0; t < threadCount; t++)
+		renderStats.MergeDraws(threadStats[t]);
+}
+
+// --------------------------------------------------------
+// Draws one pass of the GPU driven path: a single indirect
+// draw per slot (mesh + material), whose instance count was
+// written by the cull shader.  The CPU never looks at the
+// individual entities, so the cost here only grows with the
+// number of unique mesh/material pairs.
+// --------------------------------------------------------
+void Game::SubmitGpuDrivenPass(unsigned int pass, bool forward)
+{
+	std::shared_ptr<Camera> cam = camera[activeCamera];
+	bool shadow = IsShadowPass(pass);
+	bool gBufferPass = useDeferred && !shadow && !forward;
+
+	std::shared_ptr<SimpleVertexShader> vs = shadow ? gpuDrivenShadowVS : gpuDrivenVS;
+	const SceneVSParams& vsp = vsParams[vs->GetId()];
+	vs->SetShader();
+	if (shadow) {
+		vs->SetMatrix4x4(vsp.view, shadowCascades->GetView());
+		vs->SetMatrix4x4(vsp.projection, shadowCascades->GetProjection(GetPassCascade(pass)));
+	}
+	else {
+		vs->SetMatrix4x4(vsp.view, cam->GetView());
+		vs->SetMatrix4x4(vsp.projection, cam->GetProjection());
+		vs->SetMatrix4x4(vsp.lightView, shadowCascades->GetView());
+		vs->SetMatrix4x4(vsp.lightProjection, shadowCascades->GetProjection(0));
+	}
+	vs->CopyAllBufferData();
+	gpuScene->BindGeometry(pass, vs);
+
+	SimplePixelShader* boundPS = 0;
+	Material* boundMaterial = 0;
+	for (unsigned int s = 0; s < gpuScene->GetSlotCount(); s++) {
+		const GpuDrawSlot& slot = gpuScene->GetSlot(s);
+
+		// Split between the G-buffer and the forward draw after
+		// lighting, as in SubmitPackets()
+		if (useDeferred && !shadow &&
+			psParams[slot.material->GetPixelShader()->GetId()].gBuffer == forward)
+			continue;
+
+		// Materials can't be indexed on the GPU (no bindless
+		// textures in D3D11), so each slot sets its own
+		if (!shadow) {
+			std::shared_ptr<SimplePixelShader> ps = gBufferPass ? gBufferPS : slot.material->GetPixelShader();
+			const ScenePSParams& psp = psParams[ps->GetId()];
+			if (ps.get() != boundPS) {
+				ps->SetShader();
+				if (!gBufferPass)
+					SetScenePixelData(ps);
+				boundPS = ps.get();
+				boundMaterial = 0;
+			}
+			if (slot.material != boundMaterial) {
+				slot.material->PrepareMaterial();
+				renderStats.materialChanges++;
+				ps->SetFloat(psp.roughness, slot.material->GetRoughness());
+				if (gBufferPass)
+					ps->SetInt(psp.textureMask, (int)GetGBufferTextureMask(slot.material));
+				boundMaterial = slot.material;
+			}
+			ps->SetFloat4(psp.colorTint, slot.mesh->GetTint());
+			ps->CopyAllBufferData();
+		}
+
+		gpuScene->DrawSlot(pass, s);
+		renderStats.drawCalls++;
+		renderStats.instancedDrawCalls++;
+	}
+}
+
+// --------------------------------------------------------
+// Steps the thread count benchmark along by one frame,
+// averaging the submit time at 1, 2, ... maxRenderThreads
+// threads, then putting the thread count back
+// --------------------------------------------------------
+void Game::UpdateThreadBenchmark(float submitMs)
+{
+	const int warmupFrames = 10;
+	const int measuredFrames = 120;
+
+	if (benchmarkThreads == 0)
+		return;
+
+	benchmarkFrame++;
+	if (benchmarkFrame <= warmupFrames)
+		return;
+	benchmarkTotal += submitMs;
+	if (benchmarkFrame < warmupFrames + measuredFrames)
+		return;
+
+	benchmarkResults.push_back(benchmarkTotal / measuredFrames);
+	benchmarkFrame = 0;
+	benchmarkTotal = 0.0f;
+	benchmarkThreads++;
+	if (benchmarkThreads > maxRenderThreads) {
+		benchmarkThreads = 0;
+		renderThreads = 1;
+	}
+	else {
+		renderThreads = benchmarkThreads;
+	}
+}
+
+// --------------------------------------------------------
+// Steps the filtering benchmark on a frame: each mode is
+// given time for the GPU timer to catch up with it, then
+// filtering plus shading is averaged over a fixed run
+// --------------------------------------------------------
+void Game::UpdateFilterBenchmark()
+{
+	const int warmupFrames = 60;
+	const int measuredFrames = 120;
+
+	if (filterBenchmarkMode < 0)
+		return;
+
+	filterBenchmarkFrame++;
+	if (filterBenchmarkFrame <= warmupFrames)
+		return;
+	filterBenchmarkTotal +=
+		gpuTimer->GetTime(GPU_TIME_SHADOW_FILTER) +
+		gpuTimer->GetTime(useDeferred ? GPU_TIME_LIGHTING : GPU_TIME_OPAQUE);
+	if (filterBenchmarkFrame < warmupFrames + measuredFrames)
+		return;
+
+	filterBenchmarkResults[filterBenchmarkMode] = filterBenchmarkTotal / measuredFrames;
+	filterBenchmarkFrame = 0;
+	filterBenchmarkTotal = 0.0f;
+	filterBenchmarkMode++;
+	if (filterBenchmarkMode >= SHADOW_FILTER_COUNT) {
+		filterBenchmarkMode = -1;
+		shadowFilter->SetMode(filterBenchmarkRestore);
+	}
+	else {
+		shadowFilter->SetMode(filterBenchmarkMode);
+	}
+}
+
+// --------------------------------------------------------
+// Sets the pixel shader data that is the same for every
+// object in the scene (lights, camera position, etc.)
+// --------------------------------------------------------
+void Game::SetScenePixelData(std::shared_ptr<SimplePixelShader> ps)
+{
+	const ScenePSParams& psp = psParams[ps->GetId()];
+
+	// Shaders built from PixelShader.hlsl take the whole buffer,
+	// laid out by the generated struct, in one copy
+	// The clusters were binned for the active camera at the start
+	// of Draw(), which the pixel shader finds its cluster from
+	LightBinner& binner = lightManager->GetBinner();
+	CBuffers::PixelShader::PerFrame perFrame = {};
+	perFrame.cameraPos = camera[activeCamera]->GetTransform()->GetPosition();
+	perFrame.globalLightCount = binner.GetGlobalLightCount();
+	perFrame.shadowLightIndex = shadowLightIndex;
+	perFrame.cameraForward = camera[activeCamera]->GetTransform()->GetForward();
+	perFrame.lightDebugView = lightDebugView;
+	perFrame.clusterCounts = XMUINT3(binner.GetTilesX(), binner.GetTilesY(), binner.GetSlices());
+	perFrame.clusterDepthScale = binner.GetDepthScale();
+	perFrame.clusterTileScale = XMFLOAT2((float)binner.GetTilesX() / windowWidth, (float)binner.GetTilesY() / windowHeight);
+	perFrame.clusterDepthBias = binner.GetDepthBias();
+
+	if (psp.perFrame.IsValid()) {
+		ps->SetData(psp.perFrame, &perFrame, sizeof(perFrame));
+	}
+	else {
+		ps->SetInt(psp.globalLightCount, (int)perFrame.globalLightCount);
+		ps->SetInt(psp.shadowLightIndex, shadowLightIndex);
+		ps->SetFloat3(psp.cameraPos, perFrame.cameraPos);
+		ps->SetFloat3(psp.cameraForward, perFrame.cameraForward);
+		ps->SetInt(psp.lightDebugView, lightDebugView);
+		ps->SetData(psp.clusterCounts, &perFrame.clusterCounts, sizeof(perFrame.clusterCounts));
+		ps->SetFloat(psp.clusterDepthScale, perFrame.clusterDepthScale);
+		ps->SetFloat2(psp.clusterTileScale, perFrame.clusterTileScale);
+		ps->SetFloat(psp.clusterDepthBias, perFrame.clusterDepthBias);
+	}
+
+	// Only in variants with shadows
+	if (psp.shadowData.IsValid()) {
+		CBuffers::PixelShader::ShadowData shadowData = GetShadowData();
+		ps->SetData(psp.shadowData, &shadowData, sizeof(shadowData));
+		ps->SetShaderResourceView("ShadowAtlas", shadowAtlas->GetSRV());
+		ps->SetShaderResourceView("ShadowViews", shadowAtlas->GetViewSRV());
+		ps->SetShaderResourceView("ShadowMoments", shadowFilter->GetMomentsSRV());
+		ps->SetSamplerState("MomentSampler", momentSampler);
+	}
+
+	if (psp.ambientData.IsValid()) {
+		CBuffers::PixelShader::AmbientData ambientData = GetAmbientData();
+		ps->SetData(psp.ambientData, &ambientData, sizeof(ambientData));
+		ps->SetShaderResourceView("SpecularMap", skyLighting->GetSpecularSRV());
+		ps->SetShaderResourceView("BrdfLut", skyLighting->GetBrdfLutSRV());
+		ps->SetShaderResourceView("ProbeGrid", lightProbes->GetSRV());
+		ps->SetSamplerState("AmbientSampler", ambientSampler);
+	}
+
+	// The lights themselves were uploaded once, at the start of Draw()
+	ps->SetShaderResourceView("Lights", lightManager->GetSRV());
+	ps->SetShaderResourceView("ClusterRanges", lightManager->GetClusterRangeSRV());
+	ps->SetShaderResourceView("ClusterLightIndices", lightManager->GetClusterIndexSRV());
+}
+
+// --------------------------------------------------------
+// Finds the handles of every variable set while drawing the
+// scene, for every shader the scene might draw with
+// - Done once up front rather than on first use, as draws
+//   may be recorded by several threads at once
+// --------------------------------------------------------
+void Game::ResolveShaderParams()
+{
+	std::shared_ptr<SimpleVertexShader> vertexShaders[] = {
+		vertexShader, shadowVS, instancedVS, instancedShadowVS, gpuDrivenVS, gpuDrivenShadowVS };
+	std::vector<std::shared_ptr<SimplePixelShader>> pixelShaders = pixelVariants->GetLoadedShaders();
+	pixelShaders.push_back(customShader);
+	pixelShaders.push_back(gBufferPS);
+
+	for (auto& vs : vertexShaders) {
+		if (vs->GetId() >= vsParams.size())
+			vsParams.resize(vs->GetId() + 1);
+
+		SceneVSParams& vsp = vsParams[vs->GetId()];
+		vsp.world = vs->GetParam("world");
+		vsp.worldInvTranspose = vs->GetParam("worldInvTranspose");
+		vsp.view = vs->GetParam("view");
+		vsp.projection = vs->GetParam("projection");
+		vsp.lightView = vs->GetParam("lightView");
+		vsp.lightProjection = vs->GetParam("lightProjection");
+	}
+
+	for (auto& ps : pixelShaders) {
+		if (ps->GetId() >= psParams.size())
+			psParams.resize(ps->GetId() + 1);
+
+		ScenePSParams& psp = psParams[ps->GetId()];
+		psp.colorTint = ps->GetParam("colorTint");
+		psp.roughness = ps->GetParam("roughness");
+		psp.cameraPos = ps->GetParam("cameraPos");
+		psp.globalLightCount = ps->GetParam("globalLightCount");
+		psp.shadowLightIndex = ps->GetParam("shadowLightIndex");
+		psp.cameraForward = ps->GetParam("cameraForward");
+		psp.lightDebugView = ps->GetParam("lightDebugView");
+		psp.clusterCounts = ps->GetParam("clusterCounts");
+		psp.clusterDepthScale = ps->GetParam("clusterDepthScale");
+		psp.clusterTileScale = ps->GetParam("clusterTileScale");
+		psp.clusterDepthBias = ps->GetParam("clusterDepthBias");
+		psp.textureMask = ps->GetParam("textureMask");
+		psp.perFrame = ShaderParam();
+		psp.shadowData = ShaderParam();
+		psp.ambientData = ShaderParam();
+		psp.gBuffer = false;
+	}
+
+	// Every variant of PixelShader.hlsl has the same PerFrame
+	// buffer, which the generated struct must match exactly
+	for (auto& ps : pixelVariants->GetLoadedShaders()) {
+		psParams[ps->GetId()].gBuffer = true;
+		ShaderParam perFrame = ps->GetBufferParam("PerFrame");
+		if (perFrame.Size == sizeof(CBuffers::PixelShader::PerFrame))
+			psParams[ps->GetId()].perFrame = perFrame;
+		ShaderParam shadowData = ps->GetBufferParam("ShadowData");
+		if (shadowData.Size == sizeof(CBuffers::PixelShader::ShadowData))
+			psParams[ps->GetId()].shadowData = shadowData;
+		ShaderParam ambientData = ps->GetBufferParam("AmbientData");
+		if (ambientData.Size == sizeof(CBuffers::PixelShader::AmbientData))
+			psParams[ps->GetId()].ambientData = ambientData;
+	}
+}
+
+// --------------------------------------------------------
+// Gives each lit material the smallest pixel shader variant
+// that covers its textures, with shadows only while the
+// shadow casting light gives off any light or a point or
+// spot light has views in the shadow atlas (USE_SHADOWS
+// covers both).  Only does anything when that changes, so
+// it's called every frame.
+// --------------------------------------------------------
+void Game::SelectShaderVariants()
+{
+	const Light& shadowLight = lightManager->Get(shadowLightIndex);
+	bool shadowLit = shadowLight.intensity > 0.0f &&
+		(shadowLight.color.x > 0.0f || shadowLight.color.y > 0.0f || shadowLight.color.z > 0.0f);
+	bool atlasShadows = shadowAtlas->GetViewCount() > 0;
+
+	unsigned int sceneFeatures = shadowLit || atlasShadows ? PS_FEATURE_SHADOWS : 0;
+	if (sceneFeatures == sceneShaderFeatures)
+		return;
+	sceneShaderFeatures = sceneFeatures;
+
+	for (auto& m : litMaterials)
+		m->SetPixelShader(pixelVariants->Get(sceneFeatures | GetTextureFeatures(m.get())));
+
+	// Any newly loaded variants need their handles, and
+	// reloading when PixelShader.hlsl is edited
+	ResolveShaderParams();
+	WatchShaders();
+}
+
+// --------------------------------------------------------
+// The cascades as the shaders see them (see Shadows.hlsli)
+// --------------------------------------------------------
+CBuffers::PixelShader::ShadowData Game::GetShadowData()
+{
+	CBuffers::PixelShader::ShadowData shadowData = {};
+	unsigned int cascadeCount = shadowCascades->GetCascadeCount();
+	float splits[MAX_SHADOW_CASCADES] = {};
+	for (unsigned int c = 0; c < cascadeCount; c++) {
+		XMFLOAT3 scale = shadowCascades->GetShadowMapScale(c);
+		XMFLOAT3 offset = shadowCascades->GetShadowMapOffset(c);
+		shadowData.cascadeScales[c] = XMFLOAT4(scale.x, scale.y, scale.z, 0.0f);
+		shadowData.cascadeOffsets[c] = XMFLOAT4(offset.x, offset.y, offset.z, 0.0f);
+		splits[c] = shadowCascades->GetSplitDepth(c);
+	}
+	shadowData.cascadeSplits = XMFLOAT4(splits);
+	shadowData.cascadeCount = cascadeCount;
+	shadowData.cascadeBlend = shadowCascades->GetBlendFraction();
+	shadowData.atlasTexelSize = 1.0f / shadowAtlas->GetResolution();
+
+	XMFLOAT4X4 firstProjection = shadowCascades->GetProjection(0);
+	shadowData.filterMode = shadowFilter->GetMode();
+	shadowData.filterTaps = shadowFilter->GetShaderTaps();
+	shadowData.filterRadius = shadowFilter->GetRadius();
+	shadowData.cascadeProjection = XMFLOAT2(firstProjection._11, firstProjection._33);
+	shadowData.cascadeTexelSize = 1.0f / shadowCascades->GetResolution();
+	shadowData.sunSize = tanf(XMConvertToRadians(shadowFilter->GetSunSize() * 0.5f));
+	shadowData.lightSize = shadowFilter->GetLightSize();
+	shadowData.evsmBleedReduction = shadowFilter->GetBleedReduction();
+	shadowData.evsmExponents = shadowFilter->GetExponents();
+	return shadowData;
+}
+
+// --------------------------------------------------------
+// The sky's ambient light as the shaders see it, and the
+// probe grid that replaces its diffuse part (see Ambient.hlsli)
+// --------------------------------------------------------
+CBuffers::PixelShader::AmbientData Game::GetAmbientData()
+{
+	CBuffers::PixelShader::AmbientData ambientData = {};
+	const SH9& irradiance = skyLighting->GetIrradiance();
+	for (unsigned int k = 0; k < 9; k++)
+		ambientData.irradiance[k] = irradiance.coefficients[k];
+	ambientData.diffuseIntensity = ambientDiffuse;
+	ambientData.specularIntensity = ambientSpecular;
+	ambientData.specularMipCount = (float)skyLighting->GetSpecularMipCount();
+
+	if (useLightProbes && lightProbes->HasProbes()) {
+		XMUINT3 counts = lightProbes->GetCounts();
+		ambientData.useProbes = 1.0f;
+		ambientData.probeGridOrigin = lightProbes->GetOrigin();
+		ambientData.probeGridSpacing = lightProbes->GetSpacing();
+		ambientData.probeGridCounts = XMFLOAT3((float)counts.x, (float)counts.y, (float)counts.z);
+		ambientData.probeNormalBias = probeNormalBias;
+	}
+	return ambientData;
+}
+
+// --------------------------------------------------------
+// Passes for shadow cascades past the cascade count, or that
+// aren't redrawn this frame, are skipped entirely, as is the
+// atlas when no light has a view in it
+// --------------------------------------------------------
+bool Game::IsPassActive(unsigned int pass)
+{
+	if (!IsShadowPass(pass))
+		return true;
+	if (pass == RENDER_PASS_ATLAS_SHADOW)
+		return shadowAtlas->GetViewCount() > 0;
+	unsigned int cascade = GetPassCascade(pass);
+	if (cascade >= shadowCascades->GetCascadeCount())
+		return false;
+	return IsStaticShadowPass(pass) ? shadowCascades->IsStaticDrawn(cascade) : shadowCascades->IsDrawn(cascade);
+}
+
+// --------------------------------------------------------
+// Readies a shadow pass's target on the immediate context,
+// before its draws run - the cascades aren't cleared with
+// the other targets, as they start from the static cache
+// --------------------------------------------------------
+void Game::BeginShadowTarget(unsigned int pass)
+{
+	if (pass == RENDER_PASS_ATLAS_SHADOW)
+		context->ClearDepthStencilView(shadowAtlas->GetDSV(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+	else if (IsStaticShadowPass(pass))
+		shadowCascades->BeginStaticPass(context.Get(), GetPassCascade(pass));
+	else if (IsShadowPass(pass))
+		shadowCascades->BeginPass(context.Get(), GetPassCascade(pass));
+}
+
+// --------------------------------------------------------
+// Makes EVSM's moments from the cascades just drawn, between
+// the shadow passes and the opaque pass that samples them
+// - The last cascade drawn may still be bound as the depth
+//   target, which would keep the compute shaders from reading it
+// --------------------------------------------------------
+void Game::PrefilterShadows()
+{
+	if (shadowFilter->GetMode() != SHADOW_FILTER_EVSM)
+		return;
+
+	ID3D11RenderTargetView* nullRTV{};
+	stateCaches[0]->OMSetRenderTargets(1, &nullRTV, 0);
+	gpuTimer->Start(GPU_TIME_SHADOW_FILTER);
+	shadowFilter->Prefilter(shadowCascades.get());
+	gpuTimer->Stop(GPU_TIME_SHADOW_FILTER);
+}
+
+// --------------------------------------------------------
+// The PS_FEATURE_* bits for the maps a material has, which
+// pick its PixelShader variant, or GBufferPS's textureMask
+// --------------------------------------------------------
+unsigned int Game::GetTextureFeatures(Material* material)
+{
+	unsigned int features = 0;
+	if (material->HasTexture("NormalMap")) features |= PS_FEATURE_NORMAL_MAP;
+	if (material->HasTexture("RoughnessMap")) features |= PS_FEATURE_ROUGHNESS_MAP;
+	if (material->HasTexture("MetalnessMap")) features |= PS_FEATURE_METALNESS_MAP;
+	return features;
+}
+
+// --------------------------------------------------------
+// GBufferPS.hlsl's textureMask for a material: its maps, as
+// above, and whether it has an albedo map at all
+// --------------------------------------------------------
+unsigned int Game::GetGBufferTextureMask(Material* material)
+{
+	unsigned int mask = GetTextureFeatures(material);
+	if (material->HasTexture("Albedo")) mask |= GBUFFER_ALBEDO_MAP;
+	return mask;
+}
+
+// --------------------------------------------------------
+// Lights the G-buffer the opaque pass drew into, writing the
+// lit scene to the post process target, then sets that up
+// for the sky to draw into behind the scene
+// - Lights are culled per 16x16 tile by the shader itself;
+//   the light manager's clusters are only read by tiles with
+//   more lights than the shader can hold
+// --------------------------------------------------------
+void Game::RunDeferredLighting()
+{
+	std::shared_ptr<Camera> cam = camera[activeCamera];
+	XMFLOAT4X4 view = cam->GetView();
+	XMFLOAT4X4 projection = cam->GetProjection();
+	XMFLOAT4X4 invViewProjection;
+	XMStoreFloat4x4(&invViewProjection,
+		XMMatrixInverse(0, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection)));
+
+	// The G-buffer can't be read while it's still bound as targets
+	ID3D11RenderTargetView* nullRTVs[GBUFFER_TARGET_COUNT] = {};
+	stateCaches[0]->OMSetRenderTargets(GBUFFER_TARGET_COUNT, nullRTVs, 0);
+
+	unsigned int screenSize[2] = { windowWidth, windowHeight };
+	deferredLightingCS->SetShader();
+	deferredLightingCS->SetMatrix4x4("invViewProjection", invViewProjection);
+	deferredLightingCS->SetMatrix4x4("view", view);
+	deferredLightingCS->SetMatrix4x4("lightView", shadowCascades->GetView());
+	deferredLightingCS->SetMatrix4x4("lightProjection", shadowCascades->GetProjection(0));
+	deferredLightingCS->SetFloat3("cameraPos", cam->GetTransform()->GetPosition());
+	deferredLightingCS->SetInt("lightCount", (int)lightManager->GetCount());
+	deferredLightingCS->SetFloat2("projectionScale", XMFLOAT2(projection._11, projection._22));
+	deferredLightingCS->SetFloat2("depthParams", XMFLOAT2(projection._33, projection._43));
+	deferredLightingCS->SetData("screenSize", screenSize, sizeof(screenSize));
+	deferredLightingCS->SetInt("shadowLightIndex", shadowLightIndex);
+	deferredLightingCS->SetInt("lightDebugView", lightDebugView);
+	LightBinner& binner = lightManager->GetBinner();
+	XMUINT3 clusterCounts(binner.GetTilesX(), binner.GetTilesY(), binner.GetSlices());
+	deferredLightingCS->SetInt("globalLightCount", (int)binner.GetGlobalLightCount());
+	deferredLightingCS->SetData("clusterCounts", &clusterCounts, sizeof(clusterCounts));
+	deferredLightingCS->SetFloat("clusterDepthScale", binner.GetDepthScale());
+	deferredLightingCS->SetFloat2("clusterTileScale", XMFLOAT2((float)binner.GetTilesX() / windowWidth, (float)binner.GetTilesY() / windowHeight));
+	deferredLightingCS->SetFloat("clusterDepthBias", binner.GetDepthBias());
+	CBuffers::PixelShader::ShadowData shadowData = GetShadowData();
+	deferredLightingCS->SetData(deferredLightingCS->GetBufferParam("ShadowData"), &shadowData, sizeof(shadowData));
+	CBuffers::PixelShader::AmbientData ambientData = GetAmbientData();
+	deferredLightingCS->SetData(deferredLightingCS->GetBufferParam("AmbientData"), &ambientData, sizeof(ambientData));
+	deferredLightingCS->CopyAllBufferData();
+	deferredLightingCS->SetShaderResourceView("AlbedoBuffer", gBuffer->GetSRV(GBUFFER_ALBEDO));
+	deferredLightingCS->SetShaderResourceView("NormalBuffer", gBuffer->GetSRV(GBUFFER_NORMAL));
+	deferredLightingCS->SetShaderResourceView("MaterialBuffer", gBuffer->GetSRV(GBUFFER_MATERIAL));
+	deferredLightingCS->SetShaderResourceView("DepthBuffer", gBuffer->GetDepthSRV());
+	deferredLightingCS->SetShaderResourceView("ShadowMap", shadowCascades->GetSRV());
+	deferredLightingCS->SetShaderResourceView("Lights", lightManager->GetSRV());
+	deferredLightingCS->SetShaderResourceView("ShadowAtlas", shadowAtlas->GetSRV());
+	deferredLightingCS->SetShaderResourceView("ShadowViews", shadowAtlas->GetViewSRV());
+	deferredLightingCS->SetShaderResourceView("ShadowMoments", shadowFilter->GetMomentsSRV());
+	deferredLightingCS->SetShaderResourceView("SpecularMap", skyLighting->GetSpecularSRV());
+	deferredLightingCS->SetShaderResourceView("BrdfLut", skyLighting->GetBrdfLutSRV());
+	deferredLightingCS->SetShaderResourceView("ProbeGrid", lightProbes->GetSRV());
+	deferredLightingCS->SetShaderResourceView("ClusterRanges", lightManager->GetClusterRangeSRV());
+	deferredLightingCS->SetShaderResourceView("ClusterLightIndices", lightManager->GetClusterIndexSRV());
+	deferredLightingCS->SetSamplerState("ShadowSampler", shadowSampler);
+	deferredLightingCS->SetSamplerState("MomentSampler", momentSampler);
+	deferredLightingCS->SetSamplerState("AmbientSampler", ambientSampler);
+	deferredLightingCS->SetUnorderedAccessView("Output", ppUAV);
+	deferredLightingCS->DispatchByThreads(windowWidth, windowHeight, 1);
+
+	// Unbound again, so they can be targets next frame
+	ID3D11UnorderedAccessView* nullUAV = 0;
+	ID3D11ShaderResourceView* nullSRVs[14] = {};
+	context->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+	context->CSSetShaderResources(0, 14, nullSRVs);
+
+	// The sky only fills in where the scene's depth is clear
+	stateCaches[0]->OMSetRenderTargets(1, ppRTV.GetAddressOf(), gBuffer->GetDSV());
+}
+
+// --------------------------------------------------------
+// Draws the opaque materials the G-buffer can't hold (those
+// with any pixel shader but PixelShader.hlsl's variants) with
+// their own shaders, over the lit scene and tested against the
+// G-buffer's depth - to be called right after RunDeferredLighting()
+// --------------------------------------------------------
+void Game::DrawForwardAfterLighting()
+{
+	stateCaches[0]->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	stateCaches[0]->OMSetDepthStencilState(0, 0);
+	stateCaches[0]->RSSetState(0);
+
+	if (useGpuDriven) {
+		SubmitGpuDrivenPass(RENDER_PASS_OPAQUE, true);
+		stateCaches[0]->Invalidate();
+	}
+	else {
+		SubmitPackets(RENDER_PASS_OPAQUE, passStart[RENDER_PASS_OPAQUE], passStart[RENDER_PASS_OPAQUE + 1],
+			stateCaches[0].get(), renderStats, true);
+	}
+}
+
+// --------------------------------------------------------
+// Hands every shader to hot reload, along with its source
+// - Pixel shader variants are compiled with their own
+//   defines, and are added as they're loaded
+// - Watching a shader again does nothing, so this can be
+//   called whenever new variants may have been loaded
+// --------------------------------------------------------
+void Game::WatchShaders()
+{
+	hotReload->Watch(vertexShader, L"VertexShader.hlsl", "vs_5_0");
+	hotReload->Watch(customShader, L"CustomPS.hlsl", "ps_5_0");
+	hotReload->Watch(skyVS, L"SkyVertexShader.hlsl", "vs_5_0");
+	hotReload->Watch(skyPS, L"SkyPixelShader.hlsl", "ps_5_0");
+	hotReload->Watch(shadowVS, L"ShadowVS.hlsl", "vs_5_0");
+	hotReload->Watch(instancedVS, L"InstancedVS.hlsl", "vs_5_0");
+	hotReload->Watch(instancedShadowVS, L"InstancedShadowVS.hlsl", "vs_5_0");
+	hotReload->Watch(gpuDrivenVS, L"GpuDrivenVS.hlsl", "vs_5_0");
+	hotReload->Watch(gpuDrivenShadowVS, L"GpuDrivenShadowVS.hlsl", "vs_5_0");
+	hotReload->Watch(cullCS, L"CullInstancesCS.hlsl", "cs_5_0");
+	hotReload->Watch(ppVS, L"PostVS.hlsl", "vs_5_0");
+	hotReload->Watch(ppPS, L"PostPS.hlsl", "ps_5_0");
+	hotReload->Watch(gBufferPS, L"GBufferPS.hlsl", "ps_5_0");
+	hotReload->Watch(deferredLightingCS, L"DeferredLightingCS.hlsl", "cs_5_0");
+	hotReload->Watch(shadowMomentsCS, L"ShadowMomentsCS.hlsl", "cs_5_0");
+	hotReload->Watch(shadowBlurCS, L"ShadowBlurCS.hlsl", "cs_5_0");
+	hotReload->Watch(skyCaptureCS, L"SkyCaptureCS.hlsl", "cs_5_0");
+	hotReload->Watch(specularPrefilterCS, L"SpecularPrefilterCS.hlsl", "cs_5_0");
+	hotReload->Watch(brdfLutCS, L"BrdfLutCS.hlsl", "cs_5_0");
+
+	const std::vector<std::shared_ptr<SimplePixelShader>>& variants = pixelVariants->GetLoadedShaders();
+	const std::vector<unsigned int>& features = pixelVariants->GetLoadedFeatures();
+	for (size_t i = 0; i < variants.size(); i++)
+		hotReload->Watch(variants[i], L"PixelShader.hlsl", "ps_5_0", ShaderVariants::GetDefines(features[i]));
+}
+
+// --------------------------------------------------------
+// Times setting a matrix by name against setting it through
+// a handle, to show what the string lookups cost per call
+// --------------------------------------------------------
+void Game::RunParamBenchmark()
+{
+	const int iterations = 100000;
+	XMFLOAT4X4 matrix;
+	XMStoreFloat4x4(&matrix, XMMatrixIdentity());
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		matrix._41 = (float)i; // Keep the compiler from hoisting the copy
+		vertexShader->SetMatrix4x4("worldInvTranspose", matrix);
+	}
+	std::chrono::duration<float, std::nano> stringTime = std::chrono::high_resolution_clock::now() - start;
+
+	ShaderParam param = vertexShader->GetParam("worldInvTranspose");
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		matrix._41 = (float)i;
+		vertexShader->SetMatrix4x4(param, matrix);
+	}
+	std::chrono::duration<float, std::nano> handleTime = std::chrono::high_resolution_clock::now() - start;
+
+	paramBenchmarkString = stringTime.count() / iterations;
+	paramBenchmarkHandle = handleTime.count() / iterations;
+}
+
+// --------------------------------------------------------
+// Clear the screen, redraw everything, present to the user
+// --------------------------------------------------------
+void Game::Draw(float deltaTime, float totalTime)
+{
+	std::chrono::high_resolution_clock::time_point cpuStart = std::chrono::high_resolution_clock::now();
+	renderStats.Reset();
+	ISimpleShader::ResetUploadStats();
+
+	// ImGui and Present() changed the immediate context's
+	// state behind the cache's back last frame
+	stateCaches[0]->Invalidate();
+	for (auto& cache : stateCaches)
+		cache->ResetStats();
+
+	// Lights go to the GPU once, before anything that reads
+	// them is recorded (and after they're given their shadow
+	// atlas views), then are binned into clusters for the
+	// camera on the worker threads (idle until recording starts)
+	UpdateLocalShadows();
+	SelectShaderVariants(); // The atlas may have gained or lost its views
+	lightManager->Upload();
+	lightManager->BinLights(
+		camera[activeCamera]->GetView(),
+		camera[activeCamera]->GetProjection(),
+		camera[activeCamera]->GetNearClip(),
+		camera[activeCamera]->GetFarClip(),
+		workerPool.get());
+
+	// Cascades are fitted before culling, which tests casters against
+	// them, and after static batching, which invalidates their caches
+	UpdateDrawEntities();
+	UpdateShadowCascades();
+
+	//Culling, sorting and instance gathering
+	// - The GPU driven path culls on the GPU instead
+	if (!useGpuDriven) {
+		BuildRenderQueue();
+		BuildDrawPackets();
 	}
 
 	// Frame START
@@ -823,69 +2747,108 @@ void Game::Draw(float deltaTime, float totalTime)
 
 		// Clear the depth buffer (resets per-pixel occlusion information)
 		context->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-	}
-
-	//setting Ambien color for material
-	XMFLOAT3 ambientColor = XMFLOAT3(0.0f, 0.1f, 0.2f);
 
-	//Drawing shapes -A
-	for (int i = 0; i < 6; i++) {
-		shapes[i]->GetMaterial()->AddTextureSRV(
-			"ShadowMap",
-			shadowSRV);
-
-		shapes[i]->GetMaterial()->AddSampler(
-			"ShadowSampler",
-			shadowSampler);
-		shapes[i]->GetMaterial()->PrepareMaterial();
-
-		shapes[i]->GetMaterial()->GetVertexShader()->SetMatrix4x4(
-			"lightView",
-			lightViewMatrix);
-
-		shapes[i]->GetMaterial()->GetVertexShader()->SetMatrix4x4(
-			"lightProjection",
-			lightProjectionMatrix);
+		// Clear the post process target too, as the passes below
+		// may be recorded on other threads (shadow cascades are
+		// readied as their passes start, see BeginShadowTarget)
+		const float clearColor[4] = { 1.0,1.0,1.0,1.0 };
+		context->ClearRenderTargetView(ppRTV.Get(), clearColor);
 
+		// The G-buffer's colors needn't be cleared, as lighting
+		// skips every pixel its depth says wasn't drawn
+		if (useDeferred)
+			context->ClearDepthStencilView(gBuffer->GetDSV(), D3D11_CLEAR_DEPTH, 1.0f, 0);
 
-		shapes[i]->GetMaterial()->GetPixelShader()->SetData(
-			"directionalLight1",
-			&directionalLight1,
-			sizeof(Light));
+		gpuTimer->BeginFrame();
+	}
 
-		shapes[i]->GetMaterial()->GetPixelShader()->SetData(
-			"directionalLight2",
-			&directionalLight2,
-			sizeof(Light));
+	//Shadow map and shapes -A
+	{
+		std::chrono::high_resolution_clock::time_point submitStart = std::chrono::high_resolution_clock::now();
+
+		int threadCount = std::max(1, std::min(renderThreads, maxRenderThreads));
+		bool ringActive = useConstantRing && constantRing->IsSupported();
+		if (useGpuDriven) {
+			// Only the transforms of entities that moved since the
+			// last frame are re-uploaded
+			if (gpuSceneDirty) {
+				gpuScene->Build(drawEntities);
+				gpuSceneDirty = false;
+			}
+			else {
+				gpuScene->UpdateInstances(drawEntities);
+			}
 
-		shapes[i]->GetMaterial()->GetPixelShader()->SetData(
-			"directionalLight3",
-			&directionalLight3,
-			sizeof(Light));
+			XMFLOAT4X4 cameraView = camera[activeCamera]->GetView();
+			XMFLOAT4X4 cameraProjection = camera[activeCamera]->GetProjection();
+			XMFLOAT4X4 cameraViewProjection;
+			XMStoreFloat4x4(&cameraViewProjection,
+				XMLoadFloat4x4(&cameraView) * XMLoadFloat4x4(&cameraProjection));
 
-		shapes[i]->GetMaterial()->GetPixelShader()->SetData(
-			"pointLight1",
-			&pointLight1,
-			sizeof(Light));
+			for (unsigned int c = 0; c < shadowCascades->GetCascadeCount(); c++) {
+				if (shadowCascades->IsDrawn(c))
+					gpuScene->Cull(RENDER_PASS_SHADOW + c, shadowCascades->GetViewProjection(c));
+			}
+			gpuScene->Cull(RENDER_PASS_OPAQUE, cameraViewProjection);
+			for (unsigned int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+				if (!IsPassActive(pass))
+					continue;
+				if (pass == RENDER_PASS_OPAQUE)
+					PrefilterShadows();
+				gpuTimer->Start(pass);
+				BeginShadowTarget(pass);
+				BeginPass(pass, stateCaches[0].get());
+				SubmitGpuDrivenPass(pass);
+				gpuTimer->Stop(pass);
+			}
 
-		shapes[i]->GetMaterial()->GetPixelShader()->SetData(
-			"pointLight2",
-			&pointLight2,
-			sizeof(Light));
-		//set the ambient color
-		shapes[i]->GetMaterial()->GetPixelShader()->SetFloat3(
-			"ambientColor",
-			ambientColor);
+			// The GPU scene binds its buffers directly
+			stateCaches[0]->Invalidate();
+		}
+		else if (threadCount == 1 && !ringActive) {
+			for (unsigned int pass = 0; pass < RENDER_PASS_COUNT; pass++) {
+				if (!IsPassActive(pass))
+					continue;
+				if (pass == RENDER_PASS_OPAQUE)
+					PrefilterShadows();
+				gpuTimer->Start(pass);
+				BeginShadowTarget(pass);
+				BeginPass(pass, stateCaches[0].get());
+				SubmitPackets(pass, passStart[pass], passStart[pass + 1], stateCaches[0].get(), renderStats);
+				gpuTimer->Stop(pass);
+			}
+		}
+		else {
+			// Executing command lists resets the immediate context's
+			// state, so the opaque pass's targets are set again after
+			// - The ring has to be filled before it is uploaded,
+			//   so with it on even one thread records a list
+			RecordPassesThreaded(threadCount, ringActive ? constantRing.get() : 0);
+			BeginPass(RENDER_PASS_OPAQUE, stateCaches[0].get());
+		}
 
+		std::chrono::duration<float, std::milli> submitElapsed = std::chrono::high_resolution_clock::now() - submitStart;
+		submitTime = submitTime * 0.95f + submitElapsed.count() * 0.05f;
+		UpdateThreadBenchmark(submitElapsed.count());
+	}
 
-		shapes[i]->Draw(context, *camera[activeCamera]);
+	if (useDeferred) {
+		gpuTimer->Start(GPU_TIME_LIGHTING);
+		RunDeferredLighting();
+		DrawForwardAfterLighting();
+		gpuTimer->Stop(GPU_TIME_LIGHTING);
 	}
 
-	sky.Draw(camera[activeCamera]);
+	gpuTimer->Start(GPU_TIME_SKY_AND_POST);
+	sky.Draw(camera[activeCamera], stateCaches[0].get());
+	renderStats.drawCalls++;
 
 	//Post render
 	{
-		context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+		// The sky leaves front face culling on, which would cull
+		// the full screen triangle
+		stateCaches[0]->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), 0);
+		stateCaches[0]->RSSetState(0);
 
 		// Activate shaders and bind resources
 		// Also set any required cbuffer data (not shown)
@@ -898,8 +2861,26 @@ void Game::Draw(float deltaTime, float totalTime)
 		ppPS->SetShaderResourceView("Pixels", ppSRV.Get());
 		ppPS->SetSamplerState("ClampSampler", ppSampler.Get());
 		context->Draw(3, 0); // Draw exactly 3 vertices (one triangle)
+		renderStats.drawCalls++;
+	}
+	gpuTimer->Stop(GPU_TIME_SKY_AND_POST);
+	gpuTimer->EndFrame();
+	UpdateFilterBenchmark();
+
+	ISimpleShader::GetUploadStats(
+		renderStats.constantBytesUploaded,
+		renderStats.constantBuffersUploaded,
+		renderStats.constantBuffersSkipped,
+		renderStats.constantRingUploads);
+	for (auto& cache : stateCaches) {
+		renderStats.stateCallsIssued += cache->GetIssuedCount();
+		renderStats.stateCallsFiltered += cache->GetFilteredCount();
 	}
 
+	// CPU time spent building this frame's commands (excludes UI and Present)
+	std::chrono::duration<float, std::milli> cpuElapsed = std::chrono::high_resolution_clock::now() - cpuStart;
+	cpuDrawTime = cpuDrawTime * 0.95f + cpuElapsed.count() * 0.05f;
+
 	// Frame END
 	// - These should happen exactly ONCE PER FRAME
 	// - At the very end of the frame (after drawing *everything*)
@@ -4,6 +4,7 @@
 #include <DirectXMath.h>
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include <memory>
+#include <vector>
 #include "Mesh.h"
 #include "ImGui/imgui.h"
 #include "ImGui/imgui_impl_dx11.h"
@@ -14,6 +15,25 @@
 #include "Lights.h"
 #include "Sky.h"
 #include "PathHelpers.h"
+#include "InstanceBuffer.h"
+#include "RenderStats.h"
+#include "RenderQueue.h"
+#include "WorkerPool.h"
+#include "ConstantRing.h"
+#include "StateCache.h"
+#include "StateObjectCache.h"
+#include "GpuScene.h"
+#include "StaticBatcher.h"
+#include "ShaderVariants.h"
+#include "ShaderHotReload.h"
+#include "LightManager.h"
+#include "GBuffer.h"
+#include "GpuTimer.h"
+#include "ShadowCascades.h"
+#include "ShadowAtlas.h"
+#include "ShadowFilter.h"
+#include "SkyLighting.h"
+#include "LightProbeGrid.h"
 
 
 class Game
@@ -40,6 +60,88 @@ private:
 	void LoadSky();
 	void CreateShadows();
 	void PostProcessSetup();
+	void SpawnStressTest(int count);
+	void SpawnStressLights(int count);
+	void UpdateShadowCascades();
+	void UpdateLocalShadows();
+	void SetMaterialShadowMaps();
+	void UpdateDrawEntities();
+	void SetProbeLighting();
+
+	// A single draw built from a run of render queue items that
+	// need exactly the same state.  Instanced packets cover the
+	// whole run, otherwise there is one packet per entity.
+	struct DrawPacket
+	{
+		GameEntity* entity;			// The (first) entity drawn
+		bool instanced;
+		unsigned int firstInstance;	// Only used when instanced
+		unsigned int instanceCount;
+		unsigned int shadowView;	// Only used by the atlas shadow pass
+	};
+
+	// Drawing helpers
+	void BuildRenderQueue();
+	void BuildDrawPackets();
+	void BeginPass(unsigned int pass, StateCache* target);
+	void SubmitPackets(
+		unsigned int pass,
+		unsigned int firstPacket,
+		unsigned int lastPacket,
+		StateCache* target,
+		RenderStats& stats,
+		bool forward = false);
+	void RecordPassesThreaded(unsigned int threadCount, ConstantRing* ring);
+	void SubmitGpuDrivenPass(unsigned int pass, bool forward = false);
+	void UpdateThreadBenchmark(float submitMs);
+	void UpdateFilterBenchmark();
+	void SetScenePixelData(std::shared_ptr<SimplePixelShader> ps);
+	void ResolveShaderParams();
+	void RunParamBenchmark();
+	void SelectShaderVariants();
+	void WatchShaders();
+	void RunDeferredLighting();
+	void DrawForwardAfterLighting();
+	bool IsPassActive(unsigned int pass);
+	void BeginShadowTarget(unsigned int pass);
+	void PrefilterShadows();
+	CBuffers::PixelShader::ShadowData GetShadowData();
+	CBuffers::PixelShader::AmbientData GetAmbientData();
+	static unsigned int GetTextureFeatures(Material* material);
+	static unsigned int GetGBufferTextureMask(Material* material);
+
+	// Handles for the variables set while drawing the scene,
+	// found once per shader and indexed by the shader's ID
+	struct SceneVSParams
+	{
+		ShaderParam world;
+		ShaderParam worldInvTranspose;
+		ShaderParam view;
+		ShaderParam projection;
+		ShaderParam lightView;
+		ShaderParam lightProjection;
+	};
+	struct ScenePSParams
+	{
+		ShaderParam colorTint;
+		ShaderParam roughness;
+		ShaderParam cameraPos;
+		ShaderParam globalLightCount;
+		ShaderParam shadowLightIndex;
+		ShaderParam cameraForward;
+		ShaderParam lightDebugView;
+		ShaderParam clusterCounts;
+		ShaderParam clusterDepthScale;
+		ShaderParam clusterTileScale;
+		ShaderParam clusterDepthBias;
+		ShaderParam perFrame; // Only for shaders built from PixelShader.hlsl
+		ShaderParam textureMask; // Only for GBufferPS.hlsl
+		ShaderParam shadowData; // Only for shaders built from PixelShader.hlsl with shadows
+		ShaderParam ambientData; // Only for shaders built from PixelShader.hlsl
+		bool gBuffer; // GBufferPS can draw it instead (PixelShader.hlsl's variants)
+	};
+	std::vector<SceneVSParams> vsParams;
+	std::vector<ScenePSParams> psParams;
 
 	// Note the usage of ComPtr below
 	//  - This is a smart pointer for objects that abide by the
@@ -59,13 +161,36 @@ private:
 	std::shared_ptr<SimplePixelShader> skyPS;
 	//Shadow shader
 	std::shared_ptr<SimpleVertexShader> shadowVS;
+	//Instanced versions of the scene and shadow vertex shaders
+	std::shared_ptr<SimpleVertexShader> instancedVS;
+	std::shared_ptr<SimpleVertexShader> instancedShadowVS;
+	//GPU driven shaders
+	std::shared_ptr<SimpleVertexShader> gpuDrivenVS;
+	std::shared_ptr<SimpleVertexShader> gpuDrivenShadowVS;
+	std::shared_ptr<SimpleComputeShader> cullCS;
 	
 	//Post process shaders
 	std::shared_ptr<SimpleVertexShader> ppVS;
 	std::shared_ptr<SimplePixelShader> ppPS;
+	//Deferred shading shaders
+	std::shared_ptr<SimplePixelShader> gBufferPS;
+	std::shared_ptr<SimpleComputeShader> deferredLightingCS;
+	//EVSM moment shaders (see ShadowFilter)
+	std::shared_ptr<SimpleComputeShader> shadowMomentsCS;
+	std::shared_ptr<SimpleComputeShader> shadowBlurCS;
+	//Sky lighting shaders (see SkyLighting)
+	std::shared_ptr<SimpleComputeShader> skyCaptureCS;
+	std::shared_ptr<SimpleComputeShader> specularPrefilterCS;
+	std::shared_ptr<SimpleComputeShader> brdfLutCS;
 
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
-	std::shared_ptr<GameEntity> shapes[6];
+	// The first sceneShapeCount entities are the shapes editable in the UI,
+	// anything after that was added by the stress test
+	std::vector<std::shared_ptr<GameEntity>> entities;
+	// What actually gets drawn: the non-static entities followed
+	// by the static batch chunks (see UpdateDrawEntities)
+	std::vector<std::shared_ptr<GameEntity>> drawEntities;
+	static const int sceneShapeCount = 6;
 	float translation[5][3] = {
 		{ 0.0f,0.0f ,0.0f },
 		{ 0.0f,0.0f ,0.0f } ,
@@ -98,6 +223,11 @@ private:
 	std::shared_ptr<Material> mat5;
 	std::shared_ptr<Material> mat6;
 
+	//Pixel shader variants for the lit materials above (see SelectShaderVariants())
+	std::shared_ptr<ShaderVariants> pixelVariants;
+	std::vector<std::shared_ptr<Material>> litMaterials;
+	unsigned int sceneShaderFeatures = 0xFFFFFFFF; // Light and shadow features last selected for
+
 	//Variables for shape movement
 	bool going = true;
 	int counter = 0;
@@ -105,30 +235,156 @@ private:
 	std::shared_ptr<Camera> camera[3];
 	int activeCamera = 0;
 
-	Light directionalLight1;
-	Light directionalLight2;
-	Light directionalLight3;
-	Light pointLight1;
-	Light pointLight2;
+	//Every light, in a structured buffer the pixel shader loops over
+	std::shared_ptr<LightManager> lightManager;
+	unsigned int sceneLightCount = 0; // Lights set up in Init(), before any spawned ones
+	int shadowLightIndex = 1; // The light the shadow map is rendered from
+	int stressLightCount = 200;
+	bool useClusteredLighting = true;
+	int lightDebugView = 0; // One of LIGHT_DEBUG_* in PixelShader.hlsl
 
 	//Skybox Variables
+	std::shared_ptr<StateObjectCache> stateObjects; // Every rasterizer, depth, blend and sampler state
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srvSky;
 	std::shared_ptr<Mesh> skyMesh;
 	Sky sky;
 
+	//Ambient light from the sky, built from its cubemap (or
+	// loaded from the cache of it) whenever the sky changes
+	std::shared_ptr<SkyLighting> skyLighting;
+	std::vector<std::wstring> skyFaces; // The files the sky was made from
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> ambientSampler;
+	float ambientDiffuse = 1.0f;
+	float ambientSpecular = 1.0f;
+
+	//Baked diffuse ambient light over the static entities, which
+	// replaces the sky's inside the grid (see LightProbeGrid.h)
+	std::shared_ptr<LightProbeGrid> lightProbes;
+	bool useLightProbes = true;
+	float probeNormalBias = 0.25f; // In probe spacings
+
 	//Shadow variables
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV;
+	// - The cascades are refitted to the active camera every frame
+	std::shared_ptr<ShadowCascades> shadowCascades;
+	bool cacheStaticShadows = true; // Not with the GPU driven path, which can't tell static casters apart
+
+	// Point and spot light shadows, packed into one atlas each
+	// frame (see UpdateLocalShadows) - not in the GPU driven path,
+	// which draws a whole pass with one set of matrices
+	struct LocalShadow
+	{
+		unsigned int lightIndex;
+		unsigned int viewCount;	// Six for point lights, one for spot lights
+		unsigned int size;		// Texels per side of each view's tile
+		float importance;
+		int firstView;			// In the atlas
+		unsigned int casters;	// Draws into all its views this frame
+	};
+	std::shared_ptr<ShadowAtlas> shadowAtlas;
+	std::vector<LocalShadow> localShadows;
+	std::vector<DirectX::BoundingFrustum> atlasFrustums; // Per atlas view, world space
+	std::vector<int> lightShadowViews; // Per light, scratch for UpdateLocalShadows
+	int maxLocalShadows = 8;
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
-	DirectX::XMFLOAT4X4 lightViewMatrix;
-	DirectX::XMFLOAT4X4 lightProjectionMatrix;
-	int shadowMapResolution = 1024;
+
+	// How every shadow map is filtered, and EVSM's moments
+	std::shared_ptr<ShadowFilter> shadowFilter;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> momentSampler;
+
+	//Shadow filter benchmark (-1 when not running): each mode in
+	// turn, for the GPU time of filtering plus shading with it
+	int filterBenchmarkMode = -1;
+	int filterBenchmarkFrame = 0;
+	float filterBenchmarkTotal = 0.0f;
+	unsigned int filterBenchmarkRestore = 0; // The mode to go back to
+	float filterBenchmarkResults[SHADOW_FILTER_COUNT] = {};
 
 	//Post Process Variables
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> ppSampler;
 	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ppRTV; // For rendering
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ppSRV; // For sampling
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> ppUAV; // For deferred lighting to write
 	int blurAmount;
+
+	//Instancing and draw sorting variables
+	std::shared_ptr<InstanceBuffer> instanceBuffer;
+	RenderQueue renderQueue;
+	std::vector<DrawPacket> drawPackets;
+	unsigned int passStart[RENDER_PASS_COUNT + 1] = {}; // First packet of each pass
+	std::vector<DirectX::BoundingBox> worldBounds; // Per draw entity (BuildRenderQueue)
+	std::vector<DirectX::BoundingBox> lightSpaceBounds; // Per draw entity, in the shadow light's view (BuildRenderQueue)
+	bool useInstancing = true;
+
+	//Multithreaded recording variables
+	// - Thread t records into deferredContexts[t], producing one
+	//   command list per pass at commandLists[pass * maxRenderThreads + t]
+	std::shared_ptr<WorkerPool> workerPool;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11DeviceContext>> deferredContexts;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11CommandList>> commandLists;
+	std::vector<RenderStats> threadStats;
+	std::vector<std::shared_ptr<StateCache>> stateCaches; // Per shader slot: 0 is the immediate context, t + 1 deferredContexts[t]
+	int renderThreads = 1; // 1 records on the immediate context
+	int maxRenderThreads = 1;
+	bool driverCommandLists = false;
+	float submitTime = 0.0f; // Smoothed, in milliseconds
+
+	//Thread count benchmark (0 when not running)
+	int benchmarkThreads = 0;
+	int benchmarkFrame = 0;
+	float benchmarkTotal = 0.0f;
+	std::vector<float> benchmarkResults; // Average submit ms at 1, 2, ... threads
+
+	//Constant ring, for the command list paths only (see Draw())
+	std::shared_ptr<ConstantRing> constantRing;
+	bool useConstantRing = true;
+
+	//Shader parameter benchmark results, in nanoseconds per set
+	float paramBenchmarkString = 0.0f;
+	float paramBenchmarkHandle = 0.0f;
+
+	//Time taken by the last LoadShaders(), in milliseconds
+	float shaderLoadTime = 0.0f;
+
+	//Recompiles shaders as their source is edited (see WatchShaders())
+	std::shared_ptr<ShaderHotReload> hotReload;
+
+	//GPU driven rendering variables
+	std::shared_ptr<GpuScene> gpuScene;
+	bool useGpuDriven = false;
+	bool gpuSceneDirty = true; // Entities were added/removed since the last Build()
+
+	//Deferred shading variables
+	// - The opaque pass fills the G-buffer instead of lighting,
+	//   then RunDeferredLighting() lights it into the post process target
+	std::shared_ptr<GBuffer> gBuffer;
+	bool useDeferred = false;
+
+	//Parts of the frame timed on the GPU - the passes come
+	// first, so each pass is timed as its own section
+	enum GpuTimeSection
+	{
+		GPU_TIME_STATIC_SHADOW = RENDER_PASS_STATIC_SHADOW, // The first cascade's cache, the rest follow
+		GPU_TIME_SHADOW = RENDER_PASS_SHADOW,	// The first cascade, the rest follow
+		GPU_TIME_ATLAS_SHADOW = RENDER_PASS_ATLAS_SHADOW,
+		GPU_TIME_OPAQUE = RENDER_PASS_OPAQUE,	// Forward lighting, or filling the G-buffer
+		GPU_TIME_LIGHTING = RENDER_PASS_COUNT,	// Deferred only
+		GPU_TIME_SHADOW_FILTER,					// EVSM only
+		GPU_TIME_SKY_AND_POST,
+		GPU_TIME_SECTION_COUNT
+	};
+	std::shared_ptr<GpuTimer> gpuTimer;
+
+	//Static batching variables
+	std::shared_ptr<StaticBatcher> staticBatcher;
+	bool useStaticBatching = true;
+	bool staticSetDirty = true; // Static entities were added, removed or changed
+	bool stressTestStatic = true;
+
+	//Stress test and stats variables
+	std::shared_ptr<Mesh> cubeMesh;
+	int stressTestCount = 10000;
+	RenderStats renderStats;
+	float cpuDrawTime = 0.0f; // Smoothed, in milliseconds
 };
\ No newline at end of file
@@ -6,6 +6,7 @@ GameEntity::GameEntity(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> mat
 	this->material = material;
 	this->mesh->SetTint(material->GetTint().x, material->GetTint().y, material->GetTint().z, material->GetTint().w);
 	this->transform = std::make_shared<Transform>();
+	this->isStatic = false;
 }
 
 GameEntity::~GameEntity()
@@ -32,6 +33,28 @@ void GameEntity::SetMaterial(std::shared_ptr<Material> newMat)
 	this->material = newMat;
 }
 
+bool GameEntity::IsStatic()
+{
+	return isStatic;
+}
+
+void GameEntity::SetStatic(bool isStatic)
+{
+	this->isStatic = isStatic;
+}
+
+// --------------------------------------------------------
+// The mesh's bounds moved into world space by this
+// entity's current transform
+// --------------------------------------------------------
+DirectX::BoundingBox GameEntity::GetWorldBounds()
+{
+	DirectX::XMFLOAT4X4 world = transform->GetWorldMatrix();
+	DirectX::BoundingBox worldBounds;
+	mesh->GetBounds().Transform(worldBounds, DirectX::XMLoadFloat4x4(&world));
+	return worldBounds;
+}
+
 void GameEntity::Draw(
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
 	Camera camera)
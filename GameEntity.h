@@ -17,6 +17,9 @@ public:
 	std::shared_ptr<Transform> GetTransform();
 	std::shared_ptr<Material> GetMaterial();
 	void SetMaterial(std::shared_ptr<Material> newMat);
+	DirectX::BoundingBox GetWorldBounds();
+	bool IsStatic();
+	void SetStatic(bool isStatic);
 	void Draw(
 		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
 		Camera camera);
@@ -25,5 +28,6 @@ private:
 	std::shared_ptr<Transform> transform;
 	std::shared_ptr<Mesh> mesh;
 	std::shared_ptr<Material> material;
+	bool isStatic; // Never moves, so may be merged into a static batch
 };
 
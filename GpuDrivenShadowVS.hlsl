@@ -0,0 +1,29 @@
+#include "GpuScene.hlsli"
+
+// Constant Buffer for external (C++) data
+cbuffer PerPass : register(b0)
+{
+    matrix view;
+    matrix projection;
+};
+
+StructuredBuffer<GpuVertex> VertexPool : register(t0);
+StructuredBuffer<GpuInstance> Instances : register(t1);
+
+struct VertexShaderInput
+{
+    uint vertexId   : SV_VertexID;
+    uint instanceId : INSTANCEID_PER_INSTANCE;
+};
+
+// --------------------------------------------------------
+// GPU driven version of ShadowVS.hlsl
+// --------------------------------------------------------
+float4 main(VertexShaderInput input) : SV_POSITION
+{
+    GpuVertex vertex = VertexPool[input.vertexId];
+    GpuInstance instance = Instances[input.instanceId];
+
+    matrix wvp = mul(projection, mul(view, instance.world));
+    return mul(wvp, float4(vertex.position, 1.0f));
+}
@@ -0,0 +1,70 @@
+#include "Include.hlsli"
+#include "GpuScene.hlsli"
+
+// Constant buffer - only data shared by every instance lives here
+cbuffer PerFrame : register(b0)
+{
+    matrix lightView;
+    matrix lightProjection;
+}
+
+cbuffer PerPass : register(b1)
+{
+    matrix view;
+    matrix projection;
+}
+
+// Geometry and instances are pulled from structured buffers
+StructuredBuffer<GpuVertex> VertexPool : register(t0);
+StructuredBuffer<GpuInstance> Instances : register(t1);
+
+// Nothing comes from a vertex buffer except the instance's ID,
+// which the cull shader wrote into a buffer bound to slot 1
+// - The indices were rebased when the pool was built, so the
+//   vertex ID is the vertex's position in the pool
+struct VertexShaderInput
+{
+    uint vertexId   : SV_VertexID;
+    uint instanceId : INSTANCEID_PER_INSTANCE;
+};
+
+// Must match the output of VertexShader.hlsl, as both are
+// used with the same pixel shaders
+struct VertexToPixel
+{
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+    float4 screenPosition	: SV_POSITION; // XYZW position (System Value Position)
+    float2 uv				: TEXCOORD;
+    float3 normal			: NORMAL;
+    float3 worldPosition	: POSITION;
+    float3 tangent			: TANGENT;
+    float4 shadowMapPos		: SHADOW_POSITION;
+};
+
+// --------------------------------------------------------
+// GPU driven version of VertexShader.hlsl
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput input)
+{
+    GpuVertex vertex = VertexPool[input.vertexId];
+    GpuInstance instance = Instances[input.instanceId];
+
+    VertexToPixel output;
+
+    matrix wvp = mul(projection, mul(view, instance.world));
+    output.screenPosition = mul(wvp, float4(vertex.position, 1.0f));
+
+    output.uv = vertex.uv;
+    output.normal = mul((float3x3) instance.worldInvTranspose, vertex.normal);
+    output.worldPosition = mul(instance.world, float4(vertex.position, 1)).xyz;
+    output.tangent = mul((float3x3) instance.world, vertex.tangent);
+
+    matrix shadowWVP = mul(lightProjection, mul(lightView, instance.world));
+    output.shadowMapPos = mul(shadowWVP, float4(vertex.position, 1.0f));
+
+    return output;
+}
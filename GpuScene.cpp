@@ -0,0 +1,354 @@
+#include "GpuScene.h"
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+using namespace DirectX;
+
+// Size of D3D11's indexed indirect draw arguments, in uints
+#define DRAW_ARGS_SIZE 5
+
+GpuScene::GpuScene(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<SimpleComputeShader> cullShader)
+	:
+	device(device),
+	context(context),
+	cullShader(cullShader),
+	instanceCount(0)
+{
+}
+
+GpuScene::~GpuScene()
+{
+}
+
+// --------------------------------------------------------
+// (Re)creates every buffer from the given entities.  This
+// walks every entity, so it's only meant to be called when
+// entities are added or removed, or change mesh or material.
+// --------------------------------------------------------
+void GpuScene::Build(const std::vector<std::shared_ptr<GameEntity>>& entities)
+{
+	slots.clear();
+	instances.clear();
+	generations.clear();
+	instanceCount = (unsigned int)entities.size();
+	if (instanceCount == 0)
+		return;
+
+	// Find the unique meshes, and count the entities using each
+	// mesh/material pair.  The map is keyed by material first,
+	// so slots sharing a material end up next to each other.
+	std::vector<Mesh*> meshes;
+	std::unordered_map<Mesh*, unsigned int> meshIndices;
+	std::map<std::pair<unsigned int, unsigned int>, unsigned int> slotIndices;
+	for (auto& e : entities)
+	{
+		Mesh* mesh = e->GetMesh().get();
+		if (meshIndices.find(mesh) == meshIndices.end())
+		{
+			meshIndices[mesh] = (unsigned int)meshes.size();
+			meshes.push_back(mesh);
+		}
+
+		std::pair<unsigned int, unsigned int> key(e->GetMaterial()->GetId(), mesh->GetId());
+		if (slotIndices.find(key) == slotIndices.end())
+		{
+			GpuDrawSlot slot = {};
+			slot.mesh = mesh;
+			slot.material = e->GetMaterial().get();
+			slot.meshIndex = meshIndices[mesh];
+			slotIndices[key] = (unsigned int)slots.size();
+			slots.push_back(slot);
+		}
+		slots[slotIndices[key]].instanceCount++;
+	}
+
+	// Reorder the slots to match the map, then give each a
+	// range of IDs the size of its total instance count
+	std::vector<GpuDrawSlot> sortedSlots;
+	for (auto& s : slotIndices)
+	{
+		unsigned int unsortedIndex = s.second;
+		s.second = (unsigned int)sortedSlots.size();
+		sortedSlots.push_back(slots[unsortedIndex]);
+	}
+	slots.swap(sortedSlots);
+
+	unsigned int nextInstance = 0;
+	for (auto& slot : slots)
+	{
+		slot.firstInstance = nextInstance;
+		nextInstance += slot.instanceCount;
+	}
+
+	// Instance table, in entity order so UpdateInstances()
+	// can find an entity's entry by its index
+	instances.resize(instanceCount);
+	generations.resize(instanceCount);
+	for (unsigned int i = 0; i < instanceCount; i++)
+	{
+		std::shared_ptr<GameEntity> e = entities[i];
+		std::shared_ptr<Transform> transform = e->GetTransform();
+		generations[i] = transform->GetGeneration();
+		instances[i].world = transform->GetWorldMatrix();
+		instances[i].worldInvTranspose = transform->GetWorldInverseTransposeMatrix();
+		instances[i].meshIndex = meshIndices[e->GetMesh().get()];
+		instances[i].drawSlot = slotIndices[{ e->GetMaterial()->GetId(), e->GetMesh()->GetId() }];
+	}
+
+	// Geometry pool and mesh table
+	// - Indices are offset by the mesh's first vertex, so every
+	//   draw can use a base vertex of zero and SV_VertexID is
+	//   the vertex's index in the pool
+	std::vector<Vertex> poolVertices;
+	std::vector<unsigned int> poolIndices;
+	std::vector<GpuMesh> meshTable(meshes.size());
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const std::vector<Vertex>& verts = meshes[m]->GetVertices();
+		const std::vector<unsigned int>& inds = meshes[m]->GetIndices();
+		unsigned int baseVertex = (unsigned int)poolVertices.size();
+
+		BoundingBox bounds = meshes[m]->GetBounds();
+		meshTable[m].boundsCenter = bounds.Center;
+		meshTable[m].boundsExtents = bounds.Extents;
+		meshTable[m].indexCount = (unsigned int)inds.size();
+		meshTable[m].startIndex = (unsigned int)poolIndices.size();
+
+		poolVertices.insert(poolVertices.end(), verts.begin(), verts.end());
+		for (unsigned int index : inds)
+			poolIndices.push_back(index + baseVertex);
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexPool, meshTableBuffer;
+	CreateStructuredBuffer(&poolVertices[0], sizeof(Vertex), (unsigned int)poolVertices.size(), vertexPool, vertexPoolSRV);
+	CreateStructuredBuffer(&meshTable[0], sizeof(GpuMesh), (unsigned int)meshTable.size(), meshTableBuffer, meshTableSRV);
+	CreateStructuredBuffer(&instances[0], sizeof(GpuInstance), instanceCount, instanceTable, instanceTableSRV);
+
+	D3D11_BUFFER_DESC ibd = {};
+	ibd.Usage = D3D11_USAGE_IMMUTABLE;
+	ibd.ByteWidth = sizeof(unsigned int) * (unsigned int)poolIndices.size();
+	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	D3D11_SUBRESOURCE_DATA indexData = {};
+	indexData.pSysMem = &poolIndices[0];
+	indexPool.Reset();
+	device->CreateBuffer(&ibd, &indexData, indexPool.GetAddressOf());
+
+	// Indirect args, which only need their instance counts
+	// reset each frame - everything else is fixed
+	std::vector<unsigned int> args(slots.size() * DRAW_ARGS_SIZE);
+	for (size_t s = 0; s < slots.size(); s++)
+	{
+		GpuMesh& mesh = meshTable[slots[s].meshIndex];
+		unsigned int* slotArgs = &args[s * DRAW_ARGS_SIZE];
+		slotArgs[0] = mesh.indexCount;			// IndexCountPerInstance
+		slotArgs[1] = 0;						// InstanceCount, filled by the cull
+		slotArgs[2] = mesh.startIndex;			// StartIndexLocation
+		slotArgs[3] = 0;						// BaseVertexLocation
+		slotArgs[4] = slots[s].firstInstance;	// StartInstanceLocation
+	}
+
+	D3D11_BUFFER_DESC abd = {};
+	abd.Usage = D3D11_USAGE_DEFAULT;
+	abd.ByteWidth = sizeof(unsigned int) * (unsigned int)args.size();
+	abd.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+	D3D11_SUBRESOURCE_DATA argsData = {};
+	argsData.pSysMem = &args[0];
+	argsTemplate.Reset();
+	device->CreateBuffer(&abd, &argsData, argsTemplate.GetAddressOf());
+
+	// The static shadow cache and the shadow atlas are only
+	// drawn by the CPU culled paths
+	for (unsigned int pass = 0; pass < RENDER_PASS_COUNT; pass++)
+	{
+		if (IsStaticShadowPass(pass) || pass == RENDER_PASS_ATLAS_SHADOW)
+			continue;
+		CreateUintUAVBuffer(&args[0], (unsigned int)args.size(), 0, D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS, drawArgs[pass], drawArgsUAV[pass]);
+		CreateUintUAVBuffer(0, instanceCount, D3D11_BIND_VERTEX_BUFFER, 0, visibleIds[pass], visibleIdsUAV[pass]);
+	}
+}
+
+// --------------------------------------------------------
+// Re-uploads the transforms of the entities that moved since
+// they were last uploaded, by their Transform's generation,
+// one upload per run of neighbouring entities.  They must be
+// the same entities (with the same meshes and materials) as
+// when Build() was last called.
+// --------------------------------------------------------
+void GpuScene::UpdateInstances(const std::vector<std::shared_ptr<GameEntity>>& entities)
+{
+	unsigned int count = (std::min)(instanceCount, (unsigned int)entities.size());
+	unsigned int i = 0;
+	while (i < count)
+	{
+		if (entities[i]->GetTransform()->GetGeneration() == generations[i])
+		{
+			i++;
+			continue;
+		}
+
+		unsigned int first = i;
+		for (; i < count; i++)
+		{
+			std::shared_ptr<Transform> transform = entities[i]->GetTransform();
+			unsigned int generation = transform->GetGeneration();
+			if (generation == generations[i])
+				break;
+			generations[i] = generation;
+			instances[i].world = transform->GetWorldMatrix();
+			instances[i].worldInvTranspose = transform->GetWorldInverseTransposeMatrix();
+		}
+
+		D3D11_BOX box = {};
+		box.left = first * sizeof(GpuInstance);
+		box.right = i * sizeof(GpuInstance);
+		box.bottom = 1;
+		box.back = 1;
+		context->UpdateSubresource(instanceTable.Get(), 0, &box, &instances[first], 0, 0);
+	}
+}
+
+// --------------------------------------------------------
+// Culls every instance against a view's frustum on the GPU,
+// filling the pass's draw args and visible instance IDs
+//
+// viewProjection - The view matrix times the projection
+// --------------------------------------------------------
+void GpuScene::Cull(unsigned int pass, XMFLOAT4X4 viewProjection)
+{
+	if (instanceCount == 0)
+		return;
+
+	// The ID buffer may still be bound for drawing from last frame
+	ID3D11Buffer* nullBuffer = 0;
+	UINT zero = 0;
+	context->IASetVertexBuffers(1, 1, &nullBuffer, &zero, &zero);
+
+	// Zero the instance counts
+	context->CopyResource(drawArgs[pass].Get(), argsTemplate.Get());
+
+	// Frustum planes from the columns of the matrix, facing inwards
+	XMMATRIX columns = XMMatrixTranspose(XMLoadFloat4x4(&viewProjection));
+	XMVECTOR planeVectors[6] = {
+		columns.r[3] + columns.r[0], // Left
+		columns.r[3] - columns.r[0], // Right
+		columns.r[3] + columns.r[1], // Bottom
+		columns.r[3] - columns.r[1], // Top
+		columns.r[2],				 // Near
+		columns.r[3] - columns.r[2], // Far
+	};
+	XMFLOAT4 planes[6];
+	for (int p = 0; p < 6; p++)
+		XMStoreFloat4(&planes[p], XMPlaneNormalize(planeVectors[p]));
+
+	cullShader->SetShader();
+	cullShader->SetData("frustumPlanes", planes, sizeof(planes));
+	cullShader->SetData("instanceCount", &instanceCount, sizeof(unsigned int));
+	cullShader->CopyAllBufferData();
+	cullShader->SetShaderResourceView("Instances", instanceTableSRV);
+	cullShader->SetShaderResourceView("Meshes", meshTableSRV);
+	cullShader->SetUnorderedAccessView("DrawArgs", drawArgsUAV[pass]);
+	cullShader->SetUnorderedAccessView("VisibleIds", visibleIdsUAV[pass]);
+	cullShader->DispatchByThreads(instanceCount, 1, 1);
+
+	// Unbind the outputs so they can be used to draw
+	ID3D11UnorderedAccessView* nullUAVs[2] = {};
+	context->CSSetUnorderedAccessViews(0, 2, nullUAVs, 0);
+}
+
+// --------------------------------------------------------
+// Binds the geometry pool, tables and the pass's visible
+// instance IDs for drawing with a GPU driven vertex shader
+// --------------------------------------------------------
+void GpuScene::BindGeometry(unsigned int pass, std::shared_ptr<SimpleVertexShader> vs)
+{
+	if (instanceCount == 0)
+		return;
+
+	// Slot 0 is unused, as vertices come from the pool
+	ID3D11Buffer* buffers[2] = { 0, visibleIds[pass].Get() };
+	UINT strides[2] = { 0, sizeof(unsigned int) };
+	UINT offsets[2] = { 0, 0 };
+	context->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	context->IASetIndexBuffer(indexPool.Get(), DXGI_FORMAT_R32_UINT, 0);
+
+	vs->SetShaderResourceView("VertexPool", vertexPoolSRV);
+	vs->SetShaderResourceView("Instances", instanceTableSRV);
+}
+
+void GpuScene::DrawSlot(unsigned int pass, unsigned int slot)
+{
+	context->DrawIndexedInstancedIndirect(drawArgs[pass].Get(), slot * DRAW_ARGS_SIZE * sizeof(unsigned int));
+}
+
+unsigned int GpuScene::GetSlotCount() { return (unsigned int)slots.size(); }
+const GpuDrawSlot& GpuScene::GetSlot(unsigned int slot) { return slots[slot]; }
+unsigned int GpuScene::GetInstanceCount() { return instanceCount; }
+
+// --------------------------------------------------------
+// Creates a default usage structured buffer and its SRV
+// --------------------------------------------------------
+void GpuScene::CreateStructuredBuffer(
+	const void* data,
+	unsigned int stride,
+	unsigned int count,
+	Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.ByteWidth = stride * count;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = stride;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = data;
+
+	buffer.Reset();
+	srv.Reset();
+	device->CreateBuffer(&desc, &initialData, buffer.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = count;
+	device->CreateShaderResourceView(buffer.Get(), &srvDesc, srv.GetAddressOf());
+}
+
+// --------------------------------------------------------
+// Creates a buffer of uints with a typed (R32_UINT) UAV,
+// which can also be bound however bindFlags/miscFlags say
+// --------------------------------------------------------
+void GpuScene::CreateUintUAVBuffer(
+	const void* data,
+	unsigned int count,
+	unsigned int bindFlags,
+	unsigned int miscFlags,
+	Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>& uav)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.ByteWidth = sizeof(unsigned int) * count;
+	desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | bindFlags;
+	desc.MiscFlags = miscFlags;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = data;
+
+	buffer.Reset();
+	uav.Reset();
+	device->CreateBuffer(&desc, data ? &initialData : 0, buffer.GetAddressOf());
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+	uavDesc.Format = DXGI_FORMAT_R32_UINT;
+	uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	uavDesc.Buffer.FirstElement = 0;
+	uavDesc.Buffer.NumElements = count;
+	device->CreateUnorderedAccessView(buffer.Get(), &uavDesc, uav.GetAddressOf());
+}
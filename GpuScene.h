@@ -0,0 +1,118 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+#include "GameEntity.h"
+#include "SimpleShader.h"
+#include "RenderQueue.h"
+
+// --------------------------------------------------------
+// GPU side structs - each must match its HLSL version
+// in GpuScene.hlsli
+// --------------------------------------------------------
+struct GpuInstance
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInvTranspose;
+	unsigned int meshIndex;
+	unsigned int drawSlot;
+	unsigned int padding[2];
+};
+
+struct GpuMesh
+{
+	DirectX::XMFLOAT3 boundsCenter;
+	unsigned int indexCount;
+	DirectX::XMFLOAT3 boundsExtents;
+	unsigned int startIndex;
+};
+
+// --------------------------------------------------------
+// One indirect draw: every instance of one mesh using one
+// material.  Its instances own the ID range
+// [firstInstance, firstInstance + instanceCount), which the
+// cull shader fills with only the visible ones.
+// --------------------------------------------------------
+struct GpuDrawSlot
+{
+	Mesh* mesh;
+	Material* material;
+	unsigned int meshIndex;
+	unsigned int firstInstance;
+	unsigned int instanceCount;
+};
+
+// --------------------------------------------------------
+// The scene as the GPU driven path sees it: all geometry in
+// one pool, all entities in an instance table, and for each
+// pass a compute cull that writes indirect draw arguments,
+// so drawing a pass costs one draw per slot on the CPU no
+// matter how many entities there are
+// --------------------------------------------------------
+class GpuScene
+{
+public:
+	GpuScene(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<SimpleComputeShader> cullShader);
+	~GpuScene();
+
+	// Scene changes
+	void Build(const std::vector<std::shared_ptr<GameEntity>>& entities);
+	void UpdateInstances(const std::vector<std::shared_ptr<GameEntity>>& entities);
+
+	// Per pass work
+	void Cull(unsigned int pass, DirectX::XMFLOAT4X4 viewProjection);
+	void BindGeometry(unsigned int pass, std::shared_ptr<SimpleVertexShader> vs);
+	void DrawSlot(unsigned int pass, unsigned int slot);
+
+	unsigned int GetSlotCount();
+	const GpuDrawSlot& GetSlot(unsigned int slot);
+	unsigned int GetInstanceCount();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<SimpleComputeShader> cullShader;
+
+	std::vector<GpuDrawSlot> slots;
+	unsigned int instanceCount;
+	std::vector<GpuInstance> instances; // CPU copy, reused by UpdateInstances()
+	std::vector<unsigned int> generations; // Each entity's Transform generation, as last uploaded
+
+	// Geometry pool
+	Microsoft::WRL::ComPtr<ID3D11Buffer> indexPool;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> vertexPoolSRV;
+
+	// Tables
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceTable;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> instanceTableSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> meshTableSRV;
+
+	// Indirect args with every instance count at zero,
+	// copied over each pass's args before it is culled
+	Microsoft::WRL::ComPtr<ID3D11Buffer> argsTemplate;
+
+	// Written by each pass's cull
+	Microsoft::WRL::ComPtr<ID3D11Buffer> drawArgs[RENDER_PASS_COUNT];
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> drawArgsUAV[RENDER_PASS_COUNT];
+	Microsoft::WRL::ComPtr<ID3D11Buffer> visibleIds[RENDER_PASS_COUNT];
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> visibleIdsUAV[RENDER_PASS_COUNT];
+
+	void CreateStructuredBuffer(
+		const void* data,
+		unsigned int stride,
+		unsigned int count,
+		Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv);
+	void CreateUintUAVBuffer(
+		const void* data,
+		unsigned int count,
+		unsigned int bindFlags,
+		unsigned int miscFlags,
+		Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer,
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView>& uav);
+};
@@ -0,0 +1,40 @@
+#ifndef __GGP_GPU_SCENE_INCLUDES__
+#define __GGP_GPU_SCENE_INCLUDES__
+
+// Shared by the GPU driven cull and vertex shaders
+// - Each struct must match its C++ version in GpuScene.h
+
+// One vertex in the shared geometry pool (the Vertex struct in C++)
+struct GpuVertex
+{
+    float3 position;
+    float3 normal;
+    float3 tangent;
+    float2 uv;
+};
+
+// Per instance data, one entry per entity
+struct GpuInstance
+{
+    matrix world;
+    matrix worldInvTranspose;
+    uint meshIndex;     // Into the mesh table
+    uint drawSlot;      // Which indirect draw (mesh + material) this belongs to
+    uint2 padding;
+};
+
+// Per mesh data, one entry per unique mesh in the pool
+struct GpuMesh
+{
+    float3 boundsCenter;
+    uint indexCount;
+    float3 boundsExtents;
+    uint startIndex;
+};
+
+// Layout of D3D11_DRAW_INDEXED_INSTANCED_INDIRECT_ARGS, in uints
+#define DRAW_ARGS_SIZE              5
+#define DRAW_ARGS_INSTANCE_COUNT    1
+#define DRAW_ARGS_START_INSTANCE    4
+
+#endif
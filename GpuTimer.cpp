@@ -0,0 +1,121 @@
+#include "GpuTimer.h"
+
+GpuTimer::GpuTimer(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int sectionCount)
+	:
+	context(context),
+	sectionCount(sectionCount),
+	currentFrame(0),
+	times(sectionCount, 0.0f),
+	pixelInvocations(sectionCount, 0),
+	computeInvocations(sectionCount, 0)
+{
+	D3D11_QUERY_DESC disjointDesc = {};
+	disjointDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	D3D11_QUERY_DESC timestampDesc = {};
+	timestampDesc.Query = D3D11_QUERY_TIMESTAMP;
+	D3D11_QUERY_DESC statisticsDesc = {};
+	statisticsDesc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+
+	for (Frame& frame : frames)
+	{
+		device->CreateQuery(&disjointDesc, frame.disjoint.GetAddressOf());
+		frame.starts.resize(sectionCount);
+		frame.ends.resize(sectionCount);
+		frame.statistics.resize(sectionCount);
+		frame.used.assign(sectionCount, false);
+		frame.pending = false;
+		for (unsigned int s = 0; s < sectionCount; s++)
+		{
+			device->CreateQuery(&timestampDesc, frame.starts[s].GetAddressOf());
+			device->CreateQuery(&timestampDesc, frame.ends[s].GetAddressOf());
+			device->CreateQuery(&statisticsDesc, frame.statistics[s].GetAddressOf());
+		}
+	}
+}
+
+GpuTimer::~GpuTimer()
+{
+}
+
+void GpuTimer::BeginFrame()
+{
+	Frame& frame = frames[currentFrame];
+	frame.used.assign(sectionCount, false);
+	context->Begin(frame.disjoint.Get());
+}
+
+// --------------------------------------------------------
+// Ends this frame's queries, then reads back the oldest
+// frame's, whose queries are reused next
+// --------------------------------------------------------
+void GpuTimer::EndFrame()
+{
+	Frame& frame = frames[currentFrame];
+	context->End(frame.disjoint.Get());
+	frame.pending = true;
+
+	currentFrame = (currentFrame + 1) % GPU_TIMER_LATENCY;
+	ReadBack(frames[currentFrame]);
+}
+
+void GpuTimer::Start(unsigned int section)
+{
+	Frame& frame = frames[currentFrame];
+	frame.used[section] = true;
+	context->End(frame.starts[section].Get());
+	context->Begin(frame.statistics[section].Get());
+}
+
+void GpuTimer::Stop(unsigned int section)
+{
+	Frame& frame = frames[currentFrame];
+	context->End(frame.statistics[section].Get());
+	context->End(frame.ends[section].Get());
+}
+
+float GpuTimer::GetTime(unsigned int section) { return times[section]; }
+unsigned long long GpuTimer::GetPixelShaderInvocations(unsigned int section) { return pixelInvocations[section]; }
+unsigned long long GpuTimer::GetComputeShaderInvocations(unsigned int section) { return computeInvocations[section]; }
+
+// --------------------------------------------------------
+// Takes a frame's results if the GPU has them.  A frame that
+// isn't done yet (or that the GPU clock changed speed during)
+// is skipped, leaving the previous results.
+// --------------------------------------------------------
+void GpuTimer::ReadBack(Frame& frame)
+{
+	if (!frame.pending)
+		return;
+	frame.pending = false;
+
+	D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+	if (context->GetData(frame.disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK || disjoint.Disjoint)
+		return;
+
+	for (unsigned int s = 0; s < sectionCount; s++)
+	{
+		if (!frame.used[s])
+		{
+			times[s] = 0.0f;
+			pixelInvocations[s] = 0;
+			computeInvocations[s] = 0;
+			continue;
+		}
+
+		UINT64 start = 0;
+		UINT64 end = 0;
+		D3D11_QUERY_DATA_PIPELINE_STATISTICS statistics = {};
+		if (context->GetData(frame.starts[s].Get(), &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+			context->GetData(frame.ends[s].Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+			context->GetData(frame.statistics[s].Get(), &statistics, sizeof(statistics), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+			continue;
+
+		float ms = (float)((double)(end - start) * 1000.0 / disjoint.Frequency);
+		times[s] = times[s] > 0.0f ? times[s] * 0.95f + ms * 0.05f : ms;
+		pixelInvocations[s] = statistics.PSInvocations;
+		computeInvocations[s] = statistics.CSInvocations;
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <vector>
+
+// Frames a result takes to come back from the GPU - reading
+// any sooner would wait for the GPU to catch up
+#define GPU_TIMER_LATENCY 4
+
+// --------------------------------------------------------
+// Times sections of each frame on the GPU with timestamp
+// queries, and counts the shader invocations in each with
+// pipeline statistics queries
+//
+// - Sections are numbered by the caller, and must not overlap
+// - Results are read GPU_TIMER_LATENCY frames later without
+//   flushing, so timing never stalls the CPU
+// - A section that isn't run in a frame reads as zero
+// --------------------------------------------------------
+class GpuTimer
+{
+public:
+	GpuTimer(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int sectionCount);
+	~GpuTimer();
+
+	// Around everything else, once per frame
+	void BeginFrame();
+	void EndFrame();
+
+	void Start(unsigned int section);
+	void Stop(unsigned int section);
+
+	float GetTime(unsigned int section); // Milliseconds, smoothed over recent frames
+	unsigned long long GetPixelShaderInvocations(unsigned int section);
+	unsigned long long GetComputeShaderInvocations(unsigned int section);
+
+private:
+	struct Frame
+	{
+		Microsoft::WRL::ComPtr<ID3D11Query> disjoint;
+		std::vector<Microsoft::WRL::ComPtr<ID3D11Query>> starts;
+		std::vector<Microsoft::WRL::ComPtr<ID3D11Query>> ends;
+		std::vector<Microsoft::WRL::ComPtr<ID3D11Query>> statistics;
+		std::vector<bool> used;
+		bool pending; // Ended, but not read back yet
+	};
+
+	void ReadBack(Frame& frame);
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	unsigned int sectionCount;
+	Frame frames[GPU_TIMER_LATENCY];
+	unsigned int currentFrame;
+
+	std::vector<float> times;
+	std::vector<unsigned long long> pixelInvocations;
+	std::vector<unsigned long long> computeInvocations;
+};
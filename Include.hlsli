@@ -24,7 +24,8 @@ struct Light
     float intensity; // All lights need an intensity
     float3 color; // All lights need a color
     float spotFallOff; // Spot lights need a value to define their cone size
-    float3 padding; // Purposefully padding to hit the 16-byte boundary
+    int shadowView; // First of the light's views in the shadow atlas (six for point lights), or -1
+    float2 padding; // Purposefully padding to hit the 16-byte boundary
 };
 
 // Lambert diffuse BRDF - Same as the basic lighting diffuse calculation!
@@ -131,4 +132,98 @@ float3 MicrofacetBRDF(float3 n, float3 l, float3 v, float roughness, float3 f0,
     return specularResult * max(dot(n, l), 0);
 }
 
+//===========Lights=================//
+// Shared by the forward pixel shader and the deferred
+// lighting compute shader, so both paths light alike
+
+float Attenuate(Light light, float3 worldPos)
+{
+    float dist = distance(light.position, worldPos);
+    float att = saturate(1.0f - (dist * dist / (light.range * light.range)));
+    return att * att;
+}
+
+// Narrows a spot light to a cone around its direction - the
+// higher spotFallOff is, the tighter the cone
+float SpotCone(Light light, float3 dirToLight)
+{
+    float cosAngle = saturate(dot(-dirToLight, normalize(light.direction)));
+    return pow(cosAngle, light.spotFallOff);
+}
+
+// One light's contribution to a surface
+//
+// normal and V (the direction to the camera) must be normalized
+float3 EvaluateLight(
+    Light light,
+    float3 worldPos,
+    float3 normal,
+    float3 V,
+    float3 baseColor,
+    float3 specularColor,
+    float roughness,
+    float metalness)
+{
+    // Directional lights shine everywhere, the others fade out
+    // over their range (and spot lights outside their cone)
+    float3 lightDir;
+    float falloff = 1.0f;
+    if (light.type == LIGHT_TYPE_DIRECTIONAL)
+    {
+        lightDir = normalize(-light.direction);
+    }
+    else
+    {
+        lightDir = normalize(light.position - worldPos);
+        falloff = Attenuate(light, worldPos);
+        if (light.type == LIGHT_TYPE_SPOT)
+            falloff *= SpotCone(light, lightDir);
+    }
+
+    float3 diff = DiffusePBR(normal, lightDir);
+    float3 F;
+    float3 spec = MicrofacetBRDF(normal, lightDir, V, roughness, specularColor, F);
+    
+    float3 balancedDiff = DiffuseEnergyConserve(diff, F, metalness);
+    
+    float3 lightFinal = balancedDiff * baseColor + spec;
+    
+    return lightFinal * light.intensity * light.color * falloff;
+}
+
+//===========Debug views=================//
+
+// What lightDebugView shows in place of the lit surface
+#define LIGHT_DEBUG_OFF         0
+#define LIGHT_DEBUG_LIGHT_COUNT 1 // Lights evaluated per pixel, as a heatmap (deferred tiles that overflowed get a magenta edge)
+#define LIGHT_DEBUG_SLICES      2 // The cluster (or deferred tile) each pixel falls in
+#define LIGHT_DEBUG_MAX_LIGHTS  32.0f // Lights that show as full red
+
+// Blue through cyan, green and yellow to red as t goes from 0 to 1
+float3 HeatColor(float t)
+{
+    t = saturate(t) * 4.0f;
+    return saturate(float3(t - 2.0f, min(t, 4.0f - t), 2.0f - t));
+}
+
+//===========G-buffer=================//
+
+// Packs a unit normal into two values in [-1, 1] by folding
+// an octahedron flat - even over the sphere, unlike storing xy
+float2 OctahedralEncode(float3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    float2 signs = float2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    return n.z >= 0.0f ? n.xy : (1.0f - abs(n.yx)) * signs;
+}
+
+float3 OctahedralDecode(float2 e)
+{
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "InstanceBuffer.h"
+
+InstanceBuffer::InstanceBuffer(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int initialCapacity)
+	:
+	device(device),
+	context(context),
+	capacity(0)
+{
+	Resize(initialCapacity > 0 ? initialCapacity : 1);
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+}
+
+// --------------------------------------------------------
+// Forgets all instances gathered so far (keeps the memory)
+// --------------------------------------------------------
+void InstanceBuffer::Clear()
+{
+	instances.clear();
+}
+
+// --------------------------------------------------------
+// Adds one instance and returns its index in the buffer,
+// which is used as the StartInstanceLocation of a draw
+// --------------------------------------------------------
+unsigned int InstanceBuffer::Add(const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4X4& worldInvTranspose)
+{
+	instances.push_back({ world, worldInvTranspose });
+	return (unsigned int)instances.size() - 1;
+}
+
+// --------------------------------------------------------
+// Copies every gathered instance to the GPU in one go,
+// growing the buffer first if it is too small
+// --------------------------------------------------------
+void InstanceBuffer::Upload()
+{
+	if (instances.empty())
+		return;
+
+	if (instances.size() > capacity)
+	{
+		// Grow geometrically so a slowly growing scene
+		// doesn't recreate the buffer every frame
+		unsigned int newCapacity = capacity;
+		while (newCapacity < instances.size())
+			newCapacity *= 2;
+		Resize(newCapacity);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, &instances[0], sizeof(InstanceData) * instances.size());
+	context->Unmap(buffer.Get(), 0);
+}
+
+unsigned int InstanceBuffer::GetCount() { return (unsigned int)instances.size(); }
+unsigned int InstanceBuffer::GetCapacity() { return capacity; }
+Microsoft::WRL::ComPtr<ID3D11Buffer> InstanceBuffer::GetBuffer() { return buffer; }
+
+// --------------------------------------------------------
+// (Re)creates the GPU buffer with room for the given
+// number of instances
+// --------------------------------------------------------
+void InstanceBuffer::Resize(unsigned int newCapacity)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = sizeof(InstanceData) * newCapacity;
+	desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = 0;
+	desc.StructureByteStride = 0;
+
+	buffer.Reset();
+	device->CreateBuffer(&desc, 0, buffer.GetAddressOf());
+	capacity = newCapacity;
+	instances.reserve(newCapacity);
+}
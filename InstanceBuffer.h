@@ -0,0 +1,48 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <vector>
+
+// --------------------------------------------------------
+// Data for a single instance, read by the instanced vertex
+// shaders through their "_PER_INSTANCE" semantics
+// - Must match the per instance inputs in InstancedVS.hlsl
+// --------------------------------------------------------
+struct InstanceData
+{
+	DirectX::XMFLOAT4X4 world;
+	DirectX::XMFLOAT4X4 worldInvTranspose;
+};
+
+// --------------------------------------------------------
+// A dynamic vertex buffer holding one frame's worth of
+// instance data.  Instances are gathered on the CPU, then
+// sent to the GPU with a single Map() per frame.
+// --------------------------------------------------------
+class InstanceBuffer
+{
+public:
+	InstanceBuffer(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int initialCapacity);
+	~InstanceBuffer();
+
+	void Clear();
+	unsigned int Add(const DirectX::XMFLOAT4X4& world, const DirectX::XMFLOAT4X4& worldInvTranspose);
+	void Upload();
+
+	unsigned int GetCount();
+	unsigned int GetCapacity();
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetBuffer();
+
+private:
+	void Resize(unsigned int newCapacity);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	std::vector<InstanceData> instances;
+	unsigned int capacity;
+};
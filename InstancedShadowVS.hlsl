@@ -0,0 +1,34 @@
+#include "Include.hlsli"
+
+// Constant Buffer for external (C++) data
+cbuffer PerPass : register(b0)
+{
+    matrix view;
+    matrix projection;
+};
+
+struct VertexShaderInput
+{
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+    float3 localPosition		: POSITION; // XYZ position
+    float3 normal				: NORMAL;
+    float3 tangent				: TANGENT;
+    float2 uv					: UV;
+    matrix world				: WORLD_PER_INSTANCE;
+    matrix worldInvTranspose	: WORLDINVTRANSPOSE_PER_INSTANCE;
+};
+
+// --------------------------------------------------------
+// Instanced version of ShadowVS.hlsl
+// - worldInvTranspose is unused, but declared so the input
+//   layout matches the stride of the instance buffer
+// --------------------------------------------------------
+float4 main(VertexShaderInput input) : SV_POSITION
+{
+    matrix wvp = mul(projection, mul(view, input.world));
+    return mul(wvp, float4(input.localPosition, 1.0f));
+}
@@ -0,0 +1,74 @@
+#include "Include.hlsli"
+
+// Constant buffers - only data shared by every instance lives here,
+// the per instance matrices come from the instance buffer instead
+cbuffer PerFrame : register(b0)
+{
+    matrix lightView;
+    matrix lightProjection;
+}
+
+cbuffer PerPass : register(b1)
+{
+    matrix view;
+    matrix projection;
+}
+
+// Struct representing a single vertex worth of data
+// - The first four members match the vertex definition in our C++ code
+// - The "_PER_INSTANCE" members are pulled from a second vertex buffer
+//   (slot 1) once per instance, see InstanceData in InstanceBuffer.h
+// - Matrix inputs use the default (column major) packing, the same as
+//   matrices in a cbuffer, so the math is identical to VertexShader.hlsl
+struct VertexShaderInput
+{
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+    float3 localPosition		: POSITION; // XYZ position
+    float3 normal				: NORMAL;
+    float3 tangent				: TANGENT;
+    float2 uv					: UV;
+    matrix world				: WORLD_PER_INSTANCE;
+    matrix worldInvTranspose	: WORLDINVTRANSPOSE_PER_INSTANCE;
+};
+
+// Must match the output of VertexShader.hlsl, as both are
+// used with the same pixel shaders
+struct VertexToPixel
+{
+	// Data type
+	//  |
+	//  |   Name          Semantic
+	//  |    |                |
+	//  v    v                v
+    float4 screenPosition	: SV_POSITION; // XYZW position (System Value Position)
+    float2 uv				: TEXCOORD;
+    float3 normal			: NORMAL;
+    float3 worldPosition	: POSITION;
+    float3 tangent			: TANGENT;
+    float4 shadowMapPos		: SHADOW_POSITION;
+};
+
+// --------------------------------------------------------
+// Instanced version of VertexShader.hlsl
+// --------------------------------------------------------
+VertexToPixel main(VertexShaderInput input)
+{
+    VertexToPixel output;
+
+    matrix wvp = mul(projection, mul(view, input.world));
+    output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
+
+    output.uv = input.uv;
+    output.normal = mul((float3x3) input.worldInvTranspose, input.normal);
+    output.worldPosition = mul(input.world, float4(input.localPosition, 1)).xyz;
+    output.tangent = mul((float3x3) input.world, input.tangent);
+
+    matrix shadowWVP = mul(lightProjection, mul(lightView, input.world));
+    output.shadowMapPos = mul(shadowWVP, float4(input.localPosition, 1.0f));
+
+    return output;
+}
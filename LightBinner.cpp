@@ -0,0 +1,383 @@
+#include "LightBinner.h"
+#include <DirectXMath.h>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+using namespace DirectX;
+
+// Four floats from a structure of arrays, starting at "first",
+// with "pad" in the lanes past the end
+static XMVECTOR LoadLanes(const std::vector<float>& values, size_t first, float pad)
+{
+	if (first + 4 <= values.size())
+		return XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&values[first]));
+
+	XMFLOAT4 lanes(pad, pad, pad, pad);
+	float* lane = &lanes.x;
+	for (size_t i = first; i < values.size(); i++)
+		lane[i - first] = values[i];
+	return XMLoadFloat4(&lanes);
+}
+
+LightBinner::LightBinner(unsigned int tilesX, unsigned int tilesY, unsigned int slices)
+	:
+	tilesX(tilesX),
+	tilesY(tilesY),
+	slices(slices),
+	xScale(1.0f),
+	yScale(1.0f),
+	nearZ(0.1f),
+	farZ(100.0f),
+	maxClusterLights(0)
+{
+	BuildClusterBounds();
+}
+
+LightBinner::~LightBinner()
+{
+}
+
+void LightBinner::SetGrid(unsigned int tilesX, unsigned int tilesY, unsigned int slices)
+{
+	if (tilesX == this->tilesX && tilesY == this->tilesY && slices == this->slices)
+		return;
+
+	this->tilesX = tilesX > 0 ? tilesX : 1;
+	this->tilesY = tilesY > 0 ? tilesY : 1;
+	this->slices = slices > 0 ? slices : 1;
+	BuildClusterBounds();
+}
+
+// --------------------------------------------------------
+// Only rebuilds the cluster bounds when something changed,
+// so it can be called every frame
+// --------------------------------------------------------
+void LightBinner::SetProjection(float xScale, float yScale, float nearZ, float farZ)
+{
+	if (xScale == this->xScale && yScale == this->yScale && nearZ == this->nearZ && farZ == this->farZ)
+		return;
+
+	this->xScale = xScale;
+	this->yScale = yScale;
+	this->nearZ = nearZ;
+	this->farZ = farZ;
+	BuildClusterBounds();
+}
+
+void LightBinner::Clear()
+{
+	lightIndex.clear();
+	lightX.clear();
+	lightY.clear();
+	lightZ.clear();
+	lightRadius.clear();
+	globalLights.clear();
+}
+
+void LightBinner::AddGlobalLight(unsigned int lightIndex)
+{
+	globalLights.push_back(lightIndex);
+}
+
+void LightBinner::AddLight(unsigned int lightIndex, float x, float y, float z, float radius)
+{
+	this->lightIndex.push_back(lightIndex);
+	lightX.push_back(x);
+	lightY.push_back(y);
+	lightZ.push_back(z);
+	lightRadius.push_back(radius);
+}
+
+// --------------------------------------------------------
+// Bins every added light
+// - Each thread owns a run of slices, so no two threads ever
+//   touch the same cluster and nothing needs locking
+// - Within a cluster, lights stay in the order they were added
+// --------------------------------------------------------
+void LightBinner::Bin(WorkerPool* pool)
+{
+	FindLightBounds();
+
+	unsigned int jobCount = pool ? (std::min)(pool->GetThreadCount(), slices) : 1;
+	jobs.resize(jobCount);
+	for (unsigned int j = 0; j < jobCount; j++)
+	{
+		jobs[j].FirstSlice = slices * j / jobCount;
+		jobs[j].EndSlice = slices * (j + 1) / jobCount;
+	}
+
+	if (jobCount > 1)
+		pool->Run(jobCount, [this](unsigned int j) { BinSlices(jobs[j]); });
+	else
+		BinSlices(jobs[0]);
+
+	// Stitch the jobs together, after the global lights
+	clusterRanges.resize(GetClusterCount() * 2);
+	lightIndices = globalLights;
+	maxClusterLights = 0;
+	for (auto& job : jobs)
+	{
+		unsigned int firstCluster = job.FirstSlice * tilesX * tilesY;
+		unsigned int offset = (unsigned int)lightIndices.size();
+		for (unsigned int c = 0; c < job.Counts.size(); c++)
+		{
+			clusterRanges[(firstCluster + c) * 2] = offset;
+			clusterRanges[(firstCluster + c) * 2 + 1] = job.Counts[c];
+			offset += job.Counts[c];
+			maxClusterLights = (std::max)(maxClusterLights, job.Counts[c]);
+		}
+		lightIndices.insert(lightIndices.end(), job.Indices.begin(), job.Indices.end());
+	}
+}
+
+unsigned int LightBinner::GetTilesX() { return tilesX; }
+unsigned int LightBinner::GetTilesY() { return tilesY; }
+unsigned int LightBinner::GetSlices() { return slices; }
+unsigned int LightBinner::GetClusterCount() { return tilesX * tilesY * slices; }
+
+unsigned int LightBinner::GetClusterIndex(unsigned int x, unsigned int y, unsigned int z)
+{
+	return (z * tilesY + y) * tilesX + x;
+}
+
+unsigned int LightBinner::GetSlice(float viewZ)
+{
+	if (viewZ <= nearZ)
+		return 0;
+
+	float slice = floorf(logf(viewZ) * depthScale - depthBias);
+	return (unsigned int)(std::min)((std::max)(slice, 0.0f), (float)(slices - 1));
+}
+
+const std::vector<unsigned int>& LightBinner::GetClusterRanges() { return clusterRanges; }
+const std::vector<unsigned int>& LightBinner::GetLightIndices() { return lightIndices; }
+unsigned int LightBinner::GetGlobalLightCount() { return (unsigned int)globalLights.size(); }
+unsigned int LightBinner::GetMaxClusterLights() { return maxClusterLights; }
+float LightBinner::GetDepthScale() { return depthScale; }
+float LightBinner::GetDepthBias() { return depthBias; }
+
+// --------------------------------------------------------
+// Works out the view space box around every cluster, from
+// the tile's edges at the slice's near and far depths
+// --------------------------------------------------------
+void LightBinner::BuildClusterBounds()
+{
+	float depthRange = logf(farZ / nearZ);
+	depthScale = slices / depthRange;
+	depthBias = slices * logf(nearZ) / depthRange;
+
+	// Padded so BinSlices() can always load four clusters
+	clusterMinX.assign(GetClusterCount() + 3, 0.0f);
+	clusterMaxX.assign(GetClusterCount() + 3, 0.0f);
+	rowMinY.resize(tilesY * slices);
+	rowMaxY.resize(tilesY * slices);
+	sliceNear.resize(slices);
+	sliceFar.resize(slices);
+	for (unsigned int z = 0; z < slices; z++)
+	{
+		float zNear = nearZ * powf(farZ / nearZ, (float)z / slices);
+		float zFar = nearZ * powf(farZ / nearZ, (float)(z + 1) / slices);
+		sliceNear[z] = zNear;
+		sliceFar[z] = zFar;
+
+		for (unsigned int y = 0; y < tilesY; y++)
+		{
+			// Tile rows run down the screen, while view space y is up
+			float bottom = (1.0f - 2.0f * (y + 1) / tilesY) / yScale;
+			float top = (1.0f - 2.0f * y / tilesY) / yScale;
+			rowMinY[z * tilesY + y] = (std::min)(bottom * zNear, bottom * zFar);
+			rowMaxY[z * tilesY + y] = (std::max)(top * zNear, top * zFar);
+
+			for (unsigned int x = 0; x < tilesX; x++)
+			{
+				float left = (2.0f * x / tilesX - 1.0f) / xScale;
+				float right = (2.0f * (x + 1) / tilesX - 1.0f) / xScale;
+
+				unsigned int cluster = GetClusterIndex(x, y, z);
+				clusterMinX[cluster] = (std::min)(left * zNear, left * zFar);
+				clusterMaxX[cluster] = (std::max)(right * zNear, right * zFar);
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Narrows each light down to a block of clusters, from the
+// screen rectangle its bounding box projects to and the
+// slices it spans.  Loose, but BinSlices() tests each cluster
+// in the block against the light's actual sphere.
+// - Four lights at a time; only the slice lookup (a log) is
+//   done a light at a time
+// --------------------------------------------------------
+void LightBinner::FindLightBounds()
+{
+	size_t count = lightIndex.size();
+	lightFirstTileX.resize(count);
+	lightLastTileX.resize(count);
+	lightFirstTileY.resize(count);
+	lightLastTileY.resize(count);
+	lightFirstSlice.resize(count);
+	lightLastSlice.resize(count);
+
+	XMVECTOR nearV = XMVectorReplicate(nearZ);
+	XMVECTOR farV = XMVectorReplicate(farZ);
+	XMVECTOR xScaleV = XMVectorReplicate(xScale);
+	XMVECTOR yScaleV = XMVectorReplicate(yScale);
+	XMVECTOR one = XMVectorReplicate(1.0f);
+	XMVECTOR minusOne = XMVectorReplicate(-1.0f);
+	XMVECTOR half = XMVectorReplicate(0.5f);
+	XMVECTOR tilesXV = XMVectorReplicate((float)tilesX);
+	XMVECTOR tilesYV = XMVectorReplicate((float)tilesY);
+	XMVECTOR lastTileX = XMVectorReplicate((float)(tilesX - 1));
+	XMVECTOR lastTileY = XMVectorReplicate((float)(tilesY - 1));
+
+	for (size_t first = 0; first < count; first += 4)
+	{
+		// Lanes past the end are zero sized lights at the camera,
+		// which are off screen
+		XMVECTOR x = LoadLanes(lightX, first, 0.0f);
+		XMVECTOR y = LoadLanes(lightY, first, 0.0f);
+		XMVECTOR z = LoadLanes(lightZ, first, 0.0f);
+		XMVECTOR r = LoadLanes(lightRadius, first, 0.0f);
+
+		// Nothing is drawn outside the near and far planes, so
+		// any part of the light beyond them can be ignored
+		XMVECTOR zNear = XMVectorMax(XMVectorSubtract(z, r), nearV);
+		XMVECTOR zFar = XMVectorMin(XMVectorAdd(z, r), farV);
+
+		// x / z is largest and smallest at the box's corners
+		XMVECTOR xMinusR = XMVectorSubtract(x, r);
+		XMVECTOR xPlusR = XMVectorAdd(x, r);
+		XMVECTOR yMinusR = XMVectorSubtract(y, r);
+		XMVECTOR yPlusR = XMVectorAdd(y, r);
+		XMVECTOR minX = XMVectorMultiply(XMVectorMin(XMVectorDivide(xMinusR, zNear), XMVectorDivide(xMinusR, zFar)), xScaleV);
+		XMVECTOR maxX = XMVectorMultiply(XMVectorMax(XMVectorDivide(xPlusR, zNear), XMVectorDivide(xPlusR, zFar)), xScaleV);
+		XMVECTOR minY = XMVectorMultiply(XMVectorMin(XMVectorDivide(yMinusR, zNear), XMVectorDivide(yMinusR, zFar)), yScaleV);
+		XMVECTOR maxY = XMVectorMultiply(XMVectorMax(XMVectorDivide(yPlusR, zNear), XMVectorDivide(yPlusR, zFar)), yScaleV);
+
+		XMVECTOR offScreen = XMVectorOrInt(
+			XMVectorOrInt(XMVectorGreater(zNear, zFar), XMVectorLess(maxX, minusOne)),
+			XMVectorOrInt(XMVectorGreater(minX, one),
+				XMVectorOrInt(XMVectorLess(maxY, minusOne), XMVectorGreater(minY, one))));
+
+		// Clamped while still floats, as the corners may be far
+		// off screen, and to the last tile before they're whole
+		minX = XMVectorMax(minX, minusOne);
+		maxX = XMVectorMin(maxX, one);
+		minY = XMVectorMax(minY, minusOne);
+		maxY = XMVectorMin(maxY, one);
+		XMFLOAT4 firstTileX, lastTileXs, firstTileY, lastTileYs, zNears, zFars;
+		XMStoreFloat4(&firstTileX, XMVectorMin(XMVectorMultiply(XMVectorMultiply(XMVectorAdd(minX, one), half), tilesXV), lastTileX));
+		XMStoreFloat4(&lastTileXs, XMVectorMin(XMVectorMultiply(XMVectorMultiply(XMVectorAdd(maxX, one), half), tilesXV), lastTileX));
+		XMStoreFloat4(&firstTileY, XMVectorMin(XMVectorMultiply(XMVectorMultiply(XMVectorSubtract(one, maxY), half), tilesYV), lastTileY));
+		XMStoreFloat4(&lastTileYs, XMVectorMin(XMVectorMultiply(XMVectorMultiply(XMVectorSubtract(one, minY), half), tilesYV), lastTileY));
+		XMStoreFloat4(&zNears, zNear);
+		XMStoreFloat4(&zFars, zFar);
+		uint32_t offScreenLanes[4];
+		XMStoreInt4(offScreenLanes, offScreen);
+
+		size_t lanes = (std::min)(count - first, (size_t)4);
+		for (size_t l = 0; l < lanes; l++)
+		{
+			size_t i = first + l;
+			if (offScreenLanes[l])
+			{
+				lightFirstSlice[i] = 1;
+				lightLastSlice[i] = 0;
+				continue;
+			}
+
+			lightFirstTileX[i] = (unsigned int)(&firstTileX.x)[l];
+			lightLastTileX[i] = (unsigned int)(&lastTileXs.x)[l];
+			lightFirstTileY[i] = (unsigned int)(&firstTileY.x)[l];
+			lightLastTileY[i] = (unsigned int)(&lastTileYs.x)[l];
+			lightFirstSlice[i] = GetSlice((&zNears.x)[l]);
+			lightLastSlice[i] = GetSlice((&zFars.x)[l]);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Bins every light into one job's slices: hits are gathered
+// light by light, then sorted into clusters with a counting sort
+// - Each light is tested against four clusters of a row at a
+//   time, which only differ in x
+// --------------------------------------------------------
+void LightBinner::BinSlices(SliceJob& job)
+{
+	unsigned int sliceClusters = tilesX * tilesY;
+	unsigned int firstCluster = job.FirstSlice * sliceClusters;
+	job.Counts.assign((job.EndSlice - job.FirstSlice) * sliceClusters, 0);
+	job.Hits.clear();
+
+	XMVECTOR zero = XMVectorZero();
+	for (unsigned int i = 0; i < (unsigned int)lightIndex.size(); i++)
+	{
+		unsigned int firstSlice = (std::max)(lightFirstSlice[i], job.FirstSlice);
+		unsigned int lastSlice = (std::min)(lightLastSlice[i], job.EndSlice - 1);
+		if (firstSlice > lastSlice)
+			continue;
+
+		float x = lightX[i];
+		float y = lightY[i];
+		float z = lightZ[i];
+		float radiusSquared = lightRadius[i] * lightRadius[i];
+		XMVECTOR xV = XMVectorReplicate(x);
+		XMVECTOR radiusSquaredV = XMVectorReplicate(radiusSquared);
+
+		for (unsigned int cz = firstSlice; cz <= lastSlice; cz++)
+		{
+			// Distance from the sphere's center to the nearest point
+			// in the box, a component at a time
+			float dz = (std::max)((std::max)(sliceNear[cz] - z, z - sliceFar[cz]), 0.0f);
+			for (unsigned int cy = lightFirstTileY[i]; cy <= lightLastTileY[i]; cy++)
+			{
+				unsigned int row = cz * tilesY + cy;
+				float dy = (std::max)((std::max)(rowMinY[row] - y, y - rowMaxY[row]), 0.0f);
+
+				// Too far away in y and z for any cluster in the row
+				float dyzSquared = dy * dy + dz * dz;
+				if (dyzSquared > radiusSquared)
+					continue;
+				XMVECTOR dySquared = XMVectorReplicate(dy * dy);
+				XMVECTOR dzSquared = XMVectorReplicate(dz * dz);
+
+				for (unsigned int cx = lightFirstTileX[i]; cx <= lightLastTileX[i]; cx += 4)
+				{
+					// Lanes past the light's last tile are other clusters
+					// (or padding), and are skipped
+					unsigned int cluster = GetClusterIndex(cx, cy, cz);
+					XMVECTOR minX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&clusterMinX[cluster]));
+					XMVECTOR maxX = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&clusterMaxX[cluster]));
+					XMVECTOR dx = XMVectorMax(XMVectorMax(XMVectorSubtract(minX, xV), XMVectorSubtract(xV, maxX)), zero);
+					XMVECTOR distanceSquared = XMVectorAdd(XMVectorAdd(XMVectorMultiply(dx, dx), dySquared), dzSquared);
+					uint32_t inside[4];
+					XMStoreInt4(inside, XMVectorLessOrEqual(distanceSquared, radiusSquaredV));
+
+					unsigned int lanes = (std::min)(lightLastTileX[i] - cx + 1, 4u);
+					for (unsigned int l = 0; l < lanes; l++)
+					{
+						if (!inside[l])
+							continue;
+						job.Hits.push_back(cluster + l - firstCluster);
+						job.Hits.push_back(i);
+						job.Counts[cluster + l - firstCluster]++;
+					}
+				}
+			}
+		}
+	}
+
+	job.Offsets.resize(job.Counts.size());
+	unsigned int offset = 0;
+	for (size_t c = 0; c < job.Counts.size(); c++)
+	{
+		job.Offsets[c] = offset;
+		offset += job.Counts[c];
+	}
+
+	job.Indices.resize(offset);
+	for (size_t h = 0; h < job.Hits.size(); h += 2)
+		job.Indices[job.Offsets[job.Hits[h]]++] = lightIndex[job.Hits[h + 1]];
+}
@@ -0,0 +1,120 @@
+#pragma once
+#include <vector>
+#include "WorkerPool.h"
+
+// --------------------------------------------------------
+// Sorts lights into clusters - the view frustum cut into
+// tiles across the screen and slices in depth - so each pixel
+// only evaluates the lights that can reach its cluster
+//
+// - Plain C++ and DirectXMath with no D3D, so it builds (and
+//   can be checked) anywhere; LightManager feeds it lights in
+//   view space and uploads the results
+// - Four lights at a time are fitted to their clusters, and
+//   each light is tested against four clusters of a row at a
+//   time, in DirectXMath's vectors
+// - Depth slices grow exponentially from the near plane, so
+//   clusters stay roughly cube shaped all the way out
+// - Clusters are numbered (z * tilesY + y) * tilesX + x, with
+//   tile (0, 0) in the top left of the screen
+// - Global lights (directional ones) are in no cluster; they
+//   come first in the index list, ahead of every cluster's lights
+// --------------------------------------------------------
+class LightBinner
+{
+public:
+	LightBinner(unsigned int tilesX, unsigned int tilesY, unsigned int slices);
+	~LightBinner();
+
+	void SetGrid(unsigned int tilesX, unsigned int tilesY, unsigned int slices);
+
+	// xScale and yScale are the projection matrix's _11 and _22
+	void SetProjection(float xScale, float yScale, float nearZ, float farZ);
+
+	// Lights are added every frame, as view space spheres (+z forward)
+	void Clear();
+	void AddGlobalLight(unsigned int lightIndex);
+	void AddLight(unsigned int lightIndex, float x, float y, float z, float radius);
+
+	// Fills the clusters, splitting the slices between the pool's
+	// threads - or doing them all on the calling thread, without one
+	void Bin(WorkerPool* pool);
+
+	unsigned int GetTilesX();
+	unsigned int GetTilesY();
+	unsigned int GetSlices();
+	unsigned int GetClusterCount();
+	unsigned int GetClusterIndex(unsigned int x, unsigned int y, unsigned int z);
+	unsigned int GetSlice(float viewZ); // Matches the pixel shader's lookup
+
+	// Results of Bin(): an offset and count per cluster, into the
+	// light index list (whose first GetGlobalLightCount() are global)
+	const std::vector<unsigned int>& GetClusterRanges();
+	const std::vector<unsigned int>& GetLightIndices();
+	unsigned int GetGlobalLightCount();
+	unsigned int GetMaxClusterLights();
+
+	// For the pixel shader: slice = floor(log(viewZ) * scale - bias)
+	float GetDepthScale();
+	float GetDepthBias();
+
+private:
+	// The clusters in a run of slices, binned by one thread
+	struct SliceJob
+	{
+		unsigned int FirstSlice;
+		unsigned int EndSlice;
+		std::vector<unsigned int> Counts;	// Per cluster in the job
+		std::vector<unsigned int> Indices;	// Cluster by cluster
+		std::vector<unsigned int> Hits;		// Scratch: cluster in the job, then light, per hit
+		std::vector<unsigned int> Offsets;	// Scratch: where each cluster's lights go in Indices
+	};
+
+	void BuildClusterBounds();
+	void FindLightBounds();
+	void BinSlices(SliceJob& job);
+
+	unsigned int tilesX;
+	unsigned int tilesY;
+	unsigned int slices;
+	float xScale;
+	float yScale;
+	float nearZ;
+	float farZ;
+	float depthScale;
+	float depthBias;
+
+	// View space bounds of the clusters.  A cluster's x range
+	// depends on its column and slice, but its y range only on
+	// its row and slice and its z range only on its slice.
+	std::vector<float> clusterMinX; // Per cluster, then padded to a whole vector
+	std::vector<float> clusterMaxX;
+	std::vector<float> rowMinY; // Per row of each slice: z * tilesY + y
+	std::vector<float> rowMaxY;
+	std::vector<float> sliceNear; // Per slice
+	std::vector<float> sliceFar;
+
+	// Added lights, structure of arrays so the bounds pass
+	// streams through them
+	std::vector<unsigned int> lightIndex;
+	std::vector<float> lightX;
+	std::vector<float> lightY;
+	std::vector<float> lightZ;
+	std::vector<float> lightRadius;
+
+	// Clusters each light might touch (first and last, inclusive),
+	// with lightFirstSlice > lightLastSlice when it's off screen
+	std::vector<unsigned int> lightFirstTileX;
+	std::vector<unsigned int> lightLastTileX;
+	std::vector<unsigned int> lightFirstTileY;
+	std::vector<unsigned int> lightLastTileY;
+	std::vector<unsigned int> lightFirstSlice;
+	std::vector<unsigned int> lightLastSlice;
+
+	std::vector<unsigned int> globalLights;
+	std::vector<SliceJob> jobs;
+
+	std::vector<unsigned int> clusterRanges;
+	std::vector<unsigned int> lightIndices;
+	unsigned int maxClusterLights;
+};
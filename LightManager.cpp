@@ -0,0 +1,228 @@
+#include "LightManager.h"
+
+LightManager::LightManager(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int initialCapacity)
+	:
+	device(device),
+	context(context),
+	capacity(0),
+	dirty(true),
+	binner(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z),
+	clustering(true),
+	clusterRangeCapacity(0),
+	clusterIndexCapacity(0)
+{
+	Resize(initialCapacity > 0 ? initialCapacity : 1);
+}
+
+LightManager::~LightManager()
+{
+}
+
+// --------------------------------------------------------
+// Adds a light and returns its index, which stays the same
+// until the light is truncated away
+// --------------------------------------------------------
+unsigned int LightManager::Add(const Light& light)
+{
+	lights.push_back(light);
+	dirty = true;
+	return (unsigned int)lights.size() - 1;
+}
+
+void LightManager::Set(unsigned int index, const Light& light)
+{
+	if (index >= lights.size())
+		return;
+
+	lights[index] = light;
+	dirty = true;
+}
+
+void LightManager::SetShadowView(unsigned int index, int shadowView)
+{
+	if (index >= lights.size() || lights[index].shadowView == shadowView)
+		return;
+
+	lights[index].shadowView = shadowView;
+	dirty = true;
+}
+
+const Light& LightManager::Get(unsigned int index) { return lights[index]; }
+
+void LightManager::Truncate(unsigned int count)
+{
+	if (count >= lights.size())
+		return;
+
+	lights.resize(count);
+	dirty = true;
+}
+
+// --------------------------------------------------------
+// Copies every light to the GPU in one go, growing the
+// buffer first if it is too small.  Call once per frame,
+// before anything that reads the lights is recorded.
+// --------------------------------------------------------
+void LightManager::Upload()
+{
+	if (!dirty)
+		return;
+
+	if (lights.empty())
+	{
+		dirty = false; // The shader reads nothing, as its light count is zero
+		return;
+	}
+
+	if (lights.size() > capacity)
+	{
+		unsigned int newCapacity = capacity;
+		while (newCapacity < lights.size())
+			newCapacity *= 2;
+		Resize(newCapacity);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, &lights[0], sizeof(Light) * lights.size());
+	context->Unmap(buffer.Get(), 0);
+	dirty = false;
+}
+
+unsigned int LightManager::GetCount() { return (unsigned int)lights.size(); }
+unsigned int LightManager::GetCapacity() { return capacity; }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> LightManager::GetSRV() { return srv; }
+
+// --------------------------------------------------------
+// Sorts the lights into clusters for the given camera and
+// uploads the clusters
+// - Directional lights reach every pixel, so they skip the
+//   binning and go at the front of the index list
+// - Lights giving off no light are left out altogether
+// --------------------------------------------------------
+void LightManager::BinLights(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection, float nearZ, float farZ, WorkerPool* pool)
+{
+	binner.SetProjection(projection._11, projection._22, nearZ, farZ);
+	binner.Clear();
+
+	DirectX::XMMATRIX viewMatrix = DirectX::XMLoadFloat4x4(&view);
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		const Light& light = lights[i];
+		if (light.intensity <= 0.0f || (light.color.x <= 0.0f && light.color.y <= 0.0f && light.color.z <= 0.0f))
+			continue;
+
+		if (light.type == LIGHT_TYPE_DIRECTIONAL)
+		{
+			binner.AddGlobalLight(i);
+			continue;
+		}
+
+		DirectX::XMFLOAT3 viewPosition;
+		DirectX::XMStoreFloat3(&viewPosition, DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&light.position), viewMatrix));
+		binner.AddLight(i, viewPosition.x, viewPosition.y, viewPosition.z, light.range);
+	}
+
+	binner.Bin(pool);
+	UploadClusters();
+}
+
+void LightManager::SetClustering(bool enabled)
+{
+	clustering = enabled;
+	if (enabled)
+		binner.SetGrid(LIGHT_CLUSTERS_X, LIGHT_CLUSTERS_Y, LIGHT_CLUSTERS_Z);
+	else
+		binner.SetGrid(1, 1, 1);
+}
+
+bool LightManager::GetClustering() { return clustering; }
+LightBinner& LightManager::GetBinner() { return binner; }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> LightManager::GetClusterRangeSRV() { return clusterRangeSRV; }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> LightManager::GetClusterIndexSRV() { return clusterIndexSRV; }
+
+// --------------------------------------------------------
+// (Re)creates the structured buffer and its SRV with room
+// for the given number of lights
+// --------------------------------------------------------
+void LightManager::Resize(unsigned int newCapacity)
+{
+	CreateStructuredBuffer(sizeof(Light), newCapacity, buffer, srv);
+	capacity = newCapacity;
+	lights.reserve(newCapacity);
+	dirty = true;
+}
+
+// --------------------------------------------------------
+// Makes a dynamic structured buffer, written with Map(),
+// and an SRV covering all of it
+// --------------------------------------------------------
+void LightManager::CreateStructuredBuffer(
+	unsigned int stride,
+	unsigned int count,
+	Microsoft::WRL::ComPtr<ID3D11Buffer>& newBuffer,
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& newSRV)
+{
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = stride * count;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = stride;
+
+	newBuffer.Reset();
+	newSRV.Reset();
+	device->CreateBuffer(&desc, 0, newBuffer.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = count;
+	device->CreateShaderResourceView(newBuffer.Get(), &srvDesc, newSRV.GetAddressOf());
+}
+
+// --------------------------------------------------------
+// Copies the binner's results to the GPU, growing either
+// buffer first if it's too small.  Both change whenever the
+// camera moves, so they're written every frame.
+// --------------------------------------------------------
+void LightManager::UploadClusters()
+{
+	const std::vector<unsigned int>& ranges = binner.GetClusterRanges();
+	const std::vector<unsigned int>& indices = binner.GetLightIndices();
+
+	unsigned int clusterCount = binner.GetClusterCount();
+	if (clusterCount > clusterRangeCapacity)
+	{
+		CreateStructuredBuffer(sizeof(unsigned int) * 2, clusterCount, clusterRangeBuffer, clusterRangeSRV);
+		clusterRangeCapacity = clusterCount;
+	}
+
+	if (indices.size() > clusterIndexCapacity || !clusterIndexBuffer)
+	{
+		unsigned int newCapacity = clusterIndexCapacity > 0 ? clusterIndexCapacity : 1024;
+		while (newCapacity < indices.size())
+			newCapacity *= 2;
+		CreateStructuredBuffer(sizeof(unsigned int), newCapacity, clusterIndexBuffer, clusterIndexSRV);
+		clusterIndexCapacity = newCapacity;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (SUCCEEDED(context->Map(clusterRangeBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		memcpy(mapped.pData, &ranges[0], sizeof(unsigned int) * ranges.size());
+		context->Unmap(clusterRangeBuffer.Get(), 0);
+	}
+
+	if (!indices.empty() && SUCCEEDED(context->Map(clusterIndexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		memcpy(mapped.pData, &indices[0], sizeof(unsigned int) * indices.size());
+		context->Unmap(clusterIndexBuffer.Get(), 0);
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <vector>
+#include "Lights.h"
+#include "LightBinner.h"
+
+// Clusters the view frustum is cut into for clustered lighting
+#define LIGHT_CLUSTERS_X 16
+#define LIGHT_CLUSTERS_Y 9
+#define LIGHT_CLUSTERS_Z 24
+
+// --------------------------------------------------------
+// Every light in the scene, kept in a structured buffer
+// that the pixel shader loops over ("Lights" in PixelShader.hlsl)
+//
+// - Upload() copies the lights to the GPU with a single Map(),
+//   once per frame and only if something changed, so adding
+//   lights costs nothing per draw
+// - The buffer doubles in size when it runs out of room, which
+//   replaces its SRV - get it again after Upload()
+// - BinLights() sorts the point and spot lights into clusters
+//   for the camera and uploads them ("ClusterRanges" and
+//   "ClusterLightIndices"), so each pixel only loops over
+//   the lights that reach it
+// --------------------------------------------------------
+class LightManager
+{
+public:
+	LightManager(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int initialCapacity);
+	~LightManager();
+
+	unsigned int Add(const Light& light);
+	void Set(unsigned int index, const Light& light);
+	void SetShadowView(unsigned int index, int shadowView); // Only uploads again if it changed
+	const Light& Get(unsigned int index);
+	void Truncate(unsigned int count); // Removes every light from index count on
+	void Upload();
+
+	unsigned int GetCount();
+	unsigned int GetCapacity();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV();
+
+	// Call every frame after Upload(), with the camera being drawn.
+	// Without clustering, every light is in one big cluster.
+	void BinLights(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection, float nearZ, float farZ, WorkerPool* pool);
+	void SetClustering(bool enabled);
+	bool GetClustering();
+	LightBinner& GetBinner();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetClusterRangeSRV();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetClusterIndexSRV();
+
+private:
+	void Resize(unsigned int newCapacity);
+	void CreateStructuredBuffer(
+		unsigned int stride,
+		unsigned int count,
+		Microsoft::WRL::ComPtr<ID3D11Buffer>& newBuffer,
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& newSRV);
+	void UploadClusters();
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	std::vector<Light> lights;
+	unsigned int capacity;
+	bool dirty; // Lights changed since the last Upload()
+
+	LightBinner binner;
+	bool clustering;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> clusterRangeBuffer;	// Offset and count per cluster
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> clusterRangeSRV;
+	unsigned int clusterRangeCapacity;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> clusterIndexBuffer;	// Light indices the ranges point into
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> clusterIndexSRV;
+	unsigned int clusterIndexCapacity;
+};
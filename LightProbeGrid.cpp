@@ -0,0 +1,522 @@
+#include "LightProbeGrid.h"
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+
+static bool SameBounds(const BoundingBox& a, const BoundingBox& b)
+{
+	return
+		a.Center.x == b.Center.x && a.Center.y == b.Center.y && a.Center.z == b.Center.z &&
+		a.Extents.x == b.Extents.x && a.Extents.y == b.Extents.y && a.Extents.z == b.Extents.z;
+}
+
+// --------------------------------------------------------
+// spacing     - World units between neighbouring probes.  The
+//               probes' light is only as detailed as this, but
+//               halving it means eight times the probes to bake.
+// threadCount - Threads baking, the bake thread included.  They
+//               sleep between bakes.
+// --------------------------------------------------------
+LightProbeGrid::LightProbeGrid(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	float spacing,
+	unsigned int threadCount)
+	:
+	device(device),
+	context(context),
+	spacing(spacing),
+	grid(),
+	sky(),
+	rayCount(0),
+	maxDistance(0.0f),
+	applied(),
+	sceneTime(0.0f),
+	sceneRefitted(false),
+	pool(threadCount),
+	pending(),
+	hasPending(false),
+	baking(false),
+	finished(),
+	hasFinished(false),
+	quitting(false)
+{
+	grid.spacing = spacing;
+	rayCount = baker.GetRayCount();
+	maxDistance = baker.GetMaxDistance();
+	thread = std::thread(&LightProbeGrid::BakeLoop, this);
+}
+
+// --------------------------------------------------------
+// Waits for a bake that's running to finish
+// --------------------------------------------------------
+LightProbeGrid::~LightProbeGrid()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+// --------------------------------------------------------
+// Finds the static entities that changed since last time:
+// the old bounds of those removed or moved, and the new
+// bounds of those added or moved, are where the probes'
+// light may have changed
+// - Entities added or removed change which triangles the ray
+//   scene holds, so it's gathered and built again - those
+//   that only moved keep their triangles' places in it
+// --------------------------------------------------------
+void LightProbeGrid::Update(const std::vector<std::shared_ptr<GameEntity>>& entities)
+{
+	std::map<GameEntity*, Tracked> current;
+	for (auto& e : entities)
+	{
+		if (!e->IsStatic())
+			continue;
+		Tracked& t = current[e.get()];
+		t.entity = e;
+		t.bounds = e->GetWorldBounds();
+		t.firstTriangle = 0;
+		t.triangleCount = (unsigned int)(e->GetMesh()->GetIndices().size() / 3);
+	}
+
+	bool rebuildScene = false;
+	std::vector<BoundingBox> changed;
+	std::vector<GameEntity*> moved;
+	for (auto& t : tracked)
+	{
+		auto it = current.find(t.first);
+		if (it == current.end() || it->second.triangleCount != t.second.triangleCount)
+		{
+			changed.push_back(t.second.bounds);
+			rebuildScene = true;
+			continue;
+		}
+
+		it->second.firstTriangle = t.second.firstTriangle;
+		if (!SameBounds(it->second.bounds, t.second.bounds))
+		{
+			changed.push_back(t.second.bounds);
+			changed.push_back(it->second.bounds);
+			moved.push_back(t.first);
+		}
+	}
+	for (auto& t : current)
+	{
+		auto it = tracked.find(t.first);
+		if (it == tracked.end() || it->second.triangleCount != t.second.triangleCount)
+		{
+			changed.push_back(t.second.bounds);
+			rebuildScene = true;
+		}
+	}
+	tracked.swap(current);
+	if (changed.empty())
+		return;
+
+	BakeRequest request = {};
+	request.rebuildScene = rebuildScene;
+	request.changed.swap(changed);
+	if (rebuildScene)
+	{
+		// Every entity's triangles, in the order they're tracked
+		unsigned int triangles = 0;
+		for (auto& t : tracked)
+		{
+			t.second.firstTriangle = triangles;
+			triangles += t.second.triangleCount;
+			request.entities.push_back(Snapshot(t.second));
+		}
+	}
+	else
+	{
+		for (GameEntity* e : moved)
+			request.entities.push_back(Snapshot(tracked[e]));
+	}
+
+	grid = Layout();
+	Request(request);
+}
+
+void LightProbeGrid::BakeAll()
+{
+	BakeRequest request = {};
+	request.bakeAll = true;
+	Request(request);
+}
+
+void LightProbeGrid::MeasureScaling()
+{
+	BakeRequest request = {};
+	request.measureScaling = true;
+	Request(request);
+}
+
+// --------------------------------------------------------
+// Swaps in the probes of a bake that finished since the last
+// call.  The shaders are given the grid they were baked for
+// along with them, so the two always match.
+// --------------------------------------------------------
+bool LightProbeGrid::ApplyBake()
+{
+	BakeResult baked;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!hasFinished)
+			return false;
+		baked = std::move(finished);
+		hasFinished = false;
+	}
+
+	Upload(baked);
+
+	baked.probes.clear();
+	if (baked.scalingTimes.empty())
+		baked.scalingTimes.swap(applied.scalingTimes);
+	applied = std::move(baked);
+	return true;
+}
+
+bool LightProbeGrid::IsBaking()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return hasPending || baking;
+}
+
+// --------------------------------------------------------
+// Everything the bake thread reads of an entity, as it is now
+// --------------------------------------------------------
+LightProbeGrid::SceneEntity LightProbeGrid::Snapshot(const Tracked& t)
+{
+	SceneEntity s;
+	s.mesh = t.entity->GetMesh();
+	s.world = t.entity->GetTransform()->GetWorldMatrix();
+	XMFLOAT4 tint = t.entity->GetMaterial()->GetTint();
+	s.albedo = XMFLOAT3(tint.x * LIGHT_PROBE_ALBEDO, tint.y * LIGHT_PROBE_ALBEDO, tint.z * LIGHT_PROBE_ALBEDO);
+	s.firstTriangle = t.firstTriangle;
+	return s;
+}
+
+// --------------------------------------------------------
+// Fits the grid around the static entities, a probe's
+// spacing past them on every side.  Its corners snap to
+// multiples of the spacing, so it only moves when the scene
+// outgrows it.
+// --------------------------------------------------------
+LightProbeGrid::Grid LightProbeGrid::Layout()
+{
+	Grid layout;
+	layout.origin = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	layout.spacing = spacing;
+	layout.counts = XMUINT3(0, 0, 0);
+	if (tracked.empty())
+		return layout;
+
+	float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (auto& t : tracked)
+	{
+		const BoundingBox& b = t.second.bounds;
+		float center[3] = { b.Center.x, b.Center.y, b.Center.z };
+		float extents[3] = { b.Extents.x, b.Extents.y, b.Extents.z };
+		for (unsigned int a = 0; a < 3; a++)
+		{
+			boundsMin[a] = fminf(boundsMin[a], center[a] - extents[a]);
+			boundsMax[a] = fmaxf(boundsMax[a], center[a] + extents[a]);
+		}
+	}
+
+	// Wider spacing until every axis fits
+	float first[3];
+	unsigned int axisCounts[3];
+	bool fits = false;
+	while (!fits)
+	{
+		fits = true;
+		for (unsigned int a = 0; a < 3; a++)
+		{
+			first[a] = floorf(boundsMin[a] / layout.spacing - 1.0f) * layout.spacing;
+			float last = ceilf(boundsMax[a] / layout.spacing + 1.0f) * layout.spacing;
+			axisCounts[a] = (unsigned int)((last - first[a]) / layout.spacing + 0.5f) + 1;
+			fits = fits && axisCounts[a] <= LIGHT_PROBE_MAX_PER_AXIS;
+		}
+		if (!fits)
+			layout.spacing *= 2.0f;
+	}
+
+	layout.origin = XMFLOAT3(first[0], first[1], first[2]);
+	layout.counts = XMUINT3(axisCounts[0], axisCounts[1], axisCounts[2]);
+	return layout;
+}
+
+// --------------------------------------------------------
+// Hands a request to the bake thread, with the grid and the
+// settings as they are now.  One still waiting is merged in:
+// its changes are added to this one's, and if either rebuilds
+// the scene, this one does with every entity as it is now.
+// --------------------------------------------------------
+void LightProbeGrid::Request(BakeRequest& request)
+{
+	request.grid = grid;
+	request.sky = sky;
+	request.lights = lights;
+	request.rayCount = rayCount;
+	request.maxDistance = maxDistance;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (hasPending)
+		{
+			if (pending.rebuildScene && !request.rebuildScene)
+			{
+				request.rebuildScene = true;
+				request.entities.clear();
+				for (auto& t : tracked)
+					request.entities.push_back(Snapshot(t.second));
+			}
+			else if (!request.rebuildScene)
+			{
+				// Applied in order, so the later moves win
+				request.entities.insert(request.entities.begin(), pending.entities.begin(), pending.entities.end());
+			}
+			request.changed.insert(request.changed.end(), pending.changed.begin(), pending.changed.end());
+			request.bakeAll = request.bakeAll || pending.bakeAll;
+			request.measureScaling = request.measureScaling || pending.measureScaling;
+		}
+		pending = std::move(request);
+		hasPending = true;
+	}
+	wake.notify_one();
+}
+
+// --------------------------------------------------------
+// Copies every probe into the texture, coefficient k of
+// probe (x, y, z) to texel (x, y, k * counts.z + z), making
+// a texture to match first if the grid changed size
+// --------------------------------------------------------
+void LightProbeGrid::Upload(const BakeResult& baked)
+{
+	XMUINT3 counts = baked.grid.counts;
+	XMUINT3 oldCounts = applied.grid.counts;
+	if (!texture || counts.x != oldCounts.x || counts.y != oldCounts.y || counts.z != oldCounts.z)
+	{
+		// None for an empty grid
+		texture.Reset();
+		srv.Reset();
+		if (!baked.probes.empty())
+		{
+			D3D11_TEXTURE3D_DESC desc = {};
+			desc.Width = counts.x;
+			desc.Height = counts.y;
+			desc.Depth = counts.z * 9;
+			desc.MipLevels = 1;
+			desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			desc.Usage = D3D11_USAGE_DEFAULT;
+			desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			device->CreateTexture3D(&desc, 0, texture.GetAddressOf());
+			if (texture)
+				device->CreateShaderResourceView(texture.Get(), 0, srv.GetAddressOf());
+		}
+	}
+	if (!texture)
+		return;
+
+	const std::vector<SH9>& probes = baked.probes;
+	unsigned int probeCount = (unsigned int)probes.size();
+	std::vector<XMFLOAT4> texels((size_t)probeCount * 9);
+	for (unsigned int k = 0; k < 9; k++)
+	{
+		for (unsigned int p = 0; p < probeCount; p++)
+		{
+			XMFLOAT4 c = probes[p].coefficients[k];
+			texels[(size_t)k * probeCount + p] = XMFLOAT4(c.x, c.y, c.z, 1.0f);
+		}
+	}
+
+	context->UpdateSubresource(texture.Get(), 0, 0, &texels[0],
+		counts.x * sizeof(XMFLOAT4),
+		counts.x * counts.y * sizeof(XMFLOAT4));
+}
+
+// --------------------------------------------------------
+// Body of the bake thread: sleep, take the waiting request,
+// bake it and leave the probes for ApplyBake(), repeat
+// --------------------------------------------------------
+void LightProbeGrid::BakeLoop()
+{
+	while (true)
+	{
+		BakeRequest request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return quitting || hasPending; });
+			if (quitting)
+				return;
+			request = std::move(pending);
+			pending = BakeRequest();
+			hasPending = false;
+			baking = true;
+		}
+
+		BakeResult result = RunBake(request);
+
+		{
+			// A bake ApplyBake() never took is replaced, but its
+			// scaling times are still worth showing
+			std::lock_guard<std::mutex> lock(mutex);
+			if (hasFinished && result.scalingTimes.empty())
+				result.scalingTimes.swap(finished.scalingTimes);
+			finished = std::move(result);
+			hasFinished = true;
+			baking = false;
+		}
+	}
+}
+
+LightProbeGrid::BakeResult LightProbeGrid::RunBake(const BakeRequest& request)
+{
+	baker.SetSky(request.sky);
+	baker.SetLights(request.lights);
+	baker.SetRayCount(request.rayCount);
+	baker.SetMaxDistance(request.maxDistance);
+
+	BakeResult result = {};
+	UpdateScene(request, result);
+
+	// A new grid clears every probe, so they're all baked
+	const Grid& g = request.grid;
+	XMFLOAT3 origin = baker.GetOrigin();
+	XMUINT3 counts = baker.GetCounts();
+	bool newGrid =
+		g.origin.x != origin.x || g.origin.y != origin.y || g.origin.z != origin.z ||
+		g.counts.x != counts.x || g.counts.y != counts.y || g.counts.z != counts.z ||
+		g.spacing != baker.GetSpacing();
+	if (newGrid)
+		baker.SetGrid(g.origin, g.spacing, g.counts);
+
+	std::vector<unsigned int> probeIndices;
+	if (newGrid || request.bakeAll || request.measureScaling)
+	{
+		for (unsigned int i = 0; i < baker.GetProbeCount(); i++)
+			probeIndices.push_back(i);
+	}
+	else
+	{
+		std::vector<unsigned char> marks(baker.GetProbeCount(), 0);
+		for (auto& box : request.changed)
+			baker.MarkProbesNear(box, marks);
+		for (unsigned int i = 0; i < (unsigned int)marks.size(); i++)
+		{
+			if (marks[i])
+				probeIndices.push_back(i);
+		}
+	}
+
+	if (request.measureScaling)
+	{
+		for (unsigned int threads = 1; threads <= pool.GetThreadCount(); threads++)
+		{
+			baker.Bake(scene, probeIndices, &pool, threads);
+			result.scalingTimes.push_back(baker.GetBakeTime());
+		}
+	}
+	else
+	{
+		baker.Bake(scene, probeIndices, &pool, pool.GetThreadCount());
+	}
+
+	result.grid = g;
+	result.probes = baker.GetProbes();
+	result.bakedCount = baker.GetBakedCount();
+	result.invalidCount = baker.GetInvalidCount();
+	result.bakeTime = baker.GetBakeTime();
+	result.triangleCount = scene.GetTriangleCount();
+	return result;
+}
+
+// --------------------------------------------------------
+// Gathers every entity's triangles in world space and builds
+// the BVH over them, or for entities that only moved, puts
+// their triangles where they are now and refits it
+// --------------------------------------------------------
+void LightProbeGrid::UpdateScene(const BakeRequest& request, BakeResult& result)
+{
+	if (request.rebuildScene || !request.entities.empty())
+	{
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+		if (request.rebuildScene)
+		{
+			scene.Clear();
+			for (auto& e : request.entities)
+				AddEntity(e, false);
+			scene.Build();
+			sceneRefitted = false;
+		}
+		else
+		{
+			for (auto& e : request.entities)
+				AddEntity(e, true);
+			sceneRefitted = scene.Refit();
+		}
+
+		std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		sceneTime = elapsed.count();
+	}
+
+	result.sceneTime = sceneTime;
+	result.sceneRefitted = sceneRefitted;
+}
+
+// --------------------------------------------------------
+// An entity's triangles in world space, each with its
+// material's tint as the albedo - added to the scene after
+// the rest, or replacing the ones it had
+// --------------------------------------------------------
+void LightProbeGrid::AddEntity(const SceneEntity& e, bool replace)
+{
+	XMMATRIX world = XMLoadFloat4x4(&e.world);
+	const std::vector<Vertex>& vertices = e.mesh->GetVertices();
+	const std::vector<unsigned int>& indices = e.mesh->GetIndices();
+	std::vector<XMFLOAT3> positions(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++)
+		XMStoreFloat3(&positions[v], XMVector3TransformCoord(XMLoadFloat3(&vertices[v].position), world));
+
+	unsigned int triangle = e.firstTriangle;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3, triangle++)
+	{
+		const XMFLOAT3& a = positions[indices[i]];
+		const XMFLOAT3& b = positions[indices[i + 1]];
+		const XMFLOAT3& c = positions[indices[i + 2]];
+		if (replace)
+			scene.SetTriangle(triangle, a, b, c, e.albedo);
+		else
+			scene.AddTriangle(a, b, c, e.albedo);
+	}
+}
+
+void LightProbeGrid::SetSky(const SH9& radiance) { sky = radiance; }
+void LightProbeGrid::SetLights(const std::vector<Light>& lights) { this->lights = lights; }
+void LightProbeGrid::SetRayCount(unsigned int rays) { rayCount = rays; }
+void LightProbeGrid::SetMaxDistance(float distance) { maxDistance = distance; }
+
+bool LightProbeGrid::HasProbes() { return srv.Get() != 0; }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> LightProbeGrid::GetSRV() { return srv; }
+XMFLOAT3 LightProbeGrid::GetOrigin() { return applied.grid.origin; }
+float LightProbeGrid::GetSpacing() { return applied.grid.spacing; }
+XMUINT3 LightProbeGrid::GetCounts() { return applied.grid.counts; }
+unsigned int LightProbeGrid::GetProbeCount() { return applied.grid.counts.x * applied.grid.counts.y * applied.grid.counts.z; }
+unsigned int LightProbeGrid::GetRayCount() { return rayCount; }
+float LightProbeGrid::GetMaxDistance() { return maxDistance; }
+unsigned int LightProbeGrid::GetBakedCount() { return applied.bakedCount; }
+unsigned int LightProbeGrid::GetInvalidCount() { return applied.invalidCount; }
+float LightProbeGrid::GetBakeTime() { return applied.bakeTime; }
+unsigned int LightProbeGrid::GetTriangleCount() { return applied.triangleCount; }
+float LightProbeGrid::GetSceneTime() { return applied.sceneTime; }
+bool LightProbeGrid::WasSceneRefitted() { return applied.sceneRefitted; }
+const std::vector<float>& LightProbeGrid::GetScalingTimes() { return applied.scalingTimes; }
@@ -0,0 +1,206 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXCollision.h>
+#include <memory>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "GameEntity.h"
+#include "ProbeBaker.h"
+#include "RayScene.h"
+#include "WorkerPool.h"
+
+// Probes along any one axis, at most - past that the spacing
+// doubles until the grid fits
+#define LIGHT_PROBE_MAX_PER_AXIS	64
+
+// Surfaces reflect their material's tint times this, as the
+// rays can't sample textures
+#define LIGHT_PROBE_ALBEDO			0.5f
+
+// --------------------------------------------------------
+// A grid of baked irradiance probes over the static part of
+// the scene ("ProbeGrid" and AmbientIrradiance() in
+// Ambient.hlsli), which lights it in place of the sky's
+// single ambient value
+//
+// - Baked on the CPU by ProbeBaker, casting rays at every
+//   static entity's triangles (see RayScene.h)
+// - Update() compares the static entities with the ones it
+//   last saw, and re-bakes only the probes near those that
+//   were added, removed or moved - unless the grid itself
+//   has to move or grow, when every probe is baked again
+// - Bakes run in the background, on a thread of their own
+//   and a WorkerPool the frame never waits on, and only show
+//   up once ApplyBake() uploads them between frames (like
+//   ShaderHotReload's compiles).  Changes made while a bake
+//   runs are merged into the next one.
+// - Entities that only moved are changed in place in the
+//   ray scene, which is refitted rather than built again
+// - Stored in one 3D texture, the 9 coefficients stacked
+//   along z, so the shaders can sample it trilinearly
+// - Dynamic entities don't show up in the probes, they'd
+//   need baking every frame
+// --------------------------------------------------------
+class LightProbeGrid
+{
+public:
+	// threadCount - Threads of the bake's own pool
+	LightProbeGrid(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		float spacing,
+		unsigned int threadCount);
+	~LightProbeGrid();
+
+	// Catches up with the static entities, starting a bake of
+	// the probes near any that changed - nothing happens if
+	// none did
+	void Update(const std::vector<std::shared_ptr<GameEntity>>& entities);
+
+	// For changes the geometry doesn't show, like the lights,
+	// the sky or the ray settings
+	void BakeAll();
+
+	// Bakes every probe with 1, 2, ... up to all of the bake's
+	// threads, for GetScalingTimes()
+	void MeasureScaling();
+
+	// Uploads the latest finished bake, if there is one, and
+	// returns whether it did.  Call between frames, as the grid
+	// the shaders are given may change with it.
+	bool ApplyBake();
+	bool IsBaking(); // A bake is running, or waiting to
+
+	// All take effect on the next bake
+	void SetSky(const SH9& radiance);
+	void SetLights(const std::vector<Light>& lights);
+	void SetRayCount(unsigned int rays);
+	void SetMaxDistance(float distance);
+
+	// The grid as last uploaded
+	bool HasProbes();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV();
+	DirectX::XMFLOAT3 GetOrigin();
+	float GetSpacing();
+	DirectX::XMUINT3 GetCounts();
+	unsigned int GetProbeCount();
+	unsigned int GetRayCount();
+	float GetMaxDistance();
+
+	// What the last uploaded bake did
+	unsigned int GetBakedCount();
+	unsigned int GetInvalidCount();
+	float GetBakeTime(); // Milliseconds
+	unsigned int GetTriangleCount();
+	float GetSceneTime(); // Milliseconds spent gathering the triangles and building or refitting the BVH
+	bool WasSceneRefitted(); // Rather than built from scratch
+	const std::vector<float>& GetScalingTimes(); // Milliseconds at 1, 2, ... threads
+
+private:
+	// A static entity as it was last seen, kept alive so another
+	// entity created at its address can't pass for it
+	struct Tracked
+	{
+		std::shared_ptr<GameEntity> entity;
+		DirectX::BoundingBox bounds;
+		unsigned int firstTriangle; // Its triangles in the ray scene, in the order added
+		unsigned int triangleCount;
+	};
+
+	// What the bake thread needs of a static entity, copied on
+	// the main thread (meshes never change once made, so they
+	// can be shared)
+	struct SceneEntity
+	{
+		std::shared_ptr<Mesh> mesh;
+		DirectX::XMFLOAT4X4 world;
+		DirectX::XMFLOAT3 albedo;
+		unsigned int firstTriangle;
+	};
+
+	struct Grid
+	{
+		DirectX::XMFLOAT3 origin;
+		float spacing;
+		DirectX::XMUINT3 counts;
+	};
+
+	// Work for the bake thread
+	struct BakeRequest
+	{
+		bool rebuildScene; // "entities" holds every static entity, not only those that moved
+		std::vector<SceneEntity> entities;
+		std::vector<DirectX::BoundingBox> changed; // Where the probes' light may have changed
+		bool bakeAll;
+		bool measureScaling;
+		Grid grid;
+		SH9 sky;
+		std::vector<Light> lights;
+		unsigned int rayCount;
+		float maxDistance;
+	};
+
+	// A finished bake, waiting for ApplyBake()
+	struct BakeResult
+	{
+		Grid grid;
+		std::vector<SH9> probes;
+		unsigned int bakedCount;
+		unsigned int invalidCount;
+		float bakeTime;
+		unsigned int triangleCount;
+		float sceneTime;
+		bool sceneRefitted;
+		std::vector<float> scalingTimes; // Empty unless measured
+	};
+
+	// Main thread
+	SceneEntity Snapshot(const Tracked& t);
+	Grid Layout();
+	void Request(BakeRequest& request);
+	void Upload(const BakeResult& baked);
+
+	// Bake thread
+	void BakeLoop();
+	BakeResult RunBake(const BakeRequest& request);
+	void UpdateScene(const BakeRequest& request, BakeResult& result);
+	void AddEntity(const SceneEntity& e, bool replace);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	float spacing; // What the grid is spaced at, when it fits
+
+	// Only used by the main thread
+	std::map<GameEntity*, Tracked> tracked;
+	Grid grid; // As last laid out
+	SH9 sky;
+	std::vector<Light> lights;
+	unsigned int rayCount;
+	float maxDistance;
+	BakeResult applied; // Without its probes, which are in the texture
+	Microsoft::WRL::ComPtr<ID3D11Texture3D> texture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+
+	// Only used by the bake thread
+	RayScene scene;
+	ProbeBaker baker;
+	float sceneTime;
+	bool sceneRefitted;
+	WorkerPool pool;
+
+	// Guarded by the mutex
+	BakeRequest pending;
+	bool hasPending;
+	bool baking;
+	BakeResult finished;
+	bool hasFinished;
+	bool quitting;
+
+	std::mutex mutex;
+	std::condition_variable wake; // Signalled for a new request, or to quit
+	std::thread thread;
+};
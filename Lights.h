@@ -3,14 +3,8 @@
 #define LIGHT_TYPE_POINT		1
 #define LIGHT_TYPE_SPOT			2
 #include <DirectXMath.h>
+#include "ShaderCBuffers.h"
 
-struct Light {
-	int type;						// Which kind of light? 0, 1 or 2 (see above)
-	DirectX::XMFLOAT3 direction;	// Directional and Spot lights need a direction
-	float range;					// Point and Spot lights have a max range for attenuation
-	DirectX::XMFLOAT3 position;		// Point and Spot lights have a position in space
-	float intensity;				// All lights need an intensity
-	DirectX::XMFLOAT3 color;		// All lights need a color
-	float spotFallOff;				// Spot lights need a value to define their cone size
-	DirectX::XMFLOAT3 padding;		// Purposefully padding to hit the 16-byte boundary
-};
\ No newline at end of file
+// Generated from the shader's own Light struct (see Include.hlsli),
+// so the layouts can't drift apart
+typedef CBuffers::PixelShader::Light Light;
\ No newline at end of file
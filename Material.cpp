@@ -1,20 +1,27 @@
 #include "Material.h"
 
+unsigned int Material::nextId = 0;
+
 Material::Material(DirectX::XMFLOAT4 colorTint, std::shared_ptr<SimpleVertexShader> vs, std::shared_ptr<SimplePixelShader> ps, float roughness)
 {
 	this->colorTint = colorTint;
 	this->vertexShader = vs;
 	this->pixelShader = ps;
 	this->roughness = roughness;
+	this->id = nextId++;
+	ResolveBindings();
 }
 
 std::shared_ptr<SimpleVertexShader> Material::GetVertexShader() { return vertexShader; }
 std::shared_ptr<SimplePixelShader> Material::GetPixelShader() { return pixelShader; }
+std::shared_ptr<SimpleVertexShader> Material::GetInstancedVertexShader() { return instancedVertexShader; }
 
 void Material::SetVertexShader(std::shared_ptr<SimpleVertexShader> vs) { this->vertexShader = vs; }
-void Material::SetPixelShader(std::shared_ptr<SimplePixelShader> ps) { this->pixelShader = ps; }
+void Material::SetPixelShader(std::shared_ptr<SimplePixelShader> ps) { this->pixelShader = ps; ResolveBindings(); }
+void Material::SetInstancedVertexShader(std::shared_ptr<SimpleVertexShader> vs) { this->instancedVertexShader = vs; }
 
 DirectX::XMFLOAT4 Material::GetTint() { return colorTint; }
+unsigned int Material::GetId() { return id; }
 
 float Material::GetRoughness()
 {
@@ -26,11 +33,87 @@ void Material::SetRoughness(float value)
 	roughness = value;
 }
 
-void Material::AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) { textureSRVs.insert({ name, srv }); }
-void Material::AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler) { samplers.insert({ name, sampler }); }
+// --------------------------------------------------------
+// Adding or replacing resources re-resolves the binding
+// tables, so should happen at load time, not while drawing
+// --------------------------------------------------------
+void Material::AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv)
+{
+	textureSRVs[name] = srv;
+	ResolveBindings();
+}
+
+void Material::AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler)
+{
+	samplers[name] = sampler;
+	ResolveBindings();
+}
+
+bool Material::HasTexture(std::string name)
+{
+	return textureSRVs.find(name) != textureSRVs.end();
+}
 
+// --------------------------------------------------------
+// Binds every texture and sampler with a single call each.
+// Only reads the material, so several threads may prepare
+// the same material at once.
+// --------------------------------------------------------
 void Material::PrepareMaterial()
 {
-	for (auto& t : textureSRVs) { pixelShader->SetShaderResourceView(t.first.c_str(), t.second); }
-	for (auto& s : samplers) { pixelShader->SetSamplerState(s.first.c_str(), s.second); }
+	if (!srvTable.empty())
+		pixelShader->SetShaderResourceViews(firstSRVSlot, (unsigned int)srvTable.size(), &srvTable[0]);
+	if (!samplerTable.empty())
+		pixelShader->SetSamplerStates(firstSamplerSlot, (unsigned int)samplerTable.size(), &samplerTable[0]);
+}
+
+// --------------------------------------------------------
+// Turns the name based maps into arrays covering the pixel
+// shader's registers from the lowest to the highest one
+// the material has a resource for
+// - Registers in between without a resource are bound as null
+// - Resources the shader doesn't declare are ignored
+// --------------------------------------------------------
+void Material::ResolveBindings()
+{
+	srvTable.clear();
+	samplerTable.clear();
+	firstSRVSlot = 0;
+	firstSamplerSlot = 0;
+	if (!pixelShader)
+		return;
+
+	unsigned int first = D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT;
+	unsigned int last = 0;
+	for (auto& t : textureSRVs) {
+		const SimpleSRV* info = pixelShader->GetShaderResourceViewInfo(t.first);
+		if (!info) continue;
+		first = info->BindIndex < first ? info->BindIndex : first;
+		last = info->BindIndex > last ? info->BindIndex : last;
+	}
+	if (first <= last) {
+		firstSRVSlot = first;
+		srvTable.resize(last - first + 1, 0);
+		for (auto& t : textureSRVs) {
+			const SimpleSRV* info = pixelShader->GetShaderResourceViewInfo(t.first);
+			if (info) srvTable[info->BindIndex - first] = t.second.Get();
+		}
+	}
+
+	first = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	last = 0;
+	for (auto& s : samplers) {
+		const SimpleSampler* info = pixelShader->GetSamplerInfo(s.first);
+		if (!info) continue;
+		first = info->BindIndex < first ? info->BindIndex : first;
+		last = info->BindIndex > last ? info->BindIndex : last;
+	}
+	if (first <= last) {
+		firstSamplerSlot = first;
+		samplerTable.resize(last - first + 1, 0);
+		for (auto& s : samplers) {
+			const SimpleSampler* info = pixelShader->GetSamplerInfo(s.first);
+			if (info) samplerTable[info->BindIndex - first] = s.second.Get();
+		}
+	}
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <DirectXMath.h>
 #include "SimpleShader.h"
 #include <unordered_map>
+#include <vector>
 
 class Material
 {
@@ -15,20 +16,39 @@ public:
 
 	std::shared_ptr<SimpleVertexShader> GetVertexShader();
 	std::shared_ptr<SimplePixelShader> GetPixelShader();
+	std::shared_ptr<SimpleVertexShader> GetInstancedVertexShader();
 	void SetVertexShader(std::shared_ptr<SimpleVertexShader> vs);
+	void SetInstancedVertexShader(std::shared_ptr<SimpleVertexShader> vs);
 	void SetPixelShader(std::shared_ptr<SimplePixelShader> ps);
 	void SetRoughness(float value);
 	void AddTextureSRV(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	void AddSampler(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> sampler);
+	bool HasTexture(std::string name);
 	void PrepareMaterial();
 	float GetRoughness();
 	DirectX::XMFLOAT4 GetTint();
+	unsigned int GetId();
+
+	// Looks the registers up again, after the pixel shader is reloaded
+	void ResolveBindings();
 private:
 	DirectX::XMFLOAT4 colorTint;
 	std::shared_ptr<SimpleVertexShader> vertexShader;
+	std::shared_ptr<SimpleVertexShader> instancedVertexShader; // Optional, enables instanced drawing
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
+
+	// The maps above resolved against the pixel shader's registers,
+	// so binding is one call each (see ResolveBindings).  Pointers
+	// are owned by the maps.
+	unsigned int firstSRVSlot;
+	unsigned int firstSamplerSlot;
+	std::vector<ID3D11ShaderResourceView*> srvTable;
+	std::vector<ID3D11SamplerState*> samplerTable;
+
 	float roughness;
+	unsigned int id; // Unique per material, used for sorting draws
+	static unsigned int nextId;
 };
 
@@ -2,6 +2,8 @@
 
 using namespace DirectX;
 
+unsigned int Mesh::nextId = 0;
+
 /// <summary>
 /// Constructor
 /// 
@@ -16,6 +18,7 @@ Mesh::Mesh(
 
 	this->indexCount = indexCount;
 	this->deviceContext = deviceContext;
+	this->id = nextId++;
 
 	//Vertex Buffer
 	D3D11_BUFFER_DESC vbd = {};
@@ -46,6 +49,12 @@ Mesh::Mesh(
 	device->CreateBuffer(&ibd, &initialIndexData, indexBuffer.GetAddressOf());
 
 	CalculateTangents(&vertices[0], vertexCount, &indices[0], indexCount);
+
+	BoundingBox::CreateFromPoints(bounds, vertexCount, &vertices[0].position, sizeof(Vertex));
+
+	// Keep a copy for anything that repacks geometry on the CPU
+	this->vertices.assign(vertices, vertices + vertexCount);
+	this->indices.assign(indices, indices + indexCount);
 }
 
 Mesh::Mesh(
@@ -63,6 +72,7 @@ Mesh::Mesh(
 // - NOTE: You'll need to #include <fstream>
 
 	this->deviceContext = deviceContext;
+	this->id = nextId++;
 	//indexBuffer = 
 
 	// File input object
@@ -302,6 +312,12 @@ Mesh::Mesh(
 	indexCount = indexCounter;
 
 	CalculateTangents(&verts[0], vertCounter, &indices[0], indexCounter);
+
+	BoundingBox::CreateFromPoints(bounds, vertCounter, &verts[0].position, sizeof(Vertex));
+
+	// Keep a copy for anything that repacks geometry on the CPU
+	this->vertices = verts;
+	this->indices = indices;
 }
 
 /// <summary>
@@ -397,13 +413,98 @@ int Mesh::GetIndexCount() {
 }
 void Mesh::Draw() {
 	//Draw mesh using buffers
+	SetBuffers(deviceContext.Get());
+	DrawIndexed(deviceContext.Get());
+}
+
+// --------------------------------------------------------
+// Binds this mesh's vertex and index buffers
+//
+// context - The context to bind them on, which may be a
+//           deferred context owned by another thread
+// --------------------------------------------------------
+void Mesh::SetBuffers(ID3D11DeviceContext* context) {
 	UINT stride = sizeof(Vertex);
 	UINT offset = 0;
 
-	deviceContext->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
-	deviceContext->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	context->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
+	context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
+
+// --------------------------------------------------------
+// Binds this mesh's buffers through a state cache, which
+// skips them if they are still bound
+// --------------------------------------------------------
+void Mesh::SetBuffers(StateCache* state) {
+	UINT stride = sizeof(Vertex);
+	UINT offset = 0;
+
+	state->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
+	state->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
+
+// --------------------------------------------------------
+// Draws this mesh without binding anything, for when the
+// buffers are known to still be bound from SetBuffers()
+// --------------------------------------------------------
+void Mesh::DrawIndexed(ID3D11DeviceContext* context) {
+	context->DrawIndexed(indexCount, 0, 0);
+}
+
+// --------------------------------------------------------
+// Draws several copies of this mesh with one call
+//
+// instanceBuffer - Vertex buffer of per instance data, bound to slot 1
+// instanceStride - Size of a single instance's data
+// instanceCount  - How many copies to draw
+// startInstance  - Index of the first instance to read from the buffer
+// --------------------------------------------------------
+void Mesh::DrawInstanced(
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer,
+	unsigned int instanceStride,
+	unsigned int instanceCount,
+	unsigned int startInstance)
+{
+	SetInstancedBuffers(deviceContext.Get(), instanceBuffer, instanceStride);
+	DrawIndexedInstanced(deviceContext.Get(), instanceCount, startInstance);
+}
+
+// --------------------------------------------------------
+// Binds this mesh's buffers plus an instance buffer in slot 1
+// --------------------------------------------------------
+void Mesh::SetInstancedBuffers(
+	ID3D11DeviceContext* context,
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer,
+	unsigned int instanceStride)
+{
+	ID3D11Buffer* buffers[2] = { vertexBuffer.Get(), instanceBuffer.Get() };
+	UINT strides[2] = { sizeof(Vertex), instanceStride };
+	UINT offsets[2] = { 0, 0 };
+
+	context->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
+
+void Mesh::SetInstancedBuffers(
+	StateCache* state,
+	Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer,
+	unsigned int instanceStride)
+{
+	ID3D11Buffer* buffers[2] = { vertexBuffer.Get(), instanceBuffer.Get() };
+	UINT strides[2] = { sizeof(Vertex), instanceStride };
+	UINT offsets[2] = { 0, 0 };
+
+	state->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	state->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+}
 
-	deviceContext->DrawIndexed(indexCount, 0, 0);
+// --------------------------------------------------------
+// Draws instances without binding anything, for when the
+// buffers are still bound from SetInstancedBuffers()
+// --------------------------------------------------------
+void Mesh::DrawIndexedInstanced(ID3D11DeviceContext* context, unsigned int instanceCount, unsigned int startInstance)
+{
+	context->DrawIndexedInstanced(indexCount, instanceCount, 0, 0, startInstance);
 }
 
 void Mesh::SetTint(float r, float g, float b, float a)
@@ -414,4 +515,24 @@ void Mesh::SetTint(float r, float g, float b, float a)
 DirectX::XMFLOAT4 Mesh::GetTint()
 {
 	return colorTint;
-}
\ No newline at end of file
+}
+
+DirectX::BoundingBox Mesh::GetBounds()
+{
+	return bounds;
+}
+
+unsigned int Mesh::GetId()
+{
+	return id;
+}
+
+const std::vector<Vertex>& Mesh::GetVertices()
+{
+	return vertices;
+}
+
+const std::vector<unsigned int>& Mesh::GetIndices()
+{
+	return indices;
+}
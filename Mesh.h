@@ -1,9 +1,11 @@
 #pragma once
 #include "DXCore.h"
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include <wrl/client.h>
 #include <d3d11.h>
 #include "Vertex.h"
+#include "StateCache.h"
 #include <fstream>
 #include <vector>
 
@@ -26,13 +28,39 @@ public:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffed();
 	int GetIndexCount();
 	void Draw();
+	void SetBuffers(ID3D11DeviceContext* context);
+	void SetBuffers(StateCache* state);
+	void DrawIndexed(ID3D11DeviceContext* context);
+	void DrawInstanced(
+		Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer,
+		unsigned int instanceStride,
+		unsigned int instanceCount,
+		unsigned int startInstance);
+	void SetInstancedBuffers(
+		ID3D11DeviceContext* context,
+		Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer,
+		unsigned int instanceStride);
+	void SetInstancedBuffers(
+		StateCache* state,
+		Microsoft::WRL::ComPtr<ID3D11Buffer> instanceBuffer,
+		unsigned int instanceStride);
+	void DrawIndexedInstanced(ID3D11DeviceContext* context, unsigned int instanceCount, unsigned int startInstance);
 	void SetTint(float r, float g, float b, float a);
 	DirectX::XMFLOAT4 GetTint();
+	DirectX::BoundingBox GetBounds();
+	unsigned int GetId();
+	const std::vector<Vertex>& GetVertices();
+	const std::vector<unsigned int>& GetIndices();
 private:
 	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
 	int indexCount;
 	DirectX::XMFLOAT4 colorTint;
+	DirectX::BoundingBox bounds; // Object space bounds, used for culling
+	unsigned int id;			 // Unique per mesh, used for sorting draws
+	static unsigned int nextId;
+	std::vector<Vertex> vertices;		// CPU copies of the buffer contents
+	std::vector<unsigned int> indices;
 };
 
@@ -1,25 +1,84 @@
 #include "Include.hlsli"
+#include "Shadows.hlsli"
+#include "Ambient.hlsli"
 
-//Constant buffer
-cbuffer ExternalData : register(b0)
+// Features, compiled in or out per variant (see ShaderVariants.h
+// and Tools/CompileShaderVariants.bat).  Built without any of
+// these defined, as the project does, everything is on.
+#ifndef USE_NORMAL_MAP
+#define USE_NORMAL_MAP 1
+#endif
+#ifndef USE_ROUGHNESS_MAP
+#define USE_ROUGHNESS_MAP 1
+#endif
+#ifndef USE_METALNESS_MAP
+#define USE_METALNESS_MAP 1
+#endif
+#ifndef USE_SHADOWS
+#define USE_SHADOWS 1 // Shadows fall on the light at shadowLightIndex, and on lights with atlas views
+#endif
+
+// Constant buffers, split by how often they change
+cbuffer PerFrame : register(b0)
 {
-    float4 colorTint;
     float3 cameraPos;
-    float3 ambientColor;
-    Light directionalLight1;
-    Light directionalLight2;
-    Light directionalLight3;
-    Light pointLight1;
-    Light pointLight2;
+    uint globalLightCount; // Directional lights, at the front of ClusterLightIndices
+    float3 cameraForward;
+    int shadowLightIndex; // The light the shadow map is rendered from, or -1
+    uint3 clusterCounts; // Tiles across, tiles down, depth slices
+    float clusterDepthScale;
+    float2 clusterTileScale; // Pixels to tiles
+    float clusterDepthBias;
+    uint lightDebugView; // One of LIGHT_DEBUG_*
+}
+
+cbuffer PerObject : register(b1)
+{
+    float4 colorTint;
+}
+
+// b2 and b3 are ShadowData and AmbientData, in the includes
+cbuffer PerMaterial : register(b4)
+{
+    float roughness; // Used when there's no roughness map
 }
 
 Texture2D Albedo : register(t0); // "t" registers for textures
+#if USE_NORMAL_MAP
 Texture2D NormalMap : register(t1);
+#endif
+#if USE_ROUGHNESS_MAP
 Texture2D RoughnessMap : register(t2);
+#endif
+#if USE_METALNESS_MAP
 Texture2D MetalnessMap : register(t3);
-Texture2D ShadowMap : register(t4); // Adjust index as necessary
+#endif
+#if USE_SHADOWS
+Texture2DArray ShadowMap : register(t4); // A slice per cascade
+Texture2DArray ShadowAtlas : register(t8); // Point and spot light shadows
+StructuredBuffer<ShadowView> ShadowViews : register(t9);
+Texture2DArray ShadowMoments : register(t10); // EVSM only, a slice per cascade
+#endif
+
+// Every light in the scene, uploaded once per frame (see LightManager)
+StructuredBuffer<Light> Lights : register(t5);
+
+// The lights reaching each cluster of the view frustum (see
+// LightBinner): an offset and count into ClusterLightIndices
+StructuredBuffer<uint2> ClusterRanges : register(t6);
+StructuredBuffer<uint> ClusterLightIndices : register(t7);
+
+// The sky's ambient light (see Ambient.hlsli)
+TextureCube SpecularMap : register(t11);
+Texture2D BrdfLut : register(t12);
+Texture3D ProbeGrid : register(t13); // The static scene's baked irradiance, when there's any
+
 SamplerState BasicSampler : register(s0); // "s" registers for samplers
+#if USE_SHADOWS
 SamplerComparisonState ShadowSampler : register(s1);
+SamplerState MomentSampler : register(s2);
+#endif
+SamplerState AmbientSampler : register(s3);
 
 // Struct representing the data we expect to receive from earlier pipeline stages
 // - Should match the output of our corresponding vertex shader
@@ -46,55 +105,15 @@ float3 diffuse(float3 normal, float3 dirToLight)
     return saturate(dot(normal, dirToLight));
 }
 
-float Attenuate(Light light, float3 worldPos)
-{
-    float dist = distance(light.position, worldPos);
-    float att = saturate(1.0f - (dist * dist / (light.range * light.range)));
-    return att * att;
-}
-
-float3 calculateDirLight(
-    Light light,
-    VertexToPixel input,
-    float3 baseColor,
-    float3 specularColor,
-    float roughness,
-    float metalness)
+// Which cluster a pixel falls in - the screen tile it's in,
+// and its depth slice, which grow exponentially with distance
+uint3 FindCluster(VertexToPixel input)
 {
-    float3 lightDir = normalize(-light.direction);
-    float3 V = normalize(cameraPos - input.worldPosition);
-
-    float3 diff = DiffusePBR(input.normal, lightDir);
-    float3 F;
-    float3 spec = MicrofacetBRDF(input.normal, lightDir, V, roughness, specularColor, F);
-
-    float3 balancedDiff = DiffuseEnergyConserve(diff, F, metalness);
-    
-    float3 lightFinal = balancedDiff * baseColor + spec;
-    
-    return lightFinal * light.intensity * light.color;
-}
-
-float3 calculatePointLight(
-    Light light,
-    VertexToPixel input,
-    float3 baseColor,
-    float3 specularColor,
-    float roughness,
-    float metalness)
-{
-    float3 lightDir = normalize(-light.direction);
-    float3 V = normalize(cameraPos - input.worldPosition);
-
-    float3 diff = DiffusePBR(input.normal, lightDir);
-    float3 F;
-    float3 spec = MicrofacetBRDF(input.normal, lightDir, V, roughness, specularColor, F);
-    
-    float3 balancedDiff = DiffuseEnergyConserve(diff, F, metalness);
-    
-    float3 lightFinal = balancedDiff * baseColor + spec; // Tint specular?
-    
-    return lightFinal * light.intensity * light.color * Attenuate(light, input.worldPosition);
+    float viewZ = dot(input.worldPosition - cameraPos, cameraForward);
+    uint3 cluster;
+    cluster.xy = min((uint2)(input.screenPosition.xy * clusterTileScale), clusterCounts.xy - 1);
+    cluster.z = (uint)clamp(floor(log(viewZ) * clusterDepthScale - clusterDepthBias), 0.0f, (float)(clusterCounts.z - 1));
+    return cluster;
 }
 
 // --------------------------------------------------------
@@ -108,21 +127,20 @@ float3 calculatePointLight(
 // --------------------------------------------------------
 float4 main(VertexToPixel input) : SV_TARGET
 {
-    // Perform the perspective divide (divide by W) ourselves
-    input.shadowMapPos /= input.shadowMapPos.w;
-    // Convert the normalized device coordinates to UVs for sampling
-    float2 shadowUV = input.shadowMapPos.xy * 0.5f + 0.5f;
-    shadowUV.y = 1 - shadowUV.y; // Flip the Y
-    // Grab the distances we need: light-to-pixel and closest-surface
-    float distToLight = input.shadowMapPos.z;
-    // Get a ratio of comparison results using SampleCmpLevelZero()
-    float shadowAmount = ShadowMap.SampleCmpLevelZero(
-    ShadowSampler,
-    shadowUV,
-    distToLight).r;
+#if USE_SHADOWS
+    // The vertex shader gives the position in the first cascade,
+    // and the pixel's view depth picks the cascade to use
+    float viewDepth = dot(input.worldPosition - cameraPos, cameraForward);
+    float3 shadowPosition = input.shadowMapPos.xyz / input.shadowMapPos.w;
+    float shadowFootprint = max(length(ddx(shadowPosition.xy)), length(ddy(shadowPosition.xy)));
+    float2x2 shadowRotation = PoissonRotation(input.screenPosition.xy);
+    float shadowAmount = CascadedShadow(ShadowMap, ShadowMoments, ShadowSampler, MomentSampler,
+        shadowPosition, viewDepth, shadowFootprint, shadowRotation);
+#endif
     
     //NORMAL MAPPING
     input.normal = normalize(input.normal);
+#if USE_NORMAL_MAP
     float3 unpackedNormal = NormalMap.Sample(BasicSampler, input.uv).rgb * 2 - 1;
     unpackedNormal = normalize(unpackedNormal); // Dont forget to normalize!
     
@@ -132,14 +150,23 @@ float4 main(VertexToPixel input) : SV_TARGET
     float3 B = cross(T, N);
     float3x3 TBN = float3x3(T, B, N);
     input.normal = mul(unpackedNormal, TBN); // Note multiplication order!
+#endif
 
     //BASE COLOR AND LIGHT
     float3 surfaceColor = pow(Albedo.Sample(BasicSampler, input.uv).rgb, 2.2f);
     float3 totalLight = (0, 0, 0);
     
-    float roughness = RoughnessMap.Sample(BasicSampler, input.uv).r;
+#if USE_ROUGHNESS_MAP
+    float surfaceRoughness = RoughnessMap.Sample(BasicSampler, input.uv).r;
+#else
+    float surfaceRoughness = roughness;
+#endif
     
+#if USE_METALNESS_MAP
     float metalness = MetalnessMap.Sample(BasicSampler, input.uv).r;
+#else
+    float metalness = 0.0f; // Without a map, everything is a non-metal
+#endif
     
     // Specular color determination -----------------
     // Assume albedo texture is actually holding specular color where metalness == 1
@@ -147,13 +174,37 @@ float4 main(VertexToPixel input) : SV_TARGET
     // because of linear texture sampling, so we lerp the specular color to match
     float3 specularColor = lerp(F0_NON_METAL, surfaceColor.rgb, metalness);
 
-    totalLight += calculateDirLight(directionalLight1, input, surfaceColor, specularColor, roughness, metalness);
-    float3 shadowLight = calculateDirLight(directionalLight2, input, surfaceColor, specularColor, roughness, metalness);
-    shadowLight *= shadowAmount;
-    totalLight += shadowLight;
-    totalLight += calculateDirLight(directionalLight3, input, surfaceColor, specularColor, roughness, metalness);
-    totalLight += calculatePointLight(pointLight1, input, surfaceColor, specularColor, roughness, metalness);
-    totalLight += calculatePointLight(pointLight2, input, surfaceColor, specularColor, roughness, metalness);
+    // Only the lights that reach this pixel's cluster, after the
+    // global ones every pixel gets
+    uint3 cluster = FindCluster(input);
+    uint2 clusterRange = ClusterRanges[(cluster.z * clusterCounts.y + cluster.y) * clusterCounts.x + cluster.x];
+
+    if (lightDebugView == LIGHT_DEBUG_LIGHT_COUNT)
+        return float4(HeatColor((globalLightCount + clusterRange.y) / LIGHT_DEBUG_MAX_LIGHTS), 1);
+    if (lightDebugView == LIGHT_DEBUG_SLICES)
+    {
+        // Neighbouring clusters alternate in brightness
+        float checker = ((cluster.x + cluster.y + cluster.z) & 1) ? 1.0f : 0.6f;
+        return float4(HeatColor((float)cluster.z / max(clusterCounts.z - 1, 1)) * checker, 1);
+    }
+
+    float3 V = normalize(cameraPos - input.worldPosition);
+    for (uint i = 0; i < globalLightCount + clusterRange.y; i++)
+    {
+        uint lightIndex = ClusterLightIndices[i < globalLightCount ? i : clusterRange.x + i - globalLightCount];
+        Light light = Lights[lightIndex];
+        float3 lightResult = EvaluateLight(light, input.worldPosition, input.normal, V, surfaceColor, specularColor, surfaceRoughness, metalness);
+#if USE_SHADOWS
+        if ((int)lightIndex == shadowLightIndex)
+            lightResult *= shadowAmount;
+        else if (light.shadowView >= 0)
+            lightResult *= AtlasShadow(ShadowAtlas, ShadowSampler, ShadowViews, light, input.worldPosition, shadowRotation);
+#endif
+        totalLight += lightResult;
+    }
+    float3 ambientIrradiance = AmbientIrradiance(ProbeGrid, AmbientSampler, input.worldPosition, input.normal);
+    totalLight += AmbientLight(SpecularMap, BrdfLut, AmbientSampler, ambientIrradiance,
+        input.normal, V, surfaceColor, specularColor, surfaceRoughness, metalness);
 
     totalLight = pow(totalLight, 1.0f / 2.2f);
     return float4(totalLight, 1);
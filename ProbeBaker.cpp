@@ -0,0 +1,328 @@
+#include "ProbeBaker.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+// How far off a surface its shadow rays start, so they don't
+// hit the surface itself
+#define SURFACE_BIAS	0.001f
+
+ProbeBaker::ProbeBaker() :
+	origin(0.0f, 0.0f, 0.0f),
+	spacing(1.0f),
+	counts(0, 0, 0),
+	rayCount(0),
+	maxDistance(16.0f),
+	skyRadiance(),
+	skyIrradiance(),
+	bakeTime(0.0f),
+	bakedCount(0),
+	invalidCount(0)
+{
+	SetRayCount(128);
+}
+
+ProbeBaker::~ProbeBaker()
+{
+}
+
+void ProbeBaker::SetGrid(const DirectX::XMFLOAT3& origin, float spacing, const DirectX::XMUINT3& counts)
+{
+	this->origin = origin;
+	this->spacing = spacing;
+	this->counts = counts;
+
+	size_t probeCount = (size_t)counts.x * counts.y * counts.z;
+	probes.assign(probeCount, SH9());
+	baked.assign(probeCount, SH9());
+	invalid.assign(probeCount, 0);
+	invalidCount = 0;
+}
+
+void ProbeBaker::SetSky(const SH9& radiance)
+{
+	skyRadiance = radiance;
+	skyIrradiance = radiance;
+	SphericalHarmonics::ConvolveLambert(skyIrradiance);
+}
+
+void ProbeBaker::SetLights(const std::vector<Light>& lights)
+{
+	this->lights = lights;
+}
+
+// --------------------------------------------------------
+// Spreads the rays over the sphere along a Fibonacci spiral,
+// the same directions for every probe, so neighbouring
+// probes don't differ by noise alone
+// --------------------------------------------------------
+void ProbeBaker::SetRayCount(unsigned int rays)
+{
+	rayCount = std::max(rays, 1u);
+	directions.resize(rayCount);
+
+	float goldenAngle = DirectX::XM_PI * (3.0f - sqrtf(5.0f));
+	for (unsigned int i = 0; i < rayCount; i++)
+	{
+		float y = 1.0f - (2.0f * i + 1.0f) / rayCount;
+		float radius = sqrtf(std::max(0.0f, 1.0f - y * y));
+		float phi = goldenAngle * i;
+		directions[i] = DirectX::XMFLOAT3(cosf(phi) * radius, y, sinf(phi) * radius);
+	}
+}
+
+void ProbeBaker::SetMaxDistance(float distance)
+{
+	maxDistance = distance;
+}
+
+// --------------------------------------------------------
+// Threads take a few probes at a time from a shared counter
+// until none are left, so a slow part of the grid doesn't
+// hold up one thread while the rest sit idle
+// --------------------------------------------------------
+void ProbeBaker::Bake(const RayScene& scene, const std::vector<unsigned int>& probeIndices, WorkerPool* pool, unsigned int jobCount)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	unsigned int count = (unsigned int)probeIndices.size();
+	std::atomic<unsigned int> next(0);
+	auto job = [&](unsigned int)
+	{
+		while (true)
+		{
+			unsigned int first = next.fetch_add(PROBE_BAKER_BATCH_SIZE);
+			if (first >= count)
+				break;
+
+			unsigned int last = std::min(first + PROBE_BAKER_BATCH_SIZE, count);
+			for (unsigned int i = first; i < last; i++)
+				BakeProbe(scene, probeIndices[i]);
+		}
+	};
+
+	if (pool && count > 0)
+		pool->Run(std::max(1u, std::min(jobCount, pool->GetThreadCount())), job);
+	else
+		job(0);
+
+	FillInvalid();
+	bakedCount = count;
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	bakeTime = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Projects what each ray sees into SH, weighting every ray
+// the same (they cover equal parts of the sphere), and
+// convolves that for Lambert as the sky's irradiance is
+// --------------------------------------------------------
+void ProbeBaker::BakeProbe(const RayScene& scene, unsigned int index)
+{
+	DirectX::XMFLOAT3 position = GetProbePosition(index);
+	DirectX::XMVECTOR probePosition = DirectX::XMLoadFloat3(&position);
+	float weight = DirectX::XM_PI * 4.0f / rayCount;
+
+	SH9 sh = {};
+	unsigned int backFaces = 0;
+	for (unsigned int r = 0; r < rayCount; r++)
+	{
+		const DirectX::XMFLOAT3& direction = directions[r];
+		DirectX::XMVECTOR rayDirection = DirectX::XMLoadFloat3(&direction);
+
+		RayHit hit;
+		DirectX::XMVECTOR radiance;
+		if (!scene.Intersect(position, direction, maxDistance, hit))
+		{
+			radiance = DirectX::XMVectorMax(SphericalHarmonics::Evaluate(skyRadiance, rayDirection), DirectX::XMVectorZero());
+		}
+		else if (hit.backFace)
+		{
+			backFaces++;
+			continue;
+		}
+		else
+		{
+			DirectX::XMFLOAT3 hitPosition;
+			DirectX::XMStoreFloat3(&hitPosition, DirectX::XMVectorAdd(
+				DirectX::XMVectorMultiplyAdd(rayDirection, DirectX::XMVectorReplicate(hit.distance), probePosition),
+				DirectX::XMVectorScale(DirectX::XMLoadFloat3(&hit.normal), SURFACE_BIAS)));
+			radiance = DirectX::XMVectorMultiply(DirectX::XMLoadFloat3(&hit.albedo), SurfaceLight(scene, hitPosition, hit.normal));
+		}
+
+		SphericalHarmonics::AddSample(sh, rayDirection, DirectX::XMVectorSetW(radiance, 0.0f), weight);
+	}
+
+	SphericalHarmonics::ConvolveLambert(sh);
+	baked[index] = sh;
+	invalid[index] = backFaces > rayCount * PROBE_BAKER_MAX_BACKFACES ? 1 : 0;
+}
+
+// --------------------------------------------------------
+// The light falling on a surface a ray hit: the sky's (not
+// shadowed, as that would take rays of its own) and each
+// light's, the same falloff as EvaluateLight() in
+// Include.hlsli, shadowed by one ray per light
+// --------------------------------------------------------
+DirectX::XMVECTOR ProbeBaker::SurfaceLight(const RayScene& scene, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& normal)
+{
+	DirectX::XMVECTOR surfaceNormal = DirectX::XMLoadFloat3(&normal);
+	DirectX::XMVECTOR surfacePosition = DirectX::XMLoadFloat3(&position);
+	DirectX::XMVECTOR total = DirectX::XMVectorMax(SphericalHarmonics::Evaluate(skyIrradiance, surfaceNormal), DirectX::XMVectorZero());
+
+	for (const Light& light : lights)
+	{
+		if (light.intensity <= 0.0f || (light.color.x <= 0.0f && light.color.y <= 0.0f && light.color.z <= 0.0f))
+			continue;
+
+		DirectX::XMVECTOR toLight;
+		float distance = FLT_MAX;
+		float falloff = 1.0f;
+		if (light.type == LIGHT_TYPE_DIRECTIONAL)
+		{
+			toLight = DirectX::XMVector3Normalize(DirectX::XMVectorNegate(DirectX::XMLoadFloat3(&light.direction)));
+		}
+		else
+		{
+			toLight = DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&light.position), surfacePosition);
+			distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(toLight));
+			if (distance >= light.range || distance <= 0.0f)
+				continue;
+			toLight = DirectX::XMVectorScale(toLight, 1.0f / distance);
+
+			falloff = 1.0f - distance * distance / (light.range * light.range);
+			falloff *= falloff;
+			if (light.type == LIGHT_TYPE_SPOT)
+			{
+				float cosAngle = -DirectX::XMVectorGetX(DirectX::XMVector3Dot(toLight,
+					DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&light.direction))));
+				falloff *= powf(std::max(cosAngle, 0.0f), light.spotFallOff);
+			}
+		}
+
+		float NdotL = DirectX::XMVectorGetX(DirectX::XMVector3Dot(surfaceNormal, toLight));
+		if (NdotL <= 0.0f || falloff <= 0.0f)
+			continue;
+
+		DirectX::XMFLOAT3 rayDirection;
+		DirectX::XMStoreFloat3(&rayDirection, toLight);
+		if (scene.Occluded(position, rayDirection, distance))
+			continue;
+
+		total = DirectX::XMVectorMultiplyAdd(DirectX::XMLoadFloat3(&light.color),
+			DirectX::XMVectorReplicate(light.intensity * falloff * NdotL), total);
+	}
+	return total;
+}
+
+// --------------------------------------------------------
+// Probes inside geometry mostly see its inside, and would
+// darken everything around them, so they take the average
+// of the valid probes next to them (or the sky's light, if
+// there are none)
+// --------------------------------------------------------
+void ProbeBaker::FillInvalid()
+{
+	invalidCount = 0;
+	for (unsigned int z = 0; z < counts.z; z++)
+	for (unsigned int y = 0; y < counts.y; y++)
+	for (unsigned int x = 0; x < counts.x; x++)
+	{
+		unsigned int index = (z * counts.y + y) * counts.x + x;
+		if (!invalid[index])
+		{
+			probes[index] = baked[index];
+			continue;
+		}
+		invalidCount++;
+
+		SH9 sum = {};
+		unsigned int neighbours = 0;
+		for (int dz = -1; dz <= 1; dz++)
+		for (int dy = -1; dy <= 1; dy++)
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			int nx = (int)x + dx;
+			int ny = (int)y + dy;
+			int nz = (int)z + dz;
+			if (nx < 0 || ny < 0 || nz < 0 || nx >= (int)counts.x || ny >= (int)counts.y || nz >= (int)counts.z)
+				continue;
+
+			unsigned int neighbour = (nz * counts.y + ny) * counts.x + nx;
+			if (invalid[neighbour])
+				continue;
+			for (unsigned int k = 0; k < 9; k++)
+				DirectX::XMStoreFloat4(&sum.coefficients[k], DirectX::XMVectorAdd(
+					DirectX::XMLoadFloat4(&sum.coefficients[k]),
+					DirectX::XMLoadFloat4(&baked[neighbour].coefficients[k])));
+			neighbours++;
+		}
+
+		if (neighbours == 0)
+		{
+			probes[index] = skyIrradiance;
+			continue;
+		}
+		for (unsigned int k = 0; k < 9; k++)
+			DirectX::XMStoreFloat4(&sum.coefficients[k], DirectX::XMVectorScale(
+				DirectX::XMLoadFloat4(&sum.coefficients[k]), 1.0f / neighbours));
+		probes[index] = sum;
+	}
+}
+
+void ProbeBaker::MarkProbesNear(const DirectX::BoundingBox& box, std::vector<unsigned char>& marks)
+{
+	if (counts.x == 0 || counts.y == 0 || counts.z == 0)
+		return;
+
+	// The probes in the box grown by the max distance, then
+	// only those actually that close to it
+	float boxMin[3] = { box.Center.x - box.Extents.x, box.Center.y - box.Extents.y, box.Center.z - box.Extents.z };
+	float boxMax[3] = { box.Center.x + box.Extents.x, box.Center.y + box.Extents.y, box.Center.z + box.Extents.z };
+	float gridOrigin[3] = { origin.x, origin.y, origin.z };
+	unsigned int gridCounts[3] = { counts.x, counts.y, counts.z };
+	int first[3];
+	int last[3];
+	for (unsigned int a = 0; a < 3; a++)
+	{
+		first[a] = std::max(0, (int)ceilf((boxMin[a] - maxDistance - gridOrigin[a]) / spacing));
+		last[a] = std::min((int)gridCounts[a] - 1, (int)floorf((boxMax[a] + maxDistance - gridOrigin[a]) / spacing));
+	}
+
+	for (int z = first[2]; z <= last[2]; z++)
+	for (int y = first[1]; y <= last[1]; y++)
+	for (int x = first[0]; x <= last[0]; x++)
+	{
+		float p[3] = { gridOrigin[0] + x * spacing, gridOrigin[1] + y * spacing, gridOrigin[2] + z * spacing };
+		float distanceSq = 0.0f;
+		for (unsigned int a = 0; a < 3; a++)
+		{
+			float outside = std::max(std::max(boxMin[a] - p[a], p[a] - boxMax[a]), 0.0f);
+			distanceSq += outside * outside;
+		}
+		if (distanceSq <= maxDistance * maxDistance)
+			marks[(z * counts.y + y) * counts.x + x] = 1;
+	}
+}
+
+DirectX::XMFLOAT3 ProbeBaker::GetProbePosition(unsigned int index)
+{
+	unsigned int x = index % counts.x;
+	unsigned int y = (index / counts.x) % counts.y;
+	unsigned int z = index / (counts.x * counts.y);
+	return DirectX::XMFLOAT3(origin.x + x * spacing, origin.y + y * spacing, origin.z + z * spacing);
+}
+
+const std::vector<SH9>& ProbeBaker::GetProbes() { return probes; }
+unsigned int ProbeBaker::GetProbeCount() { return (unsigned int)probes.size(); }
+DirectX::XMUINT3 ProbeBaker::GetCounts() { return counts; }
+DirectX::XMFLOAT3 ProbeBaker::GetOrigin() { return origin; }
+float ProbeBaker::GetSpacing() { return spacing; }
+unsigned int ProbeBaker::GetRayCount() { return rayCount; }
+float ProbeBaker::GetMaxDistance() { return maxDistance; }
+float ProbeBaker::GetBakeTime() { return bakeTime; }
+unsigned int ProbeBaker::GetBakedCount() { return bakedCount; }
+unsigned int ProbeBaker::GetInvalidCount() { return invalidCount; }
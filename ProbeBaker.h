@@ -0,0 +1,95 @@
+#pragma once
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+#include "Lights.h"
+#include "RayScene.h"
+#include "SphericalHarmonics.h"
+#include "WorkerPool.h"
+
+// Probes handed to a thread at a time
+#define PROBE_BAKER_BATCH_SIZE	4
+
+// A probe with more than this fraction of its rays hitting
+// backfaces is inside something, and takes its neighbours' light
+#define PROBE_BAKER_MAX_BACKFACES	0.25f
+
+// --------------------------------------------------------
+// Bakes a grid of SH9 irradiance probes by casting rays at
+// a RayScene from each of them, on any number of threads
+//
+// - Needs nothing but DirectXMath and the standard library
+//   (like SphericalHarmonics), so it runs off Windows too
+// - Rays that miss see the sky's radiance, rays that hit see
+//   the surface lit once: every light (with a shadow ray) and
+//   the sky's irradiance, times the surface's albedo
+// - Light straight from the lights isn't baked, the pixel
+//   shader adds that itself - the probes only replace the
+//   sky's ambient light
+// - Rays stop at the max distance, which is what lets a
+//   change to the scene only re-bake the probes near it
+//   (see MarkProbesNear())
+// --------------------------------------------------------
+class ProbeBaker
+{
+public:
+	ProbeBaker();
+	~ProbeBaker();
+
+	// Probe (x, y, z) sits at origin + (x, y, z) * spacing,
+	// and is index (z * counts.y + y) * counts.x + x - this
+	// clears every probe
+	void SetGrid(const DirectX::XMFLOAT3& origin, float spacing, const DirectX::XMUINT3& counts);
+	void SetSky(const SH9& radiance);
+	void SetLights(const std::vector<Light>& lights);
+	void SetRayCount(unsigned int rays);
+	void SetMaxDistance(float distance);
+
+	// Bakes the listed probes, split into jobCount jobs on the
+	// pool (at most its thread count), then fills in any probe
+	// found to be inside geometry from the probes around it
+	void Bake(const RayScene& scene, const std::vector<unsigned int>& probeIndices, WorkerPool* pool, unsigned int jobCount);
+
+	// Sets the mark (one per probe) of every probe within the
+	// max distance of a box, which a change inside the box
+	// could have reached
+	void MarkProbesNear(const DirectX::BoundingBox& box, std::vector<unsigned char>& marks);
+
+	const std::vector<SH9>& GetProbes();
+	DirectX::XMFLOAT3 GetProbePosition(unsigned int index);
+	unsigned int GetProbeCount();
+	DirectX::XMUINT3 GetCounts();
+	DirectX::XMFLOAT3 GetOrigin();
+	float GetSpacing();
+	unsigned int GetRayCount();
+	float GetMaxDistance();
+
+	// What the last Bake() did
+	float GetBakeTime(); // Milliseconds, start to finish
+	unsigned int GetBakedCount();
+	unsigned int GetInvalidCount(); // Probes inside geometry, over the whole grid
+
+private:
+	void BakeProbe(const RayScene& scene, unsigned int index);
+	DirectX::XMVECTOR SurfaceLight(const RayScene& scene, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& normal);
+	void FillInvalid();
+
+	DirectX::XMFLOAT3 origin;
+	float spacing;
+	DirectX::XMUINT3 counts;
+	unsigned int rayCount;
+	float maxDistance;
+
+	SH9 skyRadiance;
+	SH9 skyIrradiance; // For surfaces the rays hit
+	std::vector<Light> lights;
+	std::vector<DirectX::XMFLOAT3> directions; // One per ray, spread evenly over the sphere
+
+	std::vector<SH9> probes;
+	std::vector<SH9> baked; // As baked, before invalid probes are filled in
+	std::vector<unsigned char> invalid;
+
+	float bakeTime;
+	unsigned int bakedCount;
+	unsigned int invalidCount;
+};
@@ -0,0 +1,508 @@
+#include "RayScene.h"
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+#include <utility>
+#include <algorithm>
+
+// Candidate split planes per axis, and the cost of testing a
+// ray against a node's bounds relative to a triangle
+#define SAH_BIN_COUNT	12
+#define SAH_NODE_COST	1.0f
+
+namespace
+{
+	struct Bounds
+	{
+		float min[3];
+		float max[3];
+
+		void Reset()
+		{
+			for (unsigned int a = 0; a < 3; a++)
+			{
+				min[a] = FLT_MAX;
+				max[a] = -FLT_MAX;
+			}
+		}
+
+		void Grow(const float p[3])
+		{
+			for (unsigned int a = 0; a < 3; a++)
+			{
+				min[a] = std::min(min[a], p[a]);
+				max[a] = std::max(max[a], p[a]);
+			}
+		}
+
+		void Grow(const Bounds& b)
+		{
+			for (unsigned int a = 0; a < 3; a++)
+			{
+				min[a] = std::min(min[a], b.min[a]);
+				max[a] = std::max(max[a], b.max[a]);
+			}
+		}
+
+		float HalfArea() const
+		{
+			float x = max[0] - min[0];
+			float y = max[1] - min[1];
+			float z = max[2] - min[2];
+			return x < 0.0f ? 0.0f : x * y + y * z + z * x;
+		}
+	};
+
+	// Where a ray enters a box, or FLT_MAX if it misses it
+	// (or only gets there past maxDistance)
+	float EnterBox(const float boundsMin[3], const float boundsMax[3], const float origin[3], const float invDirection[3], float maxDistance)
+	{
+		float enter = 0.0f;
+		float exit = maxDistance;
+		for (unsigned int a = 0; a < 3; a++)
+		{
+			float t0 = (boundsMin[a] - origin[a]) * invDirection[a];
+			float t1 = (boundsMax[a] - origin[a]) * invDirection[a];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		return enter <= exit ? enter : FLT_MAX;
+	}
+}
+
+RayScene::RayScene() :
+	builtCost(0.0f),
+	buildTime(0.0f)
+{
+}
+
+RayScene::~RayScene()
+{
+}
+
+void RayScene::Clear()
+{
+	triangles.clear();
+	slots.clear();
+	nodes.clear();
+}
+
+void RayScene::AddTriangle(
+	const DirectX::XMFLOAT3& a,
+	const DirectX::XMFLOAT3& b,
+	const DirectX::XMFLOAT3& c,
+	const DirectX::XMFLOAT3& albedo)
+{
+	slots.push_back((unsigned int)triangles.size());
+	triangles.push_back(MakeTriangle(a, b, c, albedo));
+}
+
+void RayScene::SetTriangle(
+	unsigned int index,
+	const DirectX::XMFLOAT3& a,
+	const DirectX::XMFLOAT3& b,
+	const DirectX::XMFLOAT3& c,
+	const DirectX::XMFLOAT3& albedo)
+{
+	triangles[slots[index]] = MakeTriangle(a, b, c, albedo);
+}
+
+RayScene::Triangle RayScene::MakeTriangle(
+	const DirectX::XMFLOAT3& a,
+	const DirectX::XMFLOAT3& b,
+	const DirectX::XMFLOAT3& c,
+	const DirectX::XMFLOAT3& albedo)
+{
+	Triangle t;
+	t.v0 = a;
+	t.edge1 = DirectX::XMFLOAT3(b.x - a.x, b.y - a.y, b.z - a.z);
+	t.edge2 = DirectX::XMFLOAT3(c.x - a.x, c.y - a.y, c.z - a.z);
+	t.albedo = albedo;
+	return t;
+}
+
+// --------------------------------------------------------
+// Builds the BVH over every triangle added since Clear()
+// --------------------------------------------------------
+void RayScene::Build()
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	nodes.clear();
+	if (!triangles.empty())
+	{
+		// Which triangle (in the order added) is where now, as an
+		// earlier Build() may have sorted them already
+		std::vector<unsigned int> slotOf(triangles.size());
+		for (unsigned int i = 0; i < (unsigned int)slots.size(); i++)
+			slotOf[slots[i]] = i;
+
+		std::vector<BuildItem> items(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			const Triangle& t = triangles[i];
+			float v0[3] = { t.v0.x, t.v0.y, t.v0.z };
+			float e1[3] = { t.edge1.x, t.edge1.y, t.edge1.z };
+			float e2[3] = { t.edge2.x, t.edge2.y, t.edge2.z };
+			for (unsigned int a = 0; a < 3; a++)
+			{
+				items[i].boundsMin[a] = v0[a] + std::min(0.0f, std::min(e1[a], e2[a]));
+				items[i].boundsMax[a] = v0[a] + std::max(0.0f, std::max(e1[a], e2[a]));
+				items[i].center[a] = v0[a] + (e1[a] + e2[a]) / 3.0f;
+			}
+			items[i].triangle = slotOf[i];
+		}
+
+		nodes.reserve(triangles.size() / RAY_SCENE_LEAF_SIZE * 2 + 1);
+		BuildNode(0, (unsigned int)triangles.size(), items);
+
+		// The triangles were sorted along with their items
+		for (unsigned int i = 0; i < (unsigned int)items.size(); i++)
+			slots[items[i].triangle] = i;
+	}
+	builtCost = GetCost();
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	buildTime = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Children always come after their parent, so walking the
+// nodes backwards fits every child before the node above it
+// --------------------------------------------------------
+bool RayScene::Refit()
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	for (unsigned int n = (unsigned int)nodes.size(); n-- > 0;)
+	{
+		Node& node = nodes[n];
+		Bounds bounds;
+		bounds.Reset();
+		if (node.count > 0)
+		{
+			for (unsigned int t = node.offset; t < node.offset + node.count; t++)
+			{
+				const Triangle& tri = triangles[t];
+				float v0[3] = { tri.v0.x, tri.v0.y, tri.v0.z };
+				float v1[3] = { tri.v0.x + tri.edge1.x, tri.v0.y + tri.edge1.y, tri.v0.z + tri.edge1.z };
+				float v2[3] = { tri.v0.x + tri.edge2.x, tri.v0.y + tri.edge2.y, tri.v0.z + tri.edge2.z };
+				bounds.Grow(v0);
+				bounds.Grow(v1);
+				bounds.Grow(v2);
+			}
+		}
+		else
+		{
+			const Node& first = nodes[n + 1];
+			const Node& second = nodes[node.offset];
+			bounds.Grow(first.boundsMin);
+			bounds.Grow(first.boundsMax);
+			bounds.Grow(second.boundsMin);
+			bounds.Grow(second.boundsMax);
+		}
+		for (unsigned int a = 0; a < 3; a++)
+		{
+			node.boundsMin[a] = bounds.min[a];
+			node.boundsMax[a] = bounds.max[a];
+		}
+	}
+
+	// Triangles that moved far leave nodes overlapping, which
+	// rays then pay for
+	if (GetCost() > builtCost * RAY_SCENE_REFIT_LIMIT)
+	{
+		Build();
+		return false;
+	}
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	buildTime = elapsed.count();
+	return true;
+}
+
+// --------------------------------------------------------
+// What the surface area heuristic says a ray costs, relative
+// to testing one triangle: how often a ray through the root
+// would enter each node, times what that node then tests
+// --------------------------------------------------------
+float RayScene::GetCost() const
+{
+	if (nodes.empty())
+		return 0.0f;
+
+	Bounds root;
+	root.Reset();
+	root.Grow(nodes[0].boundsMin);
+	root.Grow(nodes[0].boundsMax);
+	float rootArea = root.HalfArea();
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	float cost = 0.0f;
+	for (const Node& node : nodes)
+	{
+		Bounds bounds;
+		bounds.Reset();
+		bounds.Grow(node.boundsMin);
+		bounds.Grow(node.boundsMax);
+		cost += bounds.HalfArea() * (node.count > 0 ? (float)node.count : SAH_NODE_COST);
+	}
+	return cost / rootArea;
+}
+
+// --------------------------------------------------------
+// Makes a node for a range of the triangles, splitting it
+// (and reordering the range to match) where the surface
+// area heuristic says rays will test the fewest triangles
+// --------------------------------------------------------
+unsigned int RayScene::BuildNode(unsigned int first, unsigned int count, std::vector<BuildItem>& items)
+{
+	unsigned int index = (unsigned int)nodes.size();
+	nodes.push_back(Node());
+
+	Bounds bounds;
+	Bounds centerBounds;
+	bounds.Reset();
+	centerBounds.Reset();
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		bounds.Grow(items[i].boundsMin);
+		bounds.Grow(items[i].boundsMax);
+		centerBounds.Grow(items[i].center);
+	}
+	for (unsigned int a = 0; a < 3; a++)
+	{
+		nodes[index].boundsMin[a] = bounds.min[a];
+		nodes[index].boundsMax[a] = bounds.max[a];
+	}
+
+	// The best split over every axis
+	float bestCost = FLT_MAX;
+	unsigned int bestAxis = 0;
+	unsigned int bestBin = 0;
+	if (count > RAY_SCENE_LEAF_SIZE)
+	{
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			float extent = centerBounds.max[axis] - centerBounds.min[axis];
+			if (extent <= 0.0f)
+				continue;
+
+			Bounds binBounds[SAH_BIN_COUNT];
+			unsigned int binCounts[SAH_BIN_COUNT] = {};
+			for (unsigned int b = 0; b < SAH_BIN_COUNT; b++)
+				binBounds[b].Reset();
+
+			float binScale = SAH_BIN_COUNT / extent;
+			for (unsigned int i = first; i < first + count; i++)
+			{
+				unsigned int b = (unsigned int)((items[i].center[axis] - centerBounds.min[axis]) * binScale);
+				b = b < SAH_BIN_COUNT ? b : SAH_BIN_COUNT - 1;
+				binBounds[b].Grow(items[i].boundsMin);
+				binBounds[b].Grow(items[i].boundsMax);
+				binCounts[b]++;
+			}
+
+			// Sweeps from the right first, so the left sweep can
+			// price each plane as it goes
+			float rightAreas[SAH_BIN_COUNT];
+			unsigned int rightCounts[SAH_BIN_COUNT];
+			Bounds right;
+			right.Reset();
+			unsigned int rightCount = 0;
+			for (unsigned int b = SAH_BIN_COUNT - 1; b > 0; b--)
+			{
+				right.Grow(binBounds[b]);
+				rightCount += binCounts[b];
+				rightAreas[b] = right.HalfArea();
+				rightCounts[b] = rightCount;
+			}
+
+			Bounds left;
+			left.Reset();
+			unsigned int leftCount = 0;
+			for (unsigned int b = 0; b < SAH_BIN_COUNT - 1; b++)
+			{
+				left.Grow(binBounds[b]);
+				leftCount += binCounts[b];
+				if (leftCount == 0 || rightCounts[b + 1] == 0)
+					continue;
+
+				float cost = left.HalfArea() * leftCount + rightAreas[b + 1] * rightCounts[b + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+	}
+
+	// A leaf when the range is small, can't be split, or is
+	// cheaper to test as is
+	float leafCost = bounds.HalfArea() * count;
+	float splitCost = bestCost + bounds.HalfArea() * SAH_NODE_COST;
+	if (bestCost == FLT_MAX || (splitCost >= leafCost && count <= RAY_SCENE_LEAF_SIZE * 4))
+	{
+		nodes[index].offset = first;
+		nodes[index].count = count;
+		return index;
+	}
+
+	// Partitions the range by the chosen plane
+	float extent = centerBounds.max[bestAxis] - centerBounds.min[bestAxis];
+	float plane = centerBounds.min[bestAxis] + extent * (bestBin + 1) / SAH_BIN_COUNT;
+	unsigned int i = first;
+	unsigned int j = first + count;
+	while (i < j)
+	{
+		if (items[i].center[bestAxis] < plane)
+			i++;
+		else
+		{
+			j--;
+			std::swap(triangles[i], triangles[j]);
+			std::swap(items[i], items[j]);
+		}
+	}
+
+	unsigned int leftCount = i - first;
+	if (leftCount == 0 || leftCount == count)
+		leftCount = count / 2; // Only if rounding put every center on one side
+
+	nodes[index].count = 0;
+	BuildNode(first, leftCount, items);
+	unsigned int second = BuildNode(first + leftCount, count - leftCount, items);
+	nodes[index].offset = second;
+	return index;
+}
+
+// --------------------------------------------------------
+// Walks the BVH nearest child first, testing each leaf's
+// triangles with Moller-Trumbore, either for the closest
+// hit or (AnyHit) for any hit at all
+// --------------------------------------------------------
+template<bool AnyHit>
+bool RayScene::Trace(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, RayHit* hit) const
+{
+	if (nodes.empty())
+		return false;
+
+	float o[3] = { origin.x, origin.y, origin.z };
+	float d[3] = { direction.x, direction.y, direction.z };
+	float invD[3];
+	for (unsigned int a = 0; a < 3; a++)
+		invD[a] = d[a] != 0.0f ? 1.0f / d[a] : FLT_MAX;
+
+	float closest = maxDistance;
+	const Triangle* closestTriangle = 0;
+	bool closestBackFace = false;
+
+	unsigned int stack[64];
+	unsigned int stackSize = 0;
+	unsigned int current = 0;
+	if (EnterBox(nodes[0].boundsMin, nodes[0].boundsMax, o, invD, closest) == FLT_MAX)
+		return false;
+
+	while (true)
+	{
+		const Node& node = nodes[current];
+		if (node.count > 0)
+		{
+			for (unsigned int t = node.offset; t < node.offset + node.count; t++)
+			{
+				const Triangle& tri = triangles[t];
+				float p[3] = {
+					d[1] * tri.edge2.z - d[2] * tri.edge2.y,
+					d[2] * tri.edge2.x - d[0] * tri.edge2.z,
+					d[0] * tri.edge2.y - d[1] * tri.edge2.x };
+				float det = tri.edge1.x * p[0] + tri.edge1.y * p[1] + tri.edge1.z * p[2];
+				if (fabsf(det) < 1e-12f)
+					continue;
+
+				float invDet = 1.0f / det;
+				float s[3] = { o[0] - tri.v0.x, o[1] - tri.v0.y, o[2] - tri.v0.z };
+				float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invDet;
+				if (u < 0.0f || u > 1.0f)
+					continue;
+
+				float q[3] = {
+					s[1] * tri.edge1.z - s[2] * tri.edge1.y,
+					s[2] * tri.edge1.x - s[0] * tri.edge1.z,
+					s[0] * tri.edge1.y - s[1] * tri.edge1.x };
+				float v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * invDet;
+				if (v < 0.0f || u + v > 1.0f)
+					continue;
+
+				float distance = (tri.edge2.x * q[0] + tri.edge2.y * q[1] + tri.edge2.z * q[2]) * invDet;
+				if (distance <= 0.0f || distance >= closest)
+					continue;
+
+				if (AnyHit)
+					return true;
+				closest = distance;
+				closestTriangle = &tri;
+				closestBackFace = det < 0.0f; // Clockwise (front facing) triangles give a positive det here
+			}
+		}
+		else
+		{
+			// The nearer child is visited next, the other later
+			unsigned int first = current + 1;
+			unsigned int second = node.offset;
+			float enterFirst = EnterBox(nodes[first].boundsMin, nodes[first].boundsMax, o, invD, closest);
+			float enterSecond = EnterBox(nodes[second].boundsMin, nodes[second].boundsMax, o, invD, closest);
+			if (enterSecond < enterFirst)
+			{
+				std::swap(first, second);
+				std::swap(enterFirst, enterSecond);
+			}
+
+			if (enterFirst != FLT_MAX)
+			{
+				if (enterSecond != FLT_MAX && stackSize < 64)
+					stack[stackSize++] = second;
+				current = first;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+			break;
+		current = stack[--stackSize];
+	}
+
+	if (!closestTriangle)
+		return false;
+
+	if (hit)
+	{
+		const Triangle& tri = *closestTriangle;
+		DirectX::XMVECTOR normal = DirectX::XMVector3Normalize(DirectX::XMVector3Cross(
+			DirectX::XMLoadFloat3(&tri.edge1), DirectX::XMLoadFloat3(&tri.edge2)));
+		if (DirectX::XMVectorGetX(DirectX::XMVector3Dot(normal, DirectX::XMLoadFloat3(&direction))) > 0.0f)
+			normal = DirectX::XMVectorNegate(normal);
+
+		hit->distance = closest;
+		DirectX::XMStoreFloat3(&hit->normal, normal);
+		hit->albedo = tri.albedo;
+		hit->backFace = closestBackFace;
+	}
+	return true;
+}
+
+bool RayScene::Intersect(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, RayHit& hit) const
+{
+	return Trace<false>(origin, direction, maxDistance, &hit);
+}
+
+bool RayScene::Occluded(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance) const
+{
+	return Trace<true>(origin, direction, maxDistance, 0);
+}
+
+unsigned int RayScene::GetTriangleCount() const { return (unsigned int)triangles.size(); }
+unsigned int RayScene::GetNodeCount() const { return (unsigned int)nodes.size(); }
+float RayScene::GetBuildTime() const { return buildTime; }
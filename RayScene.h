@@ -0,0 +1,117 @@
+#pragma once
+#include <DirectXMath.h>
+#include <vector>
+
+// Triangles per BVH leaf, at most
+#define RAY_SCENE_LEAF_SIZE	4
+
+// How much worse (by the surface area heuristic) a refitted
+// BVH may get than it was when built, before Refit() builds
+// it again instead
+#define RAY_SCENE_REFIT_LIMIT	1.5f
+
+// What a ray hit first
+struct RayHit
+{
+	float distance;
+	DirectX::XMFLOAT3 normal; // Unit length, facing back along the ray
+	DirectX::XMFLOAT3 albedo;
+	bool backFace; // The ray hit the triangle from behind (counter clockwise, as D3D culls)
+};
+
+// --------------------------------------------------------
+// World space triangles to cast rays against on the CPU,
+// for baking light probes (see ProbeBaker.h)
+//
+// - Needs nothing but DirectXMath, like SphericalHarmonics
+// - Build() sorts the triangles into a BVH, split with the
+//   surface area heuristic over a few bins per axis, and
+//   stored depth first so a node's first child follows it
+// - Read only once built, so any number of threads can
+//   cast rays at it at once
+// - Triangles that move can be changed in place, then the
+//   BVH refitted around them, which is much quicker than
+//   building it again as long as they don't move far
+// --------------------------------------------------------
+class RayScene
+{
+public:
+	RayScene();
+	~RayScene();
+
+	void Clear();
+	void AddTriangle(
+		const DirectX::XMFLOAT3& a,
+		const DirectX::XMFLOAT3& b,
+		const DirectX::XMFLOAT3& c,
+		const DirectX::XMFLOAT3& albedo);
+	void Build();
+
+	// Changes a triangle (numbered in the order they were added,
+	// however Build() sorted them) - call Refit() once they're
+	// all changed, before casting any rays
+	void SetTriangle(
+		unsigned int index,
+		const DirectX::XMFLOAT3& a,
+		const DirectX::XMFLOAT3& b,
+		const DirectX::XMFLOAT3& c,
+		const DirectX::XMFLOAT3& albedo);
+
+	// Grows and shrinks every node's bounds to fit its triangles
+	// again, keeping the tree as it is - unless that leaves it
+	// RAY_SCENE_REFIT_LIMIT times worse than when it was built,
+	// when it's built again.  Returns whether it was refitted.
+	bool Refit();
+
+	// The direction must be unit length
+	bool Intersect(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, RayHit& hit) const;
+	bool Occluded(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance) const;
+
+	unsigned int GetTriangleCount() const;
+	unsigned int GetNodeCount() const;
+	float GetBuildTime() const; // Milliseconds taken by the last Build() or Refit()
+
+private:
+	struct Triangle
+	{
+		DirectX::XMFLOAT3 v0;
+		DirectX::XMFLOAT3 edge1; // v1 - v0
+		DirectX::XMFLOAT3 edge2; // v2 - v0
+		DirectX::XMFLOAT3 albedo;
+	};
+
+	// Leaves have a count, and their triangles start at
+	// "offset" - inner nodes have none, and their second
+	// child is at "offset" (the first is the next node)
+	struct Node
+	{
+		float boundsMin[3];
+		unsigned int offset;
+		float boundsMax[3];
+		unsigned int count;
+	};
+
+	// A triangle's bounds and center, only needed while building
+	struct BuildItem
+	{
+		float boundsMin[3];
+		float boundsMax[3];
+		float center[3];
+		unsigned int triangle; // Its index in the order added
+	};
+
+	static Triangle MakeTriangle(
+		const DirectX::XMFLOAT3& a,
+		const DirectX::XMFLOAT3& b,
+		const DirectX::XMFLOAT3& c,
+		const DirectX::XMFLOAT3& albedo);
+	unsigned int BuildNode(unsigned int first, unsigned int count, std::vector<BuildItem>& items);
+	float GetCost() const;
+	template<bool AnyHit> bool Trace(const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& direction, float maxDistance, RayHit* hit) const;
+
+	std::vector<Triangle> triangles;
+	std::vector<unsigned int> slots; // Where each triangle is in "triangles", by the order added
+	std::vector<Node> nodes;
+	float builtCost; // GetCost() when last built
+	float buildTime;
+};
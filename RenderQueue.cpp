@@ -0,0 +1,136 @@
+#include "RenderQueue.h"
+
+// Field sizes (in bits) of the sort key, from most to least significant
+#define KEY_PASS_BITS		4
+#define KEY_SHADER_BITS		12
+#define KEY_MATERIAL_BITS	16
+#define KEY_MESH_BITS		16
+#define KEY_DEPTH_BITS		16
+
+RenderQueue::RenderQueue()
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+// --------------------------------------------------------
+// Packs the state of a single draw into a sort key
+//
+// pass     - One of the RenderPass values
+// shader   - An ID for the shader combination used
+// material - An ID for the material (0 if it doesn't matter)
+// mesh     - An ID for the mesh
+// depth01  - Distance from the viewer, 0 (near) to 1 (far)
+// --------------------------------------------------------
+uint64_t RenderQueue::MakeKey(
+	unsigned int pass,
+	unsigned int shader,
+	unsigned int material,
+	unsigned int mesh,
+	float depth01)
+{
+	if (depth01 < 0.0f) depth01 = 0.0f;
+	if (depth01 > 1.0f) depth01 = 1.0f;
+	uint64_t depth = (uint64_t)(depth01 * ((1 << KEY_DEPTH_BITS) - 1));
+
+	uint64_t key = pass & ((1 << KEY_PASS_BITS) - 1);
+	key = (key << KEY_SHADER_BITS) | (shader & ((1 << KEY_SHADER_BITS) - 1));
+	key = (key << KEY_MATERIAL_BITS) | (material & ((1 << KEY_MATERIAL_BITS) - 1));
+	key = (key << KEY_MESH_BITS) | (mesh & ((1 << KEY_MESH_BITS) - 1));
+	key = (key << KEY_DEPTH_BITS) | depth;
+	return key;
+}
+
+unsigned int RenderQueue::GetPass(uint64_t key)
+{
+	return (unsigned int)(key >> (64 - KEY_PASS_BITS));
+}
+
+unsigned int RenderQueue::GetMaterial(uint64_t key)
+{
+	return (unsigned int)(key >> (KEY_MESH_BITS + KEY_DEPTH_BITS)) & ((1 << KEY_MATERIAL_BITS) - 1);
+}
+
+// --------------------------------------------------------
+// True if two keys only differ in depth, meaning the draws
+// need exactly the same state (and could be instanced)
+// --------------------------------------------------------
+bool RenderQueue::SameState(uint64_t a, uint64_t b)
+{
+	return (a >> KEY_DEPTH_BITS) == (b >> KEY_DEPTH_BITS);
+}
+
+void RenderQueue::Clear()
+{
+	entities.clear();
+	keys.clear();
+}
+
+void RenderQueue::Add(uint64_t key, GameEntity* entity)
+{
+	keys.push_back(key);
+	entities.push_back(entity);
+}
+
+// --------------------------------------------------------
+// LSD radix sort of the keys, one byte per pass
+// - All eight histograms are built with a single read of the keys
+// - Bytes that are identical across every key (the pass, or
+//   the upper bits of the IDs in a small scene) are skipped
+// - Stable, so equal keys keep the order they were added in
+// --------------------------------------------------------
+void RenderQueue::Sort()
+{
+	unsigned int count = (unsigned int)keys.size();
+	order.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+		order[i] = i;
+
+	if (count < 2)
+		return;
+
+	scratchKeys.resize(count);
+	scratchOrder.resize(count);
+
+	unsigned int histograms[8][256] = {};
+	for (unsigned int i = 0; i < count; i++)
+	{
+		uint64_t key = keys[i];
+		for (unsigned int b = 0; b < 8; b++)
+			histograms[b][(key >> (b * 8)) & 0xFF]++;
+	}
+
+	for (unsigned int b = 0; b < 8; b++)
+	{
+		unsigned int* histogram = histograms[b];
+
+		// Every key has the same value for this byte?
+		if (histogram[(keys[0] >> (b * 8)) & 0xFF] == count)
+			continue;
+
+		// Turn counts into starting offsets
+		unsigned int offset = 0;
+		for (unsigned int d = 0; d < 256; d++)
+		{
+			unsigned int digitCount = histogram[d];
+			histogram[d] = offset;
+			offset += digitCount;
+		}
+
+		// Scatter into the scratch arrays, then swap them in
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned int dest = histogram[(keys[i] >> (b * 8)) & 0xFF]++;
+			scratchKeys[dest] = keys[i];
+			scratchOrder[dest] = order[i];
+		}
+		keys.swap(scratchKeys);
+		order.swap(scratchOrder);
+	}
+}
+
+unsigned int RenderQueue::GetCount() { return (unsigned int)keys.size(); }
+uint64_t RenderQueue::GetKey(unsigned int sortedIndex) { return keys[sortedIndex]; }
+GameEntity* RenderQueue::GetEntity(unsigned int sortedIndex) { return entities[order[sortedIndex]]; }
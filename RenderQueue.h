@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+class GameEntity;
+
+// Shadow map cascades, each drawn as its own pass
+// - Must match MAX_SHADOW_CASCADES in Shadows.hlsli
+#define MAX_SHADOW_CASCADES 4
+
+// --------------------------------------------------------
+// Passes, in the order they are drawn.  The pass sits in
+// the top bits of the sort key, so it always sorts first.
+// --------------------------------------------------------
+enum RenderPass
+{
+	RENDER_PASS_STATIC_SHADOW = 0, // Static casters into each cascade's cache, when it's out of date
+	RENDER_PASS_SHADOW = RENDER_PASS_STATIC_SHADOW + MAX_SHADOW_CASCADES, // The first cascade, cascade c is RENDER_PASS_SHADOW + c
+	RENDER_PASS_ATLAS_SHADOW = RENDER_PASS_SHADOW + MAX_SHADOW_CASCADES, // Point and spot lights, the atlas view is the key's material
+	RENDER_PASS_OPAQUE,
+	RENDER_PASS_COUNT
+};
+
+inline bool IsShadowPass(unsigned int pass) { return pass < RENDER_PASS_OPAQUE; }
+inline bool IsStaticShadowPass(unsigned int pass) { return pass < RENDER_PASS_SHADOW; }
+inline bool IsCascadePass(unsigned int pass) { return pass < RENDER_PASS_ATLAS_SHADOW; }
+inline unsigned int GetPassCascade(unsigned int pass) { return (pass - RENDER_PASS_STATIC_SHADOW) % MAX_SHADOW_CASCADES; }
+
+// --------------------------------------------------------
+// A frame's worth of draws, each packed into a 64 bit key
+// and radix sorted so that draws sharing state end up next
+// to each other:
+//
+//  63    60 59      48 47        32 31       16 15       0
+//  | pass  | shader   | material    | mesh      | depth   |
+//
+// Depth is the least significant field, so draws of the
+// same mesh and material are also sorted front to back.
+// --------------------------------------------------------
+class RenderQueue
+{
+public:
+	RenderQueue();
+	~RenderQueue();
+
+	// Key helpers
+	static uint64_t MakeKey(
+		unsigned int pass,
+		unsigned int shader,
+		unsigned int material,
+		unsigned int mesh,
+		float depth01);
+	static unsigned int GetPass(uint64_t key);
+	static unsigned int GetMaterial(uint64_t key);
+	static bool SameState(uint64_t a, uint64_t b);
+
+	// Building and sorting
+	void Clear();
+	void Add(uint64_t key, GameEntity* entity);
+	void Sort();
+
+	// Reading back in sorted order
+	unsigned int GetCount();
+	uint64_t GetKey(unsigned int sortedIndex);
+	GameEntity* GetEntity(unsigned int sortedIndex);
+
+private:
+	std::vector<GameEntity*> entities;	// In the order they were added
+	std::vector<uint64_t> keys;			// Sorted in place by Sort()
+	std::vector<unsigned int> order;	// Sorted index -> added index
+	std::vector<uint64_t> scratchKeys;
+	std::vector<unsigned int> scratchOrder;
+};
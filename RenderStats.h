@@ -0,0 +1,55 @@
+#pragma once
+#include "RenderQueue.h"
+
+// --------------------------------------------------------
+// Per-frame rendering counters, filled in by Game::Draw()
+// and shown in the "Render Stats" section of the UI
+// --------------------------------------------------------
+struct RenderStats
+{
+	unsigned int drawCalls = 0;				// Every Draw*() call issued this frame
+	unsigned int instancedDrawCalls = 0;	// The subset of the above that were instanced
+	unsigned int instancesDrawn = 0;		// Entities drawn through instanced calls
+	unsigned int entitiesVisible = 0;		// Entities that survived frustum culling
+	unsigned int entitiesCulled = 0;		// Entities skipped by frustum culling
+	unsigned int queuedDraws = 0;			// Items sorted in the render queue
+	unsigned int materialChanges = 0;		// Times a material's textures and samplers were bound
+	unsigned int shadowCasters[MAX_SHADOW_CASCADES] = {}; // Entities drawn into each cascade (CPU culled paths)
+	unsigned int shadowCastersDrawn = 0;	// Entities drawn into any cascade
+	unsigned int shadowCastersCulled = 0;	// Entities that couldn't shadow anything visible
+
+	// State the draw submission didn't have to set again,
+	// because the previous draw in sorted order used it too
+	unsigned int shaderChangesSkipped = 0;
+	unsigned int materialChangesSkipped = 0;
+	unsigned int meshChangesSkipped = 0;
+	unsigned int constantUploadsSkipped = 0;
+
+	// Context calls made through the state caches, totalled at
+	// the end of a frame (see StateCache)
+	unsigned int stateCallsIssued = 0;
+	unsigned int stateCallsFiltered = 0;
+
+	// Constant buffer traffic, totalled over every thread
+	// by ISimpleShader::GetUploadStats() at the end of a frame
+	unsigned int constantBytesUploaded = 0;
+	unsigned int constantBuffersUploaded = 0;
+	unsigned int constantBuffersSkipped = 0;
+	unsigned int constantRingUploads = 0;	// Uploads that went to the constant ring
+
+	// Zeroes the counters at the start of a frame
+	void Reset() { *this = RenderStats(); }
+
+	// Adds the draw counters recorded by another thread
+	void MergeDraws(const RenderStats& other)
+	{
+		drawCalls += other.drawCalls;
+		instancedDrawCalls += other.instancedDrawCalls;
+		instancesDrawn += other.instancesDrawn;
+		materialChanges += other.materialChanges;
+		shaderChangesSkipped += other.shaderChangesSkipped;
+		materialChangesSkipped += other.materialChangesSkipped;
+		meshChangesSkipped += other.meshChangesSkipped;
+		constantUploadsSkipped += other.constantUploadsSkipped;
+	}
+};
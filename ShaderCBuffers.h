@@ -0,0 +1,190 @@
+// Generated by Tools/GenerateCBufferStructs.py - do not edit
+// Regenerate from the compiled shaders after changing a cbuffer:
+//   PixelShader.cso VertexShader.cso
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstddef>
+
+namespace CBuffers
+{
+	// An element of an array whose type is smaller than 16
+	// bytes, which the shader compiler pads to 16 bytes
+	template<typename T>
+	struct alignas(16) ArrayElement
+	{
+		T value;
+	};
+
+	namespace PixelShader
+	{
+		struct Light
+		{
+			int type;
+			DirectX::XMFLOAT3 direction;
+			float range;
+			DirectX::XMFLOAT3 position;
+			float intensity;
+			DirectX::XMFLOAT3 color;
+			float spotFallOff;
+			int shadowView;
+			DirectX::XMFLOAT2 padding;
+		};
+		static_assert(offsetof(Light, type) == 0, "Light.type doesn't match the shader");
+		static_assert(offsetof(Light, direction) == 4, "Light.direction doesn't match the shader");
+		static_assert(offsetof(Light, range) == 16, "Light.range doesn't match the shader");
+		static_assert(offsetof(Light, position) == 20, "Light.position doesn't match the shader");
+		static_assert(offsetof(Light, intensity) == 32, "Light.intensity doesn't match the shader");
+		static_assert(offsetof(Light, color) == 36, "Light.color doesn't match the shader");
+		static_assert(offsetof(Light, spotFallOff) == 48, "Light.spotFallOff doesn't match the shader");
+		static_assert(offsetof(Light, shadowView) == 52, "Light.shadowView doesn't match the shader");
+		static_assert(offsetof(Light, padding) == 56, "Light.padding doesn't match the shader");
+		static_assert(sizeof(Light) == 64, "Light doesn't match the shader");
+
+		struct ShadowView
+		{
+			DirectX::XMFLOAT4X4 viewProjection;
+			DirectX::XMFLOAT4 atlasRect;
+			DirectX::XMFLOAT4 projection;
+		};
+		static_assert(offsetof(ShadowView, viewProjection) == 0, "ShadowView.viewProjection doesn't match the shader");
+		static_assert(offsetof(ShadowView, atlasRect) == 64, "ShadowView.atlasRect doesn't match the shader");
+		static_assert(offsetof(ShadowView, projection) == 80, "ShadowView.projection doesn't match the shader");
+		static_assert(sizeof(ShadowView) == 96, "ShadowView doesn't match the shader");
+
+		// cbuffer PerFrame : register(b0)
+		struct alignas(16) PerFrame
+		{
+			DirectX::XMFLOAT3 cameraPos;
+			unsigned int globalLightCount;
+			DirectX::XMFLOAT3 cameraForward;
+			int shadowLightIndex;
+			DirectX::XMUINT3 clusterCounts;
+			float clusterDepthScale;
+			DirectX::XMFLOAT2 clusterTileScale;
+			float clusterDepthBias;
+			unsigned int lightDebugView;
+		};
+		static_assert(offsetof(PerFrame, cameraPos) == 0, "PerFrame.cameraPos doesn't match the shader");
+		static_assert(offsetof(PerFrame, globalLightCount) == 12, "PerFrame.globalLightCount doesn't match the shader");
+		static_assert(offsetof(PerFrame, cameraForward) == 16, "PerFrame.cameraForward doesn't match the shader");
+		static_assert(offsetof(PerFrame, shadowLightIndex) == 28, "PerFrame.shadowLightIndex doesn't match the shader");
+		static_assert(offsetof(PerFrame, clusterCounts) == 32, "PerFrame.clusterCounts doesn't match the shader");
+		static_assert(offsetof(PerFrame, clusterDepthScale) == 44, "PerFrame.clusterDepthScale doesn't match the shader");
+		static_assert(offsetof(PerFrame, clusterTileScale) == 48, "PerFrame.clusterTileScale doesn't match the shader");
+		static_assert(offsetof(PerFrame, clusterDepthBias) == 56, "PerFrame.clusterDepthBias doesn't match the shader");
+		static_assert(offsetof(PerFrame, lightDebugView) == 60, "PerFrame.lightDebugView doesn't match the shader");
+		static_assert(sizeof(PerFrame) == 64, "PerFrame doesn't match the shader");
+
+		// cbuffer PerObject : register(b1)
+		struct alignas(16) PerObject
+		{
+			DirectX::XMFLOAT4 colorTint;
+		};
+		static_assert(offsetof(PerObject, colorTint) == 0, "PerObject.colorTint doesn't match the shader");
+		static_assert(sizeof(PerObject) == 16, "PerObject doesn't match the shader");
+
+		// cbuffer ShadowData : register(b2)
+		struct alignas(16) ShadowData
+		{
+			DirectX::XMFLOAT4 cascadeScales[4];
+			DirectX::XMFLOAT4 cascadeOffsets[4];
+			DirectX::XMFLOAT4 cascadeSplits;
+			unsigned int cascadeCount;
+			float cascadeBlend;
+			float atlasTexelSize;
+			unsigned int filterMode;
+			unsigned int filterTaps;
+			float filterRadius;
+			DirectX::XMFLOAT2 cascadeProjection;
+			float cascadeTexelSize;
+			float sunSize;
+			float lightSize;
+			float evsmBleedReduction;
+			DirectX::XMFLOAT2 evsmExponents;
+			unsigned char padding0_[8];
+		};
+		static_assert(offsetof(ShadowData, cascadeScales) == 0, "ShadowData.cascadeScales doesn't match the shader");
+		static_assert(offsetof(ShadowData, cascadeOffsets) == 64, "ShadowData.cascadeOffsets doesn't match the shader");
+		static_assert(offsetof(ShadowData, cascadeSplits) == 128, "ShadowData.cascadeSplits doesn't match the shader");
+		static_assert(offsetof(ShadowData, cascadeCount) == 144, "ShadowData.cascadeCount doesn't match the shader");
+		static_assert(offsetof(ShadowData, cascadeBlend) == 148, "ShadowData.cascadeBlend doesn't match the shader");
+		static_assert(offsetof(ShadowData, atlasTexelSize) == 152, "ShadowData.atlasTexelSize doesn't match the shader");
+		static_assert(offsetof(ShadowData, filterMode) == 156, "ShadowData.filterMode doesn't match the shader");
+		static_assert(offsetof(ShadowData, filterTaps) == 160, "ShadowData.filterTaps doesn't match the shader");
+		static_assert(offsetof(ShadowData, filterRadius) == 164, "ShadowData.filterRadius doesn't match the shader");
+		static_assert(offsetof(ShadowData, cascadeProjection) == 168, "ShadowData.cascadeProjection doesn't match the shader");
+		static_assert(offsetof(ShadowData, cascadeTexelSize) == 176, "ShadowData.cascadeTexelSize doesn't match the shader");
+		static_assert(offsetof(ShadowData, sunSize) == 180, "ShadowData.sunSize doesn't match the shader");
+		static_assert(offsetof(ShadowData, lightSize) == 184, "ShadowData.lightSize doesn't match the shader");
+		static_assert(offsetof(ShadowData, evsmBleedReduction) == 188, "ShadowData.evsmBleedReduction doesn't match the shader");
+		static_assert(offsetof(ShadowData, evsmExponents) == 192, "ShadowData.evsmExponents doesn't match the shader");
+		static_assert(sizeof(ShadowData) == 208, "ShadowData doesn't match the shader");
+
+		// cbuffer AmbientData : register(b3)
+		struct alignas(16) AmbientData
+		{
+			DirectX::XMFLOAT4 irradiance[9];
+			float diffuseIntensity;
+			float specularIntensity;
+			float specularMipCount;
+			float useProbes;
+			DirectX::XMFLOAT3 probeGridOrigin;
+			float probeGridSpacing;
+			DirectX::XMFLOAT3 probeGridCounts;
+			float probeNormalBias;
+		};
+		static_assert(offsetof(AmbientData, irradiance) == 0, "AmbientData.irradiance doesn't match the shader");
+		static_assert(offsetof(AmbientData, diffuseIntensity) == 144, "AmbientData.diffuseIntensity doesn't match the shader");
+		static_assert(offsetof(AmbientData, specularIntensity) == 148, "AmbientData.specularIntensity doesn't match the shader");
+		static_assert(offsetof(AmbientData, specularMipCount) == 152, "AmbientData.specularMipCount doesn't match the shader");
+		static_assert(offsetof(AmbientData, useProbes) == 156, "AmbientData.useProbes doesn't match the shader");
+		static_assert(offsetof(AmbientData, probeGridOrigin) == 160, "AmbientData.probeGridOrigin doesn't match the shader");
+		static_assert(offsetof(AmbientData, probeGridSpacing) == 172, "AmbientData.probeGridSpacing doesn't match the shader");
+		static_assert(offsetof(AmbientData, probeGridCounts) == 176, "AmbientData.probeGridCounts doesn't match the shader");
+		static_assert(offsetof(AmbientData, probeNormalBias) == 188, "AmbientData.probeNormalBias doesn't match the shader");
+		static_assert(sizeof(AmbientData) == 192, "AmbientData doesn't match the shader");
+
+		// cbuffer PerMaterial : register(b4)
+		struct alignas(16) PerMaterial
+		{
+			float roughness;
+			unsigned char padding0_[12];
+		};
+		static_assert(offsetof(PerMaterial, roughness) == 0, "PerMaterial.roughness doesn't match the shader");
+		static_assert(sizeof(PerMaterial) == 16, "PerMaterial doesn't match the shader");
+	}
+
+	namespace VertexShader
+	{
+		// cbuffer PerFrame : register(b0)
+		struct alignas(16) PerFrame
+		{
+			DirectX::XMFLOAT4X4 lightView;
+			DirectX::XMFLOAT4X4 lightProjection;
+		};
+		static_assert(offsetof(PerFrame, lightView) == 0, "PerFrame.lightView doesn't match the shader");
+		static_assert(offsetof(PerFrame, lightProjection) == 64, "PerFrame.lightProjection doesn't match the shader");
+		static_assert(sizeof(PerFrame) == 128, "PerFrame doesn't match the shader");
+
+		// cbuffer PerPass : register(b1)
+		struct alignas(16) PerPass
+		{
+			DirectX::XMFLOAT4X4 view;
+			DirectX::XMFLOAT4X4 projection;
+		};
+		static_assert(offsetof(PerPass, view) == 0, "PerPass.view doesn't match the shader");
+		static_assert(offsetof(PerPass, projection) == 64, "PerPass.projection doesn't match the shader");
+		static_assert(sizeof(PerPass) == 128, "PerPass doesn't match the shader");
+
+		// cbuffer PerObject : register(b2)
+		struct alignas(16) PerObject
+		{
+			DirectX::XMFLOAT4X4 world;
+			DirectX::XMFLOAT4X4 worldInvTranspose;
+		};
+		static_assert(offsetof(PerObject, world) == 0, "PerObject.world doesn't match the shader");
+		static_assert(offsetof(PerObject, worldInvTranspose) == 64, "PerObject.worldInvTranspose doesn't match the shader");
+		static_assert(sizeof(PerObject) == 128, "PerObject doesn't match the shader");
+	}
+}
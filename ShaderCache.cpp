@@ -0,0 +1,472 @@
+#include "ShaderCache.h"
+#include <fstream>
+#include <atomic>
+#include <cstring>
+
+// Identifies a reflection cache file, bump the version
+// whenever the layout below changes
+#define CACHE_MAGIC		0x4C464552 // "REFL"
+#define CACHE_VERSION	1
+
+// Compiled shaders start with "DXBC", a 16 byte checksum
+// of the rest of the file, a one and the total size
+#define DXBC_MAGIC			0x43425844 // "DXBC"
+#define DXBC_HEADER_SIZE	32
+#define DXBC_CHECKSUM_SIZE	16
+
+unsigned int ShaderCache::hits = 0;
+unsigned int ShaderCache::misses = 0;
+
+// --------------------------------------------------------
+// A blob whose data is a read only view of a mapped file,
+// so the bytecode is never copied.  Unmaps on final release.
+// --------------------------------------------------------
+class MappedBlob : public ID3DBlob
+{
+public:
+	MappedBlob(void* view, SIZE_T size) : refCount(1), view(view), size(size) { }
+	virtual ~MappedBlob() { UnmapViewOfFile(view); }
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object) override
+	{
+		if (!object)
+			return E_POINTER;
+
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(ID3D10Blob))
+		{
+			*object = static_cast<ID3DBlob*>(this);
+			AddRef();
+			return S_OK;
+		}
+
+		*object = 0;
+		return E_NOINTERFACE;
+	}
+
+	ULONG STDMETHODCALLTYPE AddRef() override { return ++refCount; }
+
+	ULONG STDMETHODCALLTYPE Release() override
+	{
+		ULONG count = --refCount;
+		if (count == 0)
+			delete this;
+		return count;
+	}
+
+	LPVOID STDMETHODCALLTYPE GetBufferPointer() override { return view; }
+	SIZE_T STDMETHODCALLTYPE GetBufferSize() override { return size; }
+
+private:
+	std::atomic<ULONG> refCount;
+	void* view;
+	SIZE_T size;
+};
+
+// --------------------------------------------------------
+// Appends values to, and reads them back from, a cache file
+// - Reading past the end makes every later read fail, so
+//   a truncated file is caught by checking Ok() once
+// --------------------------------------------------------
+class CacheWriter
+{
+public:
+	std::vector<unsigned char> data;
+
+	void Write(const void* bytes, size_t size)
+	{
+		const unsigned char* start = (const unsigned char*)bytes;
+		data.insert(data.end(), start, start + size);
+	}
+
+	void WriteUInt(unsigned int value) { Write(&value, sizeof(value)); }
+
+	void WriteString(const std::string& str)
+	{
+		WriteUInt((unsigned int)str.size());
+		Write(str.data(), str.size());
+	}
+};
+
+class CacheReader
+{
+public:
+	CacheReader(const std::vector<unsigned char>& data) : data(data), offset(0), ok(true) { }
+
+	bool Ok() { return ok; }
+
+	bool Read(void* bytes, size_t size)
+	{
+		if (!ok || size > data.size() - offset)
+		{
+			ok = false;
+			return false;
+		}
+		memcpy(bytes, &data[offset], size);
+		offset += size;
+		return true;
+	}
+
+	unsigned int ReadUInt()
+	{
+		unsigned int value = 0;
+		Read(&value, sizeof(value));
+		return value;
+	}
+
+	std::string ReadString()
+	{
+		unsigned int length = ReadUInt();
+		if (!ok || length > data.size() - offset)
+		{
+			ok = false;
+			return std::string();
+		}
+		std::string str((const char*)&data[offset], length);
+		offset += length;
+		return str;
+	}
+
+private:
+	const std::vector<unsigned char>& data;
+	size_t offset;
+	bool ok;
+};
+
+// --------------------------------------------------------
+// Picks the input layout format for a vertex shader input
+// from its component mask and type
+// --------------------------------------------------------
+static DXGI_FORMAT InputFormat(BYTE mask, D3D_REGISTER_COMPONENT_TYPE componentType)
+{
+	if (mask == 1)
+	{
+		if (componentType == D3D_REGISTER_COMPONENT_UINT32) return DXGI_FORMAT_R32_UINT;
+		else if (componentType == D3D_REGISTER_COMPONENT_SINT32) return DXGI_FORMAT_R32_SINT;
+		else if (componentType == D3D_REGISTER_COMPONENT_FLOAT32) return DXGI_FORMAT_R32_FLOAT;
+	}
+	else if (mask <= 3)
+	{
+		if (componentType == D3D_REGISTER_COMPONENT_UINT32) return DXGI_FORMAT_R32G32_UINT;
+		else if (componentType == D3D_REGISTER_COMPONENT_SINT32) return DXGI_FORMAT_R32G32_SINT;
+		else if (componentType == D3D_REGISTER_COMPONENT_FLOAT32) return DXGI_FORMAT_R32G32_FLOAT;
+	}
+	else if (mask <= 7)
+	{
+		if (componentType == D3D_REGISTER_COMPONENT_UINT32) return DXGI_FORMAT_R32G32B32_UINT;
+		else if (componentType == D3D_REGISTER_COMPONENT_SINT32) return DXGI_FORMAT_R32G32B32_SINT;
+		else if (componentType == D3D_REGISTER_COMPONENT_FLOAT32) return DXGI_FORMAT_R32G32B32_FLOAT;
+	}
+	else if (mask <= 15)
+	{
+		if (componentType == D3D_REGISTER_COMPONENT_UINT32) return DXGI_FORMAT_R32G32B32A32_UINT;
+		else if (componentType == D3D_REGISTER_COMPONENT_SINT32) return DXGI_FORMAT_R32G32B32A32_SINT;
+		else if (componentType == D3D_REGISTER_COMPONENT_FLOAT32) return DXGI_FORMAT_R32G32B32A32_FLOAT;
+	}
+	return DXGI_FORMAT_UNKNOWN;
+}
+
+// --------------------------------------------------------
+// Returns the DXBC header checksum, or null if the bytecode
+// doesn't look like a DXBC container (so it isn't cached)
+// --------------------------------------------------------
+static const unsigned char* BytecodeChecksum(ID3DBlob* bytecode)
+{
+	if (bytecode->GetBufferSize() < DXBC_HEADER_SIZE)
+		return 0;
+
+	const unsigned char* bytes = (const unsigned char*)bytecode->GetBufferPointer();
+	unsigned int magic;
+	memcpy(&magic, bytes, sizeof(magic));
+	return magic == DXBC_MAGIC ? bytes + 4 : 0;
+}
+
+unsigned int ShaderCache::GetHitCount() { return hits; }
+unsigned int ShaderCache::GetMissCount() { return misses; }
+
+void ShaderCache::ResetStats()
+{
+	hits = 0;
+	misses = 0;
+}
+
+// --------------------------------------------------------
+// Maps a compiled shader file into memory
+//
+// Returns the mapped bytecode, or null if the file couldn't
+// be opened or mapped (the caller can still try reading it)
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3DBlob> ShaderCache::MapBytecode(LPCWSTR shaderFile)
+{
+	Microsoft::WRL::ComPtr<ID3DBlob> blob;
+
+	HANDLE file = CreateFileW(shaderFile, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return blob;
+
+	LARGE_INTEGER size = {};
+	HANDLE mapping = 0;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+
+	// The view keeps the mapping (and file) alive on its own
+	void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+	if (mapping)
+		CloseHandle(mapping);
+	CloseHandle(file);
+
+	if (view)
+		blob.Attach(new MappedBlob(view, (SIZE_T)size.QuadPart));
+	return blob;
+}
+
+// --------------------------------------------------------
+// Gets the reflection results for a shader, from its cache
+// file if that is still valid, otherwise by reflecting the
+// bytecode and writing a new cache file
+//
+// shaderFile - The compiled shader the bytecode came from
+// bytecode   - The compiled shader
+// reflection - Receives the results
+//
+// Returns false if the bytecode couldn't be reflected
+// --------------------------------------------------------
+bool ShaderCache::GetReflection(LPCWSTR shaderFile, ID3DBlob* bytecode, ShaderReflection& reflection)
+{
+	std::wstring cacheFile = std::wstring(shaderFile) + L".refl";
+	if (Load(cacheFile, bytecode, reflection))
+	{
+		hits++;
+		return true;
+	}
+
+	misses++;
+	if (!Reflect(bytecode, reflection))
+		return false;
+
+	Save(cacheFile, bytecode, reflection);
+	return true;
+}
+
+// --------------------------------------------------------
+// Runs shader reflection over the bytecode
+// --------------------------------------------------------
+bool ShaderCache::Reflect(ID3DBlob* bytecode, ShaderReflection& reflection)
+{
+	reflection = ShaderReflection();
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
+	HRESULT hr = D3DReflect(
+		bytecode->GetBufferPointer(),
+		bytecode->GetBufferSize(),
+		IID_ID3D11ShaderReflection,
+		(void**)refl.GetAddressOf());
+	if (FAILED(hr))
+		return false;
+
+	D3D11_SHADER_DESC shaderDesc;
+	refl->GetDesc(&shaderDesc);
+
+	// Bound resources
+	for (unsigned int r = 0; r < shaderDesc.BoundResources; r++)
+	{
+		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
+		refl->GetResourceBindingDesc(r, &resourceDesc);
+		reflection.Resources.push_back({ resourceDesc.Name, resourceDesc.Type, resourceDesc.BindPoint });
+	}
+
+	// Constant buffers and their variables
+	for (unsigned int b = 0; b < shaderDesc.ConstantBuffers; b++)
+	{
+		ID3D11ShaderReflectionConstantBuffer* cb = refl->GetConstantBufferByIndex(b);
+		D3D11_SHADER_BUFFER_DESC bufferDesc;
+		cb->GetDesc(&bufferDesc);
+
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
+
+		ShaderReflection::Buffer buffer = { bufferDesc.Name, bufferDesc.Type, bindDesc.BindPoint, bufferDesc.Size };
+		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		{
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			cb->GetVariableByIndex(v)->GetDesc(&varDesc);
+			buffer.Variables.push_back({ varDesc.Name, varDesc.StartOffset, varDesc.Size });
+		}
+		reflection.Buffers.push_back(buffer);
+	}
+
+	// Vertex inputs - system values (like SV_VertexID) are
+	// generated by the pipeline rather than read from a buffer
+	if (D3D11_SHVER_GET_TYPE(shaderDesc.Version) == D3D11_SHVER_VERTEX_SHADER)
+	{
+		std::string perInstanceStr = "_PER_INSTANCE";
+		for (unsigned int i = 0; i < shaderDesc.InputParameters; i++)
+		{
+			D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+			refl->GetInputParameterDesc(i, &paramDesc);
+			if (paramDesc.SystemValueType != D3D_NAME_UNDEFINED)
+				continue;
+
+			std::string sem = paramDesc.SemanticName;
+			int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
+			bool isPerInstance =
+				lenDiff >= 0 &&
+				sem.compare(lenDiff, perInstanceStr.size(), perInstanceStr) == 0;
+
+			reflection.Inputs.push_back({
+				sem,
+				paramDesc.SemanticIndex,
+				InputFormat(paramDesc.Mask, paramDesc.ComponentType),
+				isPerInstance });
+		}
+	}
+
+	// Thread group size (all zeros for anything but compute)
+	refl->GetThreadGroupSize(
+		&reflection.ThreadGroupSize[0],
+		&reflection.ThreadGroupSize[1],
+		&reflection.ThreadGroupSize[2]);
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Reads a cache file, failing if it's missing, damaged or
+// was written for different bytecode
+// --------------------------------------------------------
+bool ShaderCache::Load(const std::wstring& cacheFile, ID3DBlob* bytecode, ShaderReflection& reflection)
+{
+	const unsigned char* checksum = BytecodeChecksum(bytecode);
+	if (!checksum)
+		return false;
+
+	std::ifstream file(cacheFile, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	std::vector<unsigned char> data((size_t)file.tellg());
+	file.seekg(0);
+	if (data.empty() || !file.read((char*)&data[0], data.size()))
+		return false;
+
+	// Header
+	CacheReader reader(data);
+	unsigned char cachedChecksum[DXBC_CHECKSUM_SIZE] = {};
+	unsigned int magic = reader.ReadUInt();
+	unsigned int version = reader.ReadUInt();
+	unsigned int bytecodeSize = reader.ReadUInt();
+	reader.Read(cachedChecksum, DXBC_CHECKSUM_SIZE);
+	if (!reader.Ok() ||
+		magic != CACHE_MAGIC ||
+		version != CACHE_VERSION ||
+		bytecodeSize != bytecode->GetBufferSize() ||
+		memcmp(cachedChecksum, checksum, DXBC_CHECKSUM_SIZE) != 0)
+		return false;
+
+	// Tables
+	reflection = ShaderReflection();
+
+	unsigned int resourceCount = reader.ReadUInt();
+	for (unsigned int r = 0; r < resourceCount && reader.Ok(); r++)
+	{
+		ShaderReflection::Resource resource;
+		resource.Name = reader.ReadString();
+		resource.Type = (D3D_SHADER_INPUT_TYPE)reader.ReadUInt();
+		resource.BindPoint = reader.ReadUInt();
+		reflection.Resources.push_back(resource);
+	}
+
+	unsigned int bufferCount = reader.ReadUInt();
+	for (unsigned int b = 0; b < bufferCount && reader.Ok(); b++)
+	{
+		ShaderReflection::Buffer buffer;
+		buffer.Name = reader.ReadString();
+		buffer.Type = (D3D_CBUFFER_TYPE)reader.ReadUInt();
+		buffer.BindPoint = reader.ReadUInt();
+		buffer.Size = reader.ReadUInt();
+
+		unsigned int variableCount = reader.ReadUInt();
+		for (unsigned int v = 0; v < variableCount && reader.Ok(); v++)
+		{
+			ShaderReflection::Variable variable;
+			variable.Name = reader.ReadString();
+			variable.ByteOffset = reader.ReadUInt();
+			variable.Size = reader.ReadUInt();
+			buffer.Variables.push_back(variable);
+		}
+		reflection.Buffers.push_back(buffer);
+	}
+
+	unsigned int inputCount = reader.ReadUInt();
+	for (unsigned int i = 0; i < inputCount && reader.Ok(); i++)
+	{
+		ShaderReflection::InputElement input;
+		input.SemanticName = reader.ReadString();
+		input.SemanticIndex = reader.ReadUInt();
+		input.Format = (DXGI_FORMAT)reader.ReadUInt();
+		input.PerInstance = reader.ReadUInt() != 0;
+		reflection.Inputs.push_back(input);
+	}
+
+	for (unsigned int i = 0; i < 3; i++)
+		reflection.ThreadGroupSize[i] = reader.ReadUInt();
+
+	return reader.Ok();
+}
+
+// --------------------------------------------------------
+// Writes a cache file - failing to (say, in a read only
+// folder) just means the shader is reflected again next run
+// --------------------------------------------------------
+void ShaderCache::Save(const std::wstring& cacheFile, ID3DBlob* bytecode, const ShaderReflection& reflection)
+{
+	const unsigned char* checksum = BytecodeChecksum(bytecode);
+	if (!checksum)
+		return;
+
+	CacheWriter writer;
+	writer.WriteUInt(CACHE_MAGIC);
+	writer.WriteUInt(CACHE_VERSION);
+	writer.WriteUInt((unsigned int)bytecode->GetBufferSize());
+	writer.Write(checksum, DXBC_CHECKSUM_SIZE);
+
+	writer.WriteUInt((unsigned int)reflection.Resources.size());
+	for (const ShaderReflection::Resource& resource : reflection.Resources)
+	{
+		writer.WriteString(resource.Name);
+		writer.WriteUInt(resource.Type);
+		writer.WriteUInt(resource.BindPoint);
+	}
+
+	writer.WriteUInt((unsigned int)reflection.Buffers.size());
+	for (const ShaderReflection::Buffer& buffer : reflection.Buffers)
+	{
+		writer.WriteString(buffer.Name);
+		writer.WriteUInt(buffer.Type);
+		writer.WriteUInt(buffer.BindPoint);
+		writer.WriteUInt(buffer.Size);
+
+		writer.WriteUInt((unsigned int)buffer.Variables.size());
+		for (const ShaderReflection::Variable& variable : buffer.Variables)
+		{
+			writer.WriteString(variable.Name);
+			writer.WriteUInt(variable.ByteOffset);
+			writer.WriteUInt(variable.Size);
+		}
+	}
+
+	writer.WriteUInt((unsigned int)reflection.Inputs.size());
+	for (const ShaderReflection::InputElement& input : reflection.Inputs)
+	{
+		writer.WriteString(input.SemanticName);
+		writer.WriteUInt(input.SemanticIndex);
+		writer.WriteUInt(input.Format);
+		writer.WriteUInt(input.PerInstance ? 1 : 0);
+	}
+
+	for (unsigned int i = 0; i < 3; i++)
+		writer.WriteUInt(reflection.ThreadGroupSize[i]);
+
+	std::ofstream file(cacheFile, std::ios::binary | std::ios::trunc);
+	if (file)
+		file.write((const char*)&writer.data[0], writer.data.size());
+}
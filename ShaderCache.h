@@ -0,0 +1,82 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3dcompiler.h>
+#include <wrl/client.h>
+#include <vector>
+#include <string>
+
+// --------------------------------------------------------
+// Everything SimpleShader needs from shader reflection,
+// in a form that can be written to and read from disk
+// --------------------------------------------------------
+struct ShaderReflection
+{
+	struct Resource
+	{
+		std::string Name;
+		D3D_SHADER_INPUT_TYPE Type;
+		unsigned int BindPoint;
+	};
+
+	struct Variable
+	{
+		std::string Name;
+		unsigned int ByteOffset;
+		unsigned int Size;
+	};
+
+	struct Buffer
+	{
+		std::string Name;
+		D3D_CBUFFER_TYPE Type;
+		unsigned int BindPoint;
+		unsigned int Size;
+		std::vector<Variable> Variables;
+	};
+
+	// Vertex shaders only, already turned into input layout
+	// elements (system values are left out)
+	struct InputElement
+	{
+		std::string SemanticName;
+		unsigned int SemanticIndex;
+		DXGI_FORMAT Format;
+		bool PerInstance; // Semantic ends in "_PER_INSTANCE"
+	};
+
+	std::vector<Resource> Resources; // Every bound resource, constant buffers included
+	std::vector<Buffer> Buffers;
+	std::vector<InputElement> Inputs;
+	unsigned int ThreadGroupSize[3] = {}; // Compute shaders only
+};
+
+// --------------------------------------------------------
+// Loads compiled shaders without reflecting them on every run
+//
+// - The .cso is memory mapped rather than read into a copy
+// - The reflection results are saved to "<file>.refl" next
+//   to the .cso the first time it's loaded.  The cache file
+//   records the checksum fxc puts in every DXBC header, so
+//   a recompiled shader is reflected (and cached) again.
+// --------------------------------------------------------
+class ShaderCache
+{
+public:
+	static Microsoft::WRL::ComPtr<ID3DBlob> MapBytecode(LPCWSTR shaderFile);
+	static bool GetReflection(LPCWSTR shaderFile, ID3DBlob* bytecode, ShaderReflection& reflection);
+	static bool Reflect(ID3DBlob* bytecode, ShaderReflection& reflection); // No cache file, for code compiled at runtime
+
+	// Loads since the last ResetStats() that did and didn't
+	// find a valid cache file
+	static unsigned int GetHitCount();
+	static unsigned int GetMissCount();
+	static void ResetStats();
+
+private:
+	static unsigned int hits;
+	static unsigned int misses;
+
+	static bool Load(const std::wstring& cacheFile, ID3DBlob* bytecode, ShaderReflection& reflection);
+	static void Save(const std::wstring& cacheFile, ID3DBlob* bytecode, const ShaderReflection& reflection);
+};
@@ -0,0 +1,290 @@
+#include "ShaderHotReload.h"
+#include "PathHelpers.h"
+#include <d3dcompiler.h>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+// How often the watching thread checks for changes
+#define POLL_INTERVAL_MS 250
+
+// --------------------------------------------------------
+// Helpers for the watching thread
+// --------------------------------------------------------
+namespace
+{
+	// A zeroed time when the file can't be found, so a missing
+	// file counts as changed once it shows up
+	FILETIME GetWriteTime(const std::wstring& path)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+		GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes);
+		return attributes.ftLastWriteTime;
+	}
+
+	bool ReadFileText(const std::wstring& path, std::string& text)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+			return false;
+
+		std::stringstream contents;
+		contents << file.rdbuf();
+		text = contents.str();
+		return true;
+	}
+
+	// Opens #includes relative to the source directory, and
+	// records each file opened, so changes to them are noticed
+	class IncludeHandler : public ID3DInclude
+	{
+	public:
+		IncludeHandler(const std::wstring& directory, std::vector<std::pair<std::wstring, FILETIME>>& opened)
+			: directory(directory), opened(opened) { }
+
+		HRESULT STDMETHODCALLTYPE Open(D3D_INCLUDE_TYPE includeType, LPCSTR fileName, LPCVOID parentData, LPCVOID* data, UINT* bytes) override
+		{
+			// Time first, so a change during the read isn't missed
+			std::wstring path = directory + NarrowToWide(fileName);
+			opened.push_back({ path, GetWriteTime(path) });
+
+			std::string text;
+			if (!ReadFileText(path, text))
+				return E_FAIL;
+
+			char* copy = new char[text.size()];
+			memcpy(copy, text.data(), text.size());
+			*data = copy;
+			*bytes = (UINT)text.size();
+			return S_OK;
+		}
+
+		HRESULT STDMETHODCALLTYPE Close(LPCVOID data) override
+		{
+			delete[] (const char*)data;
+			return S_OK;
+		}
+
+	private:
+		const std::wstring& directory;
+		std::vector<std::pair<std::wstring, FILETIME>>& opened;
+	};
+
+	// Null terminated, pointing into the given defines
+	std::vector<D3D_SHADER_MACRO> MakeMacros(const ShaderHotReload::Defines& defines)
+	{
+		std::vector<D3D_SHADER_MACRO> macros;
+		for (auto& d : defines)
+			macros.push_back({ d.first.c_str(), d.second.c_str() });
+		macros.push_back({ 0, 0 });
+		return macros;
+	}
+}
+
+ShaderHotReload::ShaderHotReload(std::wstring sourceDirectory)
+	:
+	sourceDirectory(sourceDirectory),
+	quitting(false)
+{
+	thread = std::thread(&ShaderHotReload::WatchLoop, this);
+}
+
+ShaderHotReload::~ShaderHotReload()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+void ShaderHotReload::Watch(std::shared_ptr<ISimpleShader> shader, std::wstring sourceFile, std::string target, const Defines& defines)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& w : shaders)
+		if (w->Shader == shader)
+			return;
+
+	std::unique_ptr<WatchedShader> watched(new WatchedShader());
+	watched->Shader = shader;
+	watched->SourceFile = sourceFile;
+	watched->Target = target;
+	watched->ShaderDefines = defines;
+
+	watched->State.Name = WideToNarrow(sourceFile);
+	for (size_t i = 0; i < defines.size(); i++)
+		watched->State.Name += (i == 0 ? " (" : ", ") + defines[i].first + "=" + defines[i].second + (i + 1 == defines.size() ? ")" : "");
+	watched->State.CompileTime = 0.0f;
+	watched->State.ReloadCount = 0;
+
+	shaders.push_back(std::move(watched));
+}
+
+// --------------------------------------------------------
+// Swaps finished compiles into their shaders.  Call between
+// frames, as nothing may be recording with these shaders.
+// --------------------------------------------------------
+unsigned int ShaderHotReload::ApplyReloads()
+{
+	// Take the code first, so the watching thread isn't held
+	// up while the shaders are created
+	std::vector<std::pair<WatchedShader*, Microsoft::WRL::ComPtr<ID3DBlob>>> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& w : shaders)
+		{
+			if (!w->CompiledCode)
+				continue;
+			ready.push_back({ w.get(), w->CompiledCode });
+			w->CompiledCode.Reset();
+		}
+	}
+
+	unsigned int reloaded = 0;
+	for (auto& r : ready)
+	{
+		bool created = r.first->Shader->ReloadShader(r.second);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (created)
+		{
+			r.first->State.ReloadCount++;
+			reloaded++;
+		}
+		else
+		{
+			r.first->State.Errors = "Compiled, but the shader couldn't be created from the new code";
+		}
+	}
+	return reloaded;
+}
+
+std::vector<ShaderHotReload::Status> ShaderHotReload::GetStatus()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<Status> status;
+	for (auto& w : shaders)
+		status.push_back(w->State);
+	return status;
+}
+
+// --------------------------------------------------------
+// Runs on the watching thread until the destructor
+// - Polls rather than waiting on change notifications, as
+//   many editors save by replacing the file, and checking a
+//   handful of timestamps a few times a second costs nothing
+// --------------------------------------------------------
+void ShaderHotReload::WatchLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!quitting)
+	{
+		wake.wait_for(lock, std::chrono::milliseconds(POLL_INTERVAL_MS), [this] { return quitting; });
+
+		// Watch() only ever adds, so earlier entries stay put
+		for (size_t i = 0; i < shaders.size() && !quitting; i++)
+		{
+			WatchedShader* watched = shaders[i].get();
+			lock.unlock();
+
+			if (watched->Dependencies.empty())
+				ScanDependencies(watched);
+			else if (HasChanged(watched))
+				Compile(watched);
+
+			lock.lock();
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Finds the files a shader is built from by preprocessing
+// it, which is quick, without compiling it - the running code
+// came from the project build, and stays until something changes
+// --------------------------------------------------------
+void ShaderHotReload::ScanDependencies(WatchedShader* watched)
+{
+	std::wstring path = sourceDirectory + watched->SourceFile;
+	std::vector<std::pair<std::wstring, FILETIME>> opened;
+	opened.push_back({ path, GetWriteTime(path) });
+
+	std::string source;
+	if (ReadFileText(path, source))
+	{
+		IncludeHandler includes(sourceDirectory, opened);
+		std::vector<D3D_SHADER_MACRO> macros = MakeMacros(watched->ShaderDefines);
+		Microsoft::WRL::ComPtr<ID3DBlob> output;
+		Microsoft::WRL::ComPtr<ID3DBlob> errors;
+		D3DPreprocess(source.data(), source.size(), WideToNarrow(path).c_str(),
+			macros.data(), &includes, output.GetAddressOf(), errors.GetAddressOf());
+	}
+
+	watched->Dependencies = opened;
+}
+
+bool ShaderHotReload::HasChanged(const WatchedShader* watched)
+{
+	for (auto& d : watched->Dependencies)
+	{
+		FILETIME writeTime = GetWriteTime(d.first);
+		if (CompareFileTime(&d.second, &writeTime) != 0)
+			return true;
+	}
+	return false;
+}
+
+// --------------------------------------------------------
+// Compiles a shader from source, leaving the code for
+// ApplyReloads() or the errors for GetStatus()
+// --------------------------------------------------------
+void ShaderHotReload::Compile(WatchedShader* watched)
+{
+	std::wstring path = sourceDirectory + watched->SourceFile;
+	std::vector<std::pair<std::wstring, FILETIME>> opened;
+	opened.push_back({ path, GetWriteTime(path) });
+
+	// Match how the project builds shaders
+	unsigned int flags = 0;
+#if defined(DEBUG) || defined(_DEBUG)
+	flags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#else
+	flags |= D3DCOMPILE_OPTIMIZATION_LEVEL3;
+#endif
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	std::string source;
+	Microsoft::WRL::ComPtr<ID3DBlob> code;
+	Microsoft::WRL::ComPtr<ID3DBlob> errors;
+	HRESULT hr = E_FAIL;
+	if (ReadFileText(path, source))
+	{
+		IncludeHandler includes(sourceDirectory, opened);
+		std::vector<D3D_SHADER_MACRO> macros = MakeMacros(watched->ShaderDefines);
+		hr = D3DCompile(source.data(), source.size(), WideToNarrow(path).c_str(),
+			macros.data(), &includes, "main", watched->Target.c_str(), flags, 0,
+			code.GetAddressOf(), errors.GetAddressOf());
+	}
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	// Includes may have changed, so watch what was opened this time
+	watched->Dependencies = opened;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	watched->State.CompileTime = elapsed.count();
+	if (SUCCEEDED(hr))
+	{
+		watched->CompiledCode = code;
+		watched->State.Errors.clear();
+	}
+	else if (errors)
+	{
+		watched->State.Errors = (const char*)errors->GetBufferPointer();
+	}
+	else
+	{
+		watched->State.Errors = "Couldn't read " + WideToNarrow(path);
+	}
+}
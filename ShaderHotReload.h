@@ -0,0 +1,84 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "SimpleShader.h"
+
+// --------------------------------------------------------
+// Recompiles shaders from their HLSL source whenever it's
+// saved, so they can be worked on while the program runs
+//
+// - A background thread polls each watched source file, and
+//   every file it #includes, and compiles changed shaders
+//   with D3DCompile - a compile never stalls a frame
+// - Compiled code waits for ApplyReloads(), which is called
+//   at a frame boundary and swaps each shader's code in place
+//   (see ISimpleShader::ReloadShader).  Handles and resolved
+//   registers of reloaded shaders must be looked up again.
+// - A failed compile keeps the old code running, and its
+//   errors are kept for display until the next good compile
+// --------------------------------------------------------
+class ShaderHotReload
+{
+public:
+	typedef std::vector<std::pair<std::string, std::string>> Defines;
+
+	// Where a watched shader has got to, for display
+	struct Status
+	{
+		std::string Name;			// Source file, then any defines
+		float CompileTime;			// Of the latest compile, in milliseconds
+		unsigned int ReloadCount;
+		std::string Errors;			// Empty unless the latest compile failed
+	};
+
+	ShaderHotReload(std::wstring sourceDirectory);
+	~ShaderHotReload();
+
+	// sourceFile is relative to the source directory, and target
+	// must match the shader's type ("ps_5_0" for pixel shaders).
+	// Watching a shader a second time does nothing.
+	void Watch(std::shared_ptr<ISimpleShader> shader, std::wstring sourceFile, std::string target, const Defines& defines = Defines());
+
+	// Swaps in finished compiles, returning how many shaders changed
+	unsigned int ApplyReloads();
+
+	std::vector<Status> GetStatus();
+
+private:
+	struct WatchedShader
+	{
+		// Set by Watch(), then never changed
+		std::shared_ptr<ISimpleShader> Shader;
+		std::wstring SourceFile;
+		std::string Target;
+		Defines ShaderDefines;
+
+		// Only used by the watching thread
+		std::vector<std::pair<std::wstring, FILETIME>> Dependencies; // Files and write times, empty until first scanned
+
+		// Guarded by the mutex
+		Status State;
+		Microsoft::WRL::ComPtr<ID3DBlob> CompiledCode; // Waiting for ApplyReloads()
+	};
+
+	void WatchLoop();
+	void ScanDependencies(WatchedShader* watched);
+	void Compile(WatchedShader* watched);
+	bool HasChanged(const WatchedShader* watched);
+
+	std::wstring sourceDirectory;
+	std::vector<std::unique_ptr<WatchedShader>> shaders;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake; // Signalled to quit
+	bool quitting;
+};
@@ -0,0 +1,92 @@
+#include "ShaderVariants.h"
+#include "PathHelpers.h"
+
+ShaderVariants::ShaderVariants(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::wstring name,
+	std::shared_ptr<SimplePixelShader> fallback)
+	:
+	device(device),
+	context(context),
+	name(name),
+	fallback(fallback),
+	loadedCount(0),
+	missingCount(0),
+	loadedBytes(0)
+{
+	loadedShaders.push_back(fallback);
+	loadedFeatures.push_back(PS_FEATURE_ALL);
+}
+
+ShaderVariants::~ShaderVariants()
+{
+}
+
+const std::vector<std::shared_ptr<SimplePixelShader>>& ShaderVariants::GetLoadedShaders() { return loadedShaders; }
+const std::vector<unsigned int>& ShaderVariants::GetLoadedFeatures() { return loadedFeatures; }
+unsigned int ShaderVariants::GetLoadedCount() { return loadedCount; }
+unsigned int ShaderVariants::GetMissingCount() { return missingCount; }
+unsigned int ShaderVariants::GetLoadedBytes() { return loadedBytes; }
+
+// --------------------------------------------------------
+// Drops bits that aren't features, so they can't ask for a
+// variant the script never compiles.  Lights aren't features:
+// the shader loops over however many there are.
+// --------------------------------------------------------
+unsigned int ShaderVariants::Canonicalize(unsigned int features)
+{
+	return features & PS_FEATURE_ALL;
+}
+
+// --------------------------------------------------------
+// Same defines as Tools/CompileShaderVariants.bat passes fxc
+// --------------------------------------------------------
+std::vector<std::pair<std::string, std::string>> ShaderVariants::GetDefines(unsigned int features)
+{
+	std::vector<std::pair<std::string, std::string>> defines;
+	if (features == PS_FEATURE_ALL)
+		return defines;
+
+	defines.push_back({ "USE_NORMAL_MAP", (features & PS_FEATURE_NORMAL_MAP) ? "1" : "0" });
+	defines.push_back({ "USE_ROUGHNESS_MAP", (features & PS_FEATURE_ROUGHNESS_MAP) ? "1" : "0" });
+	defines.push_back({ "USE_METALNESS_MAP", (features & PS_FEATURE_METALNESS_MAP) ? "1" : "0" });
+	defines.push_back({ "USE_SHADOWS", (features & PS_FEATURE_SHADOWS) ? "1" : "0" });
+	return defines;
+}
+
+// --------------------------------------------------------
+// Gets the variant with exactly the given features, loading
+// it the first time it's asked for
+// --------------------------------------------------------
+std::shared_ptr<SimplePixelShader> ShaderVariants::Get(unsigned int features)
+{
+	features = Canonicalize(features);
+	if (features == PS_FEATURE_ALL)
+		return fallback;
+
+	auto found = variants.find(features);
+	if (found != variants.end())
+		return found->second;
+
+	std::wstring file = FixPath(name + L"_" + std::to_wstring(features) + L".cso");
+	std::shared_ptr<SimplePixelShader> shader = std::make_shared<SimplePixelShader>(device, context, file.c_str());
+	if (shader->IsShaderValid())
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+		if (GetFileAttributesExW(file.c_str(), GetFileExInfoStandard, &attributes))
+			loadedBytes += attributes.nFileSizeLow;
+		loadedCount++;
+		loadedShaders.push_back(shader);
+		loadedFeatures.push_back(features);
+	}
+	else
+	{
+		// Not compiled - remember that, so it's only tried once
+		shader = fallback;
+		missingCount++;
+	}
+
+	variants[features] = shader;
+	return shader;
+}
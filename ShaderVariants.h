@@ -0,0 +1,70 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "SimpleShader.h"
+
+// Feature bits of PixelShader.hlsl's variants - the defines
+// each one is compiled with are in Tools/CompileShaderVariants.bat
+#define PS_FEATURE_NORMAL_MAP		(1 << 0)
+#define PS_FEATURE_ROUGHNESS_MAP	(1 << 1)
+#define PS_FEATURE_METALNESS_MAP	(1 << 2)
+#define PS_FEATURE_SHADOWS			(1 << 3)
+#define PS_FEATURE_ALL				(PS_FEATURE_NORMAL_MAP | PS_FEATURE_ROUGHNESS_MAP | PS_FEATURE_METALNESS_MAP | PS_FEATURE_SHADOWS)
+
+// --------------------------------------------------------
+// The compiled variants of one pixel shader, each with only
+// the features in its bitmask compiled in
+//
+// - Variants are compiled ahead of time to "<name>_<features>.cso"
+//   by Tools/CompileShaderVariants.bat, and loaded on first use.
+//   Rerun it after changing the shader, or variants go stale.
+// - A variant that wasn't compiled falls back to the shader
+//   built by the project, which has every feature
+// - Loading happens on the calling thread, so pick variants
+//   while loading or between frames, not while recording
+// --------------------------------------------------------
+class ShaderVariants
+{
+public:
+	ShaderVariants(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::wstring name,
+		std::shared_ptr<SimplePixelShader> fallback);
+	~ShaderVariants();
+
+	std::shared_ptr<SimplePixelShader> Get(unsigned int features);
+	static unsigned int Canonicalize(unsigned int features);
+
+	// The defines a variant is compiled with (none for the
+	// fallback, whose source defaults to every feature)
+	static std::vector<std::pair<std::string, std::string>> GetDefines(unsigned int features);
+
+	// Every distinct shader handed out so far, fallback included,
+	// and the features of each
+	const std::vector<std::shared_ptr<SimplePixelShader>>& GetLoadedShaders();
+	const std::vector<unsigned int>& GetLoadedFeatures();
+
+	// Variant report
+	unsigned int GetLoadedCount();
+	unsigned int GetMissingCount();
+	unsigned int GetLoadedBytes();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::wstring name;
+	std::shared_ptr<SimplePixelShader> fallback;
+
+	std::unordered_map<unsigned int, std::shared_ptr<SimplePixelShader>> variants;
+	std::vector<std::shared_ptr<SimplePixelShader>> loadedShaders;
+	std::vector<unsigned int> loadedFeatures;
+	unsigned int loadedCount;
+	unsigned int missingCount;
+	unsigned int loadedBytes;
+};
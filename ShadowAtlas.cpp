@@ -0,0 +1,160 @@
+#include "ShadowAtlas.h"
+#include <cstring>
+
+ShadowAtlas::ShadowAtlas(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	unsigned int resolution,
+	unsigned int maxViews)
+	:
+	device(device),
+	context(context),
+	resolution(resolution),
+	maxViews(maxViews),
+	cursor(0)
+{
+	CreateAtlas();
+
+	// Rewritten every frame, as views follow the camera
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DYNAMIC;
+	desc.ByteWidth = sizeof(ShadowView) * maxViews;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(ShadowView);
+	device->CreateBuffer(&desc, 0, viewBuffer.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = maxViews;
+	device->CreateShaderResourceView(viewBuffer.Get(), &srvDesc, viewSRV.GetAddressOf());
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+}
+
+// --------------------------------------------------------
+// (Re)creates the depth texture
+// --------------------------------------------------------
+void ShadowAtlas::CreateAtlas()
+{
+	D3D11_TEXTURE2D_DESC atlasDesc = {};
+	atlasDesc.Width = resolution;
+	atlasDesc.Height = resolution;
+	atlasDesc.ArraySize = 1;
+	atlasDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	atlasDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	atlasDesc.MipLevels = 1;
+	atlasDesc.SampleDesc.Count = 1;
+	atlasDesc.Usage = D3D11_USAGE_DEFAULT;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> atlasTexture;
+	device->CreateTexture2D(&atlasDesc, 0, atlasTexture.GetAddressOf());
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(atlasTexture.Get(), &dsvDesc, dsv.ReleaseAndGetAddressOf());
+
+	// Read as a one slice array, so shaders filter it with the
+	// same functions as the cascades
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.ArraySize = 1;
+	device->CreateShaderResourceView(atlasTexture.Get(), &srvDesc, srv.ReleaseAndGetAddressOf());
+}
+
+void ShadowAtlas::SetResolution(unsigned int resolution)
+{
+	if (resolution == this->resolution)
+		return;
+	this->resolution = resolution;
+	CreateAtlas();
+	Clear();
+}
+
+unsigned int ShadowAtlas::GetResolution() { return resolution; }
+unsigned int ShadowAtlas::GetMaxViews() { return maxViews; }
+
+void ShadowAtlas::Clear()
+{
+	cursor = 0;
+	tiles.clear();
+	views.clear();
+	projections.clear();
+	shaderViews.clear();
+}
+
+// --------------------------------------------------------
+// Places a view's tile at the next free spot along the
+// Z-order curve.  A tile of (size / SHADOW_ATLAS_MIN_TILE)^2
+// squares is a square wherever the curve reaches a multiple
+// of that count, so the cursor is first rounded up to one -
+// which only skips space if a tile is added after a smaller one.
+//
+// size - Texels per side, a power of two from SHADOW_ATLAS_MIN_TILE up
+// --------------------------------------------------------
+int ShadowAtlas::AddView(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection, unsigned int size)
+{
+	unsigned int side = resolution / SHADOW_ATLAS_MIN_TILE;
+	unsigned int squares = (size / SHADOW_ATLAS_MIN_TILE) * (size / SHADOW_ATLAS_MIN_TILE);
+	unsigned int start = (cursor + squares - 1) / squares * squares;
+	if (squares == 0 || tiles.size() >= maxViews || start + squares > side * side)
+		return -1;
+	cursor = start + squares;
+
+	// Even bits of the Z-order index are x, odd bits are y
+	Tile tile = { 0, 0, size };
+	for (unsigned int bit = 0; (1u << (bit * 2)) < side * side; bit++)
+	{
+		tile.x |= ((start >> (bit * 2)) & 1) << bit;
+		tile.y |= ((start >> (bit * 2 + 1)) & 1) << bit;
+	}
+	tile.x *= SHADOW_ATLAS_MIN_TILE;
+	tile.y *= SHADOW_ATLAS_MIN_TILE;
+
+	ShadowView shaderView = {};
+	DirectX::XMStoreFloat4x4(&shaderView.viewProjection, DirectX::XMLoadFloat4x4(&view) * DirectX::XMLoadFloat4x4(&projection));
+	shaderView.atlasRect = DirectX::XMFLOAT4(
+		(float)tile.x / resolution,
+		(float)tile.y / resolution,
+		(float)size / resolution,
+		(float)size / resolution);
+	shaderView.projection = DirectX::XMFLOAT4(projection._11, projection._33, projection._43, 0.0f);
+
+	tiles.push_back(tile);
+	views.push_back(view);
+	projections.push_back(projection);
+	shaderViews.push_back(shaderView);
+	return (int)tiles.size() - 1;
+}
+
+// --------------------------------------------------------
+// Copies this frame's views to the GPU.  Call once per frame,
+// after adding them and before anything that reads them.
+// --------------------------------------------------------
+void ShadowAtlas::Upload()
+{
+	if (shaderViews.empty())
+		return; // No light reads a view
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(viewBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, &shaderViews[0], sizeof(ShadowView) * shaderViews.size());
+	context->Unmap(viewBuffer.Get(), 0);
+}
+
+unsigned int ShadowAtlas::GetViewCount() { return (unsigned int)tiles.size(); }
+const ShadowAtlas::Tile& ShadowAtlas::GetTile(unsigned int index) { return tiles[index]; }
+const DirectX::XMFLOAT4X4& ShadowAtlas::GetView(unsigned int index) { return views[index]; }
+const DirectX::XMFLOAT4X4& ShadowAtlas::GetProjection(unsigned int index) { return projections[index]; }
+unsigned int ShadowAtlas::GetUsedTexels() { return cursor * SHADOW_ATLAS_MIN_TILE * SHADOW_ATLAS_MIN_TILE; }
+ID3D11DepthStencilView* ShadowAtlas::GetDSV() { return dsv.Get(); }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ShadowAtlas::GetSRV() { return srv; }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ShadowAtlas::GetViewSRV() { return viewSRV; }
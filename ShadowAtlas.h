@@ -0,0 +1,85 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <vector>
+#include "ShaderCBuffers.h"
+
+// Smallest tile the atlas hands out, in texels per side
+#define SHADOW_ATLAS_MIN_TILE 64
+
+// Where a view sits in the atlas, as the shaders see it (see
+// ShadowView in Shadows.hlsli)
+typedef CBuffers::PixelShader::ShadowView ShadowView;
+
+// --------------------------------------------------------
+// One large depth texture shared by the shadows of every
+// point and spot light, each view drawn into its own square
+// tile ("ShadowAtlas" and "ShadowViews" in PixelShader.hlsl)
+//
+// - Tiles are packed again every frame, so lights can change
+//   size or come and go freely within the atlas's fixed size
+// - Tiles are powers of two, placed along a Z-order curve,
+//   which packs them as a quadtree would: each tile is one
+//   node, and a node's four children are the next four tiles
+//   of half its size.  Added largest first, they fill the
+//   atlas with no gaps, so a set fits if its area does.
+// - Changing the resolution replaces the texture - get the
+//   SRV again after
+// --------------------------------------------------------
+class ShadowAtlas
+{
+public:
+	// Position and size of a view's tile, in texels
+	struct Tile
+	{
+		unsigned int x;
+		unsigned int y;
+		unsigned int size;
+	};
+
+	ShadowAtlas(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		unsigned int resolution,
+		unsigned int maxViews);
+	~ShadowAtlas();
+
+	void SetResolution(unsigned int resolution);
+	unsigned int GetResolution();
+	unsigned int GetMaxViews();
+
+	// Packing, redone each frame
+	void Clear();
+	int AddView(const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& projection, unsigned int size); // -1 if it doesn't fit
+	void Upload();
+
+	unsigned int GetViewCount();
+	const Tile& GetTile(unsigned int index);
+	const DirectX::XMFLOAT4X4& GetView(unsigned int index);
+	const DirectX::XMFLOAT4X4& GetProjection(unsigned int index);
+	unsigned int GetUsedTexels(); // Area of the tiles, and any gaps left between them
+
+	ID3D11DepthStencilView* GetDSV();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetViewSRV();
+
+private:
+	void CreateAtlas();
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	unsigned int resolution;
+	unsigned int maxViews;
+	unsigned int cursor; // Next free SHADOW_ATLAS_MIN_TILE square, in Z-order
+
+	std::vector<Tile> tiles;
+	std::vector<DirectX::XMFLOAT4X4> views;
+	std::vector<DirectX::XMFLOAT4X4> projections;
+	std::vector<ShadowView> shaderViews;
+
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> dsv;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> viewBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> viewSRV;
+};
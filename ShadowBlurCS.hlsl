@@ -0,0 +1,51 @@
+#include "Include.hlsli"
+#include "Shadows.hlsli"
+
+// Texels per thread group, along the column it fills
+#define GROUP_SIZE 64
+
+// Must match SHADOW_BLUR_MAX_RADIUS in ShadowFilter.h
+#define MAX_BLUR_RADIUS 8
+
+cbuffer BlurData : register(b0)
+{
+    uint resolution; // Texels per side of the shadow map
+    uint blurRadius;
+}
+
+// Moments already blurred along rows (see ShadowMomentsCS.hlsl)
+Texture2D<float4> Input : register(t0);
+
+// Mip 0 of the cascade's slice of the moments, whose other
+// mips are generated from it after - a view of that one
+// slice, so always index 0 whichever cascade it is
+RWTexture2DArray<float4> Output : register(u0);
+
+groupshared float4 column[GROUP_SIZE + MAX_BLUR_RADIUS * 2];
+
+// --------------------------------------------------------
+// Second half of EVSM's separable blur: blurs the moments
+// down each column, into the cascade's slice
+// --------------------------------------------------------
+[numthreads(1, GROUP_SIZE, 1)]
+void main(uint3 groupId : SV_GroupID, uint3 threadId : SV_GroupThreadID)
+{
+    int columnStart = (int)(groupId.y * GROUP_SIZE) - (int)blurRadius;
+    for (uint i = threadId.y; i < GROUP_SIZE + blurRadius * 2; i += GROUP_SIZE)
+        column[i] = Input[uint2(groupId.x, clamp(columnStart + (int)i, 0, (int)resolution - 1))];
+    GroupMemoryBarrierWithGroupSync();
+
+    uint y = groupId.y * GROUP_SIZE + threadId.y;
+    if (y >= resolution)
+        return;
+
+    float4 sum = float4(0, 0, 0, 0);
+    float weightSum = 0.0f;
+    for (int t = -(int)blurRadius; t <= (int)blurRadius; t++)
+    {
+        float weight = BlurWeight(t, blurRadius);
+        sum += column[threadId.y + blurRadius + t] * weight;
+        weightSum += weight;
+    }
+    Output[uint3(groupId.x, y, 0)] = sum / weightSum;
+}
@@ -0,0 +1,339 @@
+#include "ShadowCascades.h"
+#include <cmath>
+#include <cstring>
+
+// How far past a cascade, towards the light, casters can be
+// and still shadow it - its projection reaches back this far
+namespace
+{
+	const float CasterReach = 100.0f;
+}
+
+ShadowCascades::ShadowCascades(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int cascadeCount, unsigned int resolution)
+	:
+	device(device),
+	cascadeCount(cascadeCount < 1 ? 1 : cascadeCount > MAX_SHADOW_CASCADES ? MAX_SHADOW_CASCADES : cascadeCount),
+	resolution(resolution),
+	splitLambda(0.75f),
+	shadowDistance(60.0f),
+	blendFraction(0.1f),
+	staticCaching(true),
+	updateInterval(1),
+	frameIndex(0)
+{
+	DirectX::XMStoreFloat4x4(&view, DirectX::XMMatrixIdentity());
+	for (unsigned int c = 0; c < MAX_SHADOW_CASCADES; c++)
+	{
+		DirectX::XMStoreFloat4x4(&projections[c], DirectX::XMMatrixIdentity());
+		splitDepths[c] = 0.0f;
+		drawn[c] = false;
+		staticDrawn[c] = false;
+	}
+	CreateShadowMap();
+}
+
+ShadowCascades::~ShadowCascades()
+{
+}
+
+// --------------------------------------------------------
+// Splits the camera's view into cascades and fits each
+// cascade's projection around its slice, then works out
+// which cascades (and static caches) are drawn this frame
+//
+// cameraView/cameraProjection - The camera being drawn (perspective)
+// nearZ/farZ                  - That camera's clip planes
+// lightDirection              - The direction the light shines in
+// --------------------------------------------------------
+void ShadowCascades::Update(
+	const DirectX::XMFLOAT4X4& cameraView,
+	const DirectX::XMFLOAT4X4& cameraProjection,
+	float nearZ,
+	float farZ,
+	DirectX::XMFLOAT3 lightDirection)
+{
+	// The light view only rotates, so it's the same wherever the
+	// camera is, and cascades can be snapped to its texel grid
+	DirectX::XMVECTOR direction = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&lightDirection));
+	DirectX::XMVECTOR up = fabsf(DirectX::XMVectorGetY(direction)) > 0.99f ?
+		DirectX::XMVectorSet(1, 0, 0, 0) :
+		DirectX::XMVectorSet(0, 1, 0, 0);
+	DirectX::XMMATRIX lightView = DirectX::XMMatrixLookToLH(DirectX::XMVectorZero(), direction, up);
+	DirectX::XMMATRIX cameraWorld = DirectX::XMMatrixInverse(0, DirectX::XMLoadFloat4x4(&cameraView));
+	DirectX::XMMATRIX cameraToLight = cameraWorld * lightView;
+
+	// Cascades share the light view, so turning the light
+	// means every cascade has to be redrawn at once
+	DirectX::XMFLOAT4X4 newView;
+	DirectX::XMStoreFloat4x4(&newView, lightView);
+	bool lightChanged = memcmp(&newView, &view, sizeof(newView)) != 0;
+	view = newView;
+	frameIndex++;
+
+	DirectX::BoundingFrustum viewFrustum;
+	DirectX::BoundingFrustum::CreateFromMatrix(viewFrustum, DirectX::XMLoadFloat4x4(&cameraProjection));
+
+	// Squared tangent of the angle from the view axis to a
+	// corner of the view, so a slice's corners at depth z are
+	// z * sqrt(diagonal) from the axis
+	float diagonal = 1.0f / (cameraProjection._11 * cameraProjection._11) + 1.0f / (cameraProjection._22 * cameraProjection._22);
+	float shadowFar = farZ < shadowDistance ? farZ : shadowDistance;
+
+	float sliceNear = nearZ;
+	for (unsigned int c = 0; c < cascadeCount; c++)
+	{
+		float t = (float)(c + 1) / cascadeCount;
+		float logSplit = nearZ * powf(shadowFar / nearZ, t);
+		float evenSplit = nearZ + (shadowFar - nearZ) * t;
+		float sliceFar = logSplit * splitLambda + evenSplit * (1.0f - splitLambda);
+		splitDepths[c] = sliceFar;
+
+		// Staggered, so the skipped cascades' redraws fall on
+		// different frames
+		drawn[c] = c == 0 || lightChanged || !hasContents[c] || (frameIndex + c) % updateInterval == 0;
+		staticDrawn[c] = false;
+		if (!drawn[c])
+		{
+			sliceNear = sliceFar;
+			continue;
+		}
+
+		// The smallest sphere around the slice is centred on the
+		// view axis, where its near and far corners are equally
+		// far away (or at the far end, if the far corners are
+		// further from the axis than that).  It doesn't change as
+		// the camera turns, unlike a box around the corners.
+		float centerZ = (sliceNear + sliceFar) * (1.0f + diagonal) * 0.5f;
+		if (centerZ > sliceFar)
+			centerZ = sliceFar;
+		float nearDistance = sliceNear * sliceNear * diagonal + (centerZ - sliceNear) * (centerZ - sliceNear);
+		float farDistance = sliceFar * sliceFar * diagonal + (sliceFar - centerZ) * (sliceFar - centerZ);
+		float radius = sqrtf(nearDistance > farDistance ? nearDistance : farDistance);
+		radius = ceilf(radius * 16.0f) / 16.0f; // So float error can't change it frame to frame
+
+		// Only moved in whole texels, so each texel keeps covering
+		// the same part of the world as the camera moves
+		DirectX::XMFLOAT3 center;
+		DirectX::XMStoreFloat3(&center, DirectX::XMVector3TransformCoord(DirectX::XMVectorSet(0, 0, centerZ, 1), cameraToLight));
+		float texelSize = 2.0f * radius / resolution;
+		center.x = floorf(center.x / texelSize) * texelSize;
+		center.y = floorf(center.y / texelSize) * texelSize;
+
+		float zNear = center.z - radius - CasterReach;
+		float zFar = center.z + radius;
+		DirectX::XMFLOAT4X4 projection;
+		DirectX::XMStoreFloat4x4(&projection, DirectX::XMMatrixOrthographicOffCenterLH(
+			center.x - radius,
+			center.x + radius,
+			center.y - radius,
+			center.y + radius,
+			zNear,
+			zFar));
+
+		// The cache stays valid until the cascade moves, which
+		// turning the camera doesn't do (see above)
+		if (lightChanged || memcmp(&projection, &projections[c], sizeof(projection)) != 0)
+			staticValid[c] = false;
+		projections[c] = projection;
+		staticDrawn[c] = staticCaching && !staticValid[c];
+		staticValid[c] = staticCaching;
+		hasContents[c] = true;
+
+		// Anything in the projection's box can cast into the cascade,
+		// but it only has to cover what's visible in the slice
+		casterBoxes[c] = DirectX::BoundingBox(
+			DirectX::XMFLOAT3(center.x, center.y, (zNear + zFar) * 0.5f),
+			DirectX::XMFLOAT3(radius, radius, (zFar - zNear) * 0.5f));
+		receiverVolumes[c] = viewFrustum;
+		receiverVolumes[c].Near = sliceNear;
+		receiverVolumes[c].Far = sliceFar;
+		receiverVolumes[c].Transform(receiverVolumes[c], cameraWorld);
+
+		sliceNear = sliceFar;
+	}
+}
+
+// --------------------------------------------------------
+// (Re)creates the texture array, with a slice per cascade
+// --------------------------------------------------------
+void ShadowCascades::CreateShadowMap()
+{
+	D3D11_TEXTURE2D_DESC shadowDesc = {};
+	shadowDesc.Width = resolution;
+	shadowDesc.Height = resolution;
+	shadowDesc.ArraySize = cascadeCount;
+	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	shadowDesc.MipLevels = 1;
+	shadowDesc.SampleDesc.Count = 1;
+	shadowDesc.Usage = D3D11_USAGE_DEFAULT;
+	device->CreateTexture2D(&shadowDesc, 0, shadowTexture.ReleaseAndGetAddressOf());
+
+	for (unsigned int c = 0; c < MAX_SHADOW_CASCADES; c++)
+	{
+		dsvs[c].Reset();
+		hasContents[c] = false;
+		if (c >= cascadeCount)
+			continue;
+
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		dsvDesc.Texture2DArray.FirstArraySlice = c;
+		dsvDesc.Texture2DArray.ArraySize = 1;
+		device->CreateDepthStencilView(shadowTexture.Get(), &dsvDesc, dsvs[c].GetAddressOf());
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.ArraySize = cascadeCount;
+	device->CreateShaderResourceView(shadowTexture.Get(), &srvDesc, srv.ReleaseAndGetAddressOf());
+
+	CreateStaticCache();
+}
+
+// --------------------------------------------------------
+// (Re)creates the static cache to match the shadow map, or
+// releases it when caching is off.  It's only ever copied
+// from, so it needn't be sampled.
+// --------------------------------------------------------
+void ShadowCascades::CreateStaticCache()
+{
+	staticTexture.Reset();
+	for (unsigned int c = 0; c < MAX_SHADOW_CASCADES; c++)
+	{
+		staticDSVs[c].Reset();
+		staticValid[c] = false;
+	}
+	if (!staticCaching)
+		return;
+
+	D3D11_TEXTURE2D_DESC cacheDesc = {};
+	cacheDesc.Width = resolution;
+	cacheDesc.Height = resolution;
+	cacheDesc.ArraySize = cascadeCount;
+	cacheDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	cacheDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	cacheDesc.MipLevels = 1;
+	cacheDesc.SampleDesc.Count = 1;
+	cacheDesc.Usage = D3D11_USAGE_DEFAULT;
+	device->CreateTexture2D(&cacheDesc, 0, staticTexture.GetAddressOf());
+
+	for (unsigned int c = 0; c < cascadeCount; c++)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		dsvDesc.Texture2DArray.FirstArraySlice = c;
+		dsvDesc.Texture2DArray.ArraySize = 1;
+		device->CreateDepthStencilView(staticTexture.Get(), &dsvDesc, staticDSVs[c].GetAddressOf());
+	}
+}
+
+void ShadowCascades::SetCascadeCount(unsigned int count)
+{
+	count = count < 1 ? 1 : count > MAX_SHADOW_CASCADES ? MAX_SHADOW_CASCADES : count;
+	if (count == cascadeCount)
+		return;
+	cascadeCount = count;
+	CreateShadowMap();
+}
+
+void ShadowCascades::SetResolution(unsigned int resolution)
+{
+	if (resolution == this->resolution)
+		return;
+	this->resolution = resolution;
+	CreateShadowMap();
+}
+
+void ShadowCascades::SetStaticCaching(bool enabled)
+{
+	if (enabled == staticCaching)
+		return;
+	staticCaching = enabled;
+	CreateStaticCache();
+}
+
+void ShadowCascades::SetUpdateInterval(unsigned int frames)
+{
+	updateInterval = frames < 1 ? 1 : frames;
+}
+
+void ShadowCascades::InvalidateStaticCache()
+{
+	for (unsigned int c = 0; c < MAX_SHADOW_CASCADES; c++)
+		staticValid[c] = false;
+}
+
+// --------------------------------------------------------
+// The static cache starts empty, and the cascade starts as
+// a copy of the cache (or empty, without caching), which the
+// dynamic casters are then drawn over
+// --------------------------------------------------------
+void ShadowCascades::BeginStaticPass(ID3D11DeviceContext* context, unsigned int cascade)
+{
+	context->ClearDepthStencilView(staticDSVs[cascade].Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+}
+
+void ShadowCascades::BeginPass(ID3D11DeviceContext* context, unsigned int cascade)
+{
+	if (staticCaching)
+		context->CopySubresourceRegion(shadowTexture.Get(), cascade, 0, 0, 0, staticTexture.Get(), cascade, 0);
+	else
+		context->ClearDepthStencilView(dsvs[cascade].Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+}
+
+void ShadowCascades::SetSplitLambda(float lambda) { splitLambda = lambda; }
+void ShadowCascades::SetShadowDistance(float distance) { shadowDistance = distance; }
+void ShadowCascades::SetBlendFraction(float fraction) { blendFraction = fraction; }
+unsigned int ShadowCascades::GetCascadeCount() { return cascadeCount; }
+unsigned int ShadowCascades::GetResolution() { return resolution; }
+float ShadowCascades::GetSplitLambda() { return splitLambda; }
+float ShadowCascades::GetShadowDistance() { return shadowDistance; }
+float ShadowCascades::GetBlendFraction() { return blendFraction; }
+bool ShadowCascades::GetStaticCaching() { return staticCaching; }
+unsigned int ShadowCascades::GetUpdateInterval() { return updateInterval; }
+
+const DirectX::XMFLOAT4X4& ShadowCascades::GetView() { return view; }
+const DirectX::XMFLOAT4X4& ShadowCascades::GetProjection(unsigned int cascade) { return projections[cascade]; }
+float ShadowCascades::GetSplitDepth(unsigned int cascade) { return splitDepths[cascade]; }
+const DirectX::BoundingBox& ShadowCascades::GetCasterBox(unsigned int cascade) { return casterBoxes[cascade]; }
+const DirectX::BoundingFrustum& ShadowCascades::GetReceiverVolume(unsigned int cascade) { return receiverVolumes[cascade]; }
+bool ShadowCascades::IsDrawn(unsigned int cascade) { return drawn[cascade]; }
+bool ShadowCascades::IsStaticDrawn(unsigned int cascade) { return staticDrawn[cascade]; }
+ID3D11DepthStencilView* ShadowCascades::GetDSV(unsigned int cascade) { return dsvs[cascade].Get(); }
+ID3D11DepthStencilView* ShadowCascades::GetStaticDSV(unsigned int cascade) { return staticDSVs[cascade].Get(); }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ShadowCascades::GetSRV() { return srv; }
+
+DirectX::XMFLOAT4X4 ShadowCascades::GetViewProjection(unsigned int cascade)
+{
+	DirectX::XMFLOAT4X4 viewProjection;
+	DirectX::XMStoreFloat4x4(&viewProjection, DirectX::XMLoadFloat4x4(&view) * DirectX::XMLoadFloat4x4(&projections[cascade]));
+	return viewProjection;
+}
+
+// --------------------------------------------------------
+// Orthographic projections map each axis with a scale and an
+// offset, and the cascades share a view, so a position in the
+// first cascade maps to this one's with another scale and offset
+// --------------------------------------------------------
+DirectX::XMFLOAT3 ShadowCascades::GetShadowMapScale(unsigned int cascade)
+{
+	const DirectX::XMFLOAT4X4& first = projections[0];
+	const DirectX::XMFLOAT4X4& other = projections[cascade];
+	return DirectX::XMFLOAT3(other._11 / first._11, other._22 / first._22, other._33 / first._33);
+}
+
+DirectX::XMFLOAT3 ShadowCascades::GetShadowMapOffset(unsigned int cascade)
+{
+	const DirectX::XMFLOAT4X4& first = projections[0];
+	const DirectX::XMFLOAT4X4& other = projections[cascade];
+	DirectX::XMFLOAT3 scale = GetShadowMapScale(cascade);
+	return DirectX::XMFLOAT3(
+		other._41 - first._41 * scale.x,
+		other._42 - first._42 * scale.y,
+		other._43 - first._43 * scale.z);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include "RenderQueue.h"
+
+// --------------------------------------------------------
+// Cascaded shadow maps for the shadow casting directional
+// light: the camera's view is cut into depth slices, each
+// with its own orthographic projection fitted around it and
+// its own slice of a shadow map texture array
+//
+// - Splits blend an even split with a logarithmic one (the
+//   "practical" scheme), set by SetSplitLambda()
+// - Each cascade is fitted to a sphere around its slice of
+//   the view, and moved in whole shadow map texels, so its
+//   shadows don't shimmer as the camera moves or turns
+// - Casters are culled in light view space, where each
+//   cascade's projection is a box (GetCasterBox()), and only
+//   need to cast onto what's visible in its slice of the view
+//   (GetReceiverVolume())
+// - Cascades share one light view, and only differ in an
+//   orthographic scale and offset, so shaders find any
+//   cascade's position from the first's (GetShadowMapScale())
+// - With static caching on, static casters are drawn into a
+//   second texture array that is only redrawn when a cascade
+//   moves or the light turns (or InvalidateStaticCache() is
+//   called), and copied under the dynamic casters each frame
+// - Cascades past the first can be redrawn only every few
+//   frames (SetUpdateInterval()), keeping what they had, and
+//   the projection it was drawn with, in between
+// - Changing the cascade count or resolution replaces the
+//   texture array - get the SRV again after
+// --------------------------------------------------------
+class ShadowCascades
+{
+public:
+	ShadowCascades(Microsoft::WRL::ComPtr<ID3D11Device> device, unsigned int cascadeCount, unsigned int resolution);
+	~ShadowCascades();
+
+	// Call every frame, with the camera being drawn
+	void Update(
+		const DirectX::XMFLOAT4X4& cameraView,
+		const DirectX::XMFLOAT4X4& cameraProjection,
+		float nearZ,
+		float farZ,
+		DirectX::XMFLOAT3 lightDirection);
+
+	void SetCascadeCount(unsigned int count);
+	void SetResolution(unsigned int resolution);
+	void SetSplitLambda(float lambda); // 0 for even splits, 1 for logarithmic
+	void SetShadowDistance(float distance); // No shadows past this far from the camera
+	void SetBlendFraction(float fraction); // How much of each cascade fades into the next
+	void SetStaticCaching(bool enabled);
+	void SetUpdateInterval(unsigned int frames); // Frames between redraws of cascades past the first
+	void InvalidateStaticCache(); // Static casters were added, removed or changed
+	unsigned int GetCascadeCount();
+	unsigned int GetResolution();
+	float GetSplitLambda();
+	float GetShadowDistance();
+	float GetBlendFraction();
+	bool GetStaticCaching();
+	unsigned int GetUpdateInterval();
+
+	// Per cascade results of the last Update()
+	const DirectX::XMFLOAT4X4& GetView();
+	const DirectX::XMFLOAT4X4& GetProjection(unsigned int cascade);
+	DirectX::XMFLOAT4X4 GetViewProjection(unsigned int cascade);
+	float GetSplitDepth(unsigned int cascade); // View depth the cascade ends at
+	DirectX::XMFLOAT3 GetShadowMapScale(unsigned int cascade); // From the first cascade's position to this one's
+	DirectX::XMFLOAT3 GetShadowMapOffset(unsigned int cascade);
+	const DirectX::BoundingBox& GetCasterBox(unsigned int cascade); // Light view space
+	const DirectX::BoundingFrustum& GetReceiverVolume(unsigned int cascade); // The cascade's slice of the view, world space
+
+	bool IsDrawn(unsigned int cascade); // Redrawn this frame, or kept from an earlier one
+	bool IsStaticDrawn(unsigned int cascade); // Static cache redrawn this frame
+
+	// Each frame's passes, before their casters are drawn
+	void BeginStaticPass(ID3D11DeviceContext* context, unsigned int cascade);
+	void BeginPass(ID3D11DeviceContext* context, unsigned int cascade);
+
+	ID3D11DepthStencilView* GetDSV(unsigned int cascade);
+	ID3D11DepthStencilView* GetStaticDSV(unsigned int cascade);
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSRV();
+
+private:
+	void CreateShadowMap();
+	void CreateStaticCache();
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	unsigned int cascadeCount;
+	unsigned int resolution;
+	float splitLambda;
+	float shadowDistance;
+	float blendFraction;
+	bool staticCaching;
+	unsigned int updateInterval;
+	unsigned int frameIndex;
+
+	DirectX::XMFLOAT4X4 view;
+	DirectX::XMFLOAT4X4 projections[MAX_SHADOW_CASCADES];
+	float splitDepths[MAX_SHADOW_CASCADES];
+	DirectX::BoundingBox casterBoxes[MAX_SHADOW_CASCADES];
+	DirectX::BoundingFrustum receiverVolumes[MAX_SHADOW_CASCADES];
+	bool drawn[MAX_SHADOW_CASCADES];
+	bool staticDrawn[MAX_SHADOW_CASCADES];
+	bool hasContents[MAX_SHADOW_CASCADES]; // Drawn since the texture was created
+	bool staticValid[MAX_SHADOW_CASCADES]; // Cache matches the cascade's projection
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staticTexture;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> dsvs[MAX_SHADOW_CASCADES];
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> staticDSVs[MAX_SHADOW_CASCADES];
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+};
@@ -0,0 +1,234 @@
+#include "ShadowFilter.h"
+#include <cmath>
+
+ShadowFilter::ShadowFilter(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<SimpleComputeShader> momentsShader,
+	std::shared_ptr<SimpleComputeShader> blurShader)
+	:
+	device(device),
+	context(context),
+	momentsShader(momentsShader),
+	blurShader(blurShader),
+	mode(SHADOW_FILTER_POISSON),
+	taps(16),
+	gridSize(3),
+	radius(1.5f),
+	sunSize(2.0f),
+	lightSize(0.2f),
+	blurRadius(2),
+	exponents(40.0f, 10.0f),
+	bleedReduction(0.2f),
+	resolution(0),
+	cascadeCount(0),
+	filteredCount(0)
+{
+	for (unsigned int c = 0; c < MAX_SHADOW_CASCADES; c++)
+		valid[c] = false;
+}
+
+ShadowFilter::~ShadowFilter()
+{
+}
+
+// --------------------------------------------------------
+// (Re)creates the moments for cascades of the given size: a
+// mipmapped array with a slice per cascade, and one texture
+// for the rows between the two halves of the blur
+// - 32 bit floats, as the positive warp's moments go past
+//   what 16 bit floats can hold
+// --------------------------------------------------------
+void ShadowFilter::CreateMoments(unsigned int resolution, unsigned int cascadeCount)
+{
+	this->resolution = resolution;
+	this->cascadeCount = cascadeCount;
+
+	D3D11_TEXTURE2D_DESC rowDesc = {};
+	rowDesc.Width = resolution;
+	rowDesc.Height = resolution;
+	rowDesc.ArraySize = 1;
+	rowDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	rowDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	rowDesc.MipLevels = 1;
+	rowDesc.SampleDesc.Count = 1;
+	rowDesc.Usage = D3D11_USAGE_DEFAULT;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> rowTexture;
+	device->CreateTexture2D(&rowDesc, 0, rowTexture.GetAddressOf());
+	device->CreateShaderResourceView(rowTexture.Get(), 0, rowSRV.ReleaseAndGetAddressOf());
+	device->CreateUnorderedAccessView(rowTexture.Get(), 0, rowUAV.ReleaseAndGetAddressOf());
+
+	// Generating mips needs the texture to be a render target too
+	D3D11_TEXTURE2D_DESC momentsDesc = rowDesc;
+	momentsDesc.ArraySize = cascadeCount;
+	momentsDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_RENDER_TARGET;
+	momentsDesc.MipLevels = 0;
+	momentsDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> momentsTexture;
+	device->CreateTexture2D(&momentsDesc, 0, momentsTexture.GetAddressOf());
+	device->CreateShaderResourceView(momentsTexture.Get(), 0, momentsSRV.ReleaseAndGetAddressOf());
+
+	for (unsigned int c = 0; c < MAX_SHADOW_CASCADES; c++)
+	{
+		sliceSRVs[c].Reset();
+		sliceUAVs[c].Reset();
+		valid[c] = false;
+		if (c >= cascadeCount)
+			continue;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = momentsDesc.Format;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MipLevels = (unsigned int)-1;
+		srvDesc.Texture2DArray.FirstArraySlice = c;
+		srvDesc.Texture2DArray.ArraySize = 1;
+		device->CreateShaderResourceView(momentsTexture.Get(), &srvDesc, sliceSRVs[c].GetAddressOf());
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.Format = momentsDesc.Format;
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+		uavDesc.Texture2DArray.FirstArraySlice = c;
+		uavDesc.Texture2DArray.ArraySize = 1;
+		device->CreateUnorderedAccessView(momentsTexture.Get(), &uavDesc, sliceUAVs[c].GetAddressOf());
+	}
+}
+
+void ShadowFilter::ReleaseMoments()
+{
+	resolution = 0;
+	cascadeCount = 0;
+	rowSRV.Reset();
+	rowUAV.Reset();
+	momentsSRV.Reset();
+	for (unsigned int c = 0; c < MAX_SHADOW_CASCADES; c++)
+	{
+		sliceSRVs[c].Reset();
+		sliceUAVs[c].Reset();
+		valid[c] = false;
+	}
+}
+
+void ShadowFilter::Update(ShadowCascades* cascades)
+{
+	if (mode != SHADOW_FILTER_EVSM)
+	{
+		if (momentsSRV)
+			ReleaseMoments();
+		return;
+	}
+	if (!momentsSRV || resolution != cascades->GetResolution() || cascadeCount != cascades->GetCascadeCount())
+		CreateMoments(cascades->GetResolution(), cascades->GetCascadeCount());
+}
+
+// --------------------------------------------------------
+// Warps and blurs along rows, blurs down columns, then fills
+// in the mips, for each cascade whose depths changed (or
+// whose moments were made with other settings)
+// --------------------------------------------------------
+void ShadowFilter::Prefilter(ShadowCascades* cascades)
+{
+	filteredCount = 0;
+	if (!momentsSRV)
+		return;
+
+	ID3D11ShaderResourceView* nullSRV = 0;
+	ID3D11UnorderedAccessView* nullUAV = 0;
+	for (unsigned int c = 0; c < cascadeCount; c++)
+	{
+		// Cascades kept from an earlier frame keep their moments
+		if (valid[c] && !cascades->IsDrawn(c))
+			continue;
+
+		momentsShader->SetShader();
+		momentsShader->SetInt("resolution", (int)resolution);
+		momentsShader->SetInt("slice", (int)c);
+		momentsShader->SetInt("blurRadius", (int)blurRadius);
+		momentsShader->SetFloat2("exponents", exponents);
+		momentsShader->CopyAllBufferData();
+		momentsShader->SetShaderResourceView("ShadowMap", cascades->GetSRV());
+		momentsShader->SetUnorderedAccessView("Output", rowUAV);
+		momentsShader->DispatchByThreads(resolution, resolution, 1);
+		context->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+
+		blurShader->SetShader();
+		blurShader->SetInt("resolution", (int)resolution);
+		blurShader->SetInt("blurRadius", (int)blurRadius);
+		blurShader->CopyAllBufferData();
+		blurShader->SetShaderResourceView("Input", rowSRV);
+		blurShader->SetUnorderedAccessView("Output", sliceUAVs[c]);
+		blurShader->DispatchByThreads(resolution, resolution, 1);
+		context->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+		context->CSSetShaderResources(0, 1, &nullSRV);
+
+		// Only this cascade's mips, from the view of its slice
+		context->GenerateMips(sliceSRVs[c].Get());
+		valid[c] = true;
+		filteredCount++;
+	}
+}
+
+void ShadowFilter::SetMode(unsigned int mode)
+{
+	this->mode = mode < SHADOW_FILTER_COUNT ? mode : SHADOW_FILTER_HARDWARE;
+}
+
+void ShadowFilter::SetTaps(unsigned int taps)
+{
+	this->taps = taps < 1 ? 1 : taps > SHADOW_FILTER_MAX_TAPS ? SHADOW_FILTER_MAX_TAPS : taps;
+}
+
+void ShadowFilter::SetGridSize(unsigned int size)
+{
+	gridSize = size < 1 ? 1 : size > SHADOW_FILTER_MAX_GRID ? SHADOW_FILTER_MAX_GRID : size;
+}
+
+// The shaders read one count, which the grid takes per side
+unsigned int ShadowFilter::GetShaderTaps()
+{
+	return mode == SHADOW_FILTER_GRID ? gridSize : taps;
+}
+
+// The moments were blurred and warped with the old settings
+void ShadowFilter::SetBlurRadius(unsigned int texels)
+{
+	blurRadius = texels > SHADOW_BLUR_MAX_RADIUS ? SHADOW_BLUR_MAX_RADIUS : texels;
+	for (unsigned int c = 0; c < MAX_SHADOW_CASCADES; c++)
+		valid[c] = false;
+}
+
+void ShadowFilter::SetExponents(float positive, float negative)
+{
+	exponents = DirectX::XMFLOAT2(positive, negative);
+	for (unsigned int c = 0; c < MAX_SHADOW_CASCADES; c++)
+		valid[c] = false;
+}
+
+void ShadowFilter::SetRadius(float texels) { radius = texels; }
+void ShadowFilter::SetSunSize(float degrees) { sunSize = degrees; }
+void ShadowFilter::SetLightSize(float radius) { lightSize = radius; }
+void ShadowFilter::SetBleedReduction(float amount) { bleedReduction = amount; }
+unsigned int ShadowFilter::GetMode() { return mode; }
+unsigned int ShadowFilter::GetTaps() { return taps; }
+unsigned int ShadowFilter::GetGridSize() { return gridSize; }
+float ShadowFilter::GetRadius() { return radius; }
+float ShadowFilter::GetSunSize() { return sunSize; }
+float ShadowFilter::GetLightSize() { return lightSize; }
+unsigned int ShadowFilter::GetBlurRadius() { return blurRadius; }
+DirectX::XMFLOAT2 ShadowFilter::GetExponents() { return exponents; }
+float ShadowFilter::GetBleedReduction() { return bleedReduction; }
+
+const char* ShadowFilter::GetModeName(unsigned int mode)
+{
+	const char* names[SHADOW_FILTER_COUNT] = { "Hardware 2x2", "Grid PCF", "Poisson PCF", "PCSS", "EVSM" };
+	return mode < SHADOW_FILTER_COUNT ? names[mode] : "Unknown";
+}
+
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ShadowFilter::GetMomentsSRV() { return momentsSRV; }
+unsigned int ShadowFilter::GetFilteredCount() { return filteredCount; }
+
+// The array with its mips (a third more), and the rows
+unsigned int ShadowFilter::GetMomentsBytes()
+{
+	unsigned int sliceBytes = resolution * resolution * 16;
+	return momentsSRV ? sliceBytes * cascadeCount / 3 * 4 + sliceBytes : 0;
+}
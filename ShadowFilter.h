@@ -0,0 +1,112 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include "SimpleShader.h"
+#include "ShadowCascades.h"
+
+// How shadow maps are filtered - must match SHADOW_FILTER_* in
+// Shadows.hlsli
+#define SHADOW_FILTER_HARDWARE	0
+#define SHADOW_FILTER_GRID		1
+#define SHADOW_FILTER_POISSON	2
+#define SHADOW_FILTER_PCSS		3
+#define SHADOW_FILTER_EVSM		4
+#define SHADOW_FILTER_COUNT		5
+
+// Must match MAX_POISSON_TAPS in Shadows.hlsli
+#define SHADOW_FILTER_MAX_TAPS 32
+#define SHADOW_FILTER_MAX_GRID 8 // Taps per side
+
+// Must match MAX_BLUR_RADIUS in ShadowMomentsCS.hlsl and ShadowBlurCS.hlsl
+#define SHADOW_BLUR_MAX_RADIUS 8
+
+// --------------------------------------------------------
+// How the shaders filter shadow maps (see Shadows.hlsli),
+// and the moments EVSM filters the cascades with
+//
+// - PCF modes are all chosen per frame in the shaders, by
+//   the ShadowData settings taken from here
+// - EVSM needs each cascade's depths turned into moments of
+//   two exponential warps, blurred (separably, by two compute
+//   shaders) and mipmapped, which Prefilter() does.  Only the
+//   cascades redrawn that frame are filtered again.
+// - The moments are only made while EVSM is on, as they take
+//   four floats per texel; the shadow atlas is never given
+//   any, and is filtered as Poisson under EVSM
+// --------------------------------------------------------
+class ShadowFilter
+{
+public:
+	ShadowFilter(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<SimpleComputeShader> momentsShader,
+		std::shared_ptr<SimpleComputeShader> blurShader);
+	~ShadowFilter();
+
+	void SetMode(unsigned int mode);
+	void SetTaps(unsigned int taps); // Poisson and PCSS
+	void SetGridSize(unsigned int size); // Taps per side of the grid
+	void SetRadius(float texels); // PCSS: the widest its kernel gets
+	void SetSunSize(float degrees); // PCSS: the shadow casting light's angular diameter
+	void SetLightSize(float radius); // PCSS: point and spot lights, in world units
+	void SetBlurRadius(unsigned int texels);
+	void SetExponents(float positive, float negative);
+	void SetBleedReduction(float amount);
+	unsigned int GetMode();
+	unsigned int GetTaps();
+	unsigned int GetGridSize();
+	unsigned int GetShaderTaps(); // filterTaps in Shadows.hlsli, for the current mode
+	float GetRadius();
+	float GetSunSize();
+	float GetLightSize();
+	unsigned int GetBlurRadius();
+	DirectX::XMFLOAT2 GetExponents();
+	float GetBleedReduction();
+	static const char* GetModeName(unsigned int mode);
+
+	// Each frame: Update() after the cascades are, before any
+	// draws that bind the moments are recorded, as it makes (or
+	// releases) them to match the cascades and mode
+	void Update(ShadowCascades* cascades);
+
+	// EVSM only: makes the moments of the cascades redrawn this
+	// frame.  Call after the shadow passes, with the cascades'
+	// targets unbound, and before anything samples them.
+	void Prefilter(ShadowCascades* cascades);
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetMomentsSRV(); // Null unless EVSM is on
+	unsigned int GetMomentsBytes();
+	unsigned int GetFilteredCount(); // Cascades Prefilter() redid this frame
+
+private:
+	void CreateMoments(unsigned int resolution, unsigned int cascadeCount);
+	void ReleaseMoments();
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<SimpleComputeShader> momentsShader;
+	std::shared_ptr<SimpleComputeShader> blurShader;
+
+	unsigned int mode;
+	unsigned int taps;
+	unsigned int gridSize;
+	float radius;
+	float sunSize;
+	float lightSize;
+	unsigned int blurRadius;
+	DirectX::XMFLOAT2 exponents;
+	float bleedReduction;
+
+	// The moments, sized to match the cascades
+	unsigned int resolution;
+	unsigned int cascadeCount;
+	unsigned int filteredCount;
+	bool valid[MAX_SHADOW_CASCADES]; // Made from the cascade's current contents
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> rowSRV; // Between the two blurs
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> rowUAV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> momentsSRV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> sliceSRVs[MAX_SHADOW_CASCADES]; // For generating each one's mips
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> sliceUAVs[MAX_SHADOW_CASCADES];
+};
@@ -0,0 +1,57 @@
+#include "Include.hlsli"
+#include "Shadows.hlsli"
+
+// Texels per thread group, along the row it fills
+#define GROUP_SIZE 64
+
+// Must match SHADOW_BLUR_MAX_RADIUS in ShadowFilter.h
+#define MAX_BLUR_RADIUS 8
+
+cbuffer MomentData : register(b0)
+{
+    uint resolution; // Texels per side of the shadow map
+    uint slice; // The cascade being filtered
+    uint blurRadius;
+    float2 exponents; // Positive and negative warps
+}
+
+Texture2DArray<float> ShadowMap : register(t0);
+
+// Moments blurred along each row, which ShadowBlurCS.hlsl blurs
+// down the columns into the cascade's slice
+RWTexture2D<float4> Output : register(u0);
+
+// The row's warped depths, and blurRadius past either end
+groupshared float4 row[GROUP_SIZE + MAX_BLUR_RADIUS * 2];
+
+// --------------------------------------------------------
+// First half of EVSM's separable blur: turns a row of one
+// cascade's depths into moments of both warps, each warped
+// once into group shared memory, then blurs them along it
+// --------------------------------------------------------
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 groupId : SV_GroupID, uint3 threadId : SV_GroupThreadID)
+{
+    int rowStart = (int)(groupId.x * GROUP_SIZE) - (int)blurRadius;
+    for (uint i = threadId.x; i < GROUP_SIZE + blurRadius * 2; i += GROUP_SIZE)
+    {
+        int x = clamp(rowStart + (int)i, 0, (int)resolution - 1);
+        float2 warped = WarpDepth(ShadowMap.Load(int4(x, groupId.y, slice, 0)), exponents);
+        row[i] = float4(warped.x, warped.x * warped.x, warped.y, warped.y * warped.y);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint x = groupId.x * GROUP_SIZE + threadId.x;
+    if (x >= resolution)
+        return;
+
+    float4 sum = float4(0, 0, 0, 0);
+    float weightSum = 0.0f;
+    for (int t = -(int)blurRadius; t <= (int)blurRadius; t++)
+    {
+        float weight = BlurWeight(t, blurRadius);
+        sum += row[threadId.x + blurRadius + t] * weight;
+        weightSum += weight;
+    }
+    Output[uint2(x, groupId.y)] = sum / weightSum;
+}
@@ -1,12 +1,15 @@
 #include "Include.hlsli"
 
 // Constant Buffer for external (C++) data
-cbuffer externalData : register(b0)
+cbuffer PerPass : register(b0)
 {
-    matrix world;
     matrix view;
     matrix projection;
-    
+};
+
+cbuffer PerObject : register(b1)
+{
+    matrix world;
 };
 
 struct VertexShaderInput
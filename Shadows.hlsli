@@ -0,0 +1,303 @@
+#ifndef __GGP_SHADOW_INCLUDES__
+#define __GGP_SHADOW_INCLUDES__
+
+// Shared by every shader that samples the cascaded shadow map
+// or the shadow atlas
+// - Include after Include.hlsli, which has the Light struct
+// - Must match MAX_SHADOW_CASCADES in RenderQueue.h
+#define MAX_SHADOW_CASCADES 4
+
+// How shadow maps are filtered - must match SHADOW_FILTER_* in
+// ShadowFilter.h
+#define SHADOW_FILTER_HARDWARE  0 // One bilinear 2x2 comparison
+#define SHADOW_FILTER_GRID      1 // A grid of filterTaps x filterTaps comparisons
+#define SHADOW_FILTER_POISSON   2 // filterTaps comparisons over a rotated Poisson disk
+#define SHADOW_FILTER_PCSS      3 // Poisson, widened by the distance to the blockers
+#define SHADOW_FILTER_EVSM      4 // Blurred, mipmapped moments (cascades only)
+
+#define MAX_POISSON_TAPS 32
+#define PCSS_BLOCKER_TAPS 16
+
+// The cascades of the shadow map (see ShadowCascades.h).  The
+// vertex shader gives the position in the first cascade, and
+// each cascade's is a scale and offset from that.
+cbuffer ShadowData : register(b2)
+{
+    float4 cascadeScales[MAX_SHADOW_CASCADES];
+    float4 cascadeOffsets[MAX_SHADOW_CASCADES];
+    float4 cascadeSplits; // View depth each cascade ends at
+    uint cascadeCount;
+    float cascadeBlend; // Fraction of each cascade that fades into the next
+    float atlasTexelSize; // One texel of the shadow atlas, in UVs
+    uint filterMode; // One of SHADOW_FILTER_*
+    uint filterTaps; // Poisson taps, or taps per side of the grid
+    float filterRadius; // Texels the kernel reaches out (PCSS: the furthest it can)
+    float2 cascadeProjection; // The first cascade's _11 and _33
+    float cascadeTexelSize; // One texel of a cascade, in UVs
+    float sunSize; // PCSS: tangent of the shadow casting light's angular radius
+    float lightSize; // PCSS: radius of point and spot lights
+    float evsmBleedReduction; // How much of the lit end of each EVSM test is cut off
+    float2 evsmExponents; // Positive and negative EVSM warps
+}
+
+// Where one of a point or spot light's views was drawn in the
+// shadow atlas (see ShadowAtlas.h)
+struct ShadowView
+{
+    matrix viewProjection;
+    float4 atlasRect; // UV offset in xy, UV scale in zw
+    float4 projection; // The view's _11, _33 and _43, for PCSS
+};
+
+// A progressive Poisson disk - each prefix of it is still
+// spread evenly, so fewer taps just take the first few
+static const float2 PoissonDisk[MAX_POISSON_TAPS] =
+{
+    float2(0.1000, 0.0500), float2(-0.5647, -0.2626), float2(0.0213, -0.6408), float2(-0.4707, 0.4219),
+    float2(0.6344, -0.2562), float2(0.1930, 0.6632), float2(0.6499, 0.3434), float2(-0.3990, -0.6472),
+    float2(0.4373, -0.6227), float2(-0.1577, -0.2751), float2(-0.2251, 0.7551), float2(-0.7823, 0.1002),
+    float2(-0.3627, 0.0602), float2(0.2332, -0.3080), float2(-0.0509, 0.3837), float2(0.4808, 0.0451),
+    float2(0.2800, 0.3425), float2(0.8245, 0.0288), float2(0.4948, 0.6196), float2(-0.6713, -0.5484),
+    float2(-0.8362, -0.2090), float2(-0.1799, -0.8351), float2(-0.7463, 0.3760), float2(-0.5062, 0.6905),
+    float2(0.2351, -0.8176), float2(0.6953, -0.5085), float2(0.0644, 0.8688), float2(-0.1820, -0.5111),
+    float2(-0.1197, 0.1459), float2(-0.5805, 0.0021), float2(-0.2437, 0.5124), float2(0.2857, -0.0844)
+};
+
+// A different turn of the Poisson disk for each pixel, from
+// interleaved gradient noise, so too few taps give noise
+// rather than banding
+float2x2 PoissonRotation(float2 pixel)
+{
+    float angle = 6.2831853f * frac(52.9829189f * frac(dot(pixel, float2(0.06711056f, 0.00583715f))));
+    float s, c;
+    sincos(angle, s, c);
+    return float2x2(c, -s, s, c);
+}
+
+// EVSM's two warps of a [0, 1] depth, which the moments are
+// made of (see ShadowMomentsCS.hlsl)
+float2 WarpDepth(float depth, float2 exponents)
+{
+    depth = depth * 2.0f - 1.0f;
+    return float2(exp(exponents.x * depth), -exp(-exponents.y * depth));
+}
+
+// Gaussian weight of a tap of the moment blur, with the
+// kernel's radius at two standard deviations
+float BlurWeight(int offset, uint radius)
+{
+    float sigma = (radius + 1) * 0.5f;
+    return exp(-(offset * offset) / (2.0f * sigma * sigma));
+}
+
+// --------------------------------------------------------
+// Averages comparisons around a UV as filterMode says: one
+// tap, a grid, or the Poisson disk (which PCSS, and EVSM for
+// maps without moments, use too)
+// - bounds: the UVs taps are kept within (min in xy, max in zw)
+// - radius: how far taps reach, in UVs
+// --------------------------------------------------------
+float FilterComparison(Texture2DArray shadowMap, SamplerComparisonState shadowSampler, float3 uv, float depth, float4 bounds, float radius, float2x2 rotation)
+{
+    if (filterMode == SHADOW_FILTER_HARDWARE)
+        return shadowMap.SampleCmpLevelZero(shadowSampler, uv, depth).r;
+
+    float shadow = 0.0f;
+    if (filterMode == SHADOW_FILTER_GRID)
+    {
+        uint side = max(filterTaps, 1);
+        float step = side > 1 ? radius * 2.0f / (side - 1) : 0.0f;
+        for (uint y = 0; y < side; y++)
+        {
+            for (uint x = 0; x < side; x++)
+            {
+                float2 tap = clamp(uv.xy + float2(x, y) * step - (side > 1 ? radius : 0.0f), bounds.xy, bounds.zw);
+                shadow += shadowMap.SampleCmpLevelZero(shadowSampler, float3(tap, uv.z), depth).r;
+            }
+        }
+        return shadow / (side * side);
+    }
+
+    uint taps = clamp(filterTaps, 1, MAX_POISSON_TAPS);
+    for (uint i = 0; i < taps; i++)
+    {
+        float2 tap = clamp(uv.xy + mul(rotation, PoissonDisk[i]) * radius, bounds.xy, bounds.zw);
+        shadow += shadowMap.SampleCmpLevelZero(shadowSampler, float3(tap, uv.z), depth).r;
+    }
+    return shadow / taps;
+}
+
+// --------------------------------------------------------
+// PCSS's blocker search: the average depth of what's closer
+// to the light than the receiver, within radius UVs, or -1
+// if nothing is
+// --------------------------------------------------------
+float FindBlockerDepth(Texture2DArray shadowMap, float3 uv, float depth, float4 bounds, float radius, float texelSize, float2x2 rotation)
+{
+    float blockerSum = 0.0f;
+    uint blockers = 0;
+    for (uint i = 0; i < PCSS_BLOCKER_TAPS; i++)
+    {
+        float2 tap = clamp(uv.xy + mul(rotation, PoissonDisk[i]) * radius, bounds.xy, bounds.zw);
+        float tapDepth = shadowMap.Load(int4(tap / texelSize, uv.z, 0)).r;
+        if (tapDepth < depth)
+        {
+            blockerSum += tapDepth;
+            blockers++;
+        }
+    }
+    return blockers > 0 ? blockerSum / blockers : -1.0f;
+}
+
+// --------------------------------------------------------
+// EVSM's test: how likely a depth is to be lit, by Chebyshev's
+// inequality on both warps' moments (the tighter one wins)
+// --------------------------------------------------------
+float Chebyshev(float2 moments, float mean, float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float difference = mean - moments.x;
+    float lit = variance / (variance + difference * difference);
+
+    // Cutting off the lit end hides light bleeding where
+    // casters overlap, at the cost of darker penumbrae
+    lit = saturate((lit - evsmBleedReduction) / (1.0f - evsmBleedReduction));
+    return mean <= moments.x ? 1.0f : lit;
+}
+
+float EvsmShadow(Texture2DArray shadowMoments, SamplerState momentSampler, float3 uv, float depth, float lod)
+{
+    float2 warped = WarpDepth(depth, evsmExponents);
+    float4 moments = shadowMoments.SampleLevel(momentSampler, uv, lod);
+
+    // A little variance for each warp, in proportion to how
+    // steep the warp is, stops acne on flat surfaces
+    float2 depthScale = 0.0001f * evsmExponents * abs(warped);
+    return min(
+        Chebyshev(moments.xy, warped.x, depthScale.x * depthScale.x),
+        Chebyshev(moments.zw, warped.y, depthScale.y * depthScale.y));
+}
+
+// --------------------------------------------------------
+// One cascade's filtered shadow for a first cascade position
+// - footprint: how far the position moves between pixels,
+//   which picks the moments' mip for EVSM
+// --------------------------------------------------------
+float SampleCascade(Texture2DArray shadowMap, Texture2DArray shadowMoments, SamplerComparisonState shadowSampler, SamplerState momentSampler,
+    float3 shadowPosition, uint cascade, float footprint, float2x2 rotation)
+{
+    float3 scale = cascadeScales[cascade].xyz;
+    float3 position = shadowPosition * scale + cascadeOffsets[cascade].xyz;
+    float3 uv = float3(position.x * 0.5f + 0.5f, 0.5f - position.y * 0.5f, cascade);
+
+    if (filterMode == SHADOW_FILTER_EVSM)
+    {
+        float texels = footprint * scale.x * 0.5f / cascadeTexelSize;
+        return EvsmShadow(shadowMoments, momentSampler, uv, position.z, log2(max(texels, 1.0f)));
+    }
+
+    float4 bounds = float4(0.0f, 0.0f, 1.0f, 1.0f);
+    float radius = filterRadius * cascadeTexelSize;
+    if (filterMode == SHADOW_FILTER_PCSS)
+    {
+        float blocker = FindBlockerDepth(shadowMap, uv, position.z, bounds, radius, cascadeTexelSize, rotation);
+        if (blocker < 0.0f)
+            return 1.0f;
+
+        // The projection is orthographic, so depths are linear and
+        // the penumbra widens with the world distance between
+        // blocker and receiver, times the light's angular size
+        float distance = (position.z - blocker) / (cascadeProjection.y * scale.z);
+        float penumbra = distance * sunSize * cascadeProjection.x * scale.x * 0.5f;
+        radius = clamp(penumbra, cascadeTexelSize, radius);
+    }
+    return FilterComparison(shadowMap, shadowSampler, uv, position.z, bounds, radius, rotation);
+}
+
+// --------------------------------------------------------
+// How lit a point is by the shadow casting light, from the
+// cascade its view depth falls in.  Over the last part of a
+// cascade it fades into the next one (or into no shadow past
+// the last one), so the seams between them don't show.
+// --------------------------------------------------------
+float CascadedShadow(Texture2DArray shadowMap, Texture2DArray shadowMoments, SamplerComparisonState shadowSampler, SamplerState momentSampler,
+    float3 shadowPosition, float viewDepth, float footprint, float2x2 rotation)
+{
+    uint cascade = 0;
+    while (cascade < cascadeCount && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if (cascade >= cascadeCount)
+        return 1.0f;
+
+    float shadow = SampleCascade(shadowMap, shadowMoments, shadowSampler, momentSampler, shadowPosition, cascade, footprint, rotation);
+
+    float cascadeStart = cascade > 0 ? cascadeSplits[cascade - 1] : 0.0f;
+    float blendStart = cascadeSplits[cascade] - (cascadeSplits[cascade] - cascadeStart) * cascadeBlend;
+    if (viewDepth > blendStart)
+    {
+        float next = cascade + 1 < cascadeCount ?
+            SampleCascade(shadowMap, shadowMoments, shadowSampler, momentSampler, shadowPosition, cascade + 1, footprint, rotation) :
+            1.0f;
+        shadow = lerp(shadow, next, (viewDepth - blendStart) / (cascadeSplits[cascade] - blendStart));
+    }
+    return shadow;
+}
+
+// Which of a point light's six views (+X, -X, +Y, -Y, +Z, -Z)
+// a direction away from it falls in
+uint CubeFace(float3 direction)
+{
+    float3 a = abs(direction);
+    if (a.x >= a.y && a.x >= a.z)
+        return direction.x > 0 ? 0 : 1;
+    if (a.y >= a.z)
+        return direction.y > 0 ? 2 : 3;
+    return direction.z > 0 ? 4 : 5;
+}
+
+// --------------------------------------------------------
+// How lit a point is by a point or spot light with a view in
+// the shadow atlas.  Anything outside the view (past the edge
+// of a spot light's cone, or behind it) is left lit.
+// - The atlas has no moments, so EVSM filters it as Poisson
+// --------------------------------------------------------
+float AtlasShadow(Texture2DArray shadowAtlas, SamplerComparisonState shadowSampler, StructuredBuffer<ShadowView> views,
+    Light light, float3 worldPosition, float2x2 rotation)
+{
+    uint viewIndex = light.shadowView;
+    if (light.type == LIGHT_TYPE_POINT)
+        viewIndex += CubeFace(worldPosition - light.position);
+    ShadowView view = views[viewIndex];
+
+    float4 position = mul(view.viewProjection, float4(worldPosition, 1.0f));
+    if (position.w <= 0.0f)
+        return 1.0f;
+    position.xyz /= position.w;
+    if (any(abs(position.xy) > 1.0f))
+        return 1.0f;
+
+    // Taps are kept half a texel inside the tile, so filtering
+    // never reads a neighbouring tile
+    float2 uv = float2(position.x * 0.5f + 0.5f, 0.5f - position.y * 0.5f) * view.atlasRect.zw + view.atlasRect.xy;
+    float4 bounds = float4(
+        view.atlasRect.xy + atlasTexelSize * 0.5f,
+        view.atlasRect.xy + view.atlasRect.zw - atlasTexelSize * 0.5f);
+    float radius = filterRadius * atlasTexelSize;
+    if (filterMode == SHADOW_FILTER_PCSS)
+    {
+        float blocker = FindBlockerDepth(shadowAtlas, float3(uv, 0), position.z, bounds, radius, atlasTexelSize, rotation);
+        if (blocker < 0.0f)
+            return 1.0f;
+
+        // A perspective projection: back to view depths, where
+        // the penumbra is the light's size scaled by how much
+        // further the receiver is than the blocker
+        float receiverDepth = view.projection.z / (position.z - view.projection.y);
+        float blockerDepth = view.projection.z / (blocker - view.projection.y);
+        float penumbra = lightSize * (receiverDepth - blockerDepth) / blockerDepth;
+        radius = clamp(penumbra * view.projection.x * 0.5f / receiverDepth * view.atlasRect.z, atlasTexelSize, radius);
+    }
+    return FilterComparison(shadowAtlas, shadowSampler, float3(uv, 0), position.z, bounds, radius, rotation);
+}
+
+#endif
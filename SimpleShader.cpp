@@ -4,6 +4,26 @@
 bool ISimpleShader::ReportErrors = false;
 bool ISimpleShader::ReportWarnings = false;
 
+// Used to give every shader a unique ID
+unsigned int ISimpleShader::nextId = 0;
+
+// Per thread context override, see SetThreadContext()
+thread_local ID3D11DeviceContext* ISimpleShader::threadContext = 0;
+thread_local unsigned int ISimpleShader::threadSlot = 0;
+thread_local ConstantRing* ISimpleShader::threadRing = 0;
+thread_local ID3D11DeviceContext1* ISimpleShader::threadContext1 = 0;
+
+// State caches per context slot, see SetStateCache()
+StateCache* ISimpleShader::stateCaches[ISimpleShader::MaxContextSlots] = {};
+
+// Constant buffer upload tracking, see InvalidateUploads()
+bool ISimpleShader::UploadUnchanged = false;
+unsigned int ISimpleShader::uploadEpoch[ISimpleShader::MaxContextSlots] = {};
+unsigned int ISimpleShader::bytesUploaded[ISimpleShader::MaxContextSlots] = {};
+unsigned int ISimpleShader::buffersUploaded[ISimpleShader::MaxContextSlots] = {};
+unsigned int ISimpleShader::buffersSkipped[ISimpleShader::MaxContextSlots] = {};
+unsigned int ISimpleShader::ringUploads[ISimpleShader::MaxContextSlots] = {};
+
 // To enable error reporting, use either or both 
 // of the following lines somewhere in your program, 
 // preferably before loading/using any shaders.
@@ -29,6 +49,7 @@ ISimpleShader::ISimpleShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Micros
 	this->constantBufferCount = 0;
 	this->constantBuffers = 0;
 	this->shaderValid = false;
+	this->id = nextId++;
 }
 
 // --------------------------------------------------------
@@ -49,19 +70,23 @@ void ISimpleShader::CleanUp()
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
 		delete[] constantBuffers[i].LocalDataBuffer;
+		delete[] constantBuffers[i].UploadState;
 	}
 
 	if (constantBuffers)
 	{
 		delete[] constantBuffers;
+		constantBuffers = 0;
 		constantBufferCount = 0;
 	}
 
 	for (unsigned int i = 0; i < shaderResourceViews.size(); i++)
 		delete shaderResourceViews[i];
+	shaderResourceViews.clear();
 	
 	for (unsigned int i = 0; i < samplerStates.size(); i++)
 		delete samplerStates[i];
+	samplerStates.clear();
 
 	// Clean up tables
 	varTable.clear();
@@ -72,7 +97,9 @@ void ISimpleShader::CleanUp()
 
 // --------------------------------------------------------
 // Loads the specified shader and builds the variable table 
-// using shader reflection.
+// using shader reflection.  The reflection results come from
+// the shader's cache file when it's still valid, so most
+// loads don't reflect at all (see ShaderCache).
 //
 // shaderFile - A "wide string" specifying the compiled shader to load
 // 
@@ -80,8 +107,11 @@ void ISimpleShader::CleanUp()
 // --------------------------------------------------------
 bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 {
-	// Load the shader to a blob and ensure it worked
-	HRESULT hr = D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
+	// Map the shader into memory, falling back to reading it
+	// into a blob, and ensure it worked
+	shaderPath = shaderFile;
+	shaderBlob = ShaderCache::MapBytecode(shaderFile);
+	HRESULT hr = shaderBlob ? S_OK : D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
 	if (hr != S_OK)
 	{
 		if (ReportErrors)
@@ -94,9 +124,31 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
+	// Get information about this shader and its variables,
+	// buffers, etc. before creating it, as creating some
+	// shaders (like the input layout of a vertex shader)
+	// depends on it
+	if (!ShaderCache::GetReflection(shaderFile, shaderBlob.Get(), reflection))
+	{
+		if (ReportErrors)
+		{
+			LogError("SimpleShader::LoadShaderFile() - Error reflecting file '");
+			LogW(shaderFile);
+			LogError("'. Ensure this file is a compiled shader.\n");
+		}
+
+		shaderBlob.Reset();
+		return false;
+	}
+
 	// Create the shader - Calls an overloaded version of this abstract
 	// method in the appropriate child class
 	shaderValid = CreateShader(shaderBlob);
+
+	// The bytecode isn't needed after this, and holding a mapped
+	// file open would stop it being rebuilt (see GetShaderBlob)
+	shaderBlob.Reset();
+
 	if (!shaderValid)
 	{
 		if (ReportErrors)
@@ -109,43 +161,108 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
-	// Set up shader reflection to get information about
-	// this shader and its variables,  buffers, etc.
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-	
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
+	BuildTables();
+	return true;
+}
+
+// --------------------------------------------------------
+// Replaces the shader's code with newly compiled bytecode,
+// keeping this object (and its ID) so everything that holds
+// it picks up the new code
+//
+// - Variables whose name and size didn't change keep their
+//   values, in every context slot.  Their offsets, and the
+//   registers of textures and samplers, come from the new code,
+//   so handles (GetParam) and resolved registers must be looked
+//   up again afterwards.
+// - Nothing changes if the bytecode can't be reflected, or
+//   the device won't create a shader from it
+// - Only call this between frames, never while recording
+//
+// bytecode - The shader's new compiled code
+//
+// Returns true if the new shader was created
+// --------------------------------------------------------
+bool ISimpleShader::ReloadShader(Microsoft::WRL::ComPtr<ID3DBlob> bytecode)
+{
+	ShaderReflection newReflection;
+	if (!ShaderCache::Reflect(bytecode.Get(), newReflection))
+		return false;
+
+	// Save every variable's data, for all context slots
+	std::unordered_map<std::string, std::vector<unsigned char>> oldValues;
+	for (auto& v : varTable)
+	{
+		const SimpleConstantBuffer& cb = constantBuffers[v.second.ConstantBufferIndex];
+		std::vector<unsigned char>& value = oldValues[v.first];
+		value.resize(v.second.Size * MaxContextSlots);
+		for (unsigned int s = 0; s < MaxContextSlots; s++)
+			memcpy(&value[v.second.Size * s], cb.LocalDataBuffer + cb.Size * s + v.second.ByteOffset, v.second.Size);
+	}
+
+	// CreateShader() leaves everything as it was if the device
+	// rejects the new code, so the old code keeps running
+	ShaderReflection oldReflection = reflection;
+	reflection = newReflection;
+	if (!CreateShader(bytecode))
+	{
+		reflection = oldReflection;
+		if (ReportErrors)
+		{
+			LogError("SimpleShader::ReloadShader() - Error creating reloaded shader '");
+			LogW(shaderPath);
+			LogError("'.\n");
+		}
+
+		return false;
+	}
 
+	// Keep the code, so GetShaderBlob() returns what's running
+	// rather than what's in the file
+	shaderBlob = bytecode;
+	BuildTables();
+
+	// Restore whatever still matches - buffers start out marked
+	// as changed, so it's all uploaded on next use
+	for (auto& v : varTable)
+	{
+		auto old = oldValues.find(v.first);
+		if (old == oldValues.end() || old->second.size() != v.second.Size * MaxContextSlots)
+			continue;
+
+		SimpleConstantBuffer& cb = constantBuffers[v.second.ConstantBufferIndex];
+		for (unsigned int s = 0; s < MaxContextSlots; s++)
+			memcpy(cb.LocalDataBuffer + cb.Size * s + v.second.ByteOffset, &old->second[v.second.Size * s], v.second.Size);
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Builds the variable, buffer and resource tables (and the
+// constant buffers themselves) from the reflection results
+// --------------------------------------------------------
+void ISimpleShader::BuildTables()
+{
 	// Create resource arrays
-	constantBufferCount = shaderDesc.ConstantBuffers;
+	constantBufferCount = (unsigned int)reflection.Buffers.size();
 	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
 	
 	// Handle bound resources (like shaders and samplers)
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
+	for (const ShaderReflection::Resource& resource : reflection.Resources)
 	{
-		// Get this resource's description
-		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
-		refl->GetResourceBindingDesc(r, &resourceDesc);
-
 		// Check the type
-		switch (resourceDesc.Type)
+		switch (resource.Type)
 		{
 		case D3D_SIT_STRUCTURED: // Treat structured buffers as texture resources
 		case D3D_SIT_TEXTURE: // A texture resource
 		{
 			// Create the SRV wrapper
 			SimpleSRV* srv = new SimpleSRV();
-			srv->BindIndex = resourceDesc.BindPoint;				// Shader bind point
+			srv->BindIndex = resource.BindPoint;					// Shader bind point
 			srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
 
-			textureTable.insert(std::pair<std::string, SimpleSRV*>(resourceDesc.Name, srv));
+			textureTable.insert(std::pair<std::string, SimpleSRV*>(resource.Name, srv));
 			shaderResourceViews.push_back(srv);
 		}
 			break;
@@ -154,10 +271,10 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		{
 			// Create the sampler wrapper
 			SimpleSampler* samp = new SimpleSampler();
-			samp->BindIndex = resourceDesc.BindPoint;			// Shader bind point
+			samp->BindIndex = resource.BindPoint;				// Shader bind point
 			samp->Index = (unsigned int)samplerStates.size();	// Raw index
 
-			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resourceDesc.Name, samp));
+			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resource.Name, samp));
 			samplerStates.push_back(samp);
 		}
 			break;
@@ -168,69 +285,64 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 	for (unsigned int b = 0; b < constantBufferCount; b++)
 	{
 		// Get this buffer
-		ID3D11ShaderReflectionConstantBuffer* cb =
-			refl->GetConstantBufferByIndex(b);
-		
-		// Get the description of this buffer
-		D3D11_SHADER_BUFFER_DESC bufferDesc;
-		cb->GetDesc(&bufferDesc);
+		const ShaderReflection::Buffer& bufferDesc = reflection.Buffers[b];
 
 		// Save the type, which we reference when setting these buffers
 		constantBuffers[b].Type = bufferDesc.Type;
 		
-		// Get the description of the resource binding, so
-		// we know exactly how it's bound in the shader
-		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
-		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
-		
 		// Set up the buffer and put its pointer in the table
-		constantBuffers[b].BindIndex = bindDesc.BindPoint;
+		constantBuffers[b].BindIndex = bufferDesc.BindPoint;
 		constantBuffers[b].Name = bufferDesc.Name;
 		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
 
 		// Create this constant buffer
 		D3D11_BUFFER_DESC newBuffDesc = {};
-		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
+		// - Dynamic, as it is rewritten with Map(DISCARD) whenever
+		//   its data changes (see UploadBuffer)
+		newBuffDesc.Usage = D3D11_USAGE_DYNAMIC;
 		newBuffDesc.ByteWidth = ((bufferDesc.Size + 15) / 16) * 16; // Quick and dirty 16-byte alignment using integer division
 		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		newBuffDesc.CPUAccessFlags = 0;
+		newBuffDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 		newBuffDesc.MiscFlags = 0;
 		newBuffDesc.StructureByteStride = 0;
 		device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
 
 		// Set up the data buffer for this constant buffer
 		constantBuffers[b].Size = bufferDesc.Size;
-		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size];
-		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
+		// - One copy per context slot, so threads recording into
+		//   different contexts never share local data
+		constantBuffers[b].LocalDataBuffer = new unsigned char[bufferDesc.Size * MaxContextSlots];
+		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size * MaxContextSlots);
+		constantBuffers[b].UploadState = new SimpleUploadState[MaxContextSlots];
+		for (unsigned int s = 0; s < MaxContextSlots; s++)
+			constantBuffers[b].UploadState[s] = { ChangedEpoch, 0, 0 };
 
 		// Loop through all variables in this buffer
-		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		for (const ShaderReflection::Variable& varDesc : bufferDesc.Variables)
 		{
-			// Get this variable
-			ID3D11ShaderReflectionVariable* var =
-				cb->GetVariableByIndex(v);
-			
-			// Get the description of the variable and its type
-			D3D11_SHADER_VARIABLE_DESC varDesc;
-			var->GetDesc(&varDesc);
-
 			// Create the variable struct
 			SimpleShaderVariable varStruct = {};
 			varStruct.ConstantBufferIndex = b;
-			varStruct.ByteOffset = varDesc.StartOffset;
+			varStruct.ByteOffset = varDesc.ByteOffset;
 			varStruct.Size = varDesc.Size;
 			
-			// Get a string version
-			std::string varName(varDesc.Name);
-
 			// Add this variable to the table and the constant buffer
-			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
+			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varDesc.Name, varStruct));
 			constantBuffers[b].Variables.push_back(varStruct);
 		}
 	}
+}
 
-	// All set
-	return true;
+// --------------------------------------------------------
+// Gets the shader's compiled code
+// - The file is only mapped while loading, so this reads it
+//   again the first time it's asked for
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3DBlob> ISimpleShader::GetShaderBlob()
+{
+	if (!shaderBlob && !shaderPath.empty())
+		D3DReadFileToBlob(shaderPath.c_str(), shaderBlob.GetAddressOf());
+	return shaderBlob;
 }
 
 // --------------------------------------------------------
@@ -335,6 +447,127 @@ void ISimpleShader::SetShader()
 	SetShaderAndCBs();
 }
 
+// --------------------------------------------------------
+// Redirects every shader used on the calling thread to
+// another context, such as a deferred context owned by a
+// worker thread.  Each thread must use a different slot,
+// which selects its own copy of the local constant data,
+// so several threads can set data on the same shader.
+//
+// context - The context to use, or null for the shader's own
+// slot    - 0 is the main thread, 1 to MaxContextSlots-1 are free
+// ring    - Optional ring to suballocate constants from instead
+//           of the shaders' own buffers (see ConstantRing), only
+//           used by vertex and pixel shaders
+// --------------------------------------------------------
+void ISimpleShader::SetThreadContext(ID3D11DeviceContext* context, unsigned int slot, ConstantRing* ring)
+{
+	threadContext = context;
+	threadSlot = slot < MaxContextSlots ? slot : 0;
+
+	// Offset binding needs the 11.1 interface of the context
+	if (threadContext1)
+	{
+		threadContext1->Release();
+		threadContext1 = 0;
+	}
+	threadRing = 0;
+	if (context && ring && ring->IsSupported() &&
+		SUCCEEDED(context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&threadContext1)))
+	{
+		threadRing = ring;
+	}
+}
+
+// --------------------------------------------------------
+// Forgets which buffers are already up to date on the GPU for
+// a context slot, so every buffer's next copy uploads again
+// - Needed whenever the slot's context starts recording a new
+//   command list, as a dynamic buffer's contents don't carry
+//   over into it, and on the immediate context after command
+//   lists that wrote the same buffers have been executed
+// - Only call for a slot no other thread is using
+// --------------------------------------------------------
+void ISimpleShader::InvalidateUploads(unsigned int slot)
+{
+	if (slot >= MaxContextSlots)
+		return;
+
+	uploadEpoch[slot]++;
+	if (uploadEpoch[slot] == ChangedEpoch)
+		uploadEpoch[slot] = 0;
+}
+
+// --------------------------------------------------------
+// Totals of every slot's uploads since ResetUploadStats()
+// - Call once no other threads are copying buffer data
+// --------------------------------------------------------
+void ISimpleShader::GetUploadStats(unsigned int& bytes, unsigned int& uploads, unsigned int& skips, unsigned int& ringUploadCount)
+{
+	bytes = 0;
+	uploads = 0;
+	skips = 0;
+	ringUploadCount = 0;
+	for (unsigned int s = 0; s < MaxContextSlots; s++)
+	{
+		bytes += bytesUploaded[s];
+		uploads += buffersUploaded[s];
+		skips += buffersSkipped[s];
+		ringUploadCount += ringUploads[s];
+	}
+}
+
+void ISimpleShader::ResetUploadStats()
+{
+	for (unsigned int s = 0; s < MaxContextSlots; s++)
+	{
+		bytesUploaded[s] = 0;
+		buffersUploaded[s] = 0;
+		buffersSkipped[s] = 0;
+		ringUploads[s] = 0;
+	}
+}
+
+// --------------------------------------------------------
+// The context this shader should use on the calling thread
+// --------------------------------------------------------
+ID3D11DeviceContext* ISimpleShader::GetContext()
+{
+	return threadContext ? threadContext : deviceContext.Get();
+}
+
+// --------------------------------------------------------
+// Routes shader, constant buffer, SRV and sampler binds made
+// from a context slot through a cache that drops redundant
+// ones.  The cache is only used while the slot's context is
+// the one it wraps.
+//
+// slot  - Context slot, see SetThreadContext()
+// cache - The cache, or null to bind on the context directly
+// --------------------------------------------------------
+void ISimpleShader::SetStateCache(unsigned int slot, StateCache* cache)
+{
+	if (slot < MaxContextSlots)
+		stateCaches[slot] = cache;
+}
+
+// --------------------------------------------------------
+// The calling thread's state cache, or null if it has none
+// --------------------------------------------------------
+StateCache* ISimpleShader::GetStateCache()
+{
+	StateCache* cache = stateCaches[threadSlot];
+	return cache && cache->GetContext() == GetContext() ? cache : 0;
+}
+
+// --------------------------------------------------------
+// The calling thread's copy of a buffer's local data
+// --------------------------------------------------------
+unsigned char* ISimpleShader::GetLocalData(SimpleConstantBuffer* cb)
+{
+	return cb->LocalDataBuffer + cb->Size * threadSlot;
+}
+
 // --------------------------------------------------------
 // Copies the relevant data to the all of this 
 // shader's constant buffers.  To just copy one
@@ -345,14 +578,9 @@ void ISimpleShader::CopyAllBufferData()
 	// Ensure the shader is valid
 	if (!shaderValid) return;
 
-	// Loop through the constant buffers and copy all data
+	// Loop through the constant buffers and copy any that changed
 	for (unsigned int i = 0; i < constantBufferCount; i++)
-	{
-		// Copy the entire local data buffer
-		deviceContext->UpdateSubresource(
-			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
-			constantBuffers[i].LocalDataBuffer, 0, 0);
-	}
+		UploadBuffer(&constantBuffers[i]);
 }
 
 // --------------------------------------------------------
@@ -380,9 +608,7 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 	if (!cb) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	UploadBuffer(cb);
 }
 
 // --------------------------------------------------------
@@ -402,9 +628,69 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 	if (!cb) return;
 
 	// Copy the data and get out
-	deviceContext->UpdateSubresource(
-		cb->ConstantBuffer.Get(), 0, 0, 
-		cb->LocalDataBuffer, 0, 0);
+	UploadBuffer(cb);
+}
+
+// --------------------------------------------------------
+// Copies the calling thread's local data into a buffer, unless
+// the buffer already holds that data on the calling thread's
+// context
+// - With a constant ring set for the thread, the data goes to
+//   a new range of the ring, which is then bound in place of
+//   the shader's own buffer
+// - Otherwise the shader's own buffer is rewritten with
+//   Map(DISCARD). As that rewrites the whole buffer, changes
+//   are tracked per buffer rather than per variable; keep data
+//   that changes at different rates in different cbuffers
+// --------------------------------------------------------
+void ISimpleShader::UploadBuffer(SimpleConstantBuffer* cb)
+{
+	SimpleUploadState& state = cb->UploadState[threadSlot];
+	unsigned int epoch = uploadEpoch[threadSlot];
+	bool useRing = threadRing && cb->Type == D3D11_CT_CBUFFER && CanBindRanges();
+
+	if (state.Epoch != epoch || UploadUnchanged)
+	{
+		unsigned char* ringData = 0;
+		state.RingConstantCount = 0;
+		if (useRing)
+			ringData = threadRing->Allocate(cb->Size, state.RingFirstConstant, state.RingConstantCount);
+
+		if (ringData)
+		{
+			memcpy(ringData, GetLocalData(cb), cb->Size);
+			ringUploads[threadSlot]++;
+		}
+		else
+		{
+			// No ring, or it is full
+			state.RingConstantCount = 0;
+			D3D11_MAPPED_SUBRESOURCE mapped = {};
+			if (FAILED(GetContext()->Map(cb->ConstantBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+				return;
+			memcpy(mapped.pData, GetLocalData(cb), cb->Size);
+			GetContext()->Unmap(cb->ConstantBuffer.Get(), 0);
+		}
+
+		state.Epoch = epoch;
+		bytesUploaded[threadSlot] += cb->Size;
+		buffersUploaded[threadSlot]++;
+	}
+	else
+	{
+		buffersSkipped[threadSlot]++;
+	}
+
+	// SetShader() binds the shader's own buffers, and an earlier
+	// copy may have bound a ring range over them, so always point
+	// the slot at wherever this data actually is
+	if (useRing)
+	{
+		if (state.RingConstantCount > 0)
+			SetConstantBufferRange(cb->BindIndex, threadRing->GetBuffer(), state.RingFirstConstant, state.RingConstantCount);
+		else
+			SetConstantBufferRange(cb->BindIndex, cb->ConstantBuffer.Get(), 0, 0);
+	}
 }
 
 
@@ -445,14 +731,12 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 		return false;
 	}
 
-	// Set the data in the local data buffer
-	memcpy(
-		constantBuffers[var->ConstantBufferIndex].LocalDataBuffer + var->ByteOffset,
-		data,
-		size);
-
-	// Success
-	return true;
+	// Set the data through the handle version
+	ShaderParam param;
+	param.BufferIndex = var->ConstantBufferIndex;
+	param.ByteOffset = var->ByteOffset;
+	param.Size = var->Size;
+	return SetData(param, data, size);
 }
 
 // --------------------------------------------------------
@@ -535,6 +819,96 @@ bool ISimpleShader::SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 dat
 	return this->SetData(name, &data, sizeof(float) * 16);
 }
 
+// --------------------------------------------------------
+// Looks up a variable once, returning a handle that can be
+// passed to the handle based setters below as often as needed
+// - The handle is invalid (see ShaderParam::IsValid) if the
+//   variable doesn't exist, and setting it does nothing
+// --------------------------------------------------------
+ShaderParam ISimpleShader::GetParam(std::string name)
+{
+	ShaderParam param;
+	SimpleShaderVariable* var = FindVariable(name, -1);
+	if (var)
+	{
+		param.BufferIndex = var->ConstantBufferIndex;
+		param.ByteOffset = var->ByteOffset;
+		param.Size = var->Size;
+	}
+	return param;
+}
+
+// --------------------------------------------------------
+// Like GetParam(), but the handle covers a whole constant
+// buffer, so it can be filled from one struct (such as the
+// generated ones in ShaderCBuffers.h) with a single SetData()
+// --------------------------------------------------------
+ShaderParam ISimpleShader::GetBufferParam(std::string bufferName)
+{
+	ShaderParam param;
+	SimpleConstantBuffer* cb = FindConstantBuffer(bufferName);
+	if (cb)
+	{
+		param.BufferIndex = (unsigned int)(cb - constantBuffers);
+		param.ByteOffset = 0;
+		param.Size = cb->Size;
+	}
+	return param;
+}
+
+// --------------------------------------------------------
+// Sets a variable through a handle from GetParam(), which
+// is just a copy into the local data buffer
+//
+// Returns true if data is copied, false if the handle is
+// invalid or the data is larger than the variable
+// --------------------------------------------------------
+bool ISimpleShader::SetData(const ShaderParam& param, const void* data, unsigned int size)
+{
+	if (size > param.Size)
+		return false;
+
+	// Only flag the buffer for upload if the value really changed
+	SimpleConstantBuffer* cb = &constantBuffers[param.BufferIndex];
+	unsigned char* dest = GetLocalData(cb) + param.ByteOffset;
+	if (memcmp(dest, data, size) != 0)
+	{
+		memcpy(dest, data, size);
+		cb->UploadState[threadSlot].Epoch = ChangedEpoch;
+	}
+	return true;
+}
+
+bool ISimpleShader::SetInt(const ShaderParam& param, int data)
+{
+	return SetData(param, &data, sizeof(int));
+}
+
+bool ISimpleShader::SetFloat(const ShaderParam& param, float data)
+{
+	return SetData(param, &data, sizeof(float));
+}
+
+bool ISimpleShader::SetFloat2(const ShaderParam& param, const DirectX::XMFLOAT2& data)
+{
+	return SetData(param, &data, sizeof(float) * 2);
+}
+
+bool ISimpleShader::SetFloat3(const ShaderParam& param, const DirectX::XMFLOAT3& data)
+{
+	return SetData(param, &data, sizeof(float) * 3);
+}
+
+bool ISimpleShader::SetFloat4(const ShaderParam& param, const DirectX::XMFLOAT4& data)
+{
+	return SetData(param, &data, sizeof(float) * 4);
+}
+
+bool ISimpleShader::SetMatrix4x4(const ShaderParam& param, const DirectX::XMFLOAT4X4& data)
+{
+	return SetData(param, &data, sizeof(float) * 16);
+}
+
 // --------------------------------------------------------
 // Determines if the shader contains the specified
 // variable within one of its constant buffers
@@ -697,6 +1071,7 @@ SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> devi
 	// Ensure we set to zero to successfully trigger
 	// the Input Layout creation during LoadShaderFile()
 	this->perInstanceCompatible = false;
+	this->reflectedInputLayout = false;
 
 	// Load the actual compiled shader file
 	this->LoadShaderFile(shaderFile);
@@ -716,6 +1091,7 @@ SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> devi
 
 	// Unable to determine from an input layout, require user to tell us
 	this->perInstanceCompatible = perInstanceCompatible;
+	this->reflectedInputLayout = false;
 
 	// Load the actual compiled shader file
 	this->LoadShaderFile(shaderFile);
@@ -746,114 +1122,87 @@ void SimpleVertexShader::CleanUp()
 // --------------------------------------------------------
 bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
 {
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
 	// Create the shader from the blob
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> newShader;
 	HRESULT result = device->CreateVertexShader(
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		newShader.GetAddressOf());
 
-	// Did the creation work?
+	// Did the creation work?  If not, the old shader stays
 	if (result != S_OK)
 		return false;
 
 	// Do we already have an input layout?
-	// (This would come from one of the constructor overloads)
-	if (inputLayout)
+	// (This would come from one of the constructor overloads,
+	// while one made from older code is replaced on reload)
+	if (inputLayout && !reflectedInputLayout)
+	{
+		// Clean up, in the event this method is
+		// called more than once on the same object
+		this->CleanUp();
+		shader = newShader;
 		return true;
+	}
 
 	// Vertex shader was created successfully, so we now use the
-	// shader code to re-reflect and create an input layout that 
-	// matches what the vertex shader expects.  Code adapted from:
+	// reflected inputs to create an input layout that matches
+	// what the vertex shader expects.  Code adapted from:
 	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
-
-	// Reflect shader info
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-	
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-
-	// Read input layout description from shader info
 	std::vector<D3D11_INPUT_ELEMENT_DESC> inputLayoutDesc;
-	for (unsigned int i = 0; i< shaderDesc.InputParameters; i++)
+	bool perInstance = false;
+	for (const ShaderReflection::InputElement& input : reflection.Inputs)
 	{
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetInputParameterDesc(i, &paramDesc);
-
-		// Check the semantic name for "_PER_INSTANCE"
-		std::string perInstanceStr = "_PER_INSTANCE";
-		std::string sem = paramDesc.SemanticName;
-		int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
-		bool isPerInstance = 
-			lenDiff >= 0 &&
-			sem.compare(lenDiff, perInstanceStr.size(), perInstanceStr) == 0;
-
 		// Fill out input element desc
 		D3D11_INPUT_ELEMENT_DESC elementDesc = {};
-		elementDesc.SemanticName = paramDesc.SemanticName;
-		elementDesc.SemanticIndex = paramDesc.SemanticIndex;
+		elementDesc.SemanticName = input.SemanticName.c_str();
+		elementDesc.SemanticIndex = input.SemanticIndex;
+		elementDesc.Format = input.Format;
 		elementDesc.InputSlot = 0;
 		elementDesc.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
 		elementDesc.InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
 		elementDesc.InstanceDataStepRate = 0;
 
 		// Replace anything affected by "per instance" data
-		if (isPerInstance)
+		if (input.PerInstance)
 		{
 			elementDesc.InputSlot = 1; // Assume per instance data comes from another input slot!
 			elementDesc.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
 			elementDesc.InstanceDataStepRate = 1;
 
-			perInstanceCompatible = true;
-		}
-
-		// Determine DXGI format
-		if (paramDesc.Mask == 1)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 3)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 7)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 15)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+			perInstance = true;
 		}
 
 		// Save element desc
 		inputLayoutDesc.push_back(elementDesc);
 	}
 
-	// Try to create Input Layout
-	HRESULT hr = device->CreateInputLayout(
-		&inputLayoutDesc[0], 
-		(unsigned int)inputLayoutDesc.size(), 
-		shaderBlob->GetBufferPointer(), 
-		shaderBlob->GetBufferSize(),
-		inputLayout.GetAddressOf());
+	// Try to create Input Layout - none is needed by shaders
+	// that only read system values (like SV_VertexID)
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> newLayout;
+	if (!inputLayoutDesc.empty())
+	{
+		HRESULT hr = device->CreateInputLayout(
+			&inputLayoutDesc[0], 
+			(unsigned int)inputLayoutDesc.size(), 
+			shaderBlob->GetBufferPointer(), 
+			shaderBlob->GetBufferSize(),
+			newLayout.GetAddressOf());
+
+		// Both or neither, so a layout the device rejects leaves
+		// the old shader and layout in place
+		if (FAILED(hr))
+			return false;
+	}
+
+	// Clean up, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+	shader = newShader;
+	inputLayout = newLayout;
+	reflectedInputLayout = newLayout.Get() != 0;
+	perInstanceCompatible = perInstance;
 
 	// All done, clean up
 	return true;
@@ -869,8 +1218,17 @@ void SimpleVertexShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	StateCache* cache = GetStateCache();
+	if (cache)
+	{
+		cache->IASetInputLayout(inputLayout.Get());
+		cache->VSSetShader(shader.Get());
+	}
+	else
+	{
+		GetContext()->IASetInputLayout(inputLayout.Get());
+		GetContext()->VSSetShader(shader.Get(), 0, 0);
+	}
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -880,13 +1238,38 @@ void SimpleVertexShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		if (cache)
+			cache->VSSetConstantBuffer(constantBuffers[i].BindIndex, constantBuffers[i].ConstantBuffer.Get());
+		else
+			GetContext()->VSSetConstantBuffers(
+				constantBuffers[i].BindIndex,
+				1,
+				constantBuffers[i].ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Binds part of a buffer to one of this shader's constant
+// buffer registers, using the thread's 11.1 context
+// --------------------------------------------------------
+void SimpleVertexShader::SetConstantBufferRange(unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	StateCache* cache = GetStateCache();
+	if (cache)
+	{
+		cache->VSSetConstantBuffer(bindIndex, buffer, firstConstant, constantCount);
+		return;
+	}
+
+	if (!threadContext1)
+		return;
+
+	if (constantCount == 0)
+		threadContext1->VSSetConstantBuffers1(bindIndex, 1, &buffer, 0, 0);
+	else
+		threadContext1->VSSetConstantBuffers1(bindIndex, 1, &buffer, &firstConstant, &constantCount);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the vertex shader stage
 //
@@ -911,7 +1294,11 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache* cache = GetStateCache();
+	if (cache)
+		cache->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	else
+		GetContext()->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -941,7 +1328,11 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache* cache = GetStateCache();
+	if (cache)
+		cache->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	else
+		GetContext()->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -987,19 +1378,23 @@ void SimplePixelShader::CleanUp()
 // --------------------------------------------------------
 bool SimplePixelShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
 {
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
 	// Create the shader from the blob
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> newShader;
 	HRESULT result = device->CreatePixelShader(
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		newShader.GetAddressOf());
 
-	// Check the result
-	return (result == S_OK);
+	// Check the result, keeping the old shader if it failed
+	if (result != S_OK)
+		return false;
+
+	// Clean up, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+	shader = newShader;
+	return true;
 }
 
 // --------------------------------------------------------
@@ -1012,7 +1407,11 @@ void SimplePixelShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 	
 	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	StateCache* cache = GetStateCache();
+	if (cache)
+		cache->PSSetShader(shader.Get());
+	else
+		GetContext()->PSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1022,13 +1421,38 @@ void SimplePixelShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
-			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+		if (cache)
+			cache->PSSetConstantBuffer(constantBuffers[i].BindIndex, constantBuffers[i].ConstantBuffer.Get());
+		else
+			GetContext()->PSSetConstantBuffers(
+				constantBuffers[i].BindIndex,
+				1,
+				constantBuffers[i].ConstantBuffer.GetAddressOf());
 	}
 }
 
+// --------------------------------------------------------
+// Binds part of a buffer to one of this shader's constant
+// buffer registers, using the thread's 11.1 context
+// --------------------------------------------------------
+void SimplePixelShader::SetConstantBufferRange(unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	StateCache* cache = GetStateCache();
+	if (cache)
+	{
+		cache->PSSetConstantBuffer(bindIndex, buffer, firstConstant, constantCount);
+		return;
+	}
+
+	if (!threadContext1)
+		return;
+
+	if (constantCount == 0)
+		threadContext1->PSSetConstantBuffers1(bindIndex, 1, &buffer, 0, 0);
+	else
+		threadContext1->PSSetConstantBuffers1(bindIndex, 1, &buffer, &firstConstant, &constantCount);
+}
+
 // --------------------------------------------------------
 // Sets a shader resource view in the pixel shader stage
 //
@@ -1053,7 +1477,11 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache* cache = GetStateCache();
+	if (cache)
+		cache->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	else
+		GetContext()->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1083,12 +1511,40 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache* cache = GetStateCache();
+	if (cache)
+		cache->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	else
+		GetContext()->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
 }
 
+// --------------------------------------------------------
+// Sets several SRVs in consecutive registers with one call
+// --------------------------------------------------------
+void SimplePixelShader::SetShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	StateCache* cache = GetStateCache();
+	if (cache)
+		cache->PSSetShaderResources(startSlot, count, srvs);
+	else
+		GetContext()->PSSetShaderResources(startSlot, count, srvs);
+}
+
+// --------------------------------------------------------
+// Sets several samplers in consecutive registers with one call
+// --------------------------------------------------------
+void SimplePixelShader::SetSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates)
+{
+	StateCache* cache = GetStateCache();
+	if (cache)
+		cache->PSSetSamplers(startSlot, count, samplerStates);
+	else
+		GetContext()->PSSetSamplers(startSlot, count, samplerStates);
+}
+
 
 
 
@@ -1131,19 +1587,23 @@ void SimpleDomainShader::CleanUp()
 // --------------------------------------------------------
 bool SimpleDomainShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
 {
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
 	// Create the shader from the blob
+	Microsoft::WRL::ComPtr<ID3D11DomainShader> newShader;
 	HRESULT result = device->CreateDomainShader(
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		newShader.GetAddressOf());
 
-	// Check the result
-	return (result == S_OK);
+	// Check the result, keeping the old shader if it failed
+	if (result != S_OK)
+		return false;
+
+	// Clean up, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+	shader = newShader;
+	return true;
 }
 
 // --------------------------------------------------------
@@ -1156,7 +1616,7 @@ void SimpleDomainShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->DSSetShader(shader.Get(), 0, 0);
+	GetContext()->DSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1166,7 +1626,7 @@ void SimpleDomainShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->DSSetConstantBuffers(
+		GetContext()->DSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1197,7 +1657,7 @@ bool SimpleDomainShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->DSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->DSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1227,7 +1687,7 @@ bool SimpleDomainShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->DSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->DSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1274,19 +1734,23 @@ void SimpleHullShader::CleanUp()
 // --------------------------------------------------------
 bool SimpleHullShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
 {
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
 	// Create the shader from the blob
+	Microsoft::WRL::ComPtr<ID3D11HullShader> newShader;
 	HRESULT result = device->CreateHullShader(
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		newShader.GetAddressOf());
 
-	// Check the result
-	return (result == S_OK);
+	// Check the result, keeping the old shader if it failed
+	if (result != S_OK)
+		return false;
+
+	// Clean up, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+	shader = newShader;
+	return true;
 }
 
 // --------------------------------------------------------
@@ -1299,7 +1763,7 @@ void SimpleHullShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->HSSetShader(shader.Get(), 0, 0);
+	GetContext()->HSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1309,7 +1773,7 @@ void SimpleHullShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->HSSetConstantBuffers(
+		GetContext()->HSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1340,7 +1804,7 @@ bool SimpleHullShader::SetShaderResourceView(std::string name, Microsoft::WRL::C
 	}
 
 	// Set the shader resource view
-	deviceContext->HSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->HSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1370,7 +1834,7 @@ bool SimpleHullShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr<
 	}
 
 	// Set the shader resource view
-	deviceContext->HSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->HSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1422,23 +1886,27 @@ void SimpleGeometryShader::CleanUp()
 // --------------------------------------------------------
 bool SimpleGeometryShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
 {
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
 	// Using stream out?
 	if (useStreamOut)
 		return this->CreateShaderWithStreamOut(shaderBlob);
 
 	// Create the shader from the blob
+	Microsoft::WRL::ComPtr<ID3D11GeometryShader> newShader;
 	HRESULT result = device->CreateGeometryShader(
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		newShader.GetAddressOf());
 
-	// Check the result
-	return (result == S_OK);
+	// Check the result, keeping the old shader if it failed
+	if (result != S_OK)
+		return false;
+
+	// Clean up, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+	shader = newShader;
+	return true;
 }
 
 // --------------------------------------------------------
@@ -1451,10 +1919,6 @@ bool SimpleGeometryShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderB
 // --------------------------------------------------------
 bool SimpleGeometryShader::CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
 {
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
 	// Reflect shader info
 	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
 	D3DReflect(
@@ -1468,7 +1932,7 @@ bool SimpleGeometryShader::CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3D
 	refl->GetDesc(&shaderDesc);
 
 	// Set up the output signature
-	streamOutVertexSize = 0;
+	unsigned int vertexSize = 0;
 	std::vector<D3D11_SO_DECLARATION_ENTRY> soDecl;
 	for (unsigned int i = 0; i < shaderDesc.OutputParameters; i++)
 	{
@@ -1488,7 +1952,7 @@ bool SimpleGeometryShader::CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3D
 		entry.ComponentCount = CalcComponentCount(paramDesc.Mask);
 	
 		// Increment the size
-		streamOutVertexSize += entry.ComponentCount * sizeof(float);
+		vertexSize += entry.ComponentCount * sizeof(float);
 
 		// Add to the declaration
 		soDecl.push_back(entry);
@@ -1498,6 +1962,7 @@ bool SimpleGeometryShader::CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3D
 	unsigned int rast = allowStreamOutRasterization ? 0 : D3D11_SO_NO_RASTERIZED_STREAM;
 
 	// Create the shader
+	Microsoft::WRL::ComPtr<ID3D11GeometryShader> newShader;
 	HRESULT result = device->CreateGeometryShaderWithStreamOutput(
 		shaderBlob->GetBufferPointer(), // Shader blob pointer
 		shaderBlob->GetBufferSize(),    // Shader blob size
@@ -1507,9 +1972,18 @@ bool SimpleGeometryShader::CreateShaderWithStreamOut(Microsoft::WRL::ComPtr<ID3D
 		0,                              // No buffer strides
 		rast,                           // Index of the stream to rasterize (if any)
 		NULL,                           // Not using class linkage
-		shader.GetAddressOf());
-	
-	return (result == S_OK);
+		newShader.GetAddressOf());
+
+	// Keep the old shader if it failed
+	if (result != S_OK)
+		return false;
+
+	// Clean up, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+	shader = newShader;
+	streamOutVertexSize = vertexSize;
+	return true;
 }
 
 // --------------------------------------------------------
@@ -1573,7 +2047,7 @@ void SimpleGeometryShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->GSSetShader(shader.Get(), 0, 0);
+	GetContext()->GSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1583,7 +2057,7 @@ void SimpleGeometryShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->GSSetConstantBuffers(
+		GetContext()->GSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1614,7 +2088,7 @@ bool SimpleGeometryShader::SetShaderResourceView(std::string name, Microsoft::WR
 	}
 
 	// Set the shader resource view
-	deviceContext->GSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->GSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1644,7 +2118,7 @@ bool SimpleGeometryShader::SetSamplerState(std::string name, Microsoft::WRL::Com
 	}
 
 	// Set the shader resource view
-	deviceContext->GSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->GSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1715,49 +2189,34 @@ void SimpleComputeShader::CleanUp()
 // --------------------------------------------------------
 bool SimpleComputeShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
 {
-	// Clean up first, in the event this method is
-	// called more than once on the same object
-	this->CleanUp();
-
 	// Create the shader from the blob
+	Microsoft::WRL::ComPtr<ID3D11ComputeShader> newShader;
 	HRESULT result = device->CreateComputeShader(
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		0,
-		shader.GetAddressOf());
+		newShader.GetAddressOf());
 
-	// Was the shader created correctly?
+	// Was the shader created correctly?  If not, the old one stays
 	if (result != S_OK)
 		return false;
 
-	// Set up shader reflection to get information about UAV's
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
+	// Clean up, in the event this method is
+	// called more than once on the same object
+	this->CleanUp();
+	shader = newShader;
 
-	// Get the description of the shader
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
-	
-	// Grab the thread info
-	threadsTotal = refl->GetThreadGroupSize(
-		&threadsX,
-		&threadsY,
-		&threadsZ);
+	// Grab the thread info from the reflection results
+	threadsX = reflection.ThreadGroupSize[0];
+	threadsY = reflection.ThreadGroupSize[1];
+	threadsZ = reflection.ThreadGroupSize[2];
+	threadsTotal = threadsX * threadsY * threadsZ;
 
 	// Loop and get all UAV resources
-	unsigned int resourceCount = shaderDesc.BoundResources;
-	for (unsigned int r = 0; r < resourceCount; r++)
+	for (const ShaderReflection::Resource& resource : reflection.Resources)
 	{
-		// Get this resource's description
-		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
-		refl->GetResourceBindingDesc(r, &resourceDesc);
-
 		// Check the type, looking for any kind of UAV
-		switch (resourceDesc.Type)
+		switch (resource.Type)
 		{
 		case D3D_SIT_UAV_APPEND_STRUCTURED:
 		case D3D_SIT_UAV_CONSUME_STRUCTURED:
@@ -1765,7 +2224,7 @@ bool SimpleComputeShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBl
 		case D3D_SIT_UAV_RWSTRUCTURED:
 		case D3D_SIT_UAV_RWSTRUCTURED_WITH_COUNTER:
 		case D3D_SIT_UAV_RWTYPED:
-			uavTable.insert(std::pair<std::string, unsigned int>(resourceDesc.Name, resourceDesc.BindPoint));
+			uavTable.insert(std::pair<std::string, unsigned int>(resource.Name, resource.BindPoint));
 		}
 	}
 
@@ -1783,7 +2242,7 @@ void SimpleComputeShader::SetShaderAndCBs()
 	if (!shaderValid) return;
 
 	// Set the shader
-	deviceContext->CSSetShader(shader.Get(), 0, 0);
+	GetContext()->CSSetShader(shader.Get(), 0, 0);
 
 	// Set the constant buffers?
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -1793,7 +2252,7 @@ void SimpleComputeShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->CSSetConstantBuffers(
+		GetContext()->CSSetConstantBuffers(
 			constantBuffers[i].BindIndex,
 			1,
 			constantBuffers[i].ConstantBuffer.GetAddressOf());
@@ -1822,7 +2281,7 @@ void SimpleComputeShader::SetShaderAndCBs()
 // --------------------------------------------------------
 void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
 {
-	deviceContext->Dispatch(groupsX, groupsY, groupsZ);
+	GetContext()->Dispatch(groupsX, groupsY, groupsZ);
 }
 
 // --------------------------------------------------------
@@ -1847,7 +2306,7 @@ void SimpleComputeShader::DispatchByGroups(unsigned int groupsX, unsigned int gr
 // --------------------------------------------------------
 void SimpleComputeShader::DispatchByThreads(unsigned int threadsX, unsigned int threadsY, unsigned int threadsZ)
 {
-	deviceContext->Dispatch(
+	GetContext()->Dispatch(
 		max((unsigned int)ceil((float)threadsX / this->threadsX), 1),
 		max((unsigned int)ceil((float)threadsY / this->threadsY), 1),
 		max((unsigned int)ceil((float)threadsZ / this->threadsZ), 1));
@@ -1885,7 +2344,7 @@ bool SimpleComputeShader::SetShaderResourceView(std::string name, Microsoft::WRL
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	GetContext()->CSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
 
 	// Success
 	return true;
@@ -1915,7 +2374,7 @@ bool SimpleComputeShader::SetSamplerState(std::string name, Microsoft::WRL::ComP
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	GetContext()->CSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
 
 	// Success
 	return true;
@@ -1946,7 +2405,7 @@ bool SimpleComputeShader::SetUnorderedAccessView(std::string name, Microsoft::WR
 	}
 
 	// Set the shader resource view
-	deviceContext->CSSetUnorderedAccessViews(bindIndex, 1, uav.GetAddressOf(), &appendConsumeOffset);
+	GetContext()->CSSetUnorderedAccessViews(bindIndex, 1, uav.GetAddressOf(), &appendConsumeOffset);
 
 	// Success
 	return true;
@@ -2,7 +2,7 @@
 #pragma comment(lib, "dxguid.lib")
 #pragma comment(lib, "d3dcompiler.lib")
 
-#include <d3d11.h>
+#include <d3d11_1.h>
 #include <d3dcompiler.h>
 #include <DirectXMath.h>
 #include <wrl/client.h>
@@ -11,6 +11,10 @@
 #include <vector>
 #include <string>
 
+#include "ConstantRing.h"
+#include "StateCache.h"
+#include "ShaderCache.h"
+
 
 // --------------------------------------------------------
 // Used by simple shaders to store information about
@@ -23,6 +27,17 @@ struct SimpleShaderVariable
 	unsigned int ConstantBufferIndex;
 };
 
+// --------------------------------------------------------
+// Where a constant buffer's data was last uploaded from one
+// context slot, see ISimpleShader::UploadBuffer()
+// --------------------------------------------------------
+struct SimpleUploadState
+{
+	unsigned int Epoch;				// Upload epoch of the data, ChangedEpoch if changed since
+	unsigned int RingFirstConstant;	// Range in the slot's constant ring,
+	unsigned int RingConstantCount;	// or a count of zero for the shader's own buffer
+};
+
 // --------------------------------------------------------
 // Contains information about a specific
 // constant buffer in a shader, as well as
@@ -35,10 +50,26 @@ struct SimpleConstantBuffer
 	unsigned int Size = 0;
 	unsigned int BindIndex = 0;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
-	unsigned char* LocalDataBuffer = 0;
+	unsigned char* LocalDataBuffer = 0; // ISimpleShader::MaxContextSlots copies of Size bytes
+	SimpleUploadState* UploadState = 0; // One per context slot
 	std::vector<SimpleShaderVariable> Variables;
 };
 
+// --------------------------------------------------------
+// A constant buffer variable found ahead of time with
+// ISimpleShader::GetParam(), so setting it later needs no
+// string or map lookup.  Only valid for the shader that
+// created it.
+// --------------------------------------------------------
+struct ShaderParam
+{
+	unsigned int BufferIndex = 0;
+	unsigned int ByteOffset = 0;
+	unsigned int Size = 0; // Zero if the variable doesn't exist
+
+	bool IsValid() const { return Size > 0; }
+};
+
 // --------------------------------------------------------
 // Contains info about a single SRV in a shader
 // --------------------------------------------------------
@@ -70,6 +101,7 @@ public:
 
 	// Simple helpers
 	bool IsShaderValid() { return shaderValid; }
+	unsigned int GetId() { return id; } // Unique per shader object
 
 	// Activating the shader and copying data
 	void SetShader();
@@ -91,6 +123,17 @@ public:
 	bool SetMatrix4x4(std::string name, const float data[16]);
 	bool SetMatrix4x4(std::string name, const DirectX::XMFLOAT4X4 data);
 
+	// Sets shader data through pre-resolved handles
+	ShaderParam GetParam(std::string name);
+	ShaderParam GetBufferParam(std::string bufferName);
+	bool SetData(const ShaderParam& param, const void* data, unsigned int size);
+	bool SetInt(const ShaderParam& param, int data);
+	bool SetFloat(const ShaderParam& param, float data);
+	bool SetFloat2(const ShaderParam& param, const DirectX::XMFLOAT2& data);
+	bool SetFloat3(const ShaderParam& param, const DirectX::XMFLOAT3& data);
+	bool SetFloat4(const ShaderParam& param, const DirectX::XMFLOAT4& data);
+	bool SetMatrix4x4(const ShaderParam& param, const DirectX::XMFLOAT4X4& data);
+
 	// Setting shader resources
 	virtual bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv) = 0;
 	virtual bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState) = 0;
@@ -118,19 +161,63 @@ public:
 	const SimpleConstantBuffer* GetBufferInfo(unsigned int index);
 	
 	// Misc getters
-	Microsoft::WRL::ComPtr<ID3DBlob> GetShaderBlob() { return shaderBlob; }
+	Microsoft::WRL::ComPtr<ID3DBlob> GetShaderBlob();
+
+	// Swaps in recompiled code, for hot reloading
+	bool ReloadShader(Microsoft::WRL::ComPtr<ID3DBlob> bytecode);
 
 	// Error reporting
 	static bool ReportErrors;
 	static bool ReportWarnings;
 
+	// Multithreaded recording
+	static const unsigned int MaxContextSlots = 9;
+	static void SetThreadContext(ID3D11DeviceContext* context, unsigned int slot, ConstantRing* ring = 0);
+
+	// Optional redundant state filtering, one cache per context slot
+	static void SetStateCache(unsigned int slot, StateCache* cache);
+
+	// Constant buffer upload tracking
+	static bool UploadUnchanged; // Upload every buffer on every copy, even if nothing changed
+	static void InvalidateUploads(unsigned int slot);
+	static void GetUploadStats(unsigned int& bytes, unsigned int& uploads, unsigned int& skips, unsigned int& ringUploads);
+	static void ResetUploadStats();
+
 protected:
 	
 	bool shaderValid;
-	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob;
+	unsigned int id;
+	static unsigned int nextId;
+	Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob; // Only set while loading, or once asked for
+	std::wstring shaderPath;
+	ShaderReflection reflection; // Filled before CreateShader() is called
 	Microsoft::WRL::ComPtr<ID3D11Device> device;
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> deviceContext;
 
+	// Per thread context and local data (see SetThreadContext)
+	static thread_local ID3D11DeviceContext* threadContext;
+	static thread_local unsigned int threadSlot;
+	static thread_local ConstantRing* threadRing;
+	static thread_local ID3D11DeviceContext1* threadContext1;
+	ID3D11DeviceContext* GetContext();
+	static StateCache* stateCaches[MaxContextSlots];
+	StateCache* GetStateCache();
+	unsigned char* GetLocalData(SimpleConstantBuffer* cb);
+
+	// Upload tracking per context slot (see InvalidateUploads)
+	static const unsigned int ChangedEpoch = 0xFFFFFFFF;
+	static unsigned int uploadEpoch[MaxContextSlots];
+	static unsigned int bytesUploaded[MaxContextSlots];
+	static unsigned int buffersUploaded[MaxContextSlots];
+	static unsigned int buffersSkipped[MaxContextSlots];
+	static unsigned int ringUploads[MaxContextSlots];
+	void UploadBuffer(SimpleConstantBuffer* cb);
+
+	// Binds part of a buffer with *SetConstantBuffers1 (the whole
+	// buffer if count is zero), for stages that support it
+	virtual bool CanBindRanges() { return false; }
+	virtual void SetConstantBufferRange(unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount) {}
+
 	// Resource counts
 	unsigned int constantBufferCount;
 	
@@ -143,11 +230,12 @@ protected:
 	std::unordered_map<std::string, SimpleSRV*> textureTable;
 	std::unordered_map<std::string, SimpleSampler*> samplerTable;
 
-	// Initialization method
+	// Initialization methods
 	bool LoadShaderFile(LPCWSTR shaderFile);
+	void BuildTables();
 
 	// Pure virtual functions for dealing with shader types
-	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0;
+	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0; // Leaves the current shader alone if it fails
 	virtual void SetShaderAndCBs() = 0;
 
 	virtual void CleanUp();
@@ -185,10 +273,13 @@ public:
 
 protected:
 	bool perInstanceCompatible;
+	bool reflectedInputLayout; // Made by CreateShader(), rather than given to the constructor
 	 Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
 	 Microsoft::WRL::ComPtr<ID3D11VertexShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	bool CanBindRanges() { return true; }
+	void SetConstantBufferRange(unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
 	void CleanUp();
 };
 
@@ -206,10 +297,17 @@ public:
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 
+	// Binds a contiguous range of registers at once, for
+	// callers that have already resolved the registers
+	void SetShaderResourceViews(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void SetSamplerStates(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplerStates);
+
 protected:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	bool CanBindRanges() { return true; }
+	void SetConstantBufferRange(unsigned int bindIndex, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
 	void CleanUp();
 };
 
@@ -7,7 +7,8 @@ Sky::Sky(
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv,
 	std::shared_ptr<SimpleVertexShader> vs,
 	std::shared_ptr<SimplePixelShader> ps,
-	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<StateObjectCache> stateObjects)
 	:
 	mesh(mesh),
 	samplerState(samplerState),
@@ -21,18 +22,23 @@ Sky::Sky(
 	rasterizerDesc.FillMode = D3D11_FILL_SOLID;
 	rasterizerDesc.CullMode = D3D11_CULL_FRONT;
 	rasterizerDesc.DepthClipEnable = true;
-	device->CreateRasterizerState(&rasterizerDesc, &rasterizerState);
+	rasterizerState = stateObjects->GetRasterizerState(rasterizerDesc);
 
 	D3D11_DEPTH_STENCIL_DESC stencilDesc = {};
 	stencilDesc.DepthEnable = true;
 	stencilDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
-	device->CreateDepthStencilState(&stencilDesc, &depthStencilState);
+	depthStencilState = stateObjects->GetDepthStencilState(stencilDesc);
 }
 
-void Sky::Draw(std::shared_ptr<Camera> camera)
+// --------------------------------------------------------
+// Draws the sky, leaving its rasterizer and depth states set.
+// Whatever draws next sets its own (through the same cache),
+// so they are only reset when it actually needs something else.
+// --------------------------------------------------------
+void Sky::Draw(std::shared_ptr<Camera> camera, StateCache* state)
 {
-	context->RSSetState(rasterizerState.Get());
-	context->OMSetDepthStencilState(depthStencilState.Get(), 0);
+	state->RSSetState(rasterizerState.Get());
+	state->OMSetDepthStencilState(depthStencilState.Get(), 0);
 
 	vs->SetShader();
 	ps->SetShader();
@@ -46,10 +52,8 @@ void Sky::Draw(std::shared_ptr<Camera> camera)
 	vs->CopyAllBufferData();
 	ps->CopyAllBufferData();
 
-	mesh->Draw();
-
-	context->RSSetState(0);
-	context->OMSetDepthStencilState(0, 0);
+	mesh->SetBuffers(state);
+	mesh->DrawIndexed(state->GetContext());
 }
 
 Sky::Sky()
@@ -5,6 +5,7 @@
 #include "SimpleShader.h"
 #include "WICTextureLoader.h"
 #include "Camera.h"
+#include "StateObjectCache.h"
 
 class Sky
 {
@@ -15,8 +16,9 @@ public:
 		Microsoft::WRL::ComPtr <ID3D11ShaderResourceView> srv,
 		std::shared_ptr<SimpleVertexShader> vs,
 		std::shared_ptr <SimplePixelShader> ps,
-		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
-	void Draw(std::shared_ptr<Camera> camera);
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<StateObjectCache> stateObjects);
+	void Draw(std::shared_ptr<Camera> camera, StateCache* state);
 	Sky();
 	// Helper for creating a cubemap from 6 individual textures
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(
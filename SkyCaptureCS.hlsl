@@ -0,0 +1,32 @@
+#include "Include.hlsli"
+#include "Ambient.hlsli"
+
+cbuffer CaptureData : register(b0)
+{
+    uint faceSize; // Texels per side of the capture
+    float sourceMip; // The sky's mip closest to that size
+}
+
+// The sky, mipmapped so shrinking it doesn't alias
+TextureCube Sky : register(t0);
+SamplerState LinearSampler : register(s0);
+
+RWTexture2DArray<float4> Output : register(u0);
+
+// --------------------------------------------------------
+// Copies the sky into linear floats, shrunk to the size the
+// ambient light is built at: the CPU projects it into SH and
+// the specular map is prefiltered from it
+// --------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    if (any(id.xy >= faceSize))
+        return;
+
+    float3 direction = CubeDirection(id.z, (id.xy + 0.5f) / faceSize);
+    float3 color = Sky.SampleLevel(LinearSampler, direction, sourceMip).rgb;
+
+    // The sky's textures are gamma encoded, like the albedo ones
+    Output[id] = float4(pow(color, 2.2f), 1.0f);
+}
@@ -0,0 +1,497 @@
+#include "SkyLighting.h"
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// Identifies a sky lighting cache file, bump the version
+// whenever the layout below (or how anything's built) changes
+#define CACHE_MAGIC		0x4C594B53 // "SKYL"
+#define CACHE_VERSION	2
+
+// Bytes per texel of what's cached
+#define CAPTURE_TEXEL_BYTES		16 // R32G32B32A32_FLOAT
+#define SPECULAR_TEXEL_BYTES	8 // R16G16B16A16_FLOAT
+#define LUT_TEXEL_BYTES			4 // R16G16_FLOAT
+
+// Starts a cache file, followed by the radiance SH, every
+// mip of each face of the specular map in turn, and the LUT
+struct CacheHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int size;
+	unsigned int specularMips;
+	unsigned int lutSize;
+	unsigned int padding;
+	uint64_t key;
+};
+
+// FNV-1a, 64 bit
+static uint64_t HashBytes(uint64_t hash, const void* bytes, size_t size)
+{
+	const unsigned char* data = (const unsigned char*)bytes;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+// Mips from the given size down to SKY_LIGHTING_MIN_MIP_SIZE
+static unsigned int SpecularMipsFor(unsigned int size)
+{
+	unsigned int mips = 1;
+	while ((size >> mips) >= SKY_LIGHTING_MIN_MIP_SIZE)
+		mips++;
+	return mips;
+}
+
+SkyLighting::SkyLighting(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<StateObjectCache> stateObjects,
+	std::shared_ptr<SimpleComputeShader> captureShader,
+	std::shared_ptr<SimpleComputeShader> prefilterShader,
+	std::shared_ptr<SimpleComputeShader> lutShader,
+	const std::wstring& cacheFile)
+	:
+	device(device),
+	context(context),
+	captureShader(captureShader),
+	prefilterShader(prefilterShader),
+	lutShader(lutShader),
+	cacheFile(cacheFile),
+	size(128),
+	sampleCount(128),
+	radiance(),
+	irradiance(),
+	loadedFromCache(false),
+	buildTime(0.0f),
+	projectionTime(0.0f),
+	cacheBytes(0)
+{
+	specularMips = SpecularMipsFor(size);
+
+	D3D11_SAMPLER_DESC sampDesc = {};
+	sampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+	sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	linearSampler = stateObjects->GetSamplerState(sampDesc);
+}
+
+SkyLighting::~SkyLighting()
+{
+}
+
+void SkyLighting::SetSky(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> skySRV, const std::vector<std::wstring>& faceFiles)
+{
+	this->skySRV = skySRV;
+	this->faceFiles = faceFiles;
+	Build(true);
+}
+
+void SkyLighting::Rebuild()
+{
+	if (skySRV)
+		Build(false);
+}
+
+void SkyLighting::SetSize(unsigned int size)
+{
+	if (size == this->size || size < SKY_LIGHTING_MIN_MIP_SIZE)
+		return;
+
+	this->size = size;
+	specularMips = SpecularMipsFor(size);
+	if (skySRV)
+		Build(true);
+}
+
+void SkyLighting::SetSampleCount(unsigned int samples)
+{
+	if (samples == sampleCount || samples < 1)
+		return;
+
+	sampleCount = samples;
+	if (skySRV)
+		Build(true);
+}
+
+// --------------------------------------------------------
+// Takes everything from the cache if it was made from the
+// same sky and settings, otherwise builds it and saves it
+// --------------------------------------------------------
+void SkyLighting::Build(bool useCache)
+{
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	projectionTime = 0.0f;
+
+	uint64_t key = HashSources();
+	loadedFromCache = useCache && LoadCache(key);
+	if (!loadedFromCache)
+	{
+		Bake();
+		SaveCache(key);
+	}
+
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	buildTime = elapsed.count();
+}
+
+// --------------------------------------------------------
+// Builds the irradiance, specular map and LUT from the sky
+//  1. Copy the sky into a texture with mips
+//  2. Capture it into linear floats at the size to build at,
+//     then read that back and project it into SH
+//  3. Prefilter the capture into each mip of the specular map
+//  4. Integrate the BRDF into the LUT
+// --------------------------------------------------------
+void SkyLighting::Bake()
+{
+	ID3D11ShaderResourceView* nullSRV = 0;
+	ID3D11UnorderedAccessView* nullUAV = 0;
+
+	// The sky's cubemap is made without mips, which it needs to
+	// be shrunk to the capture's size without aliasing
+	Microsoft::WRL::ComPtr<ID3D11Resource> skyResource;
+	skySRV->GetResource(skyResource.GetAddressOf());
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> skyTexture;
+	skyResource.As(&skyTexture);
+	D3D11_TEXTURE2D_DESC skyDesc = {};
+	skyTexture->GetDesc(&skyDesc);
+
+	D3D11_TEXTURE2D_DESC mippedDesc = skyDesc;
+	mippedDesc.MipLevels = 0;
+	mippedDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+	mippedDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE | D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	mippedDesc.Usage = D3D11_USAGE_DEFAULT;
+	mippedDesc.CPUAccessFlags = 0;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> mippedSky;
+	device->CreateTexture2D(&mippedDesc, 0, mippedSky.GetAddressOf());
+	mippedSky->GetDesc(&mippedDesc);
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		context->CopySubresourceRegion(
+			mippedSky.Get(), D3D11CalcSubresource(0, face, mippedDesc.MipLevels), 0, 0, 0,
+			skyTexture.Get(), D3D11CalcSubresource(0, face, skyDesc.MipLevels), 0);
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC cubeDesc = {};
+	cubeDesc.Format = mippedDesc.Format;
+	cubeDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	cubeDesc.TextureCube.MipLevels = (unsigned int)-1;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> mippedSkySRV;
+	device->CreateShaderResourceView(mippedSky.Get(), &cubeDesc, mippedSkySRV.GetAddressOf());
+	context->GenerateMips(mippedSkySRV.Get());
+
+	// The capture, with mips of its own for prefiltering
+	D3D11_TEXTURE2D_DESC captureDesc = {};
+	captureDesc.Width = size;
+	captureDesc.Height = size;
+	captureDesc.ArraySize = 6;
+	captureDesc.MipLevels = 0;
+	captureDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	captureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_RENDER_TARGET;
+	captureDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE | D3D11_RESOURCE_MISC_GENERATE_MIPS;
+	captureDesc.SampleDesc.Count = 1;
+	captureDesc.Usage = D3D11_USAGE_DEFAULT;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> captureTexture;
+	device->CreateTexture2D(&captureDesc, 0, captureTexture.GetAddressOf());
+
+	cubeDesc.Format = captureDesc.Format;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> captureSRV;
+	device->CreateShaderResourceView(captureTexture.Get(), &cubeDesc, captureSRV.GetAddressOf());
+
+	D3D11_UNORDERED_ACCESS_VIEW_DESC facesDesc = {};
+	facesDesc.Format = captureDesc.Format;
+	facesDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+	facesDesc.Texture2DArray.MipSlice = 0;
+	facesDesc.Texture2DArray.FirstArraySlice = 0;
+	facesDesc.Texture2DArray.ArraySize = 6;
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> captureUAV;
+	device->CreateUnorderedAccessView(captureTexture.Get(), &facesDesc, captureUAV.GetAddressOf());
+
+	captureShader->SetShader();
+	captureShader->SetInt("faceSize", (int)size);
+	captureShader->SetFloat("sourceMip", std::fmax(std::log2((float)skyDesc.Width / size), 0.0f));
+	captureShader->CopyAllBufferData();
+	captureShader->SetShaderResourceView("Sky", mippedSkySRV);
+	captureShader->SetSamplerState("LinearSampler", linearSampler);
+	captureShader->SetUnorderedAccessView("Output", captureUAV);
+	captureShader->DispatchByThreads(size, size, 6);
+	context->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+	context->CSSetShaderResources(0, 1, &nullSRV);
+	context->GenerateMips(captureSRV.Get());
+
+	// Diffuse, from the capture's first mip
+	std::vector<unsigned char> captureData;
+	ReadBack(captureTexture.Get(), 1, CAPTURE_TEXEL_BYTES, captureData);
+	const float* faces[6];
+	for (unsigned int face = 0; face < 6; face++)
+		faces[face] = (const float*)&captureData[(size_t)face * size * size * CAPTURE_TEXEL_BYTES];
+
+	std::chrono::high_resolution_clock::time_point projectStart = std::chrono::high_resolution_clock::now();
+	radiance = SphericalHarmonics::ProjectCubemap(faces, size);
+	irradiance = radiance;
+	SphericalHarmonics::ConvolveLambert(irradiance);
+	std::chrono::duration<float, std::milli> projectElapsed = std::chrono::high_resolution_clock::now() - projectStart;
+	projectionTime = projectElapsed.count();
+
+	// Specular, a mip per roughness from 0 to 1
+	D3D11_TEXTURE2D_DESC specularDesc = captureDesc;
+	specularDesc.MipLevels = specularMips;
+	specularDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	specularDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	specularDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	device->CreateTexture2D(&specularDesc, 0, specularTexture.ReleaseAndGetAddressOf());
+
+	cubeDesc.Format = specularDesc.Format;
+	device->CreateShaderResourceView(specularTexture.Get(), &cubeDesc, specularSRV.ReleaseAndGetAddressOf());
+
+	prefilterShader->SetShader();
+	prefilterShader->SetShaderResourceView("Source", captureSRV);
+	prefilterShader->SetSamplerState("LinearSampler", linearSampler);
+	facesDesc.Format = specularDesc.Format;
+	for (unsigned int mip = 0; mip < specularMips; mip++)
+	{
+		facesDesc.Texture2DArray.MipSlice = mip;
+		Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> mipUAV;
+		device->CreateUnorderedAccessView(specularTexture.Get(), &facesDesc, mipUAV.GetAddressOf());
+
+		unsigned int mipSize = size >> mip;
+		prefilterShader->SetInt("faceSize", (int)mipSize);
+		prefilterShader->SetFloat("roughness", specularMips > 1 ? (float)mip / (specularMips - 1) : 0.0f);
+		prefilterShader->SetInt("sampleCount", (int)sampleCount);
+		prefilterShader->SetFloat("sourceSize", (float)size);
+		prefilterShader->CopyAllBufferData();
+		prefilterShader->SetUnorderedAccessView("Output", mipUAV);
+		prefilterShader->DispatchByThreads(mipSize, mipSize, 6);
+	}
+	context->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+	context->CSSetShaderResources(0, 1, &nullSRV);
+
+	// The LUT
+	D3D11_TEXTURE2D_DESC lutDesc = {};
+	lutDesc.Width = SKY_LIGHTING_LUT_SIZE;
+	lutDesc.Height = SKY_LIGHTING_LUT_SIZE;
+	lutDesc.ArraySize = 1;
+	lutDesc.MipLevels = 1;
+	lutDesc.Format = DXGI_FORMAT_R16G16_FLOAT;
+	lutDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	lutDesc.SampleDesc.Count = 1;
+	lutDesc.Usage = D3D11_USAGE_DEFAULT;
+	device->CreateTexture2D(&lutDesc, 0, lutTexture.ReleaseAndGetAddressOf());
+	device->CreateShaderResourceView(lutTexture.Get(), 0, lutSRV.ReleaseAndGetAddressOf());
+	Microsoft::WRL::ComPtr<ID3D11UnorderedAccessView> lutUAV;
+	device->CreateUnorderedAccessView(lutTexture.Get(), 0, lutUAV.GetAddressOf());
+
+	lutShader->SetShader();
+	lutShader->SetInt("lutSize", SKY_LIGHTING_LUT_SIZE);
+	lutShader->SetInt("sampleCount", SKY_LIGHTING_LUT_SAMPLES);
+	lutShader->CopyAllBufferData();
+	lutShader->SetUnorderedAccessView("Output", lutUAV);
+	lutShader->DispatchByThreads(SKY_LIGHTING_LUT_SIZE, SKY_LIGHTING_LUT_SIZE, 1);
+	context->CSSetUnorderedAccessViews(0, 1, &nullUAV, 0);
+}
+
+// --------------------------------------------------------
+// Copies a texture's first mips back to the CPU, packed
+// tightly, with each array slice's mips in turn
+// - Everything is copied before anything is mapped, so
+//   there's only the one wait for the GPU
+// --------------------------------------------------------
+void SkyLighting::ReadBack(ID3D11Texture2D* texture, unsigned int mipLevels, unsigned int bytesPerTexel, std::vector<unsigned char>& data)
+{
+	D3D11_TEXTURE2D_DESC desc = {};
+	texture->GetDesc(&desc);
+	unsigned int sourceMips = desc.MipLevels;
+
+	D3D11_TEXTURE2D_DESC stagingDesc = desc;
+	stagingDesc.MipLevels = mipLevels;
+	stagingDesc.BindFlags = 0;
+	stagingDesc.MiscFlags = 0;
+	stagingDesc.Usage = D3D11_USAGE_STAGING;
+	stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staging;
+	device->CreateTexture2D(&stagingDesc, 0, staging.GetAddressOf());
+
+	for (unsigned int slice = 0; slice < desc.ArraySize; slice++)
+		for (unsigned int mip = 0; mip < mipLevels; mip++)
+			context->CopySubresourceRegion(
+				staging.Get(), D3D11CalcSubresource(mip, slice, mipLevels), 0, 0, 0,
+				texture, D3D11CalcSubresource(mip, slice, sourceMips), 0);
+
+	data.clear();
+	for (unsigned int slice = 0; slice < desc.ArraySize; slice++)
+	{
+		for (unsigned int mip = 0; mip < mipLevels; mip++)
+		{
+			unsigned int subresource = D3D11CalcSubresource(mip, slice, mipLevels);
+			unsigned int rowBytes = (desc.Width >> mip) * bytesPerTexel;
+			unsigned int rows = desc.Height >> mip;
+
+			// Rows may be padded out on the GPU
+			D3D11_MAPPED_SUBRESOURCE mapped = {};
+			context->Map(staging.Get(), subresource, D3D11_MAP_READ, 0, &mapped);
+			size_t offset = data.size();
+			data.resize(offset + (size_t)rowBytes * rows);
+			for (unsigned int y = 0; y < rows; y++)
+				memcpy(&data[offset + (size_t)y * rowBytes], (const unsigned char*)mapped.pData + (size_t)y * mapped.RowPitch, rowBytes);
+			context->Unmap(staging.Get(), subresource);
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Makes the specular map and LUT straight from the cache
+// file, if it has the key and the sizes expected
+// --------------------------------------------------------
+bool SkyLighting::LoadCache(uint64_t key)
+{
+	std::ifstream file(cacheFile, std::ios::binary | std::ios::ate);
+	if (!file)
+		return false;
+
+	std::vector<unsigned char> data((size_t)file.tellg());
+	file.seekg(0);
+	if (data.size() < sizeof(CacheHeader) || !file.read((char*)&data[0], data.size()))
+		return false;
+
+	CacheHeader header;
+	memcpy(&header, &data[0], sizeof(header));
+	if (header.magic != CACHE_MAGIC ||
+		header.version != CACHE_VERSION ||
+		header.key != key ||
+		header.size != size ||
+		header.specularMips != specularMips ||
+		header.lutSize != SKY_LIGHTING_LUT_SIZE)
+		return false;
+
+	size_t specularBytes = 0;
+	for (unsigned int mip = 0; mip < specularMips; mip++)
+		specularBytes += (size_t)(size >> mip) * (size >> mip) * SPECULAR_TEXEL_BYTES * 6;
+	size_t lutBytes = (size_t)SKY_LIGHTING_LUT_SIZE * SKY_LIGHTING_LUT_SIZE * LUT_TEXEL_BYTES;
+	if (data.size() != sizeof(CacheHeader) + sizeof(SH9) + specularBytes + lutBytes)
+		return false;
+
+	const unsigned char* texels = &data[sizeof(CacheHeader) + sizeof(SH9)];
+	std::vector<D3D11_SUBRESOURCE_DATA> specularData(specularMips * 6);
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		for (unsigned int mip = 0; mip < specularMips; mip++)
+		{
+			unsigned int mipSize = size >> mip;
+			D3D11_SUBRESOURCE_DATA& subresource = specularData[D3D11CalcSubresource(mip, face, specularMips)];
+			subresource.pSysMem = texels;
+			subresource.SysMemPitch = mipSize * SPECULAR_TEXEL_BYTES;
+			texels += (size_t)mipSize * mipSize * SPECULAR_TEXEL_BYTES;
+		}
+	}
+
+	D3D11_TEXTURE2D_DESC specularDesc = {};
+	specularDesc.Width = size;
+	specularDesc.Height = size;
+	specularDesc.ArraySize = 6;
+	specularDesc.MipLevels = specularMips;
+	specularDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	specularDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	specularDesc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+	specularDesc.SampleDesc.Count = 1;
+	specularDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	if (FAILED(device->CreateTexture2D(&specularDesc, &specularData[0], specularTexture.ReleaseAndGetAddressOf())))
+		return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC cubeDesc = {};
+	cubeDesc.Format = specularDesc.Format;
+	cubeDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+	cubeDesc.TextureCube.MipLevels = (unsigned int)-1;
+	device->CreateShaderResourceView(specularTexture.Get(), &cubeDesc, specularSRV.ReleaseAndGetAddressOf());
+
+	D3D11_SUBRESOURCE_DATA lutData = {};
+	lutData.pSysMem = texels;
+	lutData.SysMemPitch = SKY_LIGHTING_LUT_SIZE * LUT_TEXEL_BYTES;
+	D3D11_TEXTURE2D_DESC lutDesc = {};
+	lutDesc.Width = SKY_LIGHTING_LUT_SIZE;
+	lutDesc.Height = SKY_LIGHTING_LUT_SIZE;
+	lutDesc.ArraySize = 1;
+	lutDesc.MipLevels = 1;
+	lutDesc.Format = DXGI_FORMAT_R16G16_FLOAT;
+	lutDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	lutDesc.SampleDesc.Count = 1;
+	lutDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	if (FAILED(device->CreateTexture2D(&lutDesc, &lutData, lutTexture.ReleaseAndGetAddressOf())))
+		return false;
+	device->CreateShaderResourceView(lutTexture.Get(), 0, lutSRV.ReleaseAndGetAddressOf());
+
+	memcpy(&radiance, &data[sizeof(CacheHeader)], sizeof(SH9));
+	irradiance = radiance;
+	SphericalHarmonics::ConvolveLambert(irradiance);
+	cacheBytes = (unsigned int)data.size();
+	return true;
+}
+
+void SkyLighting::SaveCache(uint64_t key)
+{
+	std::vector<unsigned char> specularData;
+	std::vector<unsigned char> lutData;
+	ReadBack(specularTexture.Get(), specularMips, SPECULAR_TEXEL_BYTES, specularData);
+	ReadBack(lutTexture.Get(), 1, LUT_TEXEL_BYTES, lutData);
+
+	CacheHeader header = {};
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.size = size;
+	header.specularMips = specularMips;
+	header.lutSize = SKY_LIGHTING_LUT_SIZE;
+	header.key = key;
+
+	std::ofstream file(cacheFile, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return;
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)&radiance, sizeof(radiance));
+	file.write((const char*)&specularData[0], specularData.size());
+	file.write((const char*)&lutData[0], lutData.size());
+	cacheBytes = file ? (unsigned int)(sizeof(header) + sizeof(radiance) + specularData.size() + lutData.size()) : 0;
+}
+
+// --------------------------------------------------------
+// Hashes the sky's face files and everything that changes
+// what's built from them - a missing file hashes as empty
+// --------------------------------------------------------
+uint64_t SkyLighting::HashSources()
+{
+	unsigned int settings[4] = { CACHE_VERSION, size, sampleCount, SKY_LIGHTING_LUT_SAMPLES };
+	uint64_t hash = HashBytes(0xCBF29CE484222325ull, settings, sizeof(settings));
+
+	for (const std::wstring& path : faceFiles)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		std::vector<char> bytes(file ? (size_t)file.tellg() : 0);
+		if (!bytes.empty())
+		{
+			file.seekg(0);
+			file.read(&bytes[0], bytes.size());
+		}
+		size_t byteCount = bytes.size();
+		hash = HashBytes(hash, &byteCount, sizeof(byteCount));
+		hash = HashBytes(hash, bytes.data(), bytes.size());
+	}
+	return hash;
+}
+
+unsigned int SkyLighting::GetSize() { return size; }
+unsigned int SkyLighting::GetSampleCount() { return sampleCount; }
+const SH9& SkyLighting::GetRadiance() { return radiance; }
+const SH9& SkyLighting::GetIrradiance() { return irradiance; }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SkyLighting::GetSpecularSRV() { return specularSRV; }
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> SkyLighting::GetBrdfLutSRV() { return lutSRV; }
+unsigned int SkyLighting::GetSpecularMipCount() { return specularMips; }
+bool SkyLighting::WasLoadedFromCache() { return loadedFromCache; }
+float SkyLighting::GetBuildTime() { return buildTime; }
+float SkyLighting::GetProjectionTime() { return projectionTime; }
+unsigned int SkyLighting::GetCacheBytes() { return cacheBytes; }
@@ -0,0 +1,110 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "SimpleShader.h"
+#include "StateObjectCache.h"
+#include "SphericalHarmonics.h"
+
+// Texels per side of the split sum BRDF LUT, and the samples
+// each of them takes - the LUT doesn't depend on the sky
+#define SKY_LIGHTING_LUT_SIZE		128
+#define SKY_LIGHTING_LUT_SAMPLES	512
+
+// The smallest mip the specular map goes down to, per side
+#define SKY_LIGHTING_MIN_MIP_SIZE	4
+
+// --------------------------------------------------------
+// Ambient light from the sky's cubemap ("AmbientData",
+// "SpecularMap" and "BrdfLut" in Ambient.hlsli)
+//
+// - Diffuse: the sky is captured into linear floats on the
+//   GPU, read back, and projected into SH9 on the CPU (see
+//   SphericalHarmonics.h), convolved for Lambert
+// - Specular: the capture is prefiltered with GGX into a
+//   mip per roughness, plus a LUT for the BRDF's half of the
+//   split sum
+// - Everything built is cached in one file, keyed by a hash
+//   of the sky's face files and the settings, so it's only
+//   built again when the sky (or a setting) changes
+// --------------------------------------------------------
+class SkyLighting
+{
+public:
+	SkyLighting(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<StateObjectCache> stateObjects,
+		std::shared_ptr<SimpleComputeShader> captureShader,
+		std::shared_ptr<SimpleComputeShader> prefilterShader,
+		std::shared_ptr<SimpleComputeShader> lutShader,
+		const std::wstring& cacheFile);
+	~SkyLighting();
+
+	// Loads the lighting for a sky from the cache, or builds
+	// (and caches) it if the cache is for another sky.  The
+	// files are the ones the cubemap was made from, and only
+	// feed the hash.
+	void SetSky(Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> skySRV, const std::vector<std::wstring>& faceFiles);
+
+	// Builds everything again, ignoring (and replacing) the cache
+	void Rebuild();
+
+	// Both take effect right away, through the cache
+	void SetSize(unsigned int size); // Texels per side of the capture and the specular map's first mip
+	void SetSampleCount(unsigned int samples); // Per texel of the specular map
+	unsigned int GetSize();
+	unsigned int GetSampleCount();
+
+	const SH9& GetRadiance(); // Before ConvolveLambert(), what a ray that misses everything sees
+	const SH9& GetIrradiance();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetSpecularSRV();
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> GetBrdfLutSRV();
+	unsigned int GetSpecularMipCount();
+
+	// What the last SetSky(), Rebuild() or setting change did
+	bool WasLoadedFromCache();
+	float GetBuildTime(); // Milliseconds, start to finish
+	float GetProjectionTime(); // Milliseconds of that spent in ProjectCubemap()
+	unsigned int GetCacheBytes();
+
+private:
+	void Build(bool useCache);
+	void Bake();
+	void ReadBack(ID3D11Texture2D* texture, unsigned int mipLevels, unsigned int bytesPerTexel, std::vector<unsigned char>& data);
+	bool LoadCache(uint64_t key);
+	void SaveCache(uint64_t key);
+	uint64_t HashSources();
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<SimpleComputeShader> captureShader;
+	std::shared_ptr<SimpleComputeShader> prefilterShader;
+	std::shared_ptr<SimpleComputeShader> lutShader;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> linearSampler;
+	std::wstring cacheFile;
+
+	// The sky being lit by
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> skySRV;
+	std::vector<std::wstring> faceFiles;
+
+	unsigned int size;
+	unsigned int sampleCount;
+	unsigned int specularMips;
+
+	// What was built
+	SH9 radiance;
+	SH9 irradiance;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> specularTexture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> specularSRV;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> lutTexture;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> lutSRV;
+
+	bool loadedFromCache;
+	float buildTime;
+	float projectionTime;
+	unsigned int cacheBytes;
+};
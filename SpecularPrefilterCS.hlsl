@@ -0,0 +1,59 @@
+#include "Include.hlsli"
+#include "Ambient.hlsli"
+
+cbuffer PrefilterData : register(b0)
+{
+    uint faceSize; // Texels per side of the mip being filled
+    float roughness;
+    uint sampleCount;
+    float sourceSize; // Texels per side of the capture
+}
+
+// The captured sky (see SkyCaptureCS.hlsl), with mips
+TextureCube Source : register(t0);
+SamplerState LinearSampler : register(s0);
+
+// One mip of the specular map
+RWTexture2DArray<float4> Output : register(u0);
+
+// --------------------------------------------------------
+// Convolves the sky with GGX for one roughness, taking the
+// view and normal to be the reflection direction
+// - Each sample reads the capture's mip whose texels cover
+//   about as much of the sphere as the sample stands for,
+//   so few samples still give a smooth result
+// --------------------------------------------------------
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    if (any(id.xy >= faceSize))
+        return;
+
+    float3 N = CubeDirection(id.z, (id.xy + 0.5f) / faceSize);
+    if (roughness == 0.0f)
+    {
+        Output[id] = float4(Source.SampleLevel(LinearSampler, N, 0).rgb, 1.0f);
+        return;
+    }
+
+    float texelSolidAngle = 4.0f * PI / (6.0f * sourceSize * sourceSize);
+    float3 sum = float3(0, 0, 0);
+    float weightSum = 0.0f;
+    for (uint i = 0; i < sampleCount; i++)
+    {
+        float3 H = ImportanceSampleGGX(Hammersley(i, sampleCount), N, roughness);
+        float3 L = reflect(-N, H);
+        float NdotL = dot(N, L);
+        if (NdotL <= 0.0f)
+            continue;
+
+        // With N = V, the pdf of L is D / 4
+        float pdf = D_GGX(N, H, roughness) * 0.25f;
+        float sampleSolidAngle = 1.0f / (sampleCount * pdf + 0.0001f);
+        float mip = max(0.5f * log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f);
+
+        sum += Source.SampleLevel(LinearSampler, L, mip).rgb * NdotL;
+        weightSum += NdotL;
+    }
+    Output[id] = float4(sum / max(weightSum, 0.0001f), 1.0f);
+}
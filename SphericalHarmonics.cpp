@@ -0,0 +1,206 @@
+#include "SphericalHarmonics.h"
+
+// Each basis function is a constant times a polynomial of the
+// direction.  The projection sums the polynomials alone, and
+// applies the constants once at the end.
+static const float basisConstants[9] =
+{
+	0.282095f,	// 1
+	0.488603f,	// y
+	0.488603f,	// z
+	0.488603f,	// x
+	1.092548f,	// xy
+	1.092548f,	// yz
+	0.315392f,	// 3z^2 - 1
+	1.092548f,	// xz
+	0.546274f	// x^2 - y^2
+};
+
+// How each face's directions are built from u and v: the x, y
+// and z of the direction, each as a u, v and constant term
+static const float faceAxes[6][3][3] =
+{
+	{ {  0.0f,  0.0f,  1.0f }, { 0.0f, -1.0f,  0.0f }, { -1.0f,  0.0f,  0.0f } }, // +X
+	{ {  0.0f,  0.0f, -1.0f }, { 0.0f, -1.0f,  0.0f }, {  1.0f,  0.0f,  0.0f } }, // -X
+	{ {  1.0f,  0.0f,  0.0f }, { 0.0f,  0.0f,  1.0f }, {  0.0f,  1.0f,  0.0f } }, // +Y
+	{ {  1.0f,  0.0f,  0.0f }, { 0.0f,  0.0f, -1.0f }, {  0.0f, -1.0f,  0.0f } }, // -Y
+	{ {  1.0f,  0.0f,  0.0f }, { 0.0f, -1.0f,  0.0f }, {  0.0f,  0.0f,  1.0f } }, // +Z
+	{ { -1.0f,  0.0f,  0.0f }, { 0.0f, -1.0f,  0.0f }, {  0.0f,  0.0f, -1.0f } }  // -Z
+};
+
+// --------------------------------------------------------
+// Sums radiance times each basis function over the sphere,
+// weighting each texel by the solid angle it covers
+// - The solid angles are scaled to add up to exactly 4 pi,
+//   as summing them per texel only comes close
+// --------------------------------------------------------
+SH9 SphericalHarmonics::ProjectCubemap(const float* const faces[6], unsigned int size)
+{
+	// Per basis function and color channel, a lane per texel
+	DirectX::XMVECTOR sums[9][3];
+	for (unsigned int k = 0; k < 9; k++)
+		for (unsigned int c = 0; c < 3; c++)
+			sums[k][c] = DirectX::XMVectorZero();
+	DirectX::XMVECTOR weightSum = DirectX::XMVectorZero();
+
+	float texelSize = 2.0f / size;
+	DirectX::XMVECTOR texelArea = DirectX::XMVectorReplicate(texelSize * texelSize);
+	DirectX::XMVECTOR lanes = DirectX::XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	DirectX::XMVECTOR firstU = DirectX::XMVectorMultiplyAdd(
+		DirectX::XMVectorAdd(lanes, DirectX::XMVectorReplicate(0.5f)),
+		DirectX::XMVectorReplicate(texelSize),
+		DirectX::XMVectorReplicate(-1.0f));
+	DirectX::XMVECTOR stepU = DirectX::XMVectorReplicate(texelSize * 4.0f);
+	DirectX::XMVECTOR three = DirectX::XMVectorReplicate(3.0f);
+	DirectX::XMVECTOR one = DirectX::XMVectorReplicate(1.0f);
+
+	for (unsigned int face = 0; face < 6; face++)
+	{
+		const float (*axes)[3] = faceAxes[face];
+		DirectX::XMVECTOR uToX = DirectX::XMVectorReplicate(axes[0][0]);
+		DirectX::XMVECTOR uToY = DirectX::XMVectorReplicate(axes[1][0]);
+		DirectX::XMVECTOR uToZ = DirectX::XMVectorReplicate(axes[2][0]);
+
+		for (unsigned int y = 0; y < size; y++)
+		{
+			// The parts of the direction that stay the same along the row
+			float v = (y + 0.5f) * texelSize - 1.0f;
+			DirectX::XMVECTOR rowX = DirectX::XMVectorReplicate(axes[0][1] * v + axes[0][2]);
+			DirectX::XMVECTOR rowY = DirectX::XMVectorReplicate(axes[1][1] * v + axes[1][2]);
+			DirectX::XMVECTOR rowZ = DirectX::XMVectorReplicate(axes[2][1] * v + axes[2][2]);
+			const float* row = faces[face] + (size_t)y * size * 4;
+
+			DirectX::XMVECTOR u = firstU;
+			for (unsigned int x = 0; x < size; x += 4, u = DirectX::XMVectorAdd(u, stepU))
+			{
+				DirectX::XMVECTOR dirX = DirectX::XMVectorMultiplyAdd(u, uToX, rowX);
+				DirectX::XMVECTOR dirY = DirectX::XMVectorMultiplyAdd(u, uToY, rowY);
+				DirectX::XMVECTOR dirZ = DirectX::XMVectorMultiplyAdd(u, uToZ, rowZ);
+				DirectX::XMVECTOR lengthSq = DirectX::XMVectorMultiplyAdd(dirX, dirX,
+					DirectX::XMVectorMultiplyAdd(dirY, dirY, DirectX::XMVectorMultiply(dirZ, dirZ)));
+				DirectX::XMVECTOR invLength = DirectX::XMVectorReciprocalSqrt(lengthSq);
+				dirX = DirectX::XMVectorMultiply(dirX, invLength);
+				dirY = DirectX::XMVectorMultiply(dirY, invLength);
+				dirZ = DirectX::XMVectorMultiply(dirZ, invLength);
+
+				// A texel's solid angle shrinks with the cube of its
+				// distance from the cube's center
+				DirectX::XMVECTOR weight = DirectX::XMVectorMultiply(texelArea,
+					DirectX::XMVectorMultiply(invLength, DirectX::XMVectorMultiply(invLength, invLength)));
+
+				// Lanes past the end of a row (when the size isn't a
+				// multiple of four) read the last texel, and count for nothing
+				unsigned int texels[4];
+				for (unsigned int t = 0; t < 4; t++)
+					texels[t] = x + t < size ? x + t : size - 1;
+				if (x + 4 > size)
+					weight = DirectX::XMVectorSelect(weight, DirectX::XMVectorZero(),
+						DirectX::XMVectorGreaterOrEqual(lanes, DirectX::XMVectorReplicate((float)(size - x))));
+				weightSum = DirectX::XMVectorAdd(weightSum, weight);
+
+				// Four RGBA texels, turned into R, G and B for four texels
+				DirectX::XMMATRIX colors = DirectX::XMMatrixTranspose(DirectX::XMMATRIX(
+					DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)(row + texels[0] * 4)),
+					DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)(row + texels[1] * 4)),
+					DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)(row + texels[2] * 4)),
+					DirectX::XMLoadFloat4((const DirectX::XMFLOAT4*)(row + texels[3] * 4))));
+
+				DirectX::XMVECTOR basis[9] =
+				{
+					one,
+					dirY,
+					dirZ,
+					dirX,
+					DirectX::XMVectorMultiply(dirX, dirY),
+					DirectX::XMVectorMultiply(dirY, dirZ),
+					DirectX::XMVectorMultiplyAdd(DirectX::XMVectorMultiply(dirZ, dirZ), three, DirectX::XMVectorNegate(one)),
+					DirectX::XMVectorMultiply(dirX, dirZ),
+					DirectX::XMVectorSubtract(DirectX::XMVectorMultiply(dirX, dirX), DirectX::XMVectorMultiply(dirY, dirY))
+				};
+
+				for (unsigned int k = 0; k < 9; k++)
+				{
+					DirectX::XMVECTOR weighted = DirectX::XMVectorMultiply(basis[k], weight);
+					sums[k][0] = DirectX::XMVectorMultiplyAdd(weighted, colors.r[0], sums[k][0]);
+					sums[k][1] = DirectX::XMVectorMultiplyAdd(weighted, colors.r[1], sums[k][1]);
+					sums[k][2] = DirectX::XMVectorMultiplyAdd(weighted, colors.r[2], sums[k][2]);
+				}
+			}
+		}
+	}
+
+	// Adds up the lanes
+	float normalization = DirectX::XM_PI * 4.0f / DirectX::XMVectorGetX(DirectX::XMVectorSum(weightSum));
+	SH9 sh = {};
+	for (unsigned int k = 0; k < 9; k++)
+	{
+		float scale = basisConstants[k] * normalization;
+		sh.coefficients[k] = DirectX::XMFLOAT4(
+			DirectX::XMVectorGetX(DirectX::XMVectorSum(sums[k][0])) * scale,
+			DirectX::XMVectorGetX(DirectX::XMVectorSum(sums[k][1])) * scale,
+			DirectX::XMVectorGetX(DirectX::XMVectorSum(sums[k][2])) * scale,
+			0.0f);
+	}
+	return sh;
+}
+
+// --------------------------------------------------------
+// Convolving with the cosine lobe scales each band by its
+// own factor: pi, 2 pi / 3 and pi / 4.  Dividing by pi, for
+// Lambert's BRDF, leaves 1, 2/3 and 1/4.
+// --------------------------------------------------------
+void SphericalHarmonics::ConvolveLambert(SH9& sh)
+{
+	const float bandScales[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	for (unsigned int k = 0; k < 9; k++)
+	{
+		DirectX::XMVECTOR scaled = DirectX::XMVectorScale(DirectX::XMLoadFloat4(&sh.coefficients[k]), bandScales[k]);
+		DirectX::XMStoreFloat4(&sh.coefficients[k], scaled);
+	}
+}
+
+DirectX::XMVECTOR SphericalHarmonics::Evaluate(const SH9& sh, DirectX::FXMVECTOR direction)
+{
+	DirectX::XMFLOAT3 n;
+	DirectX::XMStoreFloat3(&n, DirectX::XMVector3Normalize(direction));
+	float polynomials[9] =
+	{
+		1.0f, n.y, n.z, n.x,
+		n.x * n.y, n.y * n.z, 3.0f * n.z * n.z - 1.0f, n.x * n.z, n.x * n.x - n.y * n.y
+	};
+
+	DirectX::XMVECTOR result = DirectX::XMVectorZero();
+	for (unsigned int k = 0; k < 9; k++)
+		result = DirectX::XMVectorMultiplyAdd(DirectX::XMLoadFloat4(&sh.coefficients[k]),
+			DirectX::XMVectorReplicate(basisConstants[k] * polynomials[k]), result);
+	return result;
+}
+
+void SphericalHarmonics::AddSample(SH9& sh, DirectX::FXMVECTOR direction, DirectX::FXMVECTOR radiance, float weight)
+{
+	DirectX::XMFLOAT3 n;
+	DirectX::XMStoreFloat3(&n, direction);
+	float polynomials[9] =
+	{
+		1.0f, n.y, n.z, n.x,
+		n.x * n.y, n.y * n.z, 3.0f * n.z * n.z - 1.0f, n.x * n.z, n.x * n.x - n.y * n.y
+	};
+
+	for (unsigned int k = 0; k < 9; k++)
+	{
+		DirectX::XMVECTOR sum = DirectX::XMVectorMultiplyAdd(radiance,
+			DirectX::XMVectorReplicate(basisConstants[k] * polynomials[k] * weight),
+			DirectX::XMLoadFloat4(&sh.coefficients[k]));
+		DirectX::XMStoreFloat4(&sh.coefficients[k], sum);
+	}
+}
+
+DirectX::XMVECTOR SphericalHarmonics::CubeDirection(unsigned int face, float u, float v)
+{
+	const float (*axes)[3] = faceAxes[face];
+	return DirectX::XMVectorSet(
+		axes[0][0] * u + axes[0][1] * v + axes[0][2],
+		axes[1][0] * u + axes[1][1] * v + axes[1][2],
+		axes[2][0] * u + axes[2][1] * v + axes[2][2],
+		0.0f);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <DirectXMath.h>
+
+// The first three bands of spherical harmonics, with an RGB
+// coefficient each (in xyz, w unused so they upload as is)
+struct SH9
+{
+	DirectX::XMFLOAT4 coefficients[9];
+};
+
+// --------------------------------------------------------
+// Projects a cubemap's radiance into spherical harmonics,
+// for diffuse ambient lighting (see Ambient.hlsli)
+//
+// - Needs nothing but DirectXMath, so it builds and runs
+//   off Windows as well, where it can be tested on its own
+// - Faces are in D3D order (+X, -X, +Y, -Y, +Z, -Z), each
+//   size x size RGBA floats with rows from the top down
+// - Four texels at once: their directions, basis functions
+//   and solid angles are worked out a lane per texel, with
+//   the colors transposed to match
+// --------------------------------------------------------
+class SphericalHarmonics
+{
+public:
+	static SH9 ProjectCubemap(const float* const faces[6], unsigned int size);
+
+	// Radiance to irradiance, divided by pi, so evaluating the
+	// result in a direction gives what a white Lambertian surface
+	// facing it reflects
+	static void ConvolveLambert(SH9& sh);
+
+	static DirectX::XMVECTOR Evaluate(const SH9& sh, DirectX::FXMVECTOR direction);
+
+	// Adds one sample of radiance from a (unit) direction, for
+	// projecting anything other than a cubemap - the weights of
+	// every sample should add up to 4 pi
+	static void AddSample(SH9& sh, DirectX::FXMVECTOR direction, DirectX::FXMVECTOR radiance, float weight);
+
+	// The (unnormalized) direction through a point on a face,
+	// with u and v from -1 to 1 across and down it
+	static DirectX::XMVECTOR CubeDirection(unsigned int face, float u, float v);
+};
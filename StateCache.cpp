@@ -0,0 +1,306 @@
+#include "StateCache.h"
+
+#define STAGE_VS 0
+#define STAGE_PS 1
+
+StateCache::StateCache(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+	:
+	context(context)
+{
+	context.As(&context1);
+	Invalidate();
+	ResetStats();
+}
+
+StateCache::~StateCache()
+{
+}
+
+ID3D11DeviceContext* StateCache::GetContext() { return context.Get(); }
+
+// --------------------------------------------------------
+// Forgets everything, so the next call of each kind is
+// always passed through to the context
+// --------------------------------------------------------
+void StateCache::Invalidate()
+{
+	knownLayout = false;
+	knownTopology = false;
+	knownIndexBuffer = false;
+	knownVS = false;
+	knownPS = false;
+	knownRasterizer = false;
+	knownViewport = false;
+	knownTargets = false;
+	knownDepthStencil = false;
+	knownVertexBuffers = 0;
+	for (unsigned int s = 0; s < 2; s++)
+	{
+		knownConstantBuffers[s] = 0;
+		knownSRVs[s] = 0;
+		knownSamplers[s] = 0;
+	}
+}
+
+unsigned int StateCache::GetIssuedCount() { return issued; }
+unsigned int StateCache::GetFilteredCount() { return filtered; }
+
+void StateCache::ResetStats()
+{
+	issued = 0;
+	filtered = 0;
+}
+
+// --------------------------------------------------------
+// Counts a call, returning true if it should be dropped
+// --------------------------------------------------------
+bool StateCache::Filter(bool redundant)
+{
+	if (redundant)
+		filtered++;
+	else
+		issued++;
+	return redundant;
+}
+
+void StateCache::IASetInputLayout(ID3D11InputLayout* layout)
+{
+	if (Filter(knownLayout && this->layout == layout))
+		return;
+
+	context->IASetInputLayout(layout);
+	this->layout = layout;
+	knownLayout = true;
+}
+
+void StateCache::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (Filter(knownTopology && this->topology == topology))
+		return;
+
+	context->IASetPrimitiveTopology(topology);
+	this->topology = topology;
+	knownTopology = true;
+}
+
+void StateCache::IASetVertexBuffers(unsigned int startSlot, unsigned int count, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets)
+{
+	bool redundant = startSlot + count <= STATE_CACHE_VERTEX_BUFFERS;
+	for (unsigned int i = 0; i < count && redundant; i++)
+	{
+		unsigned int slot = startSlot + i;
+		redundant =
+			(knownVertexBuffers & (1 << slot)) &&
+			vertexBuffers[slot] == buffers[i] &&
+			vertexStrides[slot] == strides[i] &&
+			vertexOffsets[slot] == offsets[i];
+	}
+	if (Filter(redundant))
+		return;
+
+	context->IASetVertexBuffers(startSlot, count, buffers, strides, offsets);
+	for (unsigned int i = 0; i < count && startSlot + i < STATE_CACHE_VERTEX_BUFFERS; i++)
+	{
+		unsigned int slot = startSlot + i;
+		vertexBuffers[slot] = buffers[i];
+		vertexStrides[slot] = strides[i];
+		vertexOffsets[slot] = offsets[i];
+		knownVertexBuffers |= 1 << slot;
+	}
+}
+
+void StateCache::IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	if (Filter(knownIndexBuffer && indexBuffer == buffer && indexFormat == format && indexOffset == offset))
+		return;
+
+	context->IASetIndexBuffer(buffer, format, offset);
+	indexBuffer = buffer;
+	indexFormat = format;
+	indexOffset = offset;
+	knownIndexBuffer = true;
+}
+
+void StateCache::VSSetShader(ID3D11VertexShader* shader)
+{
+	if (Filter(knownVS && vs == shader))
+		return;
+
+	context->VSSetShader(shader, 0, 0);
+	vs = shader;
+	knownVS = true;
+}
+
+void StateCache::PSSetShader(ID3D11PixelShader* shader)
+{
+	if (Filter(knownPS && ps == shader))
+		return;
+
+	context->PSSetShader(shader, 0, 0);
+	ps = shader;
+	knownPS = true;
+}
+
+// --------------------------------------------------------
+// Binds a constant buffer, or a range of one if constantCount
+// isn't zero (which needs an 11.1 context, see ConstantRing)
+// --------------------------------------------------------
+void StateCache::VSSetConstantBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	if (!SetConstantBuffer(STAGE_VS, slot, buffer, firstConstant, constantCount))
+		return;
+
+	if (constantCount == 0)
+		context->VSSetConstantBuffers(slot, 1, &buffer);
+	else if (context1)
+		context1->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+}
+
+void StateCache::PSSetConstantBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	if (!SetConstantBuffer(STAGE_PS, slot, buffer, firstConstant, constantCount))
+		return;
+
+	if (constantCount == 0)
+		context->PSSetConstantBuffers(slot, 1, &buffer);
+	else if (context1)
+		context1->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+}
+
+void StateCache::VSSetShaderResources(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	if (SetShaderResources(STAGE_VS, startSlot, count, srvs))
+		context->VSSetShaderResources(startSlot, count, srvs);
+}
+
+void StateCache::PSSetShaderResources(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	if (SetShaderResources(STAGE_PS, startSlot, count, srvs))
+		context->PSSetShaderResources(startSlot, count, srvs);
+}
+
+void StateCache::VSSetSamplers(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	if (SetSamplers(STAGE_VS, startSlot, count, samplers))
+		context->VSSetSamplers(startSlot, count, samplers);
+}
+
+void StateCache::PSSetSamplers(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	if (SetSamplers(STAGE_PS, startSlot, count, samplers))
+		context->PSSetSamplers(startSlot, count, samplers);
+}
+
+void StateCache::RSSetState(ID3D11RasterizerState* state)
+{
+	if (Filter(knownRasterizer && rasterizer == state))
+		return;
+
+	context->RSSetState(state);
+	rasterizer = state;
+	knownRasterizer = true;
+}
+
+void StateCache::RSSetViewport(const D3D11_VIEWPORT& viewport)
+{
+	if (Filter(knownViewport && memcmp(&this->viewport, &viewport, sizeof(D3D11_VIEWPORT)) == 0))
+		return;
+
+	context->RSSetViewports(1, &viewport);
+	this->viewport = viewport;
+	knownViewport = true;
+}
+
+void StateCache::OMSetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv)
+{
+	bool redundant = knownTargets && targetCount == count && this->dsv == dsv;
+	for (unsigned int i = 0; i < count && redundant; i++)
+		redundant = this->rtvs[i] == rtvs[i];
+	if (Filter(redundant))
+		return;
+
+	// The runtime unbinds any SRV of a resource that is now a
+	// target, without telling us which, so forget all of them
+	context->OMSetRenderTargets(count, rtvs, dsv);
+	knownSRVs[STAGE_VS] = 0;
+	knownSRVs[STAGE_PS] = 0;
+	targetCount = count < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT ? count : D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT;
+	for (unsigned int i = 0; i < targetCount; i++)
+		this->rtvs[i] = rtvs[i];
+	this->dsv = dsv;
+	knownTargets = true;
+}
+
+void StateCache::OMSetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef)
+{
+	if (Filter(knownDepthStencil && depthStencil == state && this->stencilRef == stencilRef))
+		return;
+
+	context->OMSetDepthStencilState(state, stencilRef);
+	depthStencil = state;
+	this->stencilRef = stencilRef;
+	knownDepthStencil = true;
+}
+
+// --------------------------------------------------------
+// The helpers below update the tracked state of a stage and
+// return true if the call needs to be passed on
+// --------------------------------------------------------
+bool StateCache::SetConstantBuffer(unsigned int stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount)
+{
+	if (slot >= STATE_CACHE_CONSTANT_BUFFERS)
+		return !Filter(false);
+
+	ConstantBinding& bound = stages[stage].constantBuffers[slot];
+	bool redundant =
+		(knownConstantBuffers[stage] & (1 << slot)) &&
+		bound.buffer == buffer &&
+		bound.firstConstant == firstConstant &&
+		bound.constantCount == constantCount;
+	if (Filter(redundant))
+		return false;
+
+	bound = { buffer, firstConstant, constantCount };
+	knownConstantBuffers[stage] |= 1 << slot;
+	return true;
+}
+
+bool StateCache::SetShaderResources(unsigned int stage, unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	StageState& state = stages[stage];
+	bool redundant = startSlot + count <= STATE_CACHE_SRVS;
+	for (unsigned int i = 0; i < count && redundant; i++)
+	{
+		unsigned int slot = startSlot + i;
+		redundant = (knownSRVs[stage] & (1 << slot)) && state.srvs[slot] == srvs[i];
+	}
+	if (Filter(redundant))
+		return false;
+
+	for (unsigned int i = 0; i < count && startSlot + i < STATE_CACHE_SRVS; i++)
+	{
+		state.srvs[startSlot + i] = srvs[i];
+		knownSRVs[stage] |= 1 << (startSlot + i);
+	}
+	return true;
+}
+
+bool StateCache::SetSamplers(unsigned int stage, unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	StageState& state = stages[stage];
+	bool redundant = startSlot + count <= STATE_CACHE_SAMPLERS;
+	for (unsigned int i = 0; i < count && redundant; i++)
+	{
+		unsigned int slot = startSlot + i;
+		redundant = (knownSamplers[stage] & (1 << slot)) && state.samplers[slot] == samplers[i];
+	}
+	if (Filter(redundant))
+		return false;
+
+	for (unsigned int i = 0; i < count && startSlot + i < STATE_CACHE_SAMPLERS; i++)
+	{
+		state.samplers[startSlot + i] = samplers[i];
+		knownSamplers[stage] |= 1 << (startSlot + i);
+	}
+	return true;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <wrl/client.h>
+
+// How many slots of each kind are tracked - calls touching
+// higher slots are always passed straight through
+#define STATE_CACHE_VERTEX_BUFFERS	4
+#define STATE_CACHE_CONSTANT_BUFFERS	D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+#define STATE_CACHE_SRVS			16
+#define STATE_CACHE_SAMPLERS		D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT
+
+// --------------------------------------------------------
+// Thin wrapper around a device context that remembers what
+// it last bound, and drops calls that would bind the same
+// thing again
+//
+// - Only sees calls made through it.  Anything that binds
+//   state on the context directly (or resets it, such as
+//   FinishCommandList, ExecuteCommandList or ImGui) must be
+//   followed by Invalidate() before the cache is used again.
+// - Not thread safe; use one per context
+// --------------------------------------------------------
+class StateCache
+{
+public:
+	StateCache(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	~StateCache();
+
+	ID3D11DeviceContext* GetContext();
+	void Invalidate();
+
+	// Input assembler
+	void IASetInputLayout(ID3D11InputLayout* layout);
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void IASetVertexBuffers(unsigned int startSlot, unsigned int count, ID3D11Buffer* const* buffers, const UINT* strides, const UINT* offsets);
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+
+	// Shaders and their resources
+	void VSSetShader(ID3D11VertexShader* shader);
+	void PSSetShader(ID3D11PixelShader* shader);
+	void VSSetConstantBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant = 0, unsigned int constantCount = 0);
+	void PSSetConstantBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant = 0, unsigned int constantCount = 0);
+	void VSSetShaderResources(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void PSSetShaderResources(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void VSSetSamplers(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+	void PSSetSamplers(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+
+	// Rasterizer and output merger
+	void RSSetState(ID3D11RasterizerState* state);
+	void RSSetViewport(const D3D11_VIEWPORT& viewport);
+	void OMSetRenderTargets(unsigned int count, ID3D11RenderTargetView* const* rtvs, ID3D11DepthStencilView* dsv);
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef);
+
+	// Calls passed on to the context and calls dropped,
+	// since the last ResetStats()
+	unsigned int GetIssuedCount();
+	unsigned int GetFilteredCount();
+	void ResetStats();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext1> context1; // For offset constant buffers, may be null
+
+	// A constant buffer binding, optionally a range of the buffer
+	struct ConstantBinding
+	{
+		ID3D11Buffer* buffer;
+		unsigned int firstConstant;
+		unsigned int constantCount; // Zero for the whole buffer
+	};
+
+	// Everything tracked for one shader stage
+	struct StageState
+	{
+		ConstantBinding constantBuffers[STATE_CACHE_CONSTANT_BUFFERS];
+		ID3D11ShaderResourceView* srvs[STATE_CACHE_SRVS];
+		ID3D11SamplerState* samplers[STATE_CACHE_SAMPLERS];
+	};
+
+	// The last bound state, only meaningful where the matching
+	// known flag (or known bit) is set
+	bool knownLayout, knownTopology, knownIndexBuffer, knownVS, knownPS;
+	bool knownRasterizer, knownViewport, knownTargets, knownDepthStencil;
+	unsigned int knownVertexBuffers;
+	unsigned int knownConstantBuffers[2];
+	unsigned int knownSRVs[2];
+	unsigned int knownSamplers[2];
+
+	ID3D11InputLayout* layout;
+	D3D11_PRIMITIVE_TOPOLOGY topology;
+	ID3D11Buffer* vertexBuffers[STATE_CACHE_VERTEX_BUFFERS];
+	UINT vertexStrides[STATE_CACHE_VERTEX_BUFFERS];
+	UINT vertexOffsets[STATE_CACHE_VERTEX_BUFFERS];
+	ID3D11Buffer* indexBuffer;
+	DXGI_FORMAT indexFormat;
+	unsigned int indexOffset;
+	ID3D11VertexShader* vs;
+	ID3D11PixelShader* ps;
+	StageState stages[2]; // Vertex, pixel
+	ID3D11RasterizerState* rasterizer;
+	D3D11_VIEWPORT viewport;
+	unsigned int targetCount;
+	ID3D11RenderTargetView* rtvs[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+	ID3D11DepthStencilView* dsv;
+	ID3D11DepthStencilState* depthStencil;
+	unsigned int stencilRef;
+
+	unsigned int issued;
+	unsigned int filtered;
+
+	// Shared by the vertex and pixel shader versions
+	bool SetConstantBuffer(unsigned int stage, unsigned int slot, ID3D11Buffer* buffer, unsigned int firstConstant, unsigned int constantCount);
+	bool SetShaderResources(unsigned int stage, unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	bool SetSamplers(unsigned int stage, unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+	bool Filter(bool redundant);
+};
@@ -0,0 +1,144 @@
+#include "StateObjectCache.h"
+#include <cassert>
+#include <cstring>
+
+// --------------------------------------------------------
+// FNV-1a over the bytes of a description
+// --------------------------------------------------------
+static uint64_t HashBytes(const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// --------------------------------------------------------
+// Copies of descriptions with any padding bytes zeroed, so
+// equal descriptions always hash and compare as equal.  The
+// rasterizer and sampler descriptions have no padding.
+// --------------------------------------------------------
+static D3D11_DEPTH_STENCIL_DESC Normalize(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	D3D11_DEPTH_STENCIL_DESC out;
+	memset(&out, 0, sizeof(out));
+	out.DepthEnable = desc.DepthEnable;
+	out.DepthWriteMask = desc.DepthWriteMask;
+	out.DepthFunc = desc.DepthFunc;
+	out.StencilEnable = desc.StencilEnable;
+	out.StencilReadMask = desc.StencilReadMask;
+	out.StencilWriteMask = desc.StencilWriteMask;
+	out.FrontFace = desc.FrontFace;
+	out.BackFace = desc.BackFace;
+	return out;
+}
+
+static D3D11_BLEND_DESC Normalize(const D3D11_BLEND_DESC& desc)
+{
+	D3D11_BLEND_DESC out;
+	memset(&out, 0, sizeof(out));
+	out.AlphaToCoverageEnable = desc.AlphaToCoverageEnable;
+	out.IndependentBlendEnable = desc.IndependentBlendEnable;
+	for (unsigned int i = 0; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; i++)
+	{
+		const D3D11_RENDER_TARGET_BLEND_DESC& src = desc.RenderTarget[i];
+		D3D11_RENDER_TARGET_BLEND_DESC& dst = out.RenderTarget[i];
+		dst.BlendEnable = src.BlendEnable;
+		dst.SrcBlend = src.SrcBlend;
+		dst.DestBlend = src.DestBlend;
+		dst.BlendOp = src.BlendOp;
+		dst.SrcBlendAlpha = src.SrcBlendAlpha;
+		dst.DestBlendAlpha = src.DestBlendAlpha;
+		dst.BlendOpAlpha = src.BlendOpAlpha;
+		dst.RenderTargetWriteMask = src.RenderTargetWriteMask;
+	}
+	return out;
+}
+
+StateObjectCache::StateObjectCache(Microsoft::WRL::ComPtr<ID3D11Device> device)
+	:
+	device(device),
+	frozen(false),
+	stateCount(0),
+	lateCreations(0)
+{
+}
+
+StateObjectCache::~StateObjectCache()
+{
+}
+
+// --------------------------------------------------------
+// Ends loading - from here on the cache never changes
+// --------------------------------------------------------
+void StateObjectCache::Freeze() { frozen = true; }
+bool StateObjectCache::IsFrozen() { return frozen; }
+unsigned int StateObjectCache::GetStateCount() { return stateCount; }
+unsigned int StateObjectCache::GetLateCreationCount() { return lateCreations; }
+
+Microsoft::WRL::ComPtr<ID3D11RasterizerState> StateObjectCache::GetRasterizerState(const D3D11_RASTERIZER_DESC& desc)
+{
+	return Find(rasterizerStates, desc, [&](const D3D11_RASTERIZER_DESC& d, ID3D11RasterizerState** state) {
+		return device->CreateRasterizerState(&d, state);
+	});
+}
+
+Microsoft::WRL::ComPtr<ID3D11DepthStencilState> StateObjectCache::GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc)
+{
+	return Find(depthStencilStates, Normalize(desc), [&](const D3D11_DEPTH_STENCIL_DESC& d, ID3D11DepthStencilState** state) {
+		return device->CreateDepthStencilState(&d, state);
+	});
+}
+
+Microsoft::WRL::ComPtr<ID3D11BlendState> StateObjectCache::GetBlendState(const D3D11_BLEND_DESC& desc)
+{
+	return Find(blendStates, Normalize(desc), [&](const D3D11_BLEND_DESC& d, ID3D11BlendState** state) {
+		return device->CreateBlendState(&d, state);
+	});
+}
+
+Microsoft::WRL::ComPtr<ID3D11SamplerState> StateObjectCache::GetSamplerState(const D3D11_SAMPLER_DESC& desc)
+{
+	return Find(samplerStates, desc, [&](const D3D11_SAMPLER_DESC& d, ID3D11SamplerState** state) {
+		return device->CreateSamplerState(&d, state);
+	});
+}
+
+// --------------------------------------------------------
+// Looks a description up in one of the tables, creating
+// (and before Freeze(), caching) its state on a miss
+// --------------------------------------------------------
+template<typename Desc, typename State, typename Create>
+Microsoft::WRL::ComPtr<State> StateObjectCache::Find(Table<Desc, State>& table, const Desc& desc, Create create)
+{
+	uint64_t hash = HashBytes(&desc, sizeof(Desc));
+
+	auto bucket = table.find(hash);
+	if (bucket != table.end())
+	{
+		for (auto& entry : bucket->second)
+		{
+			if (memcmp(&entry.desc, &desc, sizeof(Desc)) == 0)
+				return entry.state;
+		}
+	}
+
+	Microsoft::WRL::ComPtr<State> state;
+	create(desc, state.GetAddressOf());
+
+	// Inserting now could race with other threads' lookups
+	assert(!frozen && "State object created after StateObjectCache::Freeze()");
+	if (frozen)
+	{
+		lateCreations++;
+		return state;
+	}
+
+	table[hash].push_back({ desc, state });
+	stateCount++;
+	return state;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+
+// --------------------------------------------------------
+// Owns every rasterizer, depth-stencil, blend and sampler
+// state, so a description is only ever turned into a state
+// object once and equal descriptions share one object
+//
+// - States are looked up by a hash of their description
+// - Create everything while loading, then call Freeze().
+//   After that the cache is read only, so any thread can
+//   look states up without a lock.  A lookup that misses
+//   after Freeze() asserts in debug builds, and in release
+//   creates an uncached state and counts it (see
+//   GetLateCreationCount) so the mistake is visible.
+// --------------------------------------------------------
+class StateObjectCache
+{
+public:
+	StateObjectCache(Microsoft::WRL::ComPtr<ID3D11Device> device);
+	~StateObjectCache();
+
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> GetRasterizerState(const D3D11_RASTERIZER_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> GetDepthStencilState(const D3D11_DEPTH_STENCIL_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11BlendState> GetBlendState(const D3D11_BLEND_DESC& desc);
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> GetSamplerState(const D3D11_SAMPLER_DESC& desc);
+
+	void Freeze();
+	bool IsFrozen();
+	unsigned int GetStateCount();
+	unsigned int GetLateCreationCount();
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	bool frozen;
+	unsigned int stateCount;
+	std::atomic<unsigned int> lateCreations; // May happen on any thread
+
+	// One description and its state, several per hash only
+	// if two descriptions collide
+	template<typename Desc, typename State>
+	struct Entry
+	{
+		Desc desc;
+		Microsoft::WRL::ComPtr<State> state;
+	};
+	template<typename Desc, typename State>
+	using Table = std::unordered_map<uint64_t, std::vector<Entry<Desc, State>>>;
+
+	Table<D3D11_RASTERIZER_DESC, ID3D11RasterizerState> rasterizerStates;
+	Table<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState> depthStencilStates;
+	Table<D3D11_BLEND_DESC, ID3D11BlendState> blendStates;
+	Table<D3D11_SAMPLER_DESC, ID3D11SamplerState> samplerStates;
+
+	template<typename Desc, typename State, typename Create>
+	Microsoft::WRL::ComPtr<State> Find(Table<Desc, State>& table, const Desc& desc, Create create);
+};
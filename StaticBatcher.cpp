@@ -0,0 +1,164 @@
+#include "StaticBatcher.h"
+#include <set>
+#include <cmath>
+
+using namespace DirectX;
+
+// GPU memory used by a mesh's vertex and index buffers
+static size_t MeshBytes(Mesh* mesh)
+{
+	return
+		mesh->GetVertices().size() * sizeof(Vertex) +
+		mesh->GetIndices().size() * sizeof(unsigned int);
+}
+
+// --------------------------------------------------------
+// chunkSize - Width (in world units) of each grid cell.
+//             Bigger chunks mean fewer draws, but coarser
+//             culling, so more off screen triangles drawn.
+// --------------------------------------------------------
+StaticBatcher::StaticBatcher(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	float chunkSize)
+	:
+	device(device),
+	context(context),
+	chunkSize(chunkSize),
+	staticEntityCount(0),
+	lastRebuildCount(0),
+	sourceBytes(0)
+{
+}
+
+StaticBatcher::~StaticBatcher()
+{
+}
+
+// --------------------------------------------------------
+// Regroups the static entities, then recreates only the
+// chunks whose set of members is different from last time
+// - Static entities are assumed not to have moved, so a
+//   chunk with the same members is left alone
+// --------------------------------------------------------
+void StaticBatcher::Rebuild(const std::vector<std::shared_ptr<GameEntity>>& entities)
+{
+	std::map<ChunkKey, std::vector<std::shared_ptr<GameEntity>>> groups;
+	std::set<Mesh*> sourceMeshes;
+	staticEntityCount = 0;
+	sourceBytes = 0;
+
+	for (auto& e : entities)
+	{
+		if (!e->IsStatic())
+			continue;
+
+		XMFLOAT3 center = e->GetWorldBounds().Center;
+		ChunkKey key(
+			e->GetMaterial()->GetId(),
+			(int)floorf(center.x / chunkSize),
+			(int)floorf(center.z / chunkSize));
+		groups[key].push_back(e);
+		staticEntityCount++;
+
+		if (sourceMeshes.insert(e->GetMesh().get()).second)
+			sourceBytes += MeshBytes(e->GetMesh().get());
+	}
+
+	// Chunks with no members left
+	for (auto it = chunks.begin(); it != chunks.end();)
+	{
+		if (groups.find(it->first) == groups.end())
+			it = chunks.erase(it);
+		else
+			++it;
+	}
+
+	// New chunks, or ones that gained or lost members
+	lastRebuildCount = 0;
+	for (auto& g : groups)
+	{
+		Chunk& chunk = chunks[g.first];
+		if (chunk.members == g.second)
+			continue;
+
+		chunk.members = g.second;
+		BuildChunk(chunk);
+		lastRebuildCount++;
+	}
+}
+
+// --------------------------------------------------------
+// Appends the entity of every chunk, for drawing
+// --------------------------------------------------------
+void StaticBatcher::GetChunkEntities(std::vector<std::shared_ptr<GameEntity>>& out)
+{
+	for (auto& c : chunks)
+	{
+		if (c.second.entity)
+			out.push_back(c.second.entity);
+	}
+}
+
+unsigned int StaticBatcher::GetChunkCount() { return (unsigned int)chunks.size(); }
+unsigned int StaticBatcher::GetStaticEntityCount() { return staticEntityCount; }
+unsigned int StaticBatcher::GetLastRebuildCount() { return lastRebuildCount; }
+size_t StaticBatcher::GetSourceBytes() { return sourceBytes; }
+
+size_t StaticBatcher::GetMergedBytes()
+{
+	size_t bytes = 0;
+	for (auto& c : chunks)
+		bytes += c.second.bytes;
+	return bytes;
+}
+
+// --------------------------------------------------------
+// Transforms every member's vertices into world space and
+// merges them into a single mesh for the chunk
+// --------------------------------------------------------
+void StaticBatcher::BuildChunk(Chunk& chunk)
+{
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+
+	for (auto& e : chunk.members)
+	{
+		std::shared_ptr<Transform> transform = e->GetTransform();
+		XMFLOAT4X4 worldMatrix = transform->GetWorldMatrix();
+		XMFLOAT4X4 worldInvTransposeMatrix = transform->GetWorldInverseTransposeMatrix();
+		XMMATRIX world = XMLoadFloat4x4(&worldMatrix);
+		XMMATRIX worldInvTranspose = XMLoadFloat4x4(&worldInvTransposeMatrix);
+
+		unsigned int baseVertex = (unsigned int)vertices.size();
+		for (const Vertex& v : e->GetMesh()->GetVertices())
+		{
+			Vertex worldVertex = v;
+			XMStoreFloat3(&worldVertex.position, XMVector3TransformCoord(XMLoadFloat3(&v.position), world));
+			XMStoreFloat3(&worldVertex.normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&v.normal), worldInvTranspose)));
+			XMStoreFloat3(&worldVertex.tangent, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&v.tangent), world)));
+			vertices.push_back(worldVertex);
+		}
+		for (unsigned int index : e->GetMesh()->GetIndices())
+			indices.push_back(index + baseVertex);
+	}
+
+	// Nothing to draw (the members' meshes failed to load)
+	if (vertices.empty())
+	{
+		chunk.entity.reset();
+		chunk.bytes = 0;
+		return;
+	}
+
+	std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(
+		&vertices[0],
+		(int)vertices.size(),
+		&indices[0],
+		(int)indices.size(),
+		device,
+		context);
+	chunk.entity = std::make_shared<GameEntity>(mesh, chunk.members[0]->GetMaterial());
+	chunk.entity->SetStatic(true);
+	chunk.bytes = MeshBytes(mesh.get());
+}
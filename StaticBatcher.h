@@ -0,0 +1,64 @@
+#pragma once
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <memory>
+#include <vector>
+#include <map>
+#include <tuple>
+#include "GameEntity.h"
+
+// --------------------------------------------------------
+// Merges static entities into a few large meshes
+// - Static entities sharing a material are grouped by which
+//   cell of a grid (on the XZ plane) their bounds center is
+//   in, and each group is pre-transformed into world space
+//   and merged into one mesh, called a chunk
+// - Each chunk is drawn through an entity with an identity
+//   transform, so it is culled by its own bounds and goes
+//   through the same draw paths as everything else
+// - Rebuild() only recreates chunks whose members changed
+// --------------------------------------------------------
+class StaticBatcher
+{
+public:
+	StaticBatcher(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		float chunkSize);
+	~StaticBatcher();
+
+	void Rebuild(const std::vector<std::shared_ptr<GameEntity>>& entities);
+	void GetChunkEntities(std::vector<std::shared_ptr<GameEntity>>& out);
+
+	// Stats
+	unsigned int GetChunkCount();
+	unsigned int GetStaticEntityCount();
+	unsigned int GetLastRebuildCount();	// Chunks recreated by the last Rebuild()
+	size_t GetMergedBytes();			// GPU memory used by all chunks
+	size_t GetSourceBytes();			// GPU memory of the meshes they replace
+
+private:
+	// Material ID, cell X, cell Z
+	typedef std::tuple<unsigned int, int, int> ChunkKey;
+
+	struct Chunk
+	{
+		// Kept alive so a member can't be freed and another
+		// entity created at the same address, which would
+		// fool the "did the members change" check
+		std::vector<std::shared_ptr<GameEntity>> members;
+		std::shared_ptr<GameEntity> entity;
+		size_t bytes;
+	};
+
+	void BuildChunk(Chunk& chunk);
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	float chunkSize;
+
+	std::map<ChunkKey, Chunk> chunks;
+	unsigned int staticEntityCount;
+	unsigned int lastRebuildCount;
+	size_t sourceBytes;
+};
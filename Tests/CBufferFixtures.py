@@ -0,0 +1,293 @@
+# --------------------------------------------------------
+# Builds compiled shaders for GenerateCBufferStructsTests.py
+# to read: a DXBC container holding just an RDEF chunk, laid
+# out as fxc writes it for shader model 5
+#
+# - Every offset and size is worked out with HLSL's packing
+#   rules, not written by hand, so the fixtures say what the
+#   shader compiler would
+# - Only what the generator reads is filled in; there's no
+#   bytecode, signature or checksum
+# --------------------------------------------------------
+import struct
+
+# D3D_SHADER_VARIABLE_CLASS
+SVC_SCALAR = 0
+SVC_VECTOR = 1
+SVC_MATRIX_COLUMNS = 3
+SVC_STRUCT = 5
+
+# D3D_SHADER_VARIABLE_TYPE
+SVT_INT = 2
+SVT_FLOAT = 3
+SVT_UINT = 19
+
+CT_CBUFFER = 0
+CT_RESOURCE_BIND_INFO = 3
+SIT_CBUFFER = 0
+SIT_STRUCTURED = 5
+
+BASE_NAMES = {SVT_INT: 'int', SVT_FLOAT: 'float', SVT_UINT: 'uint'}
+
+
+class Type:
+    def __init__(self, cls, base, rows, columns, name, elements=0, members=None):
+        self.cls = cls
+        self.base = base
+        self.rows = rows
+        self.columns = columns
+        self.name = name
+        self.elements = elements
+        self.members = []  # (name, offset, Type), once laid out
+        if members is not None:
+            self.members, _ = layout(members)
+
+
+def scalar(base):
+    return Type(SVC_SCALAR, base, 1, 1, BASE_NAMES[base])
+
+
+def vector(base, columns):
+    return Type(SVC_VECTOR, base, 1, columns, '%s%d' % (BASE_NAMES[base], columns))
+
+
+def matrix(rows, columns):
+    return Type(SVC_MATRIX_COLUMNS, SVT_FLOAT, rows, columns, 'float%dx%d' % (rows, columns))
+
+
+def structure(name, members):
+    """members is a list of (name, Type), laid out as HLSL would"""
+    return Type(SVC_STRUCT, 0, 1, 0, name, members=members)
+
+
+def array(type, elements):
+    copy = Type(type.cls, type.base, type.rows, type.columns, type.name, elements)
+    copy.members = type.members
+    return copy
+
+
+def element_size(type):
+    if type.cls == SVC_STRUCT:
+        return max([offset + variable_size(member) for _, offset, member in type.members] or [0])
+    if type.cls == SVC_MATRIX_COLUMNS:
+        return 16 * (type.columns - 1) + 4 * type.rows
+    return 4 * type.columns
+
+
+def variable_size(type):
+    """Arrays pad every element but the last to 16 bytes"""
+    size = element_size(type)
+    if type.elements == 0:
+        return size
+    return (size + 15) // 16 * 16 * (type.elements - 1) + size
+
+
+def layout(members):
+    """Offsets for a cbuffer's or struct's members: structs,
+    arrays and matrices start a new register, and nothing
+    else may straddle one"""
+    offset = 0
+    laid = []
+    for name, type in members:
+        size = variable_size(type)
+        if type.cls in (SVC_STRUCT, SVC_MATRIX_COLUMNS) or type.elements or offset % 16 + size > 16:
+            offset = (offset + 15) // 16 * 16
+        laid.append((name, offset, type))
+        offset += size
+    return laid, offset
+
+
+class ConstantBuffer:
+    def __init__(self, name, register, members):
+        self.name = name
+        self.register = register
+        self.variables, end = layout(members)
+        self.size = (end + 15) // 16 * 16
+        self.structured = False
+
+
+class StructuredBuffer:
+    def __init__(self, name, register, element):
+        self.name = name
+        self.register = register
+        self.variables = [('$Element', 0, element)]
+        self.size = element_size(element)
+        self.structured = True
+
+
+# --------------------------------------------------------
+# Writing the blob
+# --------------------------------------------------------
+class Writer:
+    def __init__(self):
+        self.data = bytearray()
+        self.strings = []  # (position of the offset to patch, string)
+
+    def append(self, fmt, *values):
+        position = len(self.data)
+        self.data += struct.pack(fmt, *values)
+        return position
+
+    def patch(self, position, fmt, *values):
+        struct.pack_into(fmt, self.data, position, *values)
+
+    def string_at(self, position, string):
+        self.strings.append((position, string))
+
+    def write_strings(self):
+        written = {}
+        for position, string in self.strings:
+            if string not in written:
+                written[string] = len(self.data)
+                self.data += string.encode('ascii') + b'\0'
+            self.patch(position, '<I', written[string])
+
+
+def write_type(writer, type):
+    position = writer.append('<6HI', 0, 0, 0, 0, 0, 0, 0)
+    writer.append('<5I', 0, 0, 0, 0, 0)
+    member_offset = 0
+    if type.members:
+        member_offset = len(writer.data)
+        writer.append('<%dI' % (3 * len(type.members)), *([0] * 3 * len(type.members)))
+        for m, (name, offset, member) in enumerate(type.members):
+            start = member_offset + 12 * m
+            writer.string_at(start, name)
+            writer.patch(start + 4, '<2I', write_type(writer, member), offset)
+    writer.patch(position, '<6HI', type.cls, type.base, type.rows, type.columns, type.elements, len(type.members), member_offset)
+    writer.string_at(position + 32, type.name)
+    return position
+
+
+def make_shader(buffers):
+    """A compiled shader whose reflection lists these buffers"""
+    writer = Writer()
+    writer.append('<28x')  # Header, patched at the end
+    writer.append('<4s7I', b'RD11', 60, 24, 32, 40, 36, 12, 0)
+
+    cb_offset = len(writer.data)
+    for buffer in buffers:
+        position = writer.append('<6I', 0, len(buffer.variables), 0, buffer.size, 0,
+                                 CT_RESOURCE_BIND_INFO if buffer.structured else CT_CBUFFER)
+        writer.string_at(position, buffer.name)
+
+    bind_offset = len(writer.data)
+    for buffer in buffers:
+        position = writer.append('<8I', 0, SIT_STRUCTURED if buffer.structured else SIT_CBUFFER,
+                                 0, 0, 0, buffer.register, 1, 0)
+        writer.string_at(position, buffer.name)
+
+    for b, buffer in enumerate(buffers):
+        writer.patch(cb_offset + 24 * b + 8, '<I', len(writer.data))
+        variables = []
+        for name, offset, type in buffer.variables:
+            position = writer.append('<10I', 0, offset, variable_size(type), 2, 0, 0, 0xFFFFFFFF, 0, 0xFFFFFFFF, 0)
+            writer.string_at(position, name)
+            variables.append((position, type))
+        for position, type in variables:
+            writer.patch(position + 16, '<I', write_type(writer, type))
+
+    writer.write_strings()
+    writer.patch(0, '<4I', len(buffers), cb_offset, len(buffers), bind_offset)
+    writer.patch(16, '<2BH', 0, 5, 0xFFFF)  # ps_5_0
+
+    chunk = b'RDEF' + struct.pack('<I', len(writer.data)) + bytes(writer.data)
+    header_size = 32 + 4  # One chunk
+    return b'DXBC' + bytes(16) + struct.pack('<4I', 1, header_size + len(chunk), 1, header_size) + chunk
+
+
+# --------------------------------------------------------
+# The fixtures
+# --------------------------------------------------------
+FLOAT = scalar(SVT_FLOAT)
+INT = scalar(SVT_INT)
+UINT = scalar(SVT_UINT)
+FLOAT2 = vector(SVT_FLOAT, 2)
+FLOAT3 = vector(SVT_FLOAT, 3)
+FLOAT4 = vector(SVT_FLOAT, 4)
+UINT3 = vector(SVT_UINT, 3)
+UINT4 = vector(SVT_UINT, 4)
+FLOAT4X4 = matrix(4, 4)
+
+LIGHT = structure('Light', [
+    ('type', INT),
+    ('direction', FLOAT3),
+    ('range', FLOAT),
+    ('position', FLOAT3),
+    ('intensity', FLOAT),
+    ('color', FLOAT3),
+    ('spotFallOff', FLOAT),
+    ('shadowView', INT),
+    ('padding', FLOAT2),
+])
+
+
+def scene_shader():
+    """Buffers shaped like the engine's: vectors packed with
+    the scalars after them, an array, and structured buffers"""
+    return make_shader([
+        ConstantBuffer('PerFrame', 0, [
+            ('cameraPos', FLOAT3),
+            ('lightCount', UINT),
+            ('clusterCounts', UINT3),
+            ('depthScale', FLOAT),
+            ('tileScale', FLOAT2),
+            ('depthBias', FLOAT),
+        ]),
+        ConstantBuffer('PerObject', 1, [
+            ('world', FLOAT4X4),
+            ('colorTint', FLOAT4),
+        ]),
+        ConstantBuffer('Ambient', 3, [
+            ('irradiance', array(FLOAT4, 9)),
+            ('intensity', FLOAT),
+        ]),
+        StructuredBuffer('Lights', 5, LIGHT),
+        StructuredBuffer('Indices', 6, UINT),
+    ])
+
+
+def tricky_shader():
+    """What C++ can only match with padding: scalars and small
+    vectors pushed to the next register, arrays of types under
+    16 bytes, a struct array, and a nested struct"""
+    inner = structure('Inner', [('a', FLOAT), ('b', FLOAT3)])
+    outer = structure('Outer', [('inner', inner), ('scale', FLOAT), ('tail', FLOAT2)])
+    return make_shader([
+        ConstantBuffer('Tricky', 2, [
+            ('a', FLOAT),
+            ('b', FLOAT2),
+            ('c', FLOAT3),
+            ('scalars', array(FLOAT, 3)),
+            ('d', UINT4),
+            ('lights', array(LIGHT, 2)),
+            ('after', FLOAT),
+            ('nested', outer),
+            ('last', FLOAT2),
+        ]),
+    ])
+
+
+def overlap_shader():
+    """HLSL packs x into the padding of the array's last
+    element, where the C++ array still has its padding"""
+    return make_shader([
+        ConstantBuffer('Overlap', 0, [
+            ('values', array(FLOAT, 2)),
+            ('x', FLOAT),
+        ]),
+    ])
+
+
+def unsupported_shader():
+    """A 3x3 matrix, which has no DirectXMath type to map to"""
+    return make_shader([
+        ConstantBuffer('Unsupported', 0, [('rotation', matrix(3, 3))]),
+    ])
+
+
+def no_rdef_shader():
+    """A container with no reflection in it"""
+    chunk = b'SHEX' + struct.pack('<I', 4) + bytes(4)
+    header_size = 32 + 4
+    return b'DXBC' + bytes(16) + struct.pack('<4I', 1, header_size + len(chunk), 1, header_size) + chunk
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdio>
+
+// --------------------------------------------------------
+// The few checks the Linux tests need, without a test
+// framework to fetch: a failed CHECK prints where it was and
+// carries on, and the test's main() returns CheckResult()
+// so ctest sees the failure
+// --------------------------------------------------------
+
+inline unsigned int& CheckFailures()
+{
+	static unsigned int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			CheckFailures()++; \
+		} \
+	} while (0)
+
+#define CHECK_NEAR(a, b, tolerance) \
+	do \
+	{ \
+		double checkA_ = (a), checkB_ = (b); \
+		if (!(checkA_ - checkB_ <= (tolerance) && checkB_ - checkA_ <= (tolerance))) \
+		{ \
+			std::printf("%s:%d: CHECK_NEAR(%s, %s) failed: %g vs %g\n", __FILE__, __LINE__, #a, #b, checkA_, checkB_); \
+			CheckFailures()++; \
+		} \
+	} while (0)
+
+inline int CheckResult(const char* name)
+{
+	if (CheckFailures() == 0)
+	{
+		std::printf("%s: all checks passed\n", name);
+		return 0;
+	}
+	std::printf("%s: %u checks failed\n", name, CheckFailures());
+	return 1;
+}
@@ -0,0 +1,217 @@
+#!/usr/bin/env python3
+# --------------------------------------------------------
+# Tests for Tools/GenerateCBufferStructs.py, run against the
+# compiled shaders CBufferFixtures.py builds
+#
+# Usage:
+#   GenerateCBufferStructsTests.py [--cxx g++] [-I dir]...
+#
+# The generated headers are compiled with the C++ compiler,
+# so their static_asserts check every offset; the -I folders
+# must hold DirectXMath.h (and sal.h, off Windows).
+# --------------------------------------------------------
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, TESTS_DIR)
+sys.path.insert(0, os.path.join(TESTS_DIR, '..', 'Tools'))
+
+import CBufferFixtures
+import GenerateCBufferStructs
+
+GENERATOR = os.path.join(TESTS_DIR, '..', 'Tools', 'GenerateCBufferStructs.py')
+CXX = 'g++'
+INCLUDE_DIRS = []
+
+
+class GeneratorTests(unittest.TestCase):
+    def setUp(self):
+        self.folder = tempfile.TemporaryDirectory()
+        self.addCleanup(self.folder.cleanup)
+
+    def write(self, name, data):
+        path = os.path.join(self.folder.name, name)
+        with open(path, 'wb') as f:
+            f.write(data)
+        return path
+
+    def run_generator(self, *args):
+        return subprocess.run([sys.executable, GENERATOR] + list(args), capture_output=True, text=True)
+
+    def compile(self, header, source):
+        """Compiles and runs a program including the header"""
+        path = os.path.join(self.folder.name, 'Check.cpp')
+        with open(path, 'w') as f:
+            f.write('#include "%s"\n%s' % (os.path.basename(header), source))
+        program = os.path.join(self.folder.name, 'Check')
+        command = [CXX, '-std=c++17', '-Wall', '-Wextra', '-o', program, path]
+        for folder in INCLUDE_DIRS:
+            command += ['-I', folder]
+        compiled = subprocess.run(command, capture_output=True, text=True)
+        self.assertEqual(compiled.returncode, 0, compiled.stderr)
+        ran = subprocess.run([program], capture_output=True, text=True)
+        self.assertEqual(ran.returncode, 0, ran.stdout)
+
+    # ----------------------------------------------------
+    # Reading the reflection
+    # ----------------------------------------------------
+    def test_reads_buffers_and_registers(self):
+        buffers = GenerateCBufferStructs.read_constant_buffers(CBufferFixtures.scene_shader())
+        self.assertEqual([(b.name, b.register, b.size, b.structured) for b in buffers], [
+            ('PerFrame', 0, 48, False),
+            ('PerObject', 1, 80, False),
+            ('Ambient', 3, 160, False),
+            ('Lights', 5, 64, True),
+            ('Indices', 6, 4, True),
+        ])
+        per_frame = buffers[0]
+        self.assertEqual([(v.name, v.offset, v.size) for v in per_frame.variables], [
+            ('cameraPos', 0, 12),
+            ('lightCount', 12, 4),
+            ('clusterCounts', 16, 12),
+            ('depthScale', 28, 4),
+            ('tileScale', 32, 8),
+            ('depthBias', 40, 4),
+        ])
+
+    def test_reads_struct_members(self):
+        buffers = GenerateCBufferStructs.read_constant_buffers(CBufferFixtures.scene_shader())
+        light = buffers[3].variables[0].type
+        self.assertEqual(light.name, 'Light')
+        self.assertEqual([(name, offset) for name, offset, _ in light.members], [
+            ('type', 0), ('direction', 4), ('range', 16), ('position', 20),
+            ('intensity', 32), ('color', 36), ('spotFallOff', 48), ('shadowView', 52), ('padding', 56),
+        ])
+
+    # ----------------------------------------------------
+    # The generated header
+    # ----------------------------------------------------
+    def test_scene_header_compiles(self):
+        shader = self.write('Scene.cso', CBufferFixtures.scene_shader())
+        header = os.path.join(self.folder.name, 'Scene.h')
+        result = self.run_generator('-o', header, shader)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(header) as f:
+            text = f.read()
+        self.assertIn('namespace Scene', text)
+        self.assertIn('// cbuffer PerFrame : register(b0)', text)
+        self.assertIn('struct Light', text)
+        self.assertNotIn('struct alignas(16) Lights', text)  # Structured buffers only get their element type
+        self.compile(header, '''
+int main()
+{
+	CBuffers::Scene::PerFrame perFrame = {};
+	perFrame.lightCount = 3;
+	CBuffers::Scene::Ambient ambient = {};
+	ambient.irradiance[8] = DirectX::XMFLOAT4(1, 2, 3, 4);
+	static_assert(sizeof(CBuffers::Scene::Light) == 64, "");
+	static_assert(alignof(CBuffers::Scene::PerObject) == 16, "");
+	return perFrame.lightCount == 3 && ambient.irradiance[8].w == 4 ? 0 : 1;
+}
+''')
+
+    def test_padded_arrays_and_nested_structs_compile(self):
+        shader = self.write('Tricky.cso', CBufferFixtures.tricky_shader())
+        header = os.path.join(self.folder.name, 'Tricky.h')
+        result = self.run_generator('-o', header, shader)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(header) as f:
+            text = f.read()
+        self.assertIn('ArrayElement<float> scalars[3];', text)
+        self.assertIn('Light lights[2];', text)
+        # Inner types come before the types holding them
+        self.assertLess(text.index('struct Inner'), text.index('struct Outer'))
+        self.compile(header, '''
+#include <cstddef>
+using namespace CBuffers::Tricky;
+int main()
+{
+	static_assert(offsetof(Tricky, c) == 16, "");
+	static_assert(offsetof(Tricky, scalars) == 32, "");
+	static_assert(offsetof(Tricky, d) == 80, "");
+	static_assert(offsetof(Tricky, nested) == 240, "");
+	static_assert(offsetof(Tricky, last) == 272, "");
+	static_assert(sizeof(Tricky) == 288, "");
+	static_assert(sizeof(Outer) == 28, "");
+	Tricky t = {};
+	t.scalars[2].value = 1.0f;
+	return t.scalars[2].value == 1.0f ? 0 : 1;
+}
+''')
+
+    def test_several_shaders_get_their_own_namespaces(self):
+        scene = self.write('Scene.cso', CBufferFixtures.scene_shader())
+        tricky = self.write('Tricky.cso', CBufferFixtures.tricky_shader())
+        header = os.path.join(self.folder.name, 'Both.h')
+        result = self.run_generator('-o', header, scene, tricky)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        # Both declare Light, which is fine in separate namespaces
+        self.compile(header, 'int main() { return sizeof(CBuffers::Scene::Light) == sizeof(CBuffers::Tricky::Light) ? 0 : 1; }\n')
+
+    def test_writes_to_standard_output(self):
+        shader = self.write('Scene.cso', CBufferFixtures.scene_shader())
+        result = self.run_generator(shader)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertTrue(result.stdout.startswith('// Generated by Tools/GenerateCBufferStructs.py'))
+
+    # ----------------------------------------------------
+    # --check
+    # ----------------------------------------------------
+    def test_check_up_to_date_and_stale(self):
+        shader = self.write('Scene.cso', CBufferFixtures.scene_shader())
+        header = os.path.join(self.folder.name, 'Scene.h')
+        self.assertEqual(self.run_generator('--check', '-o', header, shader).returncode, 1)  # Missing
+        self.assertEqual(self.run_generator('-o', header, shader).returncode, 0)
+        self.assertEqual(self.run_generator('--check', '-o', header, shader).returncode, 0)
+
+        self.write('Scene.cso', CBufferFixtures.tricky_shader())
+        result = self.run_generator('--check', '-o', header, shader)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn('out of date', result.stderr)
+
+    # ----------------------------------------------------
+    # Errors
+    # ----------------------------------------------------
+    def assert_error(self, data, message):
+        shader = self.write('Bad.cso', data)
+        header = os.path.join(self.folder.name, 'Bad.h')
+        result = self.run_generator('-o', header, shader)
+        self.assertEqual(result.returncode, 2)
+        self.assertIn('Bad.cso', result.stderr)
+        self.assertIn(message, result.stderr)
+        self.assertFalse(os.path.exists(header))
+
+    def test_overlapping_member_is_an_error(self):
+        self.assert_error(CBufferFixtures.overlap_shader(), 'Overlap.x overlaps the member before it')
+
+    def test_unsupported_type_is_an_error(self):
+        self.assert_error(CBufferFixtures.unsupported_shader(), 'unsupported type float3x3')
+
+    def test_not_a_shader_is_an_error(self):
+        self.assert_error(b'not dxbc', 'no DXBC header')
+
+    def test_no_reflection_is_an_error(self):
+        self.assert_error(CBufferFixtures.no_rdef_shader(), 'no RDEF chunk')
+
+    def test_truncated_shader_is_an_error(self):
+        self.assert_error(CBufferFixtures.scene_shader()[:120], '')
+
+    def test_missing_file_is_an_error(self):
+        result = self.run_generator(os.path.join(self.folder.name, 'Missing.cso'))
+        self.assertEqual(result.returncode, 2)
+        self.assertIn('Missing.cso', result.stderr)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--cxx', default=CXX, help='C++ compiler for the generated headers')
+    parser.add_argument('-I', dest='include_dirs', action='append', default=[], help='folder with DirectXMath.h')
+    args, rest = parser.parse_known_args()
+    CXX = args.cxx
+    INCLUDE_DIRS = args.include_dirs
+    unittest.main(argv=[sys.argv[0]] + rest)
@@ -0,0 +1,287 @@
+#include "../LightBinner.h"
+#include "Check.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks LightBinner's clusters against where points lit by
+// each light actually land, and that any number of threads
+// bins exactly as one does
+// --------------------------------------------------------
+
+struct TestLight
+{
+	float x, y, z, radius;
+};
+
+// A perspective projection like the camera's
+struct TestView
+{
+	float xScale, yScale, nearZ, farZ;
+	unsigned int tilesX, tilesY, slices;
+};
+
+static const TestView views[] =
+{
+	{ 1.358f, 2.414f, 0.1f, 100.0f, 16, 9, 24 }, // 16:9 at 45 degrees, the engine's grid
+	{ 1.0f, 1.0f, 0.5f, 50.0f, 7, 5, 3 },        // Fewer slices than some thread counts
+	{ 0.6f, 0.9f, 1.0f, 500.0f, 1, 1, 1 },       // A single cluster
+};
+
+// Lights in front of the camera, crossing the near plane,
+// behind it, off to the sides and past the far plane
+static std::vector<TestLight> RandomLights(std::mt19937& rng, const TestView& view, unsigned int count)
+{
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<TestLight> lights(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		float z = view.nearZ + (view.farZ - view.nearZ) * (unit(rng) * 0.6f + 0.5f);
+		float spread = 1.5f * z;
+		lights[i].x = unit(rng) * spread / view.xScale;
+		lights[i].y = unit(rng) * spread / view.yScale;
+		lights[i].z = z;
+		lights[i].radius = (unit(rng) * 0.5f + 0.6f) * view.farZ * 0.08f;
+
+		if (i % 10 == 0)
+			lights[i].z = view.nearZ + unit(rng) * lights[i].radius; // Around the near plane
+		if (i % 37 == 0)
+			lights[i].z = -lights[i].z; // Behind the camera
+	}
+	return lights;
+}
+
+static void Bin(LightBinner& binner, const TestView& view, const std::vector<TestLight>& lights, unsigned int globalCount, WorkerPool* pool)
+{
+	binner.SetGrid(view.tilesX, view.tilesY, view.slices);
+	binner.SetProjection(view.xScale, view.yScale, view.nearZ, view.farZ);
+	binner.Clear();
+	for (unsigned int g = 0; g < globalCount; g++)
+		binner.AddGlobalLight(1000000 + g);
+	for (unsigned int i = 0; i < (unsigned int)lights.size(); i++)
+		binner.AddLight(i, lights[i].x, lights[i].y, lights[i].z, lights[i].radius);
+	binner.Bin(pool);
+}
+
+static bool ClusterHasLight(LightBinner& binner, unsigned int cluster, unsigned int light)
+{
+	const std::vector<unsigned int>& ranges = binner.GetClusterRanges();
+	const std::vector<unsigned int>& indices = binner.GetLightIndices();
+	auto first = indices.begin() + ranges[cluster * 2];
+	auto last = first + ranges[cluster * 2 + 1];
+	return std::find(first, last, light) != last;
+}
+
+// Every point inside a light's range that the camera can see
+// must find the light in its cluster, looked up the way the
+// pixel shader does (FindCluster() in PixelShader.hlsl)
+static void TestSamplesFindTheirLights(WorkerPool* pool)
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	for (const TestView& view : views)
+	{
+		std::vector<TestLight> lights = RandomLights(rng, view, 300);
+		LightBinner binner(1, 1, 1);
+		Bin(binner, view, lights, 0, pool);
+
+		unsigned int samples = 0;
+		unsigned int misses = 0;
+		for (unsigned int i = 0; i < (unsigned int)lights.size(); i++)
+		{
+			const TestLight& light = lights[i];
+			for (unsigned int s = 0; s < 500; s++)
+			{
+				float dx, dy, dz;
+				do
+				{
+					dx = unit(rng);
+					dy = unit(rng);
+					dz = unit(rng);
+				} while (dx * dx + dy * dy + dz * dz > 1.0f);
+
+				float x = light.x + dx * light.radius;
+				float y = light.y + dy * light.radius;
+				float z = light.z + dz * light.radius;
+				if (z < view.nearZ || z > view.farZ)
+					continue;
+				float ndcX = x * view.xScale / z;
+				float ndcY = y * view.yScale / z;
+				if (ndcX <= -1.0f || ndcX >= 1.0f || ndcY <= -1.0f || ndcY >= 1.0f)
+					continue;
+
+				unsigned int tileX = (unsigned int)((ndcX + 1.0f) * 0.5f * view.tilesX);
+				unsigned int tileY = (unsigned int)((1.0f - ndcY) * 0.5f * view.tilesY);
+				unsigned int cluster = binner.GetClusterIndex(tileX, tileY, binner.GetSlice(z));
+				samples++;
+				if (!ClusterHasLight(binner, cluster, i))
+					misses++;
+			}
+		}
+		CHECK(samples > 10000);
+		CHECK(misses == 0);
+	}
+}
+
+// ...and the other way round, every light a cluster lists
+// must reach the cluster's box, worked out separately here
+static void TestClustersOnlyListLightsThatReachThem(WorkerPool* pool)
+{
+	std::mt19937 rng(11);
+	for (const TestView& view : views)
+	{
+		std::vector<TestLight> lights = RandomLights(rng, view, 300);
+		LightBinner binner(1, 1, 1);
+		Bin(binner, view, lights, 2, pool);
+
+		const std::vector<unsigned int>& ranges = binner.GetClusterRanges();
+		const std::vector<unsigned int>& indices = binner.GetLightIndices();
+		unsigned int listed = 0;
+		unsigned int wrong = 0;
+		for (unsigned int z = 0; z < view.slices; z++)
+		{
+			float sliceNear = view.nearZ * powf(view.farZ / view.nearZ, (float)z / view.slices);
+			float sliceFar = view.nearZ * powf(view.farZ / view.nearZ, (float)(z + 1) / view.slices);
+			for (unsigned int y = 0; y < view.tilesY; y++)
+			{
+				float top = (1.0f - 2.0f * y / view.tilesY) / view.yScale;
+				float bottom = (1.0f - 2.0f * (y + 1) / view.tilesY) / view.yScale;
+				for (unsigned int x = 0; x < view.tilesX; x++)
+				{
+					float left = (2.0f * x / view.tilesX - 1.0f) / view.xScale;
+					float right = (2.0f * (x + 1) / view.tilesX - 1.0f) / view.xScale;
+					float boxMin[3] = { std::min(left * sliceNear, left * sliceFar), std::min(bottom * sliceNear, bottom * sliceFar), sliceNear };
+					float boxMax[3] = { std::max(right * sliceNear, right * sliceFar), std::max(top * sliceNear, top * sliceFar), sliceFar };
+
+					unsigned int cluster = binner.GetClusterIndex(x, y, z);
+					for (unsigned int k = 0; k < ranges[cluster * 2 + 1]; k++)
+					{
+						const TestLight& light = lights[indices[ranges[cluster * 2] + k]];
+						float center[3] = { light.x, light.y, light.z };
+						float distanceSquared = 0.0f;
+						for (unsigned int a = 0; a < 3; a++)
+						{
+							float d = std::max(std::max(boxMin[a] - center[a], center[a] - boxMax[a]), 0.0f);
+							distanceSquared += d * d;
+						}
+						listed++;
+						if (distanceSquared > light.radius * light.radius * 1.0001f)
+							wrong++;
+					}
+				}
+			}
+		}
+		CHECK(listed > 0);
+		CHECK(wrong == 0);
+	}
+}
+
+// The threads split the slices between them, which must not
+// change a single index
+static void TestThreadCountsGiveTheSameResult()
+{
+	std::mt19937 rng(3);
+	WorkerPool pools[] = { WorkerPool(1), WorkerPool(2), WorkerPool(3), WorkerPool(4), WorkerPool(8) };
+
+	for (const TestView& view : views)
+	{
+		std::vector<TestLight> lights = RandomLights(rng, view, 1000);
+		LightBinner reference(1, 1, 1);
+		Bin(reference, view, lights, 3, 0);
+
+		for (WorkerPool& pool : pools)
+		{
+			// Twice with the same binner, so leftovers from the
+			// first run can't hide in the second
+			LightBinner binner(1, 1, 1);
+			for (unsigned int run = 0; run < 2; run++)
+			{
+				Bin(binner, view, lights, 3, &pool);
+				CHECK(binner.GetClusterRanges() == reference.GetClusterRanges());
+				CHECK(binner.GetLightIndices() == reference.GetLightIndices());
+				CHECK(binner.GetMaxClusterLights() == reference.GetMaxClusterLights());
+			}
+		}
+	}
+}
+
+// Global lights go first, in order, and each cluster's lights
+// stay in the order they were added
+static void TestOrdering()
+{
+	std::mt19937 rng(5);
+	const TestView& view = views[0];
+	std::vector<TestLight> lights = RandomLights(rng, view, 200);
+	WorkerPool pool(4);
+	LightBinner binner(1, 1, 1);
+	Bin(binner, view, lights, 3, &pool);
+
+	const std::vector<unsigned int>& ranges = binner.GetClusterRanges();
+	const std::vector<unsigned int>& indices = binner.GetLightIndices();
+	CHECK(binner.GetGlobalLightCount() == 3);
+	CHECK(indices.size() >= 3 && indices[0] == 1000000 && indices[1] == 1000001 && indices[2] == 1000002);
+	CHECK(ranges.size() == binner.GetClusterCount() * 2);
+
+	unsigned int maxLights = 0;
+	unsigned int total = 0;
+	for (unsigned int c = 0; c < binner.GetClusterCount(); c++)
+	{
+		unsigned int first = ranges[c * 2];
+		unsigned int count = ranges[c * 2 + 1];
+		CHECK(first >= 3 && first + count <= indices.size());
+		CHECK(std::is_sorted(indices.begin() + first, indices.begin() + first + count));
+		maxLights = std::max(maxLights, count);
+		total += count;
+	}
+	CHECK(total + 3 == indices.size());
+	CHECK(maxLights == binner.GetMaxClusterLights());
+}
+
+// The slice lookup matches the slices' depths, and clamps
+// anything outside the near and far planes
+static void TestSliceLookup()
+{
+	for (const TestView& view : views)
+	{
+		LightBinner binner(view.tilesX, view.tilesY, view.slices);
+		binner.SetProjection(view.xScale, view.yScale, view.nearZ, view.farZ);
+		for (unsigned int z = 0; z < view.slices; z++)
+		{
+			float middle = view.nearZ * powf(view.farZ / view.nearZ, (z + 0.5f) / view.slices);
+			CHECK(binner.GetSlice(middle) == z);
+		}
+		CHECK(binner.GetSlice(view.nearZ * 0.5f) == 0);
+		CHECK(binner.GetSlice(-1.0f) == 0);
+		CHECK(binner.GetSlice(view.farZ * 2.0f) == view.slices - 1);
+
+		// The shader's version of the same formula
+		float middle = view.nearZ * powf(view.farZ / view.nearZ, 0.5f / view.slices);
+		CHECK(floorf(logf(middle) * binner.GetDepthScale() - binner.GetDepthBias()) == 0.0f);
+	}
+}
+
+static void TestNoLights()
+{
+	LightBinner binner(4, 4, 4);
+	binner.Bin(0);
+	CHECK(binner.GetLightIndices().empty());
+	CHECK(binner.GetMaxClusterLights() == 0);
+	CHECK(binner.GetClusterRanges().size() == 4 * 4 * 4 * 2);
+}
+
+int main()
+{
+	WorkerPool pool(4);
+	TestSamplesFindTheirLights(0);
+	TestSamplesFindTheirLights(&pool);
+	TestClustersOnlyListLightsThatReachThem(0);
+	TestClustersOnlyListLightsThatReachThem(&pool);
+	TestThreadCountsGiveTheSameResult();
+	TestOrdering();
+	TestSliceLookup();
+	TestNoLights();
+	return CheckResult("LightBinnerTests");
+}
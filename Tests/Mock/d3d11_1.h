@@ -0,0 +1,101 @@
+#pragma once
+#include <cstring>
+
+// --------------------------------------------------------
+// Just enough of d3d11_1.h for StateCache to build on Linux
+//
+// - Every resource is a plain object with a reference count,
+//   so tests can check what holds references to it
+// - The context's methods are all virtual, for tests to
+//   record the calls that get through (see MockContext in
+//   StateCacheTests.cpp)
+// - Signatures match the real header, minus the SAL
+//   annotations and calling conventions
+// --------------------------------------------------------
+
+typedef unsigned int UINT;
+typedef float FLOAT;
+
+#define D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT	14
+#define D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT				16
+#define D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT				8
+
+enum DXGI_FORMAT
+{
+	DXGI_FORMAT_UNKNOWN = 0,
+	DXGI_FORMAT_R32_UINT = 42,
+	DXGI_FORMAT_R16_UINT = 57,
+};
+
+enum D3D11_PRIMITIVE_TOPOLOGY
+{
+	D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED = 0,
+	D3D11_PRIMITIVE_TOPOLOGY_LINELIST = 2,
+	D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4,
+};
+
+struct D3D11_VIEWPORT
+{
+	FLOAT TopLeftX;
+	FLOAT TopLeftY;
+	FLOAT Width;
+	FLOAT Height;
+	FLOAT MinDepth;
+	FLOAT MaxDepth;
+};
+
+struct IUnknown
+{
+	IUnknown() : refCount(1) {}
+	virtual ~IUnknown() {}
+	UINT AddRef() { return ++refCount; }
+	UINT Release()
+	{
+		UINT count = --refCount;
+		if (count == 0)
+			delete this;
+		return count;
+	}
+	UINT refCount;
+};
+
+struct ID3D11DeviceChild : IUnknown {};
+struct ID3D11InputLayout : ID3D11DeviceChild {};
+struct ID3D11Buffer : ID3D11DeviceChild {};
+struct ID3D11VertexShader : ID3D11DeviceChild {};
+struct ID3D11PixelShader : ID3D11DeviceChild {};
+struct ID3D11ClassInstance : ID3D11DeviceChild {};
+struct ID3D11ShaderResourceView : ID3D11DeviceChild {};
+struct ID3D11SamplerState : ID3D11DeviceChild {};
+struct ID3D11RasterizerState : ID3D11DeviceChild {};
+struct ID3D11RenderTargetView : ID3D11DeviceChild {};
+struct ID3D11DepthStencilView : ID3D11DeviceChild {};
+struct ID3D11DepthStencilState : ID3D11DeviceChild {};
+
+struct ID3D11DeviceContext : ID3D11DeviceChild
+{
+	virtual void IASetInputLayout(ID3D11InputLayout* pInputLayout) = 0;
+	virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY Topology) = 0;
+	virtual void IASetVertexBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets) = 0;
+	virtual void IASetIndexBuffer(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT Format, UINT Offset) = 0;
+
+	virtual void VSSetShader(ID3D11VertexShader* pVertexShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances) = 0;
+	virtual void PSSetShader(ID3D11PixelShader* pPixelShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances) = 0;
+	virtual void VSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers) = 0;
+	virtual void PSSetConstantBuffers(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers) = 0;
+	virtual void VSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews) = 0;
+	virtual void PSSetShaderResources(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews) = 0;
+	virtual void VSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers) = 0;
+	virtual void PSSetSamplers(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers) = 0;
+
+	virtual void RSSetState(ID3D11RasterizerState* pRasterizerState) = 0;
+	virtual void RSSetViewports(UINT NumViewports, const D3D11_VIEWPORT* pViewports) = 0;
+	virtual void OMSetRenderTargets(UINT NumViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView) = 0;
+	virtual void OMSetDepthStencilState(ID3D11DepthStencilState* pDepthStencilState, UINT StencilRef) = 0;
+};
+
+struct ID3D11DeviceContext1 : ID3D11DeviceContext
+{
+	virtual void VSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers, const UINT* pFirstConstant, const UINT* pNumConstants) = 0;
+	virtual void PSSetConstantBuffers1(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers, const UINT* pFirstConstant, const UINT* pNumConstants) = 0;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <utility>
+
+// --------------------------------------------------------
+// Just enough of ComPtr for the Linux tests: it holds a
+// reference like the real one, and As() stands in for
+// QueryInterface with a dynamic_cast
+// --------------------------------------------------------
+namespace Microsoft
+{
+	namespace WRL
+	{
+		template<typename T>
+		class ComPtr
+		{
+		public:
+			ComPtr() : ptr(0) {}
+			ComPtr(T* p) : ptr(p) { if (ptr) ptr->AddRef(); }
+			ComPtr(const ComPtr& other) : ptr(other.ptr) { if (ptr) ptr->AddRef(); }
+			~ComPtr() { Reset(); }
+
+			ComPtr& operator=(ComPtr other)
+			{
+				std::swap(ptr, other.ptr);
+				return *this;
+			}
+
+			T* Get() const { return ptr; }
+			T* operator->() const { return ptr; }
+			explicit operator bool() const { return ptr != 0; }
+
+			void Reset()
+			{
+				if (ptr)
+					ptr->Release();
+				ptr = 0;
+			}
+
+			template<typename U>
+			int As(ComPtr<U>* other) const
+			{
+				*other = dynamic_cast<U*>(ptr);
+				return *other ? 0 : -1;
+			}
+
+		private:
+			T* ptr;
+		};
+	}
+}
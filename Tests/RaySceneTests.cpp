@@ -0,0 +1,183 @@
+#include "../RayScene.h"
+#include "Check.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Checks that a RayScene whose triangles moved and were
+// refitted hits exactly what one built from scratch does
+// --------------------------------------------------------
+
+struct TestTriangle
+{
+	XMFLOAT3 a, b, c, albedo;
+};
+
+// Small triangles scattered through a 20 unit box, in clumps
+// of "clump" triangles that move together, like entities
+static std::vector<TestTriangle> RandomTriangles(std::mt19937& rng, unsigned int count, unsigned int clump)
+{
+	std::uniform_real_distribution<float> box(-10.0f, 10.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::vector<TestTriangle> triangles(count);
+	XMFLOAT3 center;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (i % clump == 0)
+			center = XMFLOAT3(box(rng), box(rng), box(rng));
+		XMFLOAT3 v0(center.x + unit(rng), center.y + unit(rng), center.z + unit(rng));
+		triangles[i].a = v0;
+		triangles[i].b = XMFLOAT3(v0.x + unit(rng) * 0.5f, v0.y + unit(rng) * 0.5f, v0.z + unit(rng) * 0.5f);
+		triangles[i].c = XMFLOAT3(v0.x + unit(rng) * 0.5f, v0.y + unit(rng) * 0.5f, v0.z + unit(rng) * 0.5f);
+		triangles[i].albedo = XMFLOAT3((float)i, 0.0f, 0.0f); // Says which triangle was hit
+	}
+	return triangles;
+}
+
+static void Build(RayScene& scene, const std::vector<TestTriangle>& triangles)
+{
+	scene.Clear();
+	for (const TestTriangle& t : triangles)
+		scene.AddTriangle(t.a, t.b, t.c, t.albedo);
+	scene.Build();
+}
+
+static void Move(std::vector<TestTriangle>& triangles, unsigned int first, unsigned int count, XMFLOAT3 offset)
+{
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		XMFLOAT3* corners[3] = { &triangles[i].a, &triangles[i].b, &triangles[i].c };
+		for (XMFLOAT3* v : corners)
+			*v = XMFLOAT3(v->x + offset.x, v->y + offset.y, v->z + offset.z);
+	}
+}
+
+// The same rays at both scenes find the same triangles
+static void CheckSameHits(const RayScene& scene, const RayScene& reference, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> box(-12.0f, 12.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	unsigned int hits = 0;
+	unsigned int mismatches = 0;
+	for (unsigned int r = 0; r < 5000; r++)
+	{
+		XMFLOAT3 origin(box(rng), box(rng), box(rng));
+		XMFLOAT3 direction;
+		XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f)));
+
+		RayHit hit = {};
+		RayHit expected = {};
+		bool found = scene.Intersect(origin, direction, 40.0f, hit);
+		bool expectedFound = reference.Intersect(origin, direction, 40.0f, expected);
+		if (found != expectedFound ||
+			(found && (hit.albedo.x != expected.albedo.x || fabsf(hit.distance - expected.distance) > 1e-4f)) ||
+			scene.Occluded(origin, direction, 40.0f) != expectedFound)
+			mismatches++;
+		if (found)
+			hits++;
+	}
+	CHECK(hits > 100);
+	CHECK(mismatches == 0);
+}
+
+// Clumps nudged a little are refitted, not rebuilt
+static void TestSmallMovesRefit()
+{
+	std::mt19937 rng(17);
+	std::vector<TestTriangle> triangles = RandomTriangles(rng, 3000, 50);
+	RayScene scene;
+	Build(scene, triangles);
+
+	for (unsigned int round = 0; round < 3; round++)
+	{
+		for (unsigned int first = round * 50; first < triangles.size(); first += 500)
+		{
+			Move(triangles, first, 50, XMFLOAT3(0.2f, -0.1f, 0.15f));
+			for (unsigned int i = first; i < first + 50; i++)
+				scene.SetTriangle(i, triangles[i].a, triangles[i].b, triangles[i].c, triangles[i].albedo);
+		}
+		CHECK(scene.Refit());
+
+		RayScene reference;
+		Build(reference, triangles);
+		CheckSameHits(scene, reference, rng);
+		CHECK(scene.GetTriangleCount() == reference.GetTriangleCount());
+	}
+}
+
+// Clumps moved across the scene stretch the nodes above them
+// over everything, so the BVH is built again - and still hits
+// what it should
+static void TestLargeMovesRebuild()
+{
+	std::mt19937 rng(19);
+	std::vector<TestTriangle> triangles = RandomTriangles(rng, 3000, 50);
+	RayScene scene;
+	Build(scene, triangles);
+
+	for (unsigned int first = 0; first < triangles.size(); first += 50)
+	{
+		Move(triangles, first, 50, XMFLOAT3(first % 100 == 0 ? 18.0f : -18.0f, 0.0f, 0.0f));
+		for (unsigned int i = first; i < first + 50; i++)
+			scene.SetTriangle(i, triangles[i].a, triangles[i].b, triangles[i].c, triangles[i].albedo);
+	}
+	CHECK(!scene.Refit());
+
+	RayScene reference;
+	Build(reference, triangles);
+	CheckSameHits(scene, reference, rng);
+
+	// Triangles keep the numbers they were added with through
+	// the second build, so they can still be moved
+	Move(triangles, 1000, 50, XMFLOAT3(0.0f, 0.1f, 0.0f));
+	for (unsigned int i = 1000; i < 1050; i++)
+		scene.SetTriangle(i, triangles[i].a, triangles[i].b, triangles[i].c, triangles[i].albedo);
+	scene.Refit();
+	Build(reference, triangles);
+	CheckSameHits(scene, reference, rng);
+}
+
+// A triangle moved in front of a ray is the one it hits
+static void TestSetTriangleFindsItsTriangle()
+{
+	std::mt19937 rng(23);
+	std::vector<TestTriangle> triangles = RandomTriangles(rng, 500, 10);
+	RayScene scene;
+	Build(scene, triangles);
+
+	for (unsigned int i : { 0u, 7u, 250u, 499u })
+	{
+		XMFLOAT3 albedo((float)i, 0.0f, 0.0f);
+		scene.SetTriangle(i, XMFLOAT3(-1, -1, -20), XMFLOAT3(0, 1, -20), XMFLOAT3(1, -1, -20), albedo);
+		scene.Refit();
+
+		RayHit hit = {};
+		CHECK(scene.Intersect(XMFLOAT3(0, 0, -30), XMFLOAT3(0, 0, 1), 100.0f, hit));
+		CHECK(hit.albedo.x == (float)i);
+		CHECK(fabsf(hit.distance - 10.0f) < 1e-4f);
+
+		// Back where it was, out of the way of the next one
+		scene.SetTriangle(i, triangles[i].a, triangles[i].b, triangles[i].c, triangles[i].albedo);
+	}
+}
+
+static void TestEmptyScene()
+{
+	RayScene scene;
+	scene.Build();
+	CHECK(scene.Refit());
+	RayHit hit = {};
+	CHECK(!scene.Intersect(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 1), 10.0f, hit));
+}
+
+int main()
+{
+	TestSmallMovesRefit();
+	TestLargeMovesRebuild();
+	TestSetTriangleFindsItsTriangle();
+	TestEmptyScene();
+	return CheckResult("RaySceneTests");
+}
@@ -0,0 +1,225 @@
+#include "../SphericalHarmonics.h"
+#include "Check.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Checks SphericalHarmonics against skies whose irradiance is
+// known analytically - a constant sky, a clamped cosine and a
+// hemisphere, at face sizes that are and aren't multiples of
+// four - and its four texels at a time projection against a
+// plain one texel at a time sum
+// --------------------------------------------------------
+
+// Face sizes that are and aren't multiples of the four lanes,
+// down to the smallest, for checks that hold at any size...
+static const unsigned int sizes[] = { 1, 2, 3, 5, 6, 7, 16, 17, 30 };
+
+// ...and fine enough to follow a sky with edges in it
+static const unsigned int smoothSizes[] = { 16, 17, 30, 31, 64 };
+
+// Six faces filled from a function of the (unit) direction
+// through each texel's center
+struct TestCubemap
+{
+	std::vector<float> faces[6];
+	const float* pointers[6];
+
+	template<class Radiance>
+	TestCubemap(unsigned int size, Radiance radiance)
+	{
+		for (unsigned int face = 0; face < 6; face++)
+		{
+			faces[face].resize((size_t)size * size * 4);
+			for (unsigned int y = 0; y < size; y++)
+			{
+				for (unsigned int x = 0; x < size; x++)
+				{
+					float u = (x + 0.5f) * 2.0f / size - 1.0f;
+					float v = (y + 0.5f) * 2.0f / size - 1.0f;
+					XMFLOAT3 d;
+					XMStoreFloat3(&d, XMVector3Normalize(SphericalHarmonics::CubeDirection(face, u, v)));
+					radiance(d, &faces[face][((size_t)y * size + x) * 4]);
+				}
+			}
+			pointers[face] = faces[face].data();
+		}
+	}
+};
+
+static XMFLOAT4 Irradiance(const SH9& sh, float x, float y, float z)
+{
+	XMFLOAT4 result;
+	XMStoreFloat4(&result, SphericalHarmonics::Evaluate(sh, XMVectorSet(x, y, z, 0.0f)));
+	return result;
+}
+
+// Light of 1 from everywhere lights every direction by 1 (as
+// the result is divided by pi), and has nothing past band 0
+static void TestConstantSky()
+{
+	for (unsigned int size : sizes)
+	{
+		TestCubemap cube(size, [](XMFLOAT3, float* texel) {
+			texel[0] = 1.0f;
+			texel[1] = 0.5f;
+			texel[2] = 2.0f;
+			texel[3] = 1.0f;
+		});
+		SH9 sh = SphericalHarmonics::ProjectCubemap(cube.pointers, size);
+		CHECK_NEAR(sh.coefficients[0].x, 0.282095f * 4.0f * XM_PI, 1e-3f);
+		for (unsigned int k = 1; k < 9; k++)
+		{
+			CHECK_NEAR(sh.coefficients[k].x, 0.0f, 1e-4f);
+			CHECK_NEAR(sh.coefficients[k].y, 0.0f, 1e-4f);
+			CHECK_NEAR(sh.coefficients[k].z, 0.0f, 1e-4f);
+		}
+
+		SphericalHarmonics::ConvolveLambert(sh);
+		const float directions[][3] = { { 1, 0, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0.3f, 0.8f, -0.5f } };
+		for (const float* d : directions)
+		{
+			XMFLOAT4 e = Irradiance(sh, d[0], d[1], d[2]);
+			CHECK_NEAR(e.x, 1.0f, 1e-4f);
+			CHECK_NEAR(e.y, 0.5f, 1e-4f);
+			CHECK_NEAR(e.z, 2.0f, 1e-4f);
+		}
+	}
+}
+
+// Light of max(0, y): a sun spread over the upper hemisphere.
+// Nine coefficients can't hold it exactly, so these are what
+// its first three bands give, worked out by hand: 1/4 + 1/3 +
+// 5/64 facing up, 1/4 - 1/3 + 5/64 facing down and 1/4 - 5/128
+// facing sideways (against exact values of 2/3, 0 and 1/4)
+static void TestClampedCosine()
+{
+	for (unsigned int size : smoothSizes)
+	{
+		TestCubemap cube(size, [](XMFLOAT3 d, float* texel) {
+			texel[0] = texel[1] = texel[2] = std::fmax(0.0f, d.y);
+			texel[3] = 1.0f;
+		});
+		SH9 sh = SphericalHarmonics::ProjectCubemap(cube.pointers, size);
+		SphericalHarmonics::ConvolveLambert(sh);
+
+		float tolerance = 0.002f;
+		CHECK_NEAR(Irradiance(sh, 0, 1, 0).x, 1.0f / 4 + 1.0f / 3 + 5.0f / 64, tolerance);
+		CHECK_NEAR(Irradiance(sh, 0, -1, 0).x, 1.0f / 4 - 1.0f / 3 + 5.0f / 64, tolerance);
+		CHECK_NEAR(Irradiance(sh, 1, 0, 0).x, 1.0f / 4 - 5.0f / 128, tolerance);
+		CHECK_NEAR(Irradiance(sh, 0, 0, -1).x, 1.0f / 4 - 5.0f / 128, tolerance);
+		CHECK_NEAR(Irradiance(sh, 0, 1, 0).y, Irradiance(sh, 0, 1, 0).x, 1e-5f);
+	}
+}
+
+// Light of 1 over the +Z hemisphere only, which the first
+// three bands do hold exactly: 1 facing it, 0 facing away and
+// 1/2 side on (and anything between follows the cosine)
+static void TestHemisphere()
+{
+	for (unsigned int size : smoothSizes)
+	{
+		// Odd sizes have a row of texels on the horizon, which
+		// is half in each hemisphere
+		TestCubemap cube(size, [](XMFLOAT3 d, float* texel) {
+			float upper = fabsf(d.z) < 1e-4f ? 0.5f : d.z > 0.0f ? 1.0f : 0.0f;
+			texel[0] = upper;
+			texel[1] = 1.0f - upper; // The other half, in green
+			texel[2] = 0.0f;
+			texel[3] = 1.0f;
+		});
+		SH9 sh = SphericalHarmonics::ProjectCubemap(cube.pointers, size);
+		SphericalHarmonics::ConvolveLambert(sh);
+
+		float tolerance = 0.01f;
+		CHECK_NEAR(Irradiance(sh, 0, 0, 1).x, 1.0f, tolerance);
+		CHECK_NEAR(Irradiance(sh, 0, 0, -1).x, 0.0f, tolerance);
+		CHECK_NEAR(Irradiance(sh, 1, 0, 0).x, 0.5f, tolerance);
+		CHECK_NEAR(Irradiance(sh, 0, -1, 0).x, 0.5f, tolerance);
+		CHECK_NEAR(Irradiance(sh, 0, 0.6f, 0.8f).x, 0.5f + 0.5f * 0.8f, tolerance);
+		CHECK_NEAR(Irradiance(sh, 0, 0, -1).y, 1.0f, tolerance);
+		CHECK_NEAR(Irradiance(sh, 0, 0, 1).z, 0.0f, 1e-5f);
+	}
+}
+
+// Noise, projected a texel at a time with AddSample(), must
+// give what the four lane projection does at any face size -
+// which it wouldn't if the lanes past a row's end counted
+static void TestMatchesPerTexelSum()
+{
+	std::mt19937 rng(13);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	for (unsigned int size : sizes)
+	{
+		TestCubemap cube(size, [&](XMFLOAT3, float* texel) {
+			texel[0] = unit(rng);
+			texel[1] = unit(rng) * 4.0f;
+			texel[2] = unit(rng) < 0.1f ? 50.0f : 0.0f;
+			texel[3] = 1.0f;
+		});
+		SH9 sh = SphericalHarmonics::ProjectCubemap(cube.pointers, size);
+
+		// Each texel weighted by its solid angle, scaled to 4 pi
+		// at the end, as the projection does
+		SH9 reference = {};
+		float weightSum = 0.0f;
+		float texelSize = 2.0f / size;
+		for (unsigned int face = 0; face < 6; face++)
+		{
+			for (unsigned int y = 0; y < size; y++)
+			{
+				for (unsigned int x = 0; x < size; x++)
+				{
+					XMVECTOR direction = SphericalHarmonics::CubeDirection(face,
+						(x + 0.5f) * texelSize - 1.0f, (y + 0.5f) * texelSize - 1.0f);
+					float length = XMVectorGetX(XMVector3Length(direction));
+					float weight = texelSize * texelSize / (length * length * length);
+					const float* texel = &cube.faces[face][((size_t)y * size + x) * 4];
+					SphericalHarmonics::AddSample(reference, XMVector3Normalize(direction),
+						XMVectorSet(texel[0], texel[1], texel[2], 0.0f), weight);
+					weightSum += weight;
+				}
+			}
+		}
+
+		for (unsigned int k = 0; k < 9; k++)
+		{
+			float scale = 4.0f * XM_PI / weightSum;
+			CHECK_NEAR(sh.coefficients[k].x, reference.coefficients[k].x * scale, 1e-3f);
+			CHECK_NEAR(sh.coefficients[k].y, reference.coefficients[k].y * scale, 1e-3f);
+			CHECK_NEAR(sh.coefficients[k].z, reference.coefficients[k].z * scale, 1e-3f);
+			CHECK(sh.coefficients[k].w == 0.0f);
+		}
+	}
+}
+
+// Evaluate() takes any length of direction
+static void TestEvaluateNormalizes()
+{
+	TestCubemap cube(8, [](XMFLOAT3 d, float* texel) {
+		texel[0] = d.x * d.x;
+		texel[1] = std::fmax(0.0f, d.z);
+		texel[2] = 1.0f + d.y;
+		texel[3] = 1.0f;
+	});
+	SH9 sh = SphericalHarmonics::ProjectCubemap(cube.pointers, 8);
+	XMFLOAT4 unit = Irradiance(sh, 0.48f, 0.6f, 0.64f);
+	XMFLOAT4 longer = Irradiance(sh, 4.8f, 6.0f, 6.4f);
+	CHECK_NEAR(unit.x, longer.x, 1e-5f);
+	CHECK_NEAR(unit.y, longer.y, 1e-5f);
+	CHECK_NEAR(unit.z, longer.z, 1e-5f);
+}
+
+int main()
+{
+	TestConstantSky();
+	TestClampedCosine();
+	TestHemisphere();
+	TestMatchesPerTexelSum();
+	TestEvaluateNormalizes();
+	return CheckResult("SphericalHarmonicsTests");
+}
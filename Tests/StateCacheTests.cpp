@@ -0,0 +1,481 @@
+#include "../StateCache.h"
+#include "Check.h"
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Checks StateCache against a mock context (Mock/d3d11_1.h)
+// that records every call the cache lets through
+// --------------------------------------------------------
+
+// Records each call as its name and the arguments that matter
+template<typename Base>
+class RecordingContext : public Base
+{
+public:
+	std::vector<std::string> calls;
+
+	// The calls since the last Take()
+	std::vector<std::string> Take()
+	{
+		std::vector<std::string> taken;
+		taken.swap(calls);
+		return taken;
+	}
+
+	void IASetInputLayout(ID3D11InputLayout*) override { calls.push_back("IASetInputLayout"); }
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY) override { calls.push_back("IASetPrimitiveTopology"); }
+	void IASetVertexBuffers(UINT startSlot, UINT count, ID3D11Buffer* const*, const UINT*, const UINT*) override { calls.push_back("IASetVertexBuffers " + Range(startSlot, count)); }
+	void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT) override { calls.push_back("IASetIndexBuffer"); }
+	void VSSetShader(ID3D11VertexShader*, ID3D11ClassInstance* const*, UINT) override { calls.push_back("VSSetShader"); }
+	void PSSetShader(ID3D11PixelShader*, ID3D11ClassInstance* const*, UINT) override { calls.push_back("PSSetShader"); }
+	void VSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const*) override { calls.push_back("VSSetConstantBuffers " + Range(startSlot, count)); }
+	void PSSetConstantBuffers(UINT startSlot, UINT count, ID3D11Buffer* const*) override { calls.push_back("PSSetConstantBuffers " + Range(startSlot, count)); }
+	void VSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const*) override { calls.push_back("VSSetShaderResources " + Range(startSlot, count)); }
+	void PSSetShaderResources(UINT startSlot, UINT count, ID3D11ShaderResourceView* const*) override { calls.push_back("PSSetShaderResources " + Range(startSlot, count)); }
+	void VSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const*) override { calls.push_back("VSSetSamplers " + Range(startSlot, count)); }
+	void PSSetSamplers(UINT startSlot, UINT count, ID3D11SamplerState* const*) override { calls.push_back("PSSetSamplers " + Range(startSlot, count)); }
+	void RSSetState(ID3D11RasterizerState*) override { calls.push_back("RSSetState"); }
+	void RSSetViewports(UINT, const D3D11_VIEWPORT*) override { calls.push_back("RSSetViewports"); }
+	void OMSetRenderTargets(UINT count, ID3D11RenderTargetView* const*, ID3D11DepthStencilView*) override { calls.push_back("OMSetRenderTargets " + std::to_string(count)); }
+	void OMSetDepthStencilState(ID3D11DepthStencilState*, UINT) override { calls.push_back("OMSetDepthStencilState"); }
+
+protected:
+	static std::string Range(UINT startSlot, UINT count)
+	{
+		return std::to_string(startSlot) + "+" + std::to_string(count);
+	}
+};
+
+// An 11.1 context, which can bind constant buffer ranges
+class MockContext : public RecordingContext<ID3D11DeviceContext1>
+{
+public:
+	void VSSetConstantBuffers1(UINT startSlot, UINT count, ID3D11Buffer* const*, const UINT* first, const UINT* constants) override
+	{
+		calls.push_back("VSSetConstantBuffers1 " + Range(startSlot, count) + " " + std::to_string(first[0]) + "," + std::to_string(constants[0]));
+	}
+	void PSSetConstantBuffers1(UINT startSlot, UINT count, ID3D11Buffer* const*, const UINT* first, const UINT* constants) override
+	{
+		calls.push_back("PSSetConstantBuffers1 " + Range(startSlot, count) + " " + std::to_string(first[0]) + "," + std::to_string(constants[0]));
+	}
+};
+
+// An 11.0 context, which can't
+class MockContext11 : public RecordingContext<ID3D11DeviceContext>
+{
+};
+
+typedef std::vector<std::string> Calls;
+
+static void TestSingleStates()
+{
+	MockContext context;
+	StateCache cache(&context);
+	ID3D11InputLayout layoutA, layoutB;
+	ID3D11VertexShader vsA, vsB;
+	ID3D11PixelShader psA, psB;
+	ID3D11RasterizerState rasterizerA, rasterizerB;
+	ID3D11DepthStencilState depthA;
+	ID3D11Buffer indexA;
+
+	cache.IASetInputLayout(&layoutA);
+	cache.IASetInputLayout(&layoutA);
+	cache.IASetInputLayout(&layoutB);
+	CHECK(context.Take() == Calls({ "IASetInputLayout", "IASetInputLayout" }));
+
+	cache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	cache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
+	CHECK(context.Take() == Calls({ "IASetPrimitiveTopology", "IASetPrimitiveTopology" }));
+
+	// Each of the buffer, format and offset counts
+	cache.IASetIndexBuffer(&indexA, DXGI_FORMAT_R32_UINT, 0);
+	cache.IASetIndexBuffer(&indexA, DXGI_FORMAT_R32_UINT, 0);
+	cache.IASetIndexBuffer(&indexA, DXGI_FORMAT_R16_UINT, 0);
+	cache.IASetIndexBuffer(&indexA, DXGI_FORMAT_R16_UINT, 64);
+	cache.IASetIndexBuffer(0, DXGI_FORMAT_R16_UINT, 64);
+	CHECK(context.Take() == Calls({ "IASetIndexBuffer", "IASetIndexBuffer", "IASetIndexBuffer", "IASetIndexBuffer" }));
+
+	cache.VSSetShader(&vsA);
+	cache.VSSetShader(&vsA);
+	cache.VSSetShader(&vsB);
+	cache.PSSetShader(&psA);
+	cache.PSSetShader(&psA);
+	cache.PSSetShader(&psB);
+	CHECK(context.Take() == Calls({ "VSSetShader", "VSSetShader", "PSSetShader", "PSSetShader" }));
+
+	cache.RSSetState(&rasterizerA);
+	cache.RSSetState(&rasterizerA);
+	cache.RSSetState(&rasterizerB);
+	CHECK(context.Take() == Calls({ "RSSetState", "RSSetState" }));
+
+	D3D11_VIEWPORT viewport = { 0.0f, 0.0f, 1280.0f, 720.0f, 0.0f, 1.0f };
+	cache.RSSetViewport(viewport);
+	cache.RSSetViewport(viewport);
+	viewport.Width = 640.0f;
+	cache.RSSetViewport(viewport);
+	CHECK(context.Take() == Calls({ "RSSetViewports", "RSSetViewports" }));
+
+	// The stencil reference is part of the state
+	cache.OMSetDepthStencilState(&depthA, 0);
+	cache.OMSetDepthStencilState(&depthA, 0);
+	cache.OMSetDepthStencilState(&depthA, 1);
+	cache.OMSetDepthStencilState(0, 1);
+	CHECK(context.Take() == Calls({ "OMSetDepthStencilState", "OMSetDepthStencilState", "OMSetDepthStencilState" }));
+}
+
+// Null is state like any other, but not before anything is known
+static void TestFirstCallAlwaysIssued()
+{
+	MockContext context;
+	StateCache cache(&context);
+
+	cache.IASetInputLayout(0);
+	cache.VSSetShader(0);
+	cache.PSSetShader(0);
+	cache.RSSetState(0);
+	cache.OMSetDepthStencilState(0, 0);
+	cache.VSSetConstantBuffer(0, 0);
+	ID3D11ShaderResourceView* noSRV = 0;
+	cache.PSSetShaderResources(0, 1, &noSRV);
+	CHECK(context.Take().size() == 7);
+	CHECK(cache.GetIssuedCount() == 7);
+	CHECK(cache.GetFilteredCount() == 0);
+}
+
+static void TestVertexBuffers()
+{
+	MockContext context;
+	StateCache cache(&context);
+	ID3D11Buffer a, b;
+	ID3D11Buffer* buffers[2] = { &a, &b };
+	UINT strides[2] = { 32, 16 };
+	UINT offsets[2] = { 0, 0 };
+
+	cache.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	cache.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	CHECK(context.Take() == Calls({ "IASetVertexBuffers 0+2" }));
+
+	// A slot that was bound as part of a range
+	cache.IASetVertexBuffers(1, 1, &buffers[1], &strides[1], &offsets[1]);
+	CHECK(context.Take().empty());
+
+	// Any of the buffer, stride or offset changing
+	strides[1] = 12;
+	cache.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	offsets[0] = 256;
+	cache.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	buffers[0] = &b;
+	cache.IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	CHECK(context.Take() == Calls({ "IASetVertexBuffers 0+2", "IASetVertexBuffers 0+2", "IASetVertexBuffers 0+2" }));
+
+	// A slot never bound
+	cache.IASetVertexBuffers(2, 1, buffers, strides, offsets);
+	CHECK(context.Take() == Calls({ "IASetVertexBuffers 2+1" }));
+
+	// Slots past the tracked ones always go through
+	ID3D11Buffer* many[STATE_CACHE_VERTEX_BUFFERS + 1] = {};
+	UINT zeros[STATE_CACHE_VERTEX_BUFFERS + 1] = {};
+	cache.IASetVertexBuffers(0, STATE_CACHE_VERTEX_BUFFERS + 1, many, zeros, zeros);
+	cache.IASetVertexBuffers(0, STATE_CACHE_VERTEX_BUFFERS + 1, many, zeros, zeros);
+	CHECK(context.Take().size() == 2);
+
+	// ...but still record the tracked slots they covered
+	cache.IASetVertexBuffers(0, STATE_CACHE_VERTEX_BUFFERS, many, zeros, zeros);
+	CHECK(context.Take().empty());
+}
+
+static void TestConstantBuffers()
+{
+	MockContext context;
+	StateCache cache(&context);
+	ID3D11Buffer a, b;
+
+	cache.VSSetConstantBuffer(0, &a);
+	cache.VSSetConstantBuffer(0, &a);
+	cache.VSSetConstantBuffer(0, &b);
+	CHECK(context.Take() == Calls({ "VSSetConstantBuffers 0+1", "VSSetConstantBuffers 0+1" }));
+
+	// The stages are tracked apart
+	cache.PSSetConstantBuffer(0, &b);
+	cache.PSSetConstantBuffer(0, &b);
+	CHECK(context.Take() == Calls({ "PSSetConstantBuffers 0+1" }));
+
+	// Ranges of one buffer, as ConstantRing binds them: only
+	// the same first constant and count is redundant
+	cache.VSSetConstantBuffer(2, &a, 16, 16);
+	cache.VSSetConstantBuffer(2, &a, 16, 16);
+	cache.VSSetConstantBuffer(2, &a, 32, 16);
+	cache.VSSetConstantBuffer(2, &a, 32, 32);
+	CHECK(context.Take() == Calls({
+		"VSSetConstantBuffers1 2+1 16,16",
+		"VSSetConstantBuffers1 2+1 32,16",
+		"VSSetConstantBuffers1 2+1 32,32" }));
+
+	// A whole buffer isn't the same as a range of it
+	cache.VSSetConstantBuffer(2, &a);
+	cache.VSSetConstantBuffer(2, &a, 0, 0);
+	cache.VSSetConstantBuffer(2, &a, 0, 16);
+	CHECK(context.Take() == Calls({ "VSSetConstantBuffers 2+1", "VSSetConstantBuffers1 2+1 0,16" }));
+
+	cache.PSSetConstantBuffer(3, &b, 48, 16);
+	cache.PSSetConstantBuffer(3, &b, 48, 16);
+	CHECK(context.Take() == Calls({ "PSSetConstantBuffers1 3+1 48,16" }));
+
+	// Slots past the tracked ones always go through
+	cache.PSSetConstantBuffer(STATE_CACHE_CONSTANT_BUFFERS, &a);
+	cache.PSSetConstantBuffer(STATE_CACHE_CONSTANT_BUFFERS, &a);
+	CHECK(context.Take().size() == 2);
+}
+
+// Without an 11.1 context ranges can't be bound, but the
+// whole buffer binds still work
+static void TestConstantBuffersWithoutContext1()
+{
+	MockContext11 context;
+	StateCache cache(&context);
+	ID3D11Buffer a;
+
+	cache.VSSetConstantBuffer(1, &a, 16, 16);
+	CHECK(context.Take().empty());
+	cache.VSSetConstantBuffer(1, &a);
+	cache.VSSetConstantBuffer(1, &a);
+	CHECK(context.Take() == Calls({ "VSSetConstantBuffers 1+1" }));
+}
+
+static void TestShaderResources()
+{
+	MockContext context;
+	StateCache cache(&context);
+	ID3D11ShaderResourceView a, b, c;
+	ID3D11ShaderResourceView* srvs[3] = { &a, &b, &c };
+
+	cache.PSSetShaderResources(0, 3, srvs);
+	cache.PSSetShaderResources(0, 3, srvs);
+	cache.PSSetShaderResources(1, 2, &srvs[1]);
+	CHECK(context.Take() == Calls({ "PSSetShaderResources 0+3" }));
+
+	// One slot of several changing
+	srvs[2] = &a;
+	cache.PSSetShaderResources(0, 3, srvs);
+	CHECK(context.Take() == Calls({ "PSSetShaderResources 0+3" }));
+
+	// Reaching one slot past what's known
+	ID3D11ShaderResourceView* longer[3] = { &b, &a, &c };
+	cache.PSSetShaderResources(1, 3, longer);
+	CHECK(context.Take() == Calls({ "PSSetShaderResources 1+3" }));
+
+	// The vertex shader's slots are its own
+	cache.VSSetShaderResources(0, 3, srvs);
+	cache.VSSetShaderResources(0, 3, srvs);
+	CHECK(context.Take() == Calls({ "VSSetShaderResources 0+3" }));
+
+	// Slots past the tracked ones always go through
+	cache.PSSetShaderResources(STATE_CACHE_SRVS - 1, 2, srvs);
+	cache.PSSetShaderResources(STATE_CACHE_SRVS - 1, 2, srvs);
+	CHECK(context.Take().size() == 2);
+	cache.PSSetShaderResources(STATE_CACHE_SRVS - 1, 1, srvs);
+	CHECK(context.Take().empty());
+}
+
+static void TestSamplers()
+{
+	MockContext context;
+	StateCache cache(&context);
+	ID3D11SamplerState a, b;
+	ID3D11SamplerState* samplers[2] = { &a, &b };
+
+	cache.PSSetSamplers(0, 2, samplers);
+	cache.PSSetSamplers(0, 2, samplers);
+	cache.PSSetSamplers(1, 1, &samplers[1]);
+	cache.VSSetSamplers(0, 2, samplers);
+	cache.VSSetSamplers(0, 1, &samplers[1]);
+	CHECK(context.Take() == Calls({ "PSSetSamplers 0+2", "VSSetSamplers 0+2", "VSSetSamplers 0+1" }));
+
+	cache.PSSetSamplers(STATE_CACHE_SAMPLERS - 1, 2, samplers);
+	cache.PSSetSamplers(STATE_CACHE_SAMPLERS - 1, 2, samplers);
+	CHECK(context.Take().size() == 2);
+}
+
+// Binding targets can silently unbind SRVs, so every SRV
+// of both stages is forgotten - but only by a call that
+// actually reaches the context
+static void TestRenderTargetsForgetShaderResources()
+{
+	MockContext context;
+	StateCache cache(&context);
+	ID3D11RenderTargetView rtvA, rtvB;
+	ID3D11DepthStencilView dsvA, dsvB;
+	ID3D11ShaderResourceView srvA;
+	ID3D11ShaderResourceView* srvs[1] = { &srvA };
+	ID3D11RenderTargetView* targets[2] = { &rtvA, &rtvB };
+
+	cache.OMSetRenderTargets(1, targets, &dsvA);
+	cache.OMSetRenderTargets(1, targets, &dsvA);
+	CHECK(context.Take() == Calls({ "OMSetRenderTargets 1" }));
+
+	cache.VSSetShaderResources(0, 1, srvs);
+	cache.PSSetShaderResources(0, 1, srvs);
+	cache.OMSetRenderTargets(1, targets, &dsvA);
+	cache.VSSetShaderResources(0, 1, srvs);
+	cache.PSSetShaderResources(0, 1, srvs);
+	CHECK(context.Take() == Calls({ "VSSetShaderResources 0+1", "PSSetShaderResources 0+1" }));
+
+	cache.OMSetRenderTargets(2, targets, &dsvA);
+	cache.VSSetShaderResources(0, 1, srvs);
+	cache.PSSetShaderResources(0, 1, srvs);
+	CHECK(context.Take() == Calls({ "OMSetRenderTargets 2", "VSSetShaderResources 0+1", "PSSetShaderResources 0+1" }));
+
+	// A different depth buffer alone, or no targets at all
+	cache.OMSetRenderTargets(2, targets, &dsvB);
+	cache.PSSetShaderResources(0, 1, srvs);
+	cache.OMSetRenderTargets(0, 0, 0);
+	cache.OMSetRenderTargets(0, 0, 0);
+	cache.PSSetShaderResources(0, 1, srvs);
+	CHECK(context.Take() == Calls({
+		"OMSetRenderTargets 2", "PSSetShaderResources 0+1",
+		"OMSetRenderTargets 0", "PSSetShaderResources 0+1" }));
+
+	// Samplers and constant buffers aren't touched
+	ID3D11SamplerState sampler;
+	ID3D11SamplerState* samplers[1] = { &sampler };
+	ID3D11Buffer buffer;
+	cache.PSSetSamplers(0, 1, samplers);
+	cache.PSSetConstantBuffer(0, &buffer);
+	cache.OMSetRenderTargets(1, targets, 0);
+	cache.PSSetSamplers(0, 1, samplers);
+	cache.PSSetConstantBuffer(0, &buffer);
+	CHECK(context.Take() == Calls({ "PSSetSamplers 0+1", "PSSetConstantBuffers 0+1", "OMSetRenderTargets 1" }));
+}
+
+static void TestInvalidate()
+{
+	MockContext context;
+	StateCache cache(&context);
+	ID3D11InputLayout layout;
+	ID3D11VertexShader vs;
+	ID3D11PixelShader ps;
+	ID3D11Buffer buffer;
+	ID3D11ShaderResourceView srv;
+	ID3D11SamplerState sampler;
+	ID3D11RasterizerState rasterizer;
+	ID3D11RenderTargetView rtv;
+	ID3D11DepthStencilState depth;
+	ID3D11Buffer* buffers[1] = { &buffer };
+	ID3D11ShaderResourceView* srvs[1] = { &srv };
+	ID3D11SamplerState* samplers[1] = { &sampler };
+	ID3D11RenderTargetView* rtvs[1] = { &rtv };
+	UINT stride = 32, offset = 0;
+	D3D11_VIEWPORT viewport = { 0.0f, 0.0f, 64.0f, 64.0f, 0.0f, 1.0f };
+
+	auto bindEverything = [&]()
+	{
+		cache.OMSetRenderTargets(1, rtvs, 0);
+		cache.IASetInputLayout(&layout);
+		cache.IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		cache.IASetVertexBuffers(0, 1, buffers, &stride, &offset);
+		cache.IASetIndexBuffer(&buffer, DXGI_FORMAT_R32_UINT, 0);
+		cache.VSSetShader(&vs);
+		cache.PSSetShader(&ps);
+		cache.VSSetConstantBuffer(0, &buffer);
+		cache.PSSetConstantBuffer(1, &buffer, 16, 16);
+		cache.VSSetShaderResources(0, 1, srvs);
+		cache.PSSetShaderResources(0, 1, srvs);
+		cache.VSSetSamplers(0, 1, samplers);
+		cache.PSSetSamplers(0, 1, samplers);
+		cache.RSSetState(&rasterizer);
+		cache.RSSetViewport(viewport);
+		cache.OMSetDepthStencilState(&depth, 0);
+	};
+	const size_t everything = 16;
+
+	bindEverything();
+	CHECK(context.Take().size() == everything);
+	bindEverything();
+	CHECK(context.Take().empty());
+
+	cache.Invalidate();
+	bindEverything();
+	CHECK(context.Take().size() == everything);
+	bindEverything();
+	CHECK(context.Take().empty());
+}
+
+static void TestCounters()
+{
+	MockContext context;
+	StateCache cache(&context);
+	ID3D11VertexShader vs;
+	ID3D11Buffer buffer;
+
+	CHECK(cache.GetIssuedCount() == 0);
+	CHECK(cache.GetFilteredCount() == 0);
+
+	cache.VSSetShader(&vs);
+	cache.VSSetShader(&vs);
+	cache.VSSetShader(&vs);
+	cache.VSSetConstantBuffer(0, &buffer, 16, 16);
+	cache.VSSetConstantBuffer(0, &buffer, 16, 16);
+	cache.VSSetConstantBuffer(STATE_CACHE_CONSTANT_BUFFERS, &buffer);
+	CHECK(cache.GetIssuedCount() == 3);
+	CHECK(cache.GetFilteredCount() == 3);
+	CHECK(context.Take().size() == cache.GetIssuedCount());
+
+	// Resetting the counts keeps what's bound
+	cache.ResetStats();
+	CHECK(cache.GetIssuedCount() == 0);
+	CHECK(cache.GetFilteredCount() == 0);
+	cache.VSSetShader(&vs);
+	CHECK(cache.GetIssuedCount() == 0);
+	CHECK(cache.GetFilteredCount() == 1);
+
+	// ...and forgetting what's bound keeps the counts
+	cache.Invalidate();
+	CHECK(cache.GetFilteredCount() == 1);
+	cache.VSSetShader(&vs);
+	CHECK(cache.GetIssuedCount() == 1);
+}
+
+// The cache compares raw pointers and holds no references,
+// so it never keeps a released object alive - which is why
+// it must be invalidated once something it saw is released
+static void TestHoldsNoReferences()
+{
+	MockContext context;
+	ID3D11VertexShader vs;
+	ID3D11Buffer buffer;
+	ID3D11ShaderResourceView srv;
+	ID3D11ShaderResourceView* srvs[1] = { &srv };
+	UINT contextRefs = context.refCount;
+	{
+		StateCache cache(&context);
+		CHECK(context.refCount > contextRefs);
+		CHECK(cache.GetContext() == &context);
+
+		cache.VSSetShader(&vs);
+		cache.VSSetConstantBuffer(0, &buffer);
+		cache.PSSetConstantBuffer(0, &buffer, 0, 16);
+		cache.PSSetShaderResources(0, 1, srvs);
+		CHECK(vs.refCount == 1);
+		CHECK(buffer.refCount == 1);
+		CHECK(srv.refCount == 1);
+	}
+	CHECK(context.refCount == contextRefs);
+}
+
+int main()
+{
+	TestSingleStates();
+	TestFirstCallAlwaysIssued();
+	TestVertexBuffers();
+	TestConstantBuffers();
+	TestConstantBuffersWithoutContext1();
+	TestShaderResources();
+	TestSamplers();
+	TestRenderTargetsForgetShaderResources();
+	TestInvalidate();
+	TestCounters();
+	TestHoldsNoReferences();
+	return CheckResult("StateCacheTests");
+}
@@ -0,0 +1,47 @@
+@echo off
+rem --------------------------------------------------------
+rem Compiles every variant of PixelShader.hlsl that
+rem ShaderVariants can ask for, then reports how many there
+rem are and how big they are in total
+rem
+rem Usage: CompileShaderVariants.bat [output folder]
+rem - The output folder should be where the project puts
+rem   PixelShader.cso (default: x64\Debug)
+rem - fxc must be on the PATH (a Developer Command Prompt),
+rem   or set FXC to its full path
+rem
+rem Feature bits match the PS_FEATURE_* defines in ShaderVariants.h
+rem --------------------------------------------------------
+setlocal EnableDelayedExpansion
+
+set SOURCE=%~dp0..\PixelShader.hlsl
+set OUTPUT=%~1
+if "%OUTPUT%"=="" set OUTPUT=%~dp0..\x64\Debug
+if "%FXC%"=="" set FXC=fxc
+
+set COUNT=0
+set BYTES=0
+for /L %%f in (0,1,15) do (
+	set /a NORMAL="%%f & 1", ROUGHNESS="(%%f >> 1) & 1", METALNESS="(%%f >> 2) & 1", SHADOWS="(%%f >> 3) & 1"
+
+	rem Skip the full variant, which the project already builds
+	set SKIP=0
+	if %%f==15 set SKIP=1
+
+	if !SKIP!==0 (
+		"%FXC%" /nologo /T ps_5_0 /E main /O3 ^
+			/D USE_NORMAL_MAP=!NORMAL! /D USE_ROUGHNESS_MAP=!ROUGHNESS! /D USE_METALNESS_MAP=!METALNESS! ^
+			/D USE_SHADOWS=!SHADOWS! ^
+			/Fo "%OUTPUT%\PixelShader_%%f.cso" "%SOURCE%" >nul
+		if errorlevel 1 (
+			echo Failed to compile variant %%f
+			exit /b 1
+		)
+		for %%s in ("%OUTPUT%\PixelShader_%%f.cso") do set /a BYTES+=%%~zs
+		set /a COUNT+=1
+	)
+)
+
+set /a KB=BYTES / 1024
+echo Compiled %COUNT% PixelShader variants, %KB% KB in total (%BYTES% bytes)
+echo Full shader: PixelShader.cso (built by the project)
@@ -0,0 +1,352 @@
+#!/usr/bin/env python3
+# --------------------------------------------------------
+# Generates C++ structs matching the constant buffers of
+# compiled shaders, so engine code can fill a whole buffer
+# and copy it in one go instead of setting fields by name
+#
+# - Reads the reflection data (the RDEF chunk) straight out
+#   of each .cso, so it runs anywhere Python does - no
+#   Windows or D3DCompiler needed
+# - Every member is placed at the offset the shader compiler
+#   gave it, with explicit padding, and the output checks each
+#   offset and size with static_assert, so a struct that no
+#   longer matches its shader fails to compile
+#
+# Usage:
+#   GenerateCBufferStructs.py [-o Output.h] [--check] Shader.cso...
+#
+# Each shader's structs go in a namespace named after its file
+# (CBuffers::PixelShader for PixelShader.cso).  Element types
+# of structured buffers are written too, without a buffer
+# struct, so buffers filled from C++ match the shader as well.
+# With --check,
+# nothing is written; the exit code is 1 if the output file
+# is out of date.
+# --------------------------------------------------------
+import argparse
+import os
+import struct
+import sys
+
+# D3D_SHADER_VARIABLE_CLASS
+SVC_SCALAR = 0
+SVC_VECTOR = 1
+SVC_MATRIX_ROWS = 2
+SVC_MATRIX_COLUMNS = 3
+SVC_STRUCT = 5
+
+# D3D_SHADER_VARIABLE_TYPE
+SVT_BOOL = 1
+SVT_INT = 2
+SVT_FLOAT = 3
+SVT_UINT = 19
+
+# D3D_CBUFFER_TYPE
+CT_CBUFFER = 0
+CT_RESOURCE_BIND_INFO = 3  # Structured buffers
+
+
+class GeneratorError(Exception):
+    pass
+
+
+class Type:
+    def __init__(self, cls, base, rows, columns, elements, name):
+        self.cls = cls
+        self.base = base
+        self.rows = rows
+        self.columns = columns
+        self.elements = elements  # 0 if not an array
+        self.name = name
+        self.members = []  # (name, offset, Type) for structs
+
+
+class Variable:
+    def __init__(self, name, offset, size, type):
+        self.name = name
+        self.offset = offset
+        self.size = size
+        self.type = type
+
+
+class ConstantBuffer:
+    def __init__(self, name, size, register, structured):
+        self.name = name
+        self.size = size
+        self.register = register
+        self.structured = structured  # Only variable is the element, "$Element"
+        self.variables = []
+
+
+# --------------------------------------------------------
+# Reading compiled shaders
+# --------------------------------------------------------
+def read_string(data, offset):
+    end = data.index(b'\0', offset)
+    return data[offset:end].decode('ascii')
+
+
+def find_chunk(blob, fourcc):
+    if blob[0:4] != b'DXBC':
+        raise GeneratorError('not a compiled shader (no DXBC header)')
+    chunk_count = struct.unpack_from('<I', blob, 28)[0]
+    for i in range(chunk_count):
+        offset = struct.unpack_from('<I', blob, 32 + 4 * i)[0]
+        if blob[offset:offset + 4] == fourcc:
+            size = struct.unpack_from('<I', blob, offset + 4)[0]
+            return blob[offset + 8:offset + 8 + size]
+    raise GeneratorError('no %s chunk' % fourcc.decode('ascii'))
+
+
+def read_type(rdef, offset, sm5):
+    cls, base, rows, columns, elements, member_count, member_offset = struct.unpack_from('<6HI', rdef, offset)
+    name = read_string(rdef, struct.unpack_from('<I', rdef, offset + 32)[0]) if sm5 else ''
+    type = Type(cls, base, rows, columns, elements, name)
+    for m in range(member_count):
+        name_offset, type_offset, member_start = struct.unpack_from('<3I', rdef, member_offset + 12 * m)
+        type.members.append((read_string(rdef, name_offset), member_start, read_type(rdef, type_offset, sm5)))
+    return type
+
+
+def read_constant_buffers(blob):
+    rdef = find_chunk(blob, b'RDEF')
+    cb_count, cb_offset, bind_count, bind_offset = struct.unpack_from('<4I', rdef, 0)
+    minor, major = struct.unpack_from('<2B', rdef, 16)
+    sm5 = major >= 5
+    variable_stride = 40 if sm5 else 24
+    bind_stride = 32
+
+    registers = {}
+    for b in range(bind_count):
+        name_offset, _, _, _, _, bind_point = struct.unpack_from('<6I', rdef, bind_offset + bind_stride * b)
+        registers.setdefault(read_string(rdef, name_offset), bind_point)
+
+    buffers = []
+    for c in range(cb_count):
+        name_offset, variable_count, variable_offset, size, _, cb_type = struct.unpack_from('<6I', rdef, cb_offset + 24 * c)
+        if cb_type not in (CT_CBUFFER, CT_RESOURCE_BIND_INFO):
+            continue  # Texture buffers and such aren't plain constant buffers
+        name = read_string(rdef, name_offset)
+        buffer = ConstantBuffer(name, size, registers.get(name, 0), cb_type == CT_RESOURCE_BIND_INFO)
+        for v in range(variable_count):
+            start = variable_offset + variable_stride * v
+            var_name_offset, var_start, var_size, _, type_offset = struct.unpack_from('<5I', rdef, start)
+            buffer.variables.append(Variable(
+                read_string(rdef, var_name_offset),
+                var_start,
+                var_size,
+                read_type(rdef, type_offset, sm5)))
+        buffers.append(buffer)
+    return buffers
+
+
+# --------------------------------------------------------
+# Mapping HLSL types to C++
+# --------------------------------------------------------
+SCALARS = {SVT_FLOAT: 'float', SVT_INT: 'int', SVT_UINT: 'unsigned int', SVT_BOOL: 'int'}
+VECTORS = {SVT_FLOAT: 'DirectX::XMFLOAT', SVT_INT: 'DirectX::XMINT', SVT_UINT: 'DirectX::XMUINT', SVT_BOOL: 'DirectX::XMINT'}
+
+
+def element_type(type, structs):
+    """C++ type name and size in bytes of one element of a type"""
+    if type.cls == SVC_SCALAR and type.base in SCALARS:
+        return SCALARS[type.base], 4
+    if type.cls == SVC_VECTOR and type.base in VECTORS:
+        return '%s%d' % (VECTORS[type.base], type.columns), 4 * type.columns
+    if type.cls in (SVC_MATRIX_ROWS, SVC_MATRIX_COLUMNS) and type.base == SVT_FLOAT and type.rows == 4 and type.columns == 4:
+        return 'DirectX::XMFLOAT4X4', 64
+    if type.cls == SVC_STRUCT:
+        if not type.name:
+            raise GeneratorError('struct types need shader model 5 reflection to be named')
+        return type.name, struct_size(type, structs)
+    raise GeneratorError('unsupported type %s' % (type.name or 'class %d' % type.cls))
+
+
+def struct_size(type, structs):
+    """Registers a struct type to be written, returning its size"""
+    size = 0
+    for name, offset, member in type.members:
+        size = max(size, offset + hlsl_size(member, structs))
+    if type.name in structs and structs[type.name][1] != size:
+        raise GeneratorError('two different structs named %s' % type.name)
+    structs.setdefault(type.name, (type, size))
+    return size
+
+
+def hlsl_size(type, structs):
+    """Size the shader compiler gives a variable: array elements
+    start on 16 byte boundaries, but the last one isn't padded"""
+    _, size = element_type(type, structs)
+    if type.elements == 0:
+        return size
+    stride = (size + 15) // 16 * 16
+    return stride * (type.elements - 1) + size
+
+
+def cpp_member(name, type, structs):
+    """Declaration of a member, and its size in C++"""
+    cpp, size = element_type(type, structs)
+    if type.elements == 0:
+        return '%s %s;' % (cpp, name), size
+    if size % 16 == 0:
+        return '%s %s[%d];' % (cpp, name, type.elements), size * type.elements
+    stride = (size + 15) // 16 * 16
+    return 'ArrayElement<%s> %s[%d];' % (cpp, name, type.elements), stride * type.elements
+
+
+# --------------------------------------------------------
+# Writing the header
+# --------------------------------------------------------
+def write_struct(out, name, members, size, aligned, comment, structs):
+    """members is a list of (name, offset, Type)"""
+    lines = []
+    if comment:
+        lines.append('\t\t// %s' % comment)
+    lines.append('\t\tstruct %s%s' % ('alignas(16) ' if aligned else '', name))
+    lines.append('\t\t{')
+
+    position = 0
+    padding = 0
+    checks = []
+    for member_name, offset, type in sorted(members, key=lambda m: m[1]):
+        if offset < position:
+            raise GeneratorError('%s.%s overlaps the member before it, which C++ can\'t match' % (name, member_name))
+        if offset > position:
+            lines.append('\t\t\tunsigned char padding%d_[%d];' % (padding, offset - position))
+            padding += 1
+        declaration, cpp_size = cpp_member(member_name, type, structs)
+        lines.append('\t\t\t%s' % declaration)
+        checks.append('\t\tstatic_assert(offsetof(%s, %s) == %d, "%s.%s doesn\'t match the shader");' % (name, member_name, offset, name, member_name))
+        position = offset + cpp_size
+
+    if size > position:
+        lines.append('\t\t\tunsigned char padding%d_[%d];' % (padding, size - position))
+        position = size
+    lines.append('\t\t};')
+
+    # An unaligned struct may legitimately be shorter than C++
+    # array padding makes it, but then it can't be copied whole
+    if position != size and (aligned or position > size):
+        raise GeneratorError('%s is %d bytes in C++ but %d in the shader' % (name, position, size))
+    checks.append('\t\tstatic_assert(sizeof(%s) == %d, "%s doesn\'t match the shader");' % (name, size, name))
+    out.extend(lines + checks + [''])
+
+
+def generate(shader_files):
+    out = [
+        '// Generated by Tools/GenerateCBufferStructs.py - do not edit',
+        '// Regenerate from the compiled shaders after changing a cbuffer:',
+        '//   %s' % ' '.join(os.path.basename(path) for path in shader_files),
+        '#pragma once',
+        '',
+        '#include <DirectXMath.h>',
+        '#include <cstddef>',
+        '',
+        'namespace CBuffers',
+        '{',
+        '\t// An element of an array whose type is smaller than 16',
+        '\t// bytes, which the shader compiler pads to 16 bytes',
+        '\ttemplate<typename T>',
+        '\tstruct alignas(16) ArrayElement',
+        '\t{',
+        '\t\tT value;',
+        '\t};',
+    ]
+
+    for path in shader_files:
+        namespace = os.path.splitext(os.path.basename(path))[0]
+        with open(path, 'rb') as f:
+            blob = f.read()
+        try:
+            buffers = read_constant_buffers(blob)
+        except (GeneratorError, struct.error, ValueError) as e:
+            # Truncated or corrupt files fail inside struct or
+            # the string reads, so name the file for those too
+            raise GeneratorError('%s: %s' % (path, e))
+
+        body = []
+        structs = {}
+        try:
+            for buffer in buffers:
+                if buffer.structured:
+                    # Just the element type, if it's a struct
+                    element = buffer.variables[0].type if buffer.variables else None
+                    if element is not None and element.cls == SVC_STRUCT and element.elements == 0:
+                        if struct_size(element, structs) != buffer.size:
+                            raise GeneratorError('%s elements are %d bytes, expected %d' % (buffer.name, buffer.size, struct_size(element, structs)))
+                    continue
+                members = [(v.name, v.offset, v.type) for v in buffer.variables]
+                for v in buffer.variables:
+                    if hlsl_size(v.type, structs) != v.size:
+                        raise GeneratorError('%s.%s is %d bytes, expected %d' % (buffer.name, v.name, v.size, hlsl_size(v.type, structs)))
+                write_struct(body, buffer.name, members, buffer.size, True,
+                             'cbuffer %s : register(b%d)' % (buffer.name, buffer.register), structs)
+
+            # Struct types used by the buffers come first, inner
+            # types before the types that contain them
+            written = set()
+            types = []
+
+            def add_type(name):
+                if name in written:
+                    return
+                type, size = structs[name]
+                for _, _, member in type.members:
+                    if member.cls == SVC_STRUCT:
+                        add_type(member.name)
+                written.add(name)
+                write_struct(types, name, type.members, size, False, None, structs)
+
+            for name in list(structs):
+                add_type(name)
+        except GeneratorError as e:
+            raise GeneratorError('%s: %s' % (path, e))
+
+        out.append('')
+        out.append('\tnamespace %s' % namespace)
+        out.append('\t{')
+        out.extend(types + body)
+        if out[-1] == '':
+            out.pop()
+        out.append('\t}')
+
+    out.append('}')
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generates C++ structs for the constant buffers of compiled shaders')
+    parser.add_argument('shaders', nargs='+', help='compiled shader (.cso) files')
+    parser.add_argument('-o', '--output', help='header to write (default: standard output)')
+    parser.add_argument('--check', action='store_true', help='only check that the output file is up to date')
+    args = parser.parse_args()
+
+    try:
+        header = generate(args.shaders)
+    except (GeneratorError, OSError, struct.error, ValueError) as e:
+        sys.stderr.write('GenerateCBufferStructs: error: %s\n' % e)
+        return 2
+
+    if args.check:
+        if not args.output:
+            parser.error('--check needs an output file')
+        try:
+            with open(args.output, 'r', newline='') as f:
+                current = f.read()
+        except OSError:
+            current = None
+        if current != header:
+            sys.stderr.write('GenerateCBufferStructs: %s is out of date\n' % args.output)
+            return 1
+        return 0
+
+    if args.output:
+        with open(args.output, 'w', newline='') as f:
+            f.write(header)
+    else:
+        sys.stdout.write(header)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
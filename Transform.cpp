@@ -8,6 +8,7 @@ Transform::Transform() {
 	rotation = XMFLOAT3(0.0f, 0.0f, 0.0f);
 	scale = XMFLOAT3(1.0f, 1.0f, 1.0f);
 	matrixChanged = false;
+	generation = 0;
 
 	//local transform variables
 	up = XMFLOAT3(0.0, 1.0, 0.0);
@@ -74,6 +75,9 @@ void Transform::MoveRelative(float x, float y, float z)
 	XMVECTOR newDirection = XMVector3Rotate(movement, rotationQuat);
 	movement = XMLoadFloat3(&position) + newDirection;
 	XMStoreFloat3(&position, movement);
+
+	matrixChanged = true;
+	generation++;
 }
 
 void Transform::MoveRelative(DirectX::XMFLOAT3 offset)
@@ -84,6 +88,9 @@ void Transform::MoveRelative(DirectX::XMFLOAT3 offset)
 	XMVECTOR newDirection = XMVector3Rotate(movement, rotationQuat);
 	movement = XMLoadFloat3(&position) + newDirection;
 	XMStoreFloat3(&position, movement);
+
+	matrixChanged = true;
+	generation++;
 }
 
 //ROTATION
@@ -119,11 +126,13 @@ void Transform::SetPosition(float x, float y, float z) {
 	this->position.z = z;
 
 	matrixChanged = true;
+	generation++;
 }
 void Transform::SetPosition(DirectX::XMFLOAT3 position) {
 	this->position = position;
 
 	matrixChanged = true;
+	generation++;
 }
 void Transform::SetRotation(float pitch, float yaw, float roll) {
 	this->rotation.x = pitch;
@@ -131,12 +140,14 @@ void Transform::SetRotation(float pitch, float yaw, float roll) {
 	this->rotation.z = roll;
 
 	matrixChanged = true;
+	generation++;
 	vectorsChanged = true;
 }
 void Transform::SetRotation(DirectX::XMFLOAT3 rotation) {
 	this->rotation = rotation;
 
 	matrixChanged = true;
+	generation++;
 	vectorsChanged = true;
 }
 void Transform::SetScale(float x, float y, float z) {
@@ -145,11 +156,13 @@ void Transform::SetScale(float x, float y, float z) {
 	this->scale.z = z;
 
 	matrixChanged = true;
+	generation++;
 }
 void Transform::SetScale(DirectX::XMFLOAT3 scale) {
 	this->scale = scale;
 
 	matrixChanged = true;
+	generation++;
 }
 
 //GETTER FUNCTIONS ===========================================
@@ -196,3 +209,7 @@ DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix() {
 	UpdateMatrices();
 	return worldInverseTranspose;
 }
+
+unsigned int Transform::GetGeneration() {
+	return generation;
+}
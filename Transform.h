@@ -37,6 +37,7 @@ public:
 	DirectX::XMFLOAT3 GetRight();
 	DirectX::XMFLOAT3 GetUp();
 	DirectX::XMFLOAT3 GetForward();
+	unsigned int GetGeneration(); // Bumped by every change, so users can tell it moved
 
 private:
 	DirectX::XMFLOAT3 position;
@@ -45,6 +46,7 @@ private:
 	DirectX::XMFLOAT4X4 world;
 	DirectX::XMFLOAT4X4 worldInverseTranspose;
 	bool matrixChanged;
+	unsigned int generation;
 
 	//local vectors
 	DirectX::XMFLOAT3 forward;
@@ -1,16 +1,25 @@
 #include "Include.hlsli"
 
-//Constant buffer
-cbuffer ExternalData : register(b0)
+// Constant buffers, split by how often they change so
+// that only the ones that did are uploaded again
+cbuffer PerFrame : register(b0)
 {
-	matrix world;
-    matrix view;
-	matrix projection;
-    matrix worldInvTranspose;
     matrix lightView;
     matrix lightProjection;
 }
 
+cbuffer PerPass : register(b1)
+{
+    matrix view;
+    matrix projection;
+}
+
+cbuffer PerObject : register(b2)
+{
+    matrix world;
+    matrix worldInvTranspose;
+}
+
 // Struct representing a single vertex worth of data
 // - This should match the vertex definition in our C++ code
 // - By "match", I mean the size, order and number of members
@@ -0,0 +1,86 @@
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(unsigned int threadCount)
+	:
+	jobCount(0),
+	generation(0),
+	pending(0),
+	quitting(false)
+{
+	// The calling thread counts as one of the threads
+	for (unsigned int i = 1; i < threadCount; i++)
+		threads.push_back(std::thread(&WorkerPool::WorkerLoop, this, i));
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quitting = true;
+	}
+	wake.notify_all();
+
+	for (auto& t : threads)
+		t.join();
+}
+
+// --------------------------------------------------------
+// Runs job(0) to job(jobCount - 1) in parallel and waits
+// for them all to finish
+// - Jobs past the number of threads run on the caller
+// --------------------------------------------------------
+void WorkerPool::Run(unsigned int jobCount, std::function<void(unsigned int)> job)
+{
+	if (jobCount == 0)
+		return;
+
+	unsigned int threadCount = GetThreadCount();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		currentJob = job;
+		this->jobCount = jobCount;
+		pending = (jobCount < threadCount ? jobCount : threadCount) - 1;
+		generation++;
+	}
+	wake.notify_all();
+
+	job(0);
+	for (unsigned int i = threadCount; i < jobCount; i++)
+		job(i);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return pending == 0; });
+}
+
+unsigned int WorkerPool::GetThreadCount() { return (unsigned int)threads.size() + 1; }
+
+// --------------------------------------------------------
+// Body of each worker thread: sleep, run its job, repeat
+// --------------------------------------------------------
+void WorkerPool::WorkerLoop(unsigned int index)
+{
+	unsigned int seenGeneration = 0;
+	while (true)
+	{
+		std::function<void(unsigned int)> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return quitting || generation != seenGeneration; });
+			if (quitting)
+				return;
+
+			seenGeneration = generation;
+			if (index >= jobCount)
+				continue;
+			job = currentJob;
+		}
+
+		job(index);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending--;
+		}
+		finished.notify_one();
+	}
+}
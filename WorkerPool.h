@@ -0,0 +1,35 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+// --------------------------------------------------------
+// A fixed set of threads that sleep until given work.
+// Run() hands job i to thread i, with the calling thread
+// doing job 0 itself, and returns once all jobs are done.
+// --------------------------------------------------------
+class WorkerPool
+{
+public:
+	WorkerPool(unsigned int threadCount);
+	~WorkerPool();
+
+	void Run(unsigned int jobCount, std::function<void(unsigned int)> job);
+	unsigned int GetThreadCount(); // Including the calling thread
+
+private:
+	void WorkerLoop(unsigned int index);
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;		// Signalled when new jobs are available
+	std::condition_variable finished;	// Signalled as each job completes
+
+	std::function<void(unsigned int)> currentJob;
+	unsigned int jobCount;
+	unsigned int generation;	// Bumped by every Run(), so workers know to wake
+	unsigned int pending;		// Jobs handed to workers that haven't finished
+	bool quitting;
+};